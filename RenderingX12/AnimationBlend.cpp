@@ -0,0 +1,731 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "AnimationBlend.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static const uint8_t MAX_BLEND_LAYERS = 8;
+
+static inline float& laneOf(XMVECTOR* pData, uint32_t index, uint32_t bone)
+{
+	return reinterpret_cast<float*>(&pData[index])[bone & 3];
+}
+
+static inline float laneOf(const XMVECTOR* pData, uint32_t index, uint32_t bone)
+{
+	return reinterpret_cast<const float*>(&pData[index])[bone & 3];
+}
+
+// Quaternion product a * b of 4 quaternions in SoA
+static void quaternionMultiply4(XMVECTOR q[4], const XMVECTOR a[4], const XMVECTOR b[4])
+{
+	const auto x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+	const auto y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+	const auto z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+	const auto w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+	q[0] = x;
+	q[1] = y;
+	q[2] = z;
+	q[3] = w;
+}
+
+static void quaternionNormalize4(XMVECTOR q[4])
+{
+	const auto rcpLen = XMVectorReciprocalSqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (uint8_t i = 0; i < 4; ++i) q[i] *= rcpLen;
+}
+
+// Frame time to the key pair and the lerp factor, wrapping for looped playback
+static void getKeyPair(uint32_t& k0, uint32_t& k1, float& t, const AnimationClip& clip, double time)
+{
+	const auto numKeys = clip.GetNumKeys();
+	auto keyTime = fmod(time * clip.GetFPS(), static_cast<double>(numKeys));
+	if (keyTime < 0.0) keyTime += numKeys;
+
+	k0 = (min)(static_cast<uint32_t>(keyTime), numKeys - 1);
+	k1 = k0 + 1 < numKeys ? k0 + 1 : 0;
+	t = static_cast<float>(keyTime - k0);
+}
+
+//--------------------------------------------------------------------------------------
+// Skeleton
+//--------------------------------------------------------------------------------------
+
+bool Skeleton::Create(const SDKMesh* pMesh)
+{
+	const auto numBones = pMesh->GetNumFrames();
+	BoneNames.resize(numBones);
+	Parents.resize(numBones);
+	BindLocals.resize(numBones);
+
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto pFrame = pMesh->GetFrame(i);
+		BoneNames[i] = pFrame->Name;
+		Parents[i] = pFrame->ParentFrame;
+		BindLocals[i] = pFrame->Matrix;
+
+		// Hierarchy evaluation is a single forward pass
+		XUSG_N_RETURN(Parents[i] == UINT32_MAX || Parents[i] < i, false);
+	}
+
+	return true;
+}
+
+uint32_t Skeleton::FindBone(const char* name) const
+{
+	for (auto i = 0u; i < GetNumBones(); ++i)
+		if (BoneNames[i] == name) return i;
+
+	return UINT32_MAX;
+}
+
+//--------------------------------------------------------------------------------------
+// Local pose
+//--------------------------------------------------------------------------------------
+
+LocalPose::LocalPose() :
+	m_data(0),
+	m_numBones(0),
+	m_numGroups(0)
+{
+}
+
+LocalPose::~LocalPose()
+{
+}
+
+void LocalPose::Create(uint32_t numBones)
+{
+	m_numBones = numBones;
+	m_numGroups = XUSG_DIV_UP(numBones, 4);
+	m_data.resize(NUM_COMPONENT * m_numGroups);
+
+	// Identity, including the padding lanes
+	for (auto i = 0u; i < m_numGroups; ++i)
+	{
+		for (uint8_t c = TX; c < NUM_COMPONENT; ++c)
+			*GetComponent(static_cast<Component>(c), i) = c == QW || c >= SX ? XMVectorSplatOne() : XMVectorZero();
+	}
+}
+
+void LocalPose::SetBone(uint32_t bone, const XMFLOAT3& t, const XMFLOAT4& q, const XMFLOAT3& s)
+{
+	const float values[] = { t.x, t.y, t.z, q.x, q.y, q.z, q.w, s.x, s.y, s.z };
+	const auto group = bone / 4;
+	for (uint8_t c = TX; c < NUM_COMPONENT; ++c)
+		laneOf(m_data.data(), m_numGroups * c + group, bone) = values[c];
+}
+
+XMMATRIX LocalPose::GetBoneMatrix(uint32_t bone) const
+{
+	float v[NUM_COMPONENT];
+	const auto group = bone / 4;
+	for (uint8_t c = TX; c < NUM_COMPONENT; ++c)
+		v[c] = laneOf(m_data.data(), m_numGroups * c + group, bone);
+
+	// S * R * T in row-vector convention
+	return XMMatrixAffineTransformation(XMVectorSet(v[SX], v[SY], v[SZ], 0.0f), XMVectorZero(),
+		XMVectorSet(v[QX], v[QY], v[QZ], v[QW]), XMVectorSet(v[TX], v[TY], v[TZ], 0.0f));
+}
+
+//--------------------------------------------------------------------------------------
+// Animation clip
+//--------------------------------------------------------------------------------------
+
+AnimationClip::AnimationClip() :
+	m_keys(0),
+	m_numKeys(0),
+	m_numGroups(0),
+	m_fps(30.0f),
+	m_isAdditive(false)
+{
+}
+
+AnimationClip::~AnimationClip()
+{
+}
+
+bool AnimationClip::Create(const wchar_t* fileName, const Skeleton& skeleton)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0 && pFile, false);
+
+	_fseeki64(pFile, 0, SEEK_END);
+	const auto fileSize = static_cast<size_t>(_ftelli64(pFile));
+	_fseeki64(pFile, 0, SEEK_SET);
+
+	vector<uint8_t> data(fileSize);
+	const auto bytesRead = fread(data.data(), 1, fileSize, pFile);
+	fclose(pFile);
+	XUSG_N_RETURN(bytesRead == fileSize, false);
+
+	return Create(data.data(), fileSize, skeleton);
+}
+
+bool AnimationClip::Create(const uint8_t* pData, size_t dataSize, const Skeleton& skeleton)
+{
+	using FileHeader = SDKMesh::AnimationFileHeader;
+	using FrameData = SDKMesh::AnimationFrameData;
+	using KeyData = SDKMesh::AnimationData;
+
+	XUSG_N_RETURN(dataSize >= sizeof(FileHeader), false);
+	const auto& header = *reinterpret_cast<const FileHeader*>(pData);
+	const auto frameDataEnd = header.AnimationDataOffset + sizeof(FrameData) * header.NumFrames;
+	XUSG_N_RETURN(header.NumAnimationKeys > 0 && frameDataEnd <= dataSize, false);
+
+	const auto numBones = skeleton.GetNumBones();
+	m_numKeys = header.NumAnimationKeys;
+	m_numGroups = XUSG_DIV_UP(numBones, 4);
+	m_fps = header.AnimationFPS > 0 ? static_cast<float>(header.AnimationFPS) : 30.0f;
+	m_isAdditive = false;
+	m_keys.resize(static_cast<size_t>(LocalPose::NUM_COMPONENT) * m_numGroups * m_numKeys);
+
+	// Tracks by bone index; bones without a track keep the bind pose
+	const auto pFrameData = reinterpret_cast<const FrameData*>(&pData[header.AnimationDataOffset]);
+	vector<const KeyData*> tracks(numBones, nullptr);
+	for (auto i = 0u; i < header.NumFrames; ++i)
+	{
+		const auto bone = skeleton.FindBone(pFrameData[i].FrameName);
+		if (bone == UINT32_MAX) continue;
+
+		const auto offset = header.AnimationDataOffset + pFrameData[i].DataOffset;
+		XUSG_N_RETURN(offset + sizeof(KeyData) * m_numKeys <= dataSize, false);
+		tracks[bone] = reinterpret_cast<const KeyData*>(&pData[offset]);
+	}
+
+	const auto numLanes = m_numGroups * 4;
+	for (auto i = 0u; i < numLanes; ++i)
+	{
+		KeyData bindKey = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+		if (i < numBones && !tracks[i])
+		{
+			XMVECTOR s, q, t;
+			XMMatrixDecompose(&s, &q, &t, XMLoadFloat4x4(&skeleton.BindLocals[i]));
+			XMStoreFloat3(&bindKey.Translation, t);
+			XMStoreFloat4(&bindKey.Orientation, q);
+			XMStoreFloat3(&bindKey.Scaling, s);
+		}
+
+		auto prevQ = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		const auto group = i / 4;
+		for (auto k = 0u; k < m_numKeys; ++k)
+		{
+			const auto& key = i < numBones && tracks[i] ? tracks[i][k] : bindKey;
+
+			// Keep consecutive keys in one hemisphere so that sampling can lerp directly
+			auto q = XMLoadFloat4(&key.Orientation);
+			if (XMVectorGetX(XMQuaternionDot(prevQ, q)) < 0.0f) q = -q;
+			prevQ = q;
+
+			XMFLOAT4 orientation;
+			XMStoreFloat4(&orientation, q);
+			const float values[] =
+			{
+				key.Translation.x, key.Translation.y, key.Translation.z,
+				orientation.x, orientation.y, orientation.z, orientation.w,
+				key.Scaling.x, key.Scaling.y, key.Scaling.z
+			};
+
+			for (uint8_t c = LocalPose::TX; c < LocalPose::NUM_COMPONENT; ++c)
+				laneOf(m_keys.data(), (LocalPose::NUM_COMPONENT * k + c) * m_numGroups + group, i) = values[c];
+		}
+	}
+
+	return true;
+}
+
+void AnimationClip::MakeAdditive(uint32_t referenceKey)
+{
+	if (m_isAdditive || referenceKey >= m_numKeys) return;
+
+	vector<XMVECTOR> reference(&m_keys[LocalPose::NUM_COMPONENT * m_numGroups * referenceKey],
+		&m_keys[LocalPose::NUM_COMPONENT * m_numGroups * (referenceKey + 1)]);
+	const auto getRef = [&](uint8_t c, uint32_t g) { return reference[m_numGroups * c + g]; };
+	const auto getKey = [&](uint32_t k, uint8_t c, uint32_t g) -> XMVECTOR&
+	{ return m_keys[(LocalPose::NUM_COMPONENT * k + c) * m_numGroups + g]; };
+
+	for (auto k = 0u; k < m_numKeys; ++k)
+	{
+		for (auto g = 0u; g < m_numGroups; ++g)
+		{
+			// dt = t - t_ref, ds = s / s_ref
+			for (uint8_t c = LocalPose::TX; c <= LocalPose::TZ; ++c) getKey(k, c, g) -= getRef(c, g);
+			for (uint8_t c = LocalPose::SX; c <= LocalPose::SZ; ++c)
+				getKey(k, c, g) *= XMVectorReciprocal(getRef(c, g));
+
+			// dq = conj(q_ref) * q, so that q_ref * dq = q
+			const XMVECTOR qRef[] = { -getRef(LocalPose::QX, g), -getRef(LocalPose::QY, g), -getRef(LocalPose::QZ, g), getRef(LocalPose::QW, g) };
+			const XMVECTOR q[] = { getKey(k, LocalPose::QX, g), getKey(k, LocalPose::QY, g), getKey(k, LocalPose::QZ, g), getKey(k, LocalPose::QW, g) };
+			XMVECTOR dq[4];
+			quaternionMultiply4(dq, qRef, q);
+			for (uint8_t i = 0; i < 4; ++i) getKey(k, LocalPose::QX + i, g) = dq[i];
+		}
+	}
+
+	m_isAdditive = true;
+}
+
+XMVECTOR AnimationClip::GetKeys(uint32_t key, LocalPose::Component c, uint32_t group) const
+{
+	return m_keys[(LocalPose::NUM_COMPONENT * key + c) * m_numGroups + group];
+}
+
+//--------------------------------------------------------------------------------------
+// Animation blender
+//--------------------------------------------------------------------------------------
+
+AnimationBlender::AnimationBlender() :
+	m_pSkeleton(nullptr),
+	m_states(0),
+	m_additiveStates(0),
+	m_fadeDuration(0.0f)
+{
+}
+
+AnimationBlender::~AnimationBlender()
+{
+}
+
+void AnimationBlender::Init(const Skeleton& skeleton)
+{
+	m_pSkeleton = &skeleton;
+	m_states.clear();
+	m_additiveStates.clear();
+
+	const auto numBones = skeleton.GetNumBones();
+	m_bindPose.Create(numBones);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		XMVECTOR s, q, t;
+		XMMatrixDecompose(&s, &q, &t, XMLoadFloat4x4(&skeleton.BindLocals[i]));
+
+		XMFLOAT3 translation, scaling;
+		XMFLOAT4 orientation;
+		XMStoreFloat3(&translation, t);
+		XMStoreFloat4(&orientation, q);
+		XMStoreFloat3(&scaling, s);
+		m_bindPose.SetBone(i, translation, orientation, scaling);
+	}
+}
+
+void AnimationBlender::Play(const AnimationClip::sptr& clip, float fadeDuration, float speed)
+{
+	const State state = { clip, nullptr, 0.0, speed, 0.0f };
+
+	if (fadeDuration <= 0.0f || m_states.empty())
+	{
+		m_states.assign(1, state);
+		m_states.back().Weight = 1.0f;
+	}
+	else
+	{
+		// Keep at most MAX_BLEND_LAYERS states in flight; drop the faintest
+		if (m_states.size() >= MAX_BLEND_LAYERS)
+		{
+			const auto faintest = min_element(m_states.begin(), m_states.end() - 1,
+				[](const State& a, const State& b) { return a.Weight < b.Weight; });
+			const auto weight = faintest->Weight;
+			m_states.erase(faintest);
+			for (auto& s : m_states) s.Weight /= 1.0f - weight;
+		}
+		m_states.emplace_back(state);
+	}
+
+	m_fadeDuration = fadeDuration;
+}
+
+void AnimationBlender::AddAdditiveLayer(const AnimationClip::sptr& clip, float weight,
+	const vector<XMVECTOR>* pMask, float speed)
+{
+	assert(clip->IsAdditive());
+	assert(m_additiveStates.size() < MAX_BLEND_LAYERS);
+	const State state = { clip, pMask, 0.0, speed, weight };
+	m_additiveStates.emplace_back(state);
+}
+
+void AnimationBlender::SetAdditiveWeight(uint32_t layer, float weight)
+{
+	if (layer < m_additiveStates.size()) m_additiveStates[layer].Weight = weight;
+}
+
+void AnimationBlender::Update(float timeStep)
+{
+	for (auto& state : m_states) state.Time += timeStep * state.Speed;
+	for (auto& state : m_additiveStates) state.Time += timeStep * state.Speed;
+
+	if (m_states.size() > 1)
+	{
+		// Fade the target in; the outgoing states share the rest in their current proportion
+		auto& target = m_states.back();
+		const auto prevWeight = target.Weight;
+		target.Weight = (min)(prevWeight + timeStep / m_fadeDuration, 1.0f);
+
+		if (target.Weight >= 1.0f) m_states.erase(m_states.begin(), m_states.end() - 1);
+		else
+		{
+			const auto scale = (1.0f - target.Weight) / (1.0f - prevWeight);
+			for (auto i = 0u; i + 1 < m_states.size(); ++i) m_states[i].Weight *= scale;
+		}
+	}
+}
+
+void AnimationBlender::Evaluate(LocalPose& pose) const
+{
+	Layer layers[MAX_BLEND_LAYERS];
+	Layer additiveLayers[MAX_BLEND_LAYERS];
+
+	const auto toLayer = [](const State& state)
+	{
+		const Layer layer = { state.Clip.get(), state.pMask, state.Time, state.Weight };
+		return layer;
+	};
+
+	auto numLayers = 0u;
+	for (const auto& state : m_states)
+		if (state.Weight > 0.0f) layers[numLayers++] = toLayer(state);
+
+	auto numAdditiveLayers = 0u;
+	for (const auto& state : m_additiveStates)
+		if (state.Weight > 0.0f) additiveLayers[numAdditiveLayers++] = toLayer(state);
+
+	Evaluate(pose, layers, numLayers, additiveLayers, numAdditiveLayers);
+}
+
+void AnimationBlender::Evaluate(LocalPose& pose, const Layer* pLayers, uint32_t numLayers,
+	const Layer* pAdditiveLayers, uint32_t numAdditiveLayers) const
+{
+	assert(m_pSkeleton);
+	assert(numLayers <= MAX_BLEND_LAYERS && numAdditiveLayers <= MAX_BLEND_LAYERS);
+
+	const auto numGroups = m_bindPose.GetNumGroups();
+	if (pose.GetNumBones() != m_bindPose.GetNumBones()) pose.Create(m_bindPose.GetNumBones());
+
+	// Key pairs of all layers, resolved once for the whole skeleton
+	struct Sample
+	{
+		uint32_t K0, K1;
+		XMVECTOR T;
+	};
+	Sample samples[MAX_BLEND_LAYERS], additiveSamples[MAX_BLEND_LAYERS];
+	const auto resolve = [](Sample* pSamples, const Layer* pLayers, uint32_t numLayers)
+	{
+		for (auto i = 0u; i < numLayers; ++i)
+		{
+			float t;
+			getKeyPair(pSamples[i].K0, pSamples[i].K1, t, *pLayers[i].pClip, pLayers[i].Time);
+			pSamples[i].T = XMVectorReplicate(t);
+		}
+	};
+	resolve(samples, pLayers, numLayers);
+	resolve(additiveSamples, pAdditiveLayers, numAdditiveLayers);
+
+	const auto zero = XMVectorZero();
+	const auto one = XMVectorSplatOne();
+
+	for (auto g = 0u; g < numGroups; ++g)
+	{
+		XMVECTOR t[3] = { zero, zero, zero };
+		XMVECTOR q[4] = { zero, zero, zero, zero };
+		XMVECTOR s[3] = { zero, zero, zero };
+		auto weightSum = zero;
+
+		// Weighted sum of the base layers
+		for (auto i = 0u; i < numLayers; ++i)
+		{
+			const auto& layer = pLayers[i];
+			const auto& sample = samples[i];
+			const auto& clip = *layer.pClip;
+			auto w = XMVectorReplicate(layer.Weight);
+			if (layer.pMask) w *= (*layer.pMask)[g];
+
+			const auto lerp = [&](LocalPose::Component c)
+			{ return XMVectorLerpV(clip.GetKeys(sample.K0, c, g), clip.GetKeys(sample.K1, c, g), sample.T); };
+
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				t[c] += w * lerp(static_cast<LocalPose::Component>(LocalPose::TX + c));
+				s[c] += w * lerp(static_cast<LocalPose::Component>(LocalPose::SX + c));
+			}
+
+			// Looping wraps from the last key to the first, which may be in the other hemisphere
+			XMVECTOR q0[4], q1[4];
+			for (uint8_t c = 0; c < 4; ++c)
+			{
+				q0[c] = clip.GetKeys(sample.K0, static_cast<LocalPose::Component>(LocalPose::QX + c), g);
+				q1[c] = clip.GetKeys(sample.K1, static_cast<LocalPose::Component>(LocalPose::QX + c), g);
+			}
+			const auto flip01 = XMVectorLess(q0[0] * q1[0] + q0[1] * q1[1] + q0[2] * q1[2] + q0[3] * q1[3], zero);
+			for (uint8_t c = 0; c < 4; ++c)
+				q1[c] = XMVectorLerpV(q0[c], XMVectorSelect(q1[c], -q1[c], flip01), sample.T);
+
+			// Align with the accumulated rotation before summing
+			const auto flip = XMVectorLess(q[0] * q1[0] + q[1] * q1[1] + q[2] * q1[2] + q[3] * q1[3], zero);
+			const auto wq = XMVectorSelect(w, -w, flip);
+			for (uint8_t c = 0; c < 4; ++c) q[c] += wq * q1[c];
+
+			weightSum += w;
+		}
+
+		// The bind pose fills the weight left over by masks and fades
+		{
+			const auto w = XMVectorMax(one - weightSum, zero);
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				t[c] += w * *m_bindPose.GetComponent(static_cast<LocalPose::Component>(LocalPose::TX + c), g);
+				s[c] += w * *m_bindPose.GetComponent(static_cast<LocalPose::Component>(LocalPose::SX + c), g);
+			}
+
+			XMVECTOR qb[4];
+			for (uint8_t c = 0; c < 4; ++c)
+				qb[c] = *m_bindPose.GetComponent(static_cast<LocalPose::Component>(LocalPose::QX + c), g);
+			const auto flip = XMVectorLess(q[0] * qb[0] + q[1] * qb[1] + q[2] * qb[2] + q[3] * qb[3], zero);
+			const auto wq = XMVectorSelect(w, -w, flip);
+			for (uint8_t c = 0; c < 4; ++c) q[c] += wq * qb[c];
+
+			const auto rcpWeight = XMVectorReciprocal(weightSum + w);
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				t[c] *= rcpWeight;
+				s[c] *= rcpWeight;
+			}
+			quaternionNormalize4(q);
+		}
+
+		// Additive layers on top: t += w dt, q = q * nlerp(1, dq, w), s *= 1 + w (ds - 1)
+		for (auto i = 0u; i < numAdditiveLayers; ++i)
+		{
+			const auto& layer = pAdditiveLayers[i];
+			const auto& sample = additiveSamples[i];
+			const auto& clip = *layer.pClip;
+			auto w = XMVectorReplicate(layer.Weight);
+			if (layer.pMask) w *= (*layer.pMask)[g];
+
+			const auto lerp = [&](LocalPose::Component c)
+			{ return XMVectorLerpV(clip.GetKeys(sample.K0, c, g), clip.GetKeys(sample.K1, c, g), sample.T); };
+
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				t[c] += w * lerp(static_cast<LocalPose::Component>(LocalPose::TX + c));
+				s[c] *= one + w * (lerp(static_cast<LocalPose::Component>(LocalPose::SX + c)) - one);
+			}
+
+			XMVECTOR dq[4];
+			for (uint8_t c = 0; c < 4; ++c) dq[c] = lerp(static_cast<LocalPose::Component>(LocalPose::QX + c));
+
+			// Shortest path from identity
+			const auto flip = XMVectorLess(dq[3], zero);
+			for (uint8_t c = 0; c < 4; ++c) dq[c] = XMVectorSelect(dq[c], -dq[c], flip);
+			for (uint8_t c = 0; c < 3; ++c) dq[c] *= w;
+			dq[3] = one + w * (dq[3] - one);
+			quaternionNormalize4(dq);
+
+			XMVECTOR base[4];
+			for (uint8_t c = 0; c < 4; ++c) base[c] = q[c];
+			quaternionMultiply4(q, base, dq);
+		}
+
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			*pose.GetComponent(static_cast<LocalPose::Component>(LocalPose::TX + c), g) = t[c];
+			*pose.GetComponent(static_cast<LocalPose::Component>(LocalPose::SX + c), g) = s[c];
+		}
+		for (uint8_t c = 0; c < 4; ++c)
+			*pose.GetComponent(static_cast<LocalPose::Component>(LocalPose::QX + c), g) = q[c];
+	}
+}
+
+void AnimationBlender::ComputeModelMatrices(XMFLOAT4X4* pMatrices, const LocalPose& pose,
+	const XMFLOAT4X4* pInvBindMatrices, const vector<uint32_t>* pBoneRemap) const
+{
+	assert(m_pSkeleton);
+	const auto& parents = m_pSkeleton->Parents;
+	const auto numBones = m_pSkeleton->GetNumBones();
+	const auto isCollapsed = [pBoneRemap](uint32_t i) { return pBoneRemap && (*pBoneRemap)[i] != i; };
+
+	// Parents precede children, so one forward pass resolves the hierarchy
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		auto matrix = isCollapsed(i) ? XMLoadFloat4x4(&m_pSkeleton->BindLocals[i]) : pose.GetBoneMatrix(i);
+		if (parents[i] != UINT32_MAX) matrix = XMMatrixMultiply(matrix, XMLoadFloat4x4(&pMatrices[parents[i]]));
+		XMStoreFloat4x4(&pMatrices[i], matrix);
+	}
+
+	if (pInvBindMatrices)
+	{
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			// A collapsed bone stays in the bind pose relative to its kept ancestor, which makes
+			// their skinning matrices equal.
+			if (isCollapsed(i)) pMatrices[i] = pMatrices[(*pBoneRemap)[i]];
+			else
+			{
+				const auto matrix = XMMatrixMultiply(XMLoadFloat4x4(&pInvBindMatrices[i]), XMLoadFloat4x4(&pMatrices[i]));
+				XMStoreFloat4x4(&pMatrices[i], matrix);
+			}
+		}
+	}
+}
+
+void AnimationBlender::CreateMask(vector<XMVECTOR>& mask, const Skeleton& skeleton,
+	const char* rootBone, float weight)
+{
+	const auto numBones = skeleton.GetNumBones();
+	const auto root = skeleton.FindBone(rootBone);
+	mask.assign(XUSG_DIV_UP(numBones, 4), XMVectorZero());
+
+	// Subtree membership propagates from parents to children
+	vector<bool> inSubtree(numBones, false);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		inSubtree[i] = i == root || (skeleton.Parents[i] != UINT32_MAX && inSubtree[skeleton.Parents[i]]);
+		if (inSubtree[i]) laneOf(mask.data(), i / 4, i) = weight;
+	}
+}
+
+bool AnimationBlender::CreateBenchmarkClips(Skeleton& skeleton, vector<vector<uint8_t>>& clipData,
+	vector<AnimationClip>& clips, uint32_t numClips, uint32_t numBones)
+{
+	using FileHeader = SDKMesh::AnimationFileHeader;
+	using FrameData = SDKMesh::AnimationFrameData;
+	using KeyData = SDKMesh::AnimationData;
+
+	XUSG_N_RETURN(numClips > 0 && numBones > 0, false);
+
+	// Four limbs chained from the root
+	skeleton = Skeleton();
+	skeleton.BindLocals.resize(numBones);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		skeleton.BoneNames.push_back("Bone" + to_string(i));
+		skeleton.Parents.push_back(i ? (i < 5 ? 0 : i - 4) : UINT32_MAX);
+		XMStoreFloat4x4(&skeleton.BindLocals[i], XMMatrixTranslation(0.0f, 0.1f, 0.0f));
+	}
+
+	// Clips of random keys in the .sdkmesh_anim layout
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	const auto numKeys = 30u;
+	const auto keysOffset = sizeof(FrameData) * numBones;
+	clipData.assign(numClips, vector<uint8_t>());
+	clips.clear();
+	clips.resize(numClips);
+	for (auto i = 0u; i < numClips; ++i)
+	{
+		auto& data = clipData[i];
+		data.resize(sizeof(FileHeader) + keysOffset + sizeof(KeyData) * numKeys * numBones);
+
+		auto& header = *reinterpret_cast<FileHeader*>(data.data());
+		header.NumFrames = numBones;
+		header.NumAnimationKeys = numKeys;
+		header.AnimationFPS = 30;
+		header.AnimationDataSize = data.size() - sizeof(FileHeader);
+		header.AnimationDataOffset = sizeof(FileHeader);
+
+		const auto pFrameData = reinterpret_cast<FrameData*>(&data[sizeof(FileHeader)]);
+		for (auto j = 0u; j < numBones; ++j)
+		{
+			strncpy_s(pFrameData[j].FrameName, skeleton.BoneNames[j].c_str(), _TRUNCATE);
+			pFrameData[j].DataOffset = keysOffset + sizeof(KeyData) * numKeys * j;
+
+			const auto pKeys = reinterpret_cast<KeyData*>(&data[sizeof(FileHeader) + pFrameData[j].DataOffset]);
+			for (auto k = 0u; k < numKeys; ++k)
+			{
+				pKeys[k].Translation = XMFLOAT3(unit(rng) * 0.01f, 0.1f, unit(rng) * 0.01f);
+				XMStoreFloat4(&pKeys[k].Orientation, XMQuaternionNormalize(
+					XMVectorSet(unit(rng) * 0.3f, unit(rng) * 0.3f, unit(rng) * 0.3f, 1.0f)));
+				pKeys[k].Scaling = XMFLOAT3(1.0f, 1.0f, 1.0f);
+			}
+		}
+
+		XUSG_N_RETURN(clips[i].Create(data.data(), data.size(), skeleton), false);
+	}
+
+	return true;
+}
+
+void AnimationBlender::Benchmark(BenchmarkResult& result, uint32_t numLayers, uint32_t numCharacters,
+	uint32_t numBones, uint32_t numFrames)
+{
+	using FileHeader = SDKMesh::AnimationFileHeader;
+	using FrameData = SDKMesh::AnimationFrameData;
+	using KeyData = SDKMesh::AnimationData;
+
+	result = {};
+	XUSG_N_RETURN(numLayers > 0 && numLayers <= MAX_BLEND_LAYERS && numCharacters > 0 &&
+		numBones > 0 && numFrames > 0, );
+
+	Skeleton skeleton;
+	vector<vector<uint8_t>> clipData;
+	vector<AnimationClip> clips;
+	XUSG_N_RETURN(CreateBenchmarkClips(skeleton, clipData, clips, numLayers, numBones), );
+
+	AnimationBlender blender;
+	blender.Init(skeleton);
+
+	LocalPose pose;
+	Layer layers[MAX_BLEND_LAYERS];
+	vector<XMFLOAT4X4> matrices(numBones);
+	vector<XMMATRIX> palettes(numBones * numLayers);
+	const auto weight = 1.0f / numLayers;
+
+	chrono::duration<double, milli> fusedTime(0.0), naiveTime(0.0);
+	for (auto n = 0u; n < numFrames; ++n)
+	{
+		auto start = chrono::high_resolution_clock::now();
+		for (auto c = 0u; c < numCharacters; ++c)
+		{
+			for (auto i = 0u; i < numLayers; ++i)
+				layers[i] = { &clips[i], nullptr, n / 30.0 + c * 0.37 + i * 0.11, weight };
+			blender.Evaluate(pose, layers, numLayers, nullptr, 0);
+			blender.ComputeModelMatrices(matrices.data(), pose);
+		}
+		fusedTime += chrono::high_resolution_clock::now() - start;
+
+		start = chrono::high_resolution_clock::now();
+		for (auto c = 0u; c < numCharacters; ++c)
+		{
+			// Per clip: sample every bone, then resolve the hierarchy into a full palette
+			for (auto i = 0u; i < numLayers; ++i)
+			{
+				uint32_t k0, k1;
+				float t;
+				getKeyPair(k0, k1, t, clips[i], n / 30.0 + c * 0.37 + i * 0.11);
+
+				const auto& data = clipData[i];
+				const auto pFrameData = reinterpret_cast<const FrameData*>(&data[sizeof(FileHeader)]);
+				const auto pPalette = &palettes[numBones * i];
+				for (auto j = 0u; j < numBones; ++j)
+				{
+					const auto pKeys = reinterpret_cast<const KeyData*>(&data[sizeof(FileHeader) + pFrameData[j].DataOffset]);
+					const auto& key0 = pKeys[k0];
+					const auto& key1 = pKeys[k1];
+					pPalette[j] = XMMatrixAffineTransformation(
+						XMVectorLerp(XMLoadFloat3(&key0.Scaling), XMLoadFloat3(&key1.Scaling), t), XMVectorZero(),
+						XMQuaternionSlerp(XMLoadFloat4(&key0.Orientation), XMLoadFloat4(&key1.Orientation), t),
+						XMVectorLerp(XMLoadFloat3(&key0.Translation), XMLoadFloat3(&key1.Translation), t));
+					if (skeleton.Parents[j] != UINT32_MAX)
+						pPalette[j] = XMMatrixMultiply(pPalette[j], pPalette[skeleton.Parents[j]]);
+				}
+			}
+
+			// Weighted sum of the palettes
+			for (auto j = 0u; j < numBones; ++j)
+			{
+				XMMATRIX matrix = palettes[j] * weight;
+				for (auto i = 1u; i < numLayers; ++i) matrix += palettes[numBones * i + j] * weight;
+				XMStoreFloat4x4(&matrices[j], matrix);
+			}
+		}
+		naiveTime += chrono::high_resolution_clock::now() - start;
+	}
+
+	result.FusedMilliseconds = fusedTime.count() / numFrames;
+	result.NaiveMilliseconds = naiveTime.count() / numFrames;
+}
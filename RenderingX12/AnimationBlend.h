@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Skeleton (frame hierarchy of an SDKMesh)
+	//--------------------------------------------------------------------------------------
+	struct Skeleton
+	{
+		std::vector<std::string>		BoneNames;
+		std::vector<uint32_t>			Parents;		// UINT32_MAX for roots; parents precede children
+		std::vector<DirectX::XMFLOAT4X4> BindLocals;
+
+		bool Create(const SDKMesh* pMesh);
+		uint32_t FindBone(const char* name) const;
+		uint32_t GetNumBones() const { return static_cast<uint32_t>(Parents.size()); }
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Local-space pose in structure-of-arrays layout, 4 bones per XMVECTOR
+	//--------------------------------------------------------------------------------------
+	class LocalPose
+	{
+	public:
+		enum Component : uint8_t
+		{
+			TX, TY, TZ,
+			QX, QY, QZ, QW,
+			SX, SY, SZ,
+
+			NUM_COMPONENT
+		};
+
+		LocalPose();
+		virtual ~LocalPose();
+
+		void Create(uint32_t numBones);
+		void SetBone(uint32_t bone, const DirectX::XMFLOAT3& t, const DirectX::XMFLOAT4& q, const DirectX::XMFLOAT3& s);
+
+		DirectX::XMMATRIX GetBoneMatrix(uint32_t bone) const;
+		DirectX::XMVECTOR* GetComponent(Component c, uint32_t group = 0) { return &m_data[m_numGroups * c + group]; }
+		const DirectX::XMVECTOR* GetComponent(Component c, uint32_t group = 0) const { return &m_data[m_numGroups * c + group]; }
+
+		uint32_t GetNumBones() const { return m_numBones; }
+		uint32_t GetNumGroups() const { return m_numGroups; }
+
+	protected:
+		std::vector<DirectX::XMVECTOR> m_data;
+		uint32_t m_numBones;
+		uint32_t m_numGroups;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Animation clip from an .sdkmesh_anim file, key-major SoA resampled to a skeleton
+	//--------------------------------------------------------------------------------------
+	class AnimationClip
+	{
+	public:
+		AnimationClip();
+		virtual ~AnimationClip();
+
+		bool Create(const wchar_t* fileName, const Skeleton& skeleton);
+		bool Create(const uint8_t* pData, size_t dataSize, const Skeleton& skeleton);
+
+		// Converts the keys to deltas against the reference key for additive layers
+		void MakeAdditive(uint32_t referenceKey = 0);
+
+		// Keys of component c for the 4 bones of a group
+		DirectX::XMVECTOR GetKeys(uint32_t key, LocalPose::Component c, uint32_t group) const;
+
+		uint32_t GetNumKeys() const { return m_numKeys; }
+		uint32_t GetNumGroups() const { return m_numGroups; }
+		float GetFPS() const { return m_fps; }
+		float GetDuration() const { return m_numKeys / m_fps; }
+		bool IsAdditive() const { return m_isAdditive; }
+
+		using uptr = std::unique_ptr<AnimationClip>;
+		using sptr = std::shared_ptr<AnimationClip>;
+
+	protected:
+		std::vector<DirectX::XMVECTOR> m_keys;	// [key][component][group]
+		uint32_t m_numKeys;
+		uint32_t m_numGroups;
+		float m_fps;
+		bool m_isAdditive;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Blend tree: cross-faded base layers, additive layers and per-bone masks, evaluated
+	// in a single fused pass into a local pose
+	//--------------------------------------------------------------------------------------
+	class AnimationBlender
+	{
+	public:
+		struct Layer
+		{
+			const AnimationClip* pClip;
+			const std::vector<DirectX::XMVECTOR>* pMask;	// Per-bone weights in groups of 4; nullptr for all bones
+			double Time;
+			float Weight;
+		};
+
+		struct BenchmarkResult
+		{
+			double		FusedMilliseconds;	// Per frame of all characters
+			double		NaiveMilliseconds;
+		};
+
+		AnimationBlender();
+		virtual ~AnimationBlender();
+
+		void Init(const Skeleton& skeleton);
+
+		// State machine: fades the current state out while the new one fades in
+		void Play(const AnimationClip::sptr& clip, float fadeDuration = 0.0f, float speed = 1.0f);
+		void AddAdditiveLayer(const AnimationClip::sptr& clip, float weight,
+			const std::vector<DirectX::XMVECTOR>* pMask = nullptr, float speed = 1.0f);
+		void SetAdditiveWeight(uint32_t layer, float weight);
+		void Update(float timeStep);
+
+		// Fused evaluation of every layer; no per-layer pose or palette is materialized
+		void Evaluate(LocalPose& pose) const;
+		void Evaluate(LocalPose& pose, const Layer* pLayers, uint32_t numLayers,
+			const Layer* pAdditiveLayers, uint32_t numAdditiveLayers) const;
+
+		// Model-space matrices of the bones, optionally multiplied by the inverse bind matrices.
+		// Bones collapsed by an LOD bone remap are not sampled and keep their bind pose.
+		void ComputeModelMatrices(DirectX::XMFLOAT4X4* pMatrices, const LocalPose& pose,
+			const DirectX::XMFLOAT4X4* pInvBindMatrices = nullptr,
+			const std::vector<uint32_t>* pBoneRemap = nullptr) const;
+
+		static void CreateMask(std::vector<DirectX::XMVECTOR>& mask, const Skeleton& skeleton,
+			const char* rootBone, float weight = 1.0f);
+
+		// Skeleton of four limbs chained from the root and clips of random keys in the
+		// .sdkmesh_anim layout, whose data the naive evaluation of Benchmark samples
+		static bool CreateBenchmarkClips(Skeleton& skeleton, std::vector<std::vector<uint8_t>>& clipData,
+			std::vector<AnimationClip>& clips, uint32_t numClips, uint32_t numBones);
+
+		// Blends numLayers synthetic clips per character into model-space matrices: fused SoA
+		// evaluation against naive per-clip evaluation, which samples each clip bone by bone,
+		// builds its full palette and blends the palettes.
+		static void Benchmark(BenchmarkResult& result, uint32_t numLayers = 4, uint32_t numCharacters = 100,
+			uint32_t numBones = 64, uint32_t numFrames = 60);
+
+	protected:
+		struct State
+		{
+			AnimationClip::sptr Clip;
+			const std::vector<DirectX::XMVECTOR>* pMask;
+			double Time;
+			float Speed;
+			float Weight;
+		};
+
+		const Skeleton*		m_pSkeleton;
+		LocalPose			m_bindPose;
+
+		std::vector<State>	m_states;		// Base states; the last one is the current target
+		std::vector<State>	m_additiveStates;
+		float				m_fadeDuration;
+	};
+}
@@ -0,0 +1,300 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "AnimationLOD.h"
+#include "DualQuatSkinning.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static const AnimationLOD::Level DEFAULT_LEVELS[] =
+{
+	{ 0.0f, 1, 0.0f },
+	{ 40.0f, 2, 0.1f },
+	{ 80.0f, 4, 0.3f }
+};
+
+AnimationLOD::AnimationLOD() :
+	m_levels(0),
+	m_boneRemaps(0),
+	m_numActiveBones(0),
+	m_hysteresis(0.1f)
+{
+}
+
+AnimationLOD::~AnimationLOD()
+{
+}
+
+bool AnimationLOD::Init(void* pSceneReader)
+{
+	XUSG_N_RETURN(pSceneReader, false);
+	auto& sceneReader = *static_cast<tiny::TinyJson*>(pSceneReader);
+
+	auto levelsReader = sceneReader.Get<tiny::xarray>("AnimationLOD");
+	const auto numLevels = static_cast<uint8_t>(levelsReader.Count());
+	vector<Level> levels(numLevels);
+	for (uint8_t i = 0; i < numLevels; ++i)
+	{
+		levelsReader.Enter(i);
+		levels[i].Distance = levelsReader.Get<float>("Distance", 0.0f);
+		levels[i].UpdateInterval = (max)(levelsReader.Get<uint32_t>("UpdateInterval", 1u), 1u);
+		levels[i].MinInfluence = levelsReader.Get<float>("MinInfluence", 0.0f);
+	}
+	if (levels.empty()) levels.assign(begin(DEFAULT_LEVELS), end(DEFAULT_LEVELS));
+	m_hysteresis = sceneReader.Get<float>("AnimationLODHysteresis", 0.1f);
+
+	SetLevels(levels.data(), static_cast<uint8_t>(levels.size()));
+
+	return true;
+}
+
+void AnimationLOD::SetLevels(const Level* pLevels, uint8_t numLevels)
+{
+	const Level fullRate = { 0.0f, 1, 0.0f };
+	if (numLevels > 0) m_levels.assign(pLevels, pLevels + numLevels);
+	else m_levels.assign(1, fullRate);
+
+	sort(m_levels.begin(), m_levels.end(), [](const Level& a, const Level& b) { return a.Distance < b.Distance; });
+	m_boneRemaps.assign(m_levels.size(), vector<uint32_t>());
+	m_numActiveBones.assign(m_levels.size(), 0);
+}
+
+bool AnimationLOD::CreateBoneLevels(const SDKMesh* pMesh, const Skeleton& skeleton)
+{
+	const auto numBones = skeleton.GetNumBones();
+	const auto& layout = DualQuatSkinning::GetDefaultVertexLayout();
+
+	// Peak skinning weight of each bone over all the vertices of the mesh
+	vector<float> influences(numBones, 0.0f);
+	const auto numMeshes = pMesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto pMeshData = pMesh->GetMesh(m);
+		if (!pMeshData->NumFrameInfluences) continue;
+		XUSG_N_RETURN(pMesh->GetVertexStride(m, 0) == layout.Stride, false);
+
+		const auto pVertices = pMesh->GetRawVerticesAt(pMeshData->VertexBuffers[0]);
+		const auto numVertices = static_cast<uint32_t>(pMesh->GetNumVertices(m, 0));
+		XUSG_N_RETURN(pVertices, false);
+
+		for (auto i = 0u; i < numVertices; ++i)
+		{
+			const auto pVertex = &pVertices[layout.Stride * i];
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				const auto influence = pVertex[layout.IndicesOffset + j];
+				if (influence >= pMeshData->NumFrameInfluences) continue;
+
+				const auto bone = pMeshData->pFrameInfluences[influence];
+				if (bone < numBones) influences[bone] = (max)(influences[bone], pVertex[layout.WeightsOffset + j] / 255.0f);
+			}
+		}
+	}
+
+	CreateBoneLevels(influences.data(), skeleton);
+
+	return true;
+}
+
+void AnimationLOD::CreateBoneLevels(const float* pInfluences, const Skeleton& skeleton)
+{
+	const auto numBones = skeleton.GetNumBones();
+
+	// A bone is kept if it or any of its descendants is influential enough. Children follow
+	// their parents, so a reverse pass propagates the decision up to the roots.
+	const auto numLevels = GetNumLevels();
+	vector<bool> kept(numBones);
+	for (uint8_t level = 0; level < numLevels; ++level)
+	{
+		const auto minInfluence = m_levels[level].MinInfluence;
+		for (auto i = 0u; i < numBones; ++i) kept[i] = minInfluence <= 0.0f || pInfluences[i] >= minInfluence;
+		for (auto i = numBones; i-- > 0;)
+		{
+			const auto parent = skeleton.Parents[i];
+			if (kept[i] && parent != UINT32_MAX) kept[parent] = true;
+		}
+
+		// Collapsed bones follow their nearest kept ancestor rigidly in the bind pose
+		auto& boneRemap = m_boneRemaps[level];
+		boneRemap.resize(numBones);
+		m_numActiveBones[level] = 0;
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			if (kept[i])
+			{
+				boneRemap[i] = i;
+				++m_numActiveBones[level];
+			}
+			else boneRemap[i] = skeleton.Parents[i] != UINT32_MAX ? boneRemap[skeleton.Parents[i]] : i;
+		}
+	}
+}
+
+void AnimationLOD::InitInstance(Instance& instance, uint32_t index) const
+{
+	instance.Level = 0;
+	instance.Phase = index;
+	instance.Frame = 0;
+	instance.Blend = 1.0f;
+}
+
+bool AnimationLOD::Tick(Instance& instance, float distance) const
+{
+	const auto level = SelectLevel(distance, instance.Level);
+	const auto interval = m_levels[level].UpdateInterval;
+
+	// Re-evaluate immediately on a level change, since the last target is not one interval ahead
+	if (level != instance.Level)
+	{
+		instance.Level = level;
+		instance.Frame = interval - instance.Phase % interval;
+	}
+
+	const auto step = (instance.Frame++ + instance.Phase) % interval;
+	instance.Blend = step / static_cast<float>(interval);
+
+	return step == 0;
+}
+
+uint8_t AnimationLOD::SelectLevel(float distance, uint8_t currentLevel) const
+{
+	const auto numLevels = GetNumLevels();
+	auto level = 0u;
+	while (level + 1u < numLevels && distance >= m_levels[level + 1].Distance) ++level;
+
+	// Hysteresis: stay at the current level while within a fraction of its bounds
+	if (currentLevel < numLevels && level != currentLevel)
+	{
+		const auto lower = m_levels[currentLevel].Distance * (1.0f - m_hysteresis);
+		const auto upper = currentLevel + 1u < numLevels ?
+			m_levels[currentLevel + 1].Distance * (1.0f + m_hysteresis) : FLT_MAX;
+		if (distance >= lower && distance < upper) level = currentLevel;
+	}
+
+	return static_cast<uint8_t>(level);
+}
+
+void AnimationLOD::ApplyBoneRemap(XMFLOAT4X4* pPalette, const vector<uint32_t>& boneRemap)
+{
+	// With the bind pose between a collapsed bone and its ancestor, the two skinning
+	// matrices are equal, so the ancestor's entry is exact for a frozen bone.
+	const auto numBones = static_cast<uint32_t>(boneRemap.size());
+	for (auto i = 0u; i < numBones; ++i)
+		if (boneRemap[i] != i) pPalette[i] = pPalette[boneRemap[i]];
+}
+
+void AnimationLOD::InterpolatePalette(XMFLOAT4X4* pDst, const XMFLOAT4X4* pPrev,
+	const XMFLOAT4X4* pNext, uint32_t numBones, float t)
+{
+	// Linear blend skinning is linear in the matrices, so lerping the palette matches
+	// lerping the skinned positions.
+	const auto f = XMVectorReplicate(t);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto prev = XMLoadFloat4x4(&pPrev[i]);
+		const auto next = XMLoadFloat4x4(&pNext[i]);
+		XMMATRIX m;
+		for (uint8_t j = 0; j < 4; ++j) m.r[j] = XMVectorLerpV(prev.r[j], next.r[j], f);
+		XMStoreFloat4x4(&pDst[i], m);
+	}
+}
+
+void AnimationLOD::Benchmark(BenchmarkResult& result, uint32_t numCharacters, uint32_t numBones,
+	uint32_t numFrames) const
+{
+	result = {};
+	XUSG_N_RETURN(numCharacters > 0 && numBones > 0 && numFrames > 0, );
+
+	const auto numClips = 2u;
+	Skeleton skeleton;
+	vector<vector<uint8_t>> clipData;
+	vector<AnimationClip> clips;
+	XUSG_N_RETURN(AnimationBlender::CreateBenchmarkClips(skeleton, clipData, clips, numClips, numBones), );
+
+	// Limbs hang from the root in bone order, so the peak weight falls with the depth.
+	vector<float> influences(numBones);
+	for (auto i = 0u; i < numBones; ++i) influences[i] = i ? 4.0f / (i + 3) : 1.0f;
+	auto lod = *this;
+	lod.CreateBoneLevels(influences.data(), skeleton);
+
+	vector<XMFLOAT4X4> bindMatrices(numBones), invBindMatrices(numBones);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		auto bind = XMLoadFloat4x4(&skeleton.BindLocals[i]);
+		if (skeleton.Parents[i] != UINT32_MAX) bind = XMMatrixMultiply(bind, XMLoadFloat4x4(&bindMatrices[skeleton.Parents[i]]));
+		XMStoreFloat4x4(&bindMatrices[i], bind);
+		XMStoreFloat4x4(&invBindMatrices[i], XMMatrixInverse(nullptr, bind));
+	}
+
+	AnimationBlender blender;
+	blender.Init(skeleton);
+
+	LocalPose pose;
+	AnimationBlender::Layer layers[numClips];
+	const auto evaluate = [&](XMFLOAT4X4* pPalette, double time, const vector<uint32_t>* pBoneRemap)
+	{
+		for (auto i = 0u; i < numClips; ++i) layers[i] = { &clips[i], nullptr, time + i * 0.11, 1.0f / numClips };
+		blender.Evaluate(pose, layers, numClips, nullptr, 0);
+		blender.ComputeModelMatrices(pPalette, pose, invBindMatrices.data(), pBoneRemap);
+	};
+
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> distances(5.0f, 150.0f);
+	vector<float> baseDistances(numCharacters);
+	for (auto& distance : baseDistances) distance = distances(rng);
+	const auto getDistance = [&](uint32_t c, uint32_t n)
+	{
+		return (max)(baseDistances[c] + 20.0f * sinf(n * 0.02f + c), 0.0f);
+	};
+
+	// The previous and the next evaluated palettes of each character, and the one drawn
+	vector<XMFLOAT4X4> palettes(static_cast<size_t>(numBones) * numCharacters * 2);
+	vector<XMFLOAT4X4> drawPalette(numBones);
+	vector<Instance> instances(numCharacters);
+	for (auto c = 0u; c < numCharacters; ++c)
+	{
+		lod.InitInstance(instances[c], c);
+		evaluate(&palettes[numBones * 2 * c], c * 0.37, nullptr);
+		palettes[numBones * (2 * c + 1)] = palettes[numBones * 2 * c];
+	}
+
+	chrono::duration<double, milli> fullTime(0.0), lodTime(0.0);
+	uint64_t numEvaluations = 0;
+	for (auto n = 0u; n < numFrames; ++n)
+	{
+		auto start = chrono::high_resolution_clock::now();
+		for (auto c = 0u; c < numCharacters; ++c) evaluate(drawPalette.data(), n / 30.0 + c * 0.37, nullptr);
+		fullTime += chrono::high_resolution_clock::now() - start;
+
+		start = chrono::high_resolution_clock::now();
+		for (auto c = 0u; c < numCharacters; ++c)
+		{
+			auto& instance = instances[c];
+			const auto level = instance.Level;
+			const auto pPrev = &palettes[numBones * 2 * c];
+			const auto pNext = pPrev + numBones;
+			if (lod.Tick(instance, getDistance(c, n)))
+			{
+				// One interval ahead of the frame
+				const auto interval = lod.GetLevel(instance.Level).UpdateInterval;
+				memcpy(pPrev, pNext, sizeof(XMFLOAT4X4) * numBones);
+				evaluate(pNext, (n + interval) / 30.0 + c * 0.37, &lod.GetBoneRemap(instance.Level));
+				++numEvaluations;
+			}
+			result.NumLevelChanges += instance.Level != level;
+
+			if (instance.Blend > 0.0f) InterpolatePalette(drawPalette.data(), pPrev, pNext, numBones, instance.Blend);
+			else memcpy(drawPalette.data(), pPrev, sizeof(XMFLOAT4X4) * numBones);
+		}
+		lodTime += chrono::high_resolution_clock::now() - start;
+	}
+
+	result.FullMilliseconds = fullTime.count() / numFrames;
+	result.LODMilliseconds = lodTime.count() / numFrames;
+	result.EvaluationRatio = static_cast<double>(numEvaluations) / (static_cast<uint64_t>(numCharacters) * numFrames);
+}
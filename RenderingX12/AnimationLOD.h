@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AnimationBlend.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Animation LOD: distance-based update rate and bone reduction for characters
+	//--------------------------------------------------------------------------------------
+	class AnimationLOD
+	{
+	public:
+		struct Level
+		{
+			float Distance;			// Lower bound of the camera distance
+			uint32_t UpdateInterval;	// Frames between two evaluations
+			float MinInfluence;		// Bones whose peak skinning weight is below this are collapsed
+		};
+
+		// Per-character LOD state
+		struct Instance
+		{
+			uint8_t Level;
+			uint32_t Phase;			// Staggers the updates of characters sharing a level
+			uint32_t Frame;
+			float Blend;			// Interpolation factor between the last two evaluated palettes
+		};
+
+		struct BenchmarkResult
+		{
+			double		FullMilliseconds;	// Per frame of all characters, each evaluated with every bone
+			double		LODMilliseconds;
+			double		EvaluationRatio;	// Evaluations with LOD over those at full rate
+			uint32_t	NumLevelChanges;
+		};
+
+		AnimationLOD();
+		virtual ~AnimationLOD();
+
+		// Reads "AnimationLOD" from the scene file; takes levels at 0, 40 and 80 units if absent
+		bool Init(void* pSceneReader);
+		void SetLevels(const Level* pLevels, uint8_t numLevels);
+
+		// Offline reduced bone sets from the skinning weights of the mesh, one per level
+		bool CreateBoneLevels(const SDKMesh* pMesh, const Skeleton& skeleton);
+		void CreateBoneLevels(const float* pInfluences, const Skeleton& skeleton);	// Peak weight per bone
+
+		void InitInstance(Instance& instance, uint32_t index) const;
+
+		// Selects the level of the character and returns true if its pose must be evaluated
+		// this frame. Evaluations are one interval ahead, so the previous palette is the
+		// current pose on an evaluating frame; instance.Blend then rises from 0 towards the
+		// new palette over the interval.
+		bool Tick(Instance& instance, float distance) const;
+		uint8_t SelectLevel(float distance, uint8_t currentLevel) const;
+
+		const Level& GetLevel(uint8_t level) const { return m_levels[level]; }
+		uint8_t GetNumLevels() const { return static_cast<uint8_t>(m_levels.size()); }
+
+		// Bone-to-evaluated-bone mapping of a level; collapsed bones map to their nearest kept ancestor
+		const std::vector<uint32_t>& GetBoneRemap(uint8_t level) const { return m_boneRemaps[level]; }
+		uint32_t GetNumActiveBones(uint8_t level) const { return m_numActiveBones[level]; }
+
+		// Copies the palette entries of the kept ancestors to the collapsed bones
+		static void ApplyBoneRemap(DirectX::XMFLOAT4X4* pPalette, const std::vector<uint32_t>& boneRemap);
+		static void InterpolatePalette(DirectX::XMFLOAT4X4* pDst, const DirectX::XMFLOAT4X4* pPrev,
+			const DirectX::XMFLOAT4X4* pNext, uint32_t numBones, float t);
+
+		// Stress test over the levels: numCharacters characters of a synthetic skeleton, whose
+		// limb bones weigh less towards their ends, walk between 5 and 150 units from the camera.
+		// Times their skinning palettes per frame at full rate and with LOD.
+		void Benchmark(BenchmarkResult& result, uint32_t numCharacters = 500, uint32_t numBones = 64,
+			uint32_t numFrames = 120) const;
+
+	protected:
+		std::vector<Level>					m_levels;		// Ascending distances
+		std::vector<std::vector<uint32_t>>	m_boneRemaps;
+		std::vector<uint32_t>				m_numActiveBones;
+		float								m_hysteresis;
+	};
+}
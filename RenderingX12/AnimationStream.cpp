@@ -0,0 +1,456 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "AnimationStream.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static const uint32_t ANIM_STREAM_FOURCC = 0x534e4158;	// "XANS"
+static const uint32_t ANIM_STREAM_VERSION = 1;
+
+//--------------------------------------------------------------------------------------
+// Streamer
+//--------------------------------------------------------------------------------------
+
+AnimationStreamer::AnimationStreamer() :
+	m_isRunning(false)
+{
+}
+
+AnimationStreamer::~AnimationStreamer()
+{
+	Stop();
+}
+
+void AnimationStreamer::Start()
+{
+	if (m_isRunning) return;
+
+	m_isRunning = true;
+	m_worker = thread(&AnimationStreamer::run, this);
+}
+
+void AnimationStreamer::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isRunning = false;
+	}
+	m_requestCV.notify_all();
+
+	if (m_worker.joinable()) m_worker.join();
+
+	// Waiters on the dropped slots, e.g. StreamedAnimationClip::Close, see them empty
+	{
+		lock_guard<mutex> lock(m_mutex);
+		for (const auto& request : m_requests) request.pClip->cancelSlot(request.Slot);
+		m_requests.clear();
+	}
+	m_completionCV.notify_all();
+}
+
+bool AnimationStreamer::Request(StreamedAnimationClip* pClip, uint8_t slot)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!m_isRunning) return false;
+		m_requests.push_back({ pClip, slot });
+	}
+	m_requestCV.notify_one();
+
+	return true;
+}
+
+void AnimationStreamer::WaitForCompletion(const function<bool()>& isDone)
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_completionCV.wait(lock, isDone);
+}
+
+void AnimationStreamer::run()
+{
+	while (true)
+	{
+		WorkItem item;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_requestCV.wait(lock, [this]() { return !m_isRunning || !m_requests.empty(); });
+			if (!m_isRunning) break;
+
+			item = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		item.pClip->loadSlot(item.Slot);
+
+		// Lock so that a waiter cannot miss the notification between its check and its wait
+		{ lock_guard<mutex> lock(m_mutex); }
+		m_completionCV.notify_all();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Streamed clip
+//--------------------------------------------------------------------------------------
+
+StreamedAnimationClip::StreamedAnimationClip() :
+	m_header(),
+	m_chunks(0),
+	m_boneTracks(0),
+	m_slots(nullptr),
+	m_numSlots(0),
+	m_pFile(nullptr),
+	m_pStreamer(nullptr),
+	m_numStalls(0)
+{
+}
+
+StreamedAnimationClip::~StreamedAnimationClip()
+{
+	Close();
+}
+
+bool StreamedAnimationClip::Open(const wchar_t* fileName, const Skeleton& skeleton,
+	AnimationStreamer* pStreamer, uint8_t numResidentChunks)
+{
+	Close();
+
+	XUSG_N_RETURN(_wfopen_s(&m_pFile, fileName, L"rb") == 0 && m_pFile, false);
+	XUSG_N_RETURN(fread(&m_header, sizeof(m_header), 1, m_pFile) == 1, false);
+	XUSG_N_RETURN(m_header.FourCC == ANIM_STREAM_FOURCC && m_header.Version == ANIM_STREAM_VERSION, false);
+	XUSG_N_RETURN(m_header.NumKeys > 0 && m_header.NumChunks > 0 && m_header.FPS > 0.0f, false);
+
+	// Track names to skeleton bones
+	const auto numBones = skeleton.GetNumBones();
+	m_boneTracks.assign(numBones, UINT32_MAX);
+	{
+		vector<char> names(static_cast<size_t>(SDKMesh::MAX_FRAME_NAME) * m_header.NumTracks);
+		_fseeki64(m_pFile, m_header.TrackNameOffset, SEEK_SET);
+		XUSG_N_RETURN(fread(names.data(), 1, names.size(), m_pFile) == names.size(), false);
+
+		for (auto i = 0u; i < m_header.NumTracks; ++i)
+		{
+			const auto pName = &names[SDKMesh::MAX_FRAME_NAME * i];
+			const auto bone = skeleton.FindBone(string(pName, strnlen(pName, SDKMesh::MAX_FRAME_NAME)).c_str());
+			if (bone != UINT32_MAX) m_boneTracks[bone] = i;
+		}
+	}
+
+	m_chunks.resize(m_header.NumChunks);
+	_fseeki64(m_pFile, m_header.ChunkTableOffset, SEEK_SET);
+	XUSG_N_RETURN(fread(m_chunks.data(), sizeof(AnimationStreamChunk), m_chunks.size(), m_pFile) == m_chunks.size(), false);
+
+	// Bones without a track keep the bind pose
+	m_bindPose.Create(numBones);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		XMVECTOR s, q, t;
+		XMMatrixDecompose(&s, &q, &t, XMLoadFloat4x4(&skeleton.BindLocals[i]));
+
+		XMFLOAT3 translation, scaling;
+		XMFLOAT4 orientation;
+		XMStoreFloat3(&translation, t);
+		XMStoreFloat4(&orientation, q);
+		XMStoreFloat3(&scaling, s);
+		m_bindPose.SetBone(i, translation, orientation, scaling);
+	}
+
+	m_numSlots = static_cast<uint8_t>((max)(numResidentChunks, static_cast<uint8_t>(1)));
+	m_slots.reset(new Slot[m_numSlots]);
+	for (uint8_t i = 0; i < m_numSlots; ++i)
+	{
+		m_slots[i].State = SLOT_EMPTY;
+		m_slots[i].Chunk = UINT32_MAX;
+	}
+
+	m_pStreamer = pStreamer;
+	m_numStalls = 0;
+
+	return true;
+}
+
+void StreamedAnimationClip::Close()
+{
+	// Drain the in-flight loads of this clip before releasing the slots
+	if (m_pStreamer && m_slots)
+	{
+		m_pStreamer->WaitForCompletion([this]()
+		{
+			for (uint8_t i = 0; i < m_numSlots; ++i)
+			{
+				const auto state = m_slots[i].State.load();
+				if (state == SLOT_QUEUED || state == SLOT_LOADING) return false;
+			}
+
+			return true;
+		});
+	}
+
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+		m_pFile = nullptr;
+	}
+
+	m_slots.reset();
+	m_numSlots = 0;
+	m_pStreamer = nullptr;
+}
+
+void StreamedAnimationClip::Prefetch(double time)
+{
+	uint32_t key;
+	float t;
+	const auto chunk = getChunk(time, key, t);
+
+	// The current chunk and the next ones, wrapping around for looped playback
+	const auto numChunks = (min)(static_cast<uint32_t>(m_numSlots), m_header.NumChunks);
+	for (auto i = 0u; i < numChunks; ++i) requestChunk((chunk + i) % m_header.NumChunks, chunk);
+}
+
+bool StreamedAnimationClip::Sample(LocalPose& pose, double time)
+{
+	uint32_t key;
+	float t;
+	const auto chunk = getChunk(time, key, t);
+	auto slotIdx = findSlot(chunk);
+
+	// Outside the prefetch window or still in flight: wait for the worker, or load on the
+	// calling thread if the request was dropped
+	if (slotIdx >= m_numSlots || m_slots[slotIdx].State.load(memory_order_acquire) != SLOT_READY)
+	{
+		++m_numStalls;
+		slotIdx = requestChunk(chunk, chunk);
+		auto& slot = m_slots[slotIdx];
+		if (m_pStreamer) m_pStreamer->WaitForCompletion([&slot]()
+		{
+			const auto state = slot.State.load(memory_order_acquire);
+			return state == SLOT_READY || state == SLOT_EMPTY || state == SLOT_FAILED;
+		});
+
+		if (slot.State.load(memory_order_acquire) == SLOT_EMPTY)
+		{
+			slot.Chunk = chunk;
+			loadSlot(slotIdx);
+		}
+	}
+
+	const auto& slot = m_slots[slotIdx];
+
+	pose = m_bindPose;
+	XUSG_N_RETURN(slot.State.load(memory_order_acquire) == SLOT_READY, false);
+
+	const auto& chunkInfo = m_chunks[chunk];
+	const auto k0 = key - chunkInfo.FirstKey;
+	const auto k1 = (min)(k0 + 1, chunkInfo.NumKeys - 1);
+	const auto pKeys0 = &slot.Keys[m_header.NumTracks * k0];
+	const auto pKeys1 = &slot.Keys[m_header.NumTracks * k1];
+
+	const auto numBones = pose.GetNumBones();
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto track = m_boneTracks[i];
+		if (track == UINT32_MAX) continue;
+
+		const auto& key0 = pKeys0[track];
+		const auto& key1 = pKeys1[track];
+		const auto q0 = XMLoadFloat4(&key0.Orientation);
+		auto q1 = XMLoadFloat4(&key1.Orientation);
+		if (XMVectorGetX(XMQuaternionDot(q0, q1)) < 0.0f) q1 = -q1;
+
+		XMFLOAT3 translation, scaling;
+		XMFLOAT4 orientation;
+		XMStoreFloat3(&translation, XMVectorLerp(XMLoadFloat3(&key0.Translation), XMLoadFloat3(&key1.Translation), t));
+		XMStoreFloat4(&orientation, XMQuaternionNormalize(XMVectorLerp(q0, q1, t)));
+		XMStoreFloat3(&scaling, XMVectorLerp(XMLoadFloat3(&key0.Scaling), XMLoadFloat3(&key1.Scaling), t));
+		pose.SetBone(i, translation, orientation, scaling);
+	}
+
+	return true;
+}
+
+size_t StreamedAnimationClip::GetResidentBytes() const
+{
+	auto bytes = sizeof(AnimationStreamChunk) * m_chunks.size();
+	for (uint8_t i = 0; i < m_numSlots; ++i) bytes += sizeof(SDKMesh::AnimationData) * m_slots[i].Keys.capacity();
+
+	return bytes;
+}
+
+bool StreamedAnimationClip::CreateStreamFile(const wchar_t* animFileName, const wchar_t* streamFileName,
+	float chunkDuration)
+{
+	using FileHeader = SDKMesh::AnimationFileHeader;
+	using FrameData = SDKMesh::AnimationFrameData;
+	using KeyData = SDKMesh::AnimationData;
+
+	vector<uint8_t> data;
+	{
+		FILE* pFile;
+		XUSG_N_RETURN(_wfopen_s(&pFile, animFileName, L"rb") == 0 && pFile, false);
+		_fseeki64(pFile, 0, SEEK_END);
+		data.resize(static_cast<size_t>(_ftelli64(pFile)));
+		_fseeki64(pFile, 0, SEEK_SET);
+		const auto bytesRead = fread(data.data(), 1, data.size(), pFile);
+		fclose(pFile);
+		XUSG_N_RETURN(bytesRead == data.size() && data.size() >= sizeof(FileHeader), false);
+	}
+
+	const auto& animHeader = *reinterpret_cast<const FileHeader*>(data.data());
+	XUSG_N_RETURN(animHeader.NumAnimationKeys > 0, false);
+	XUSG_N_RETURN(animHeader.AnimationDataOffset + sizeof(FrameData) * animHeader.NumFrames <= data.size(), false);
+
+	const auto pFrameData = reinterpret_cast<const FrameData*>(&data[animHeader.AnimationDataOffset]);
+	const auto numTracks = animHeader.NumFrames;
+	const auto numKeys = animHeader.NumAnimationKeys;
+	for (auto i = 0u; i < numTracks; ++i)
+		XUSG_N_RETURN(animHeader.AnimationDataOffset + pFrameData[i].DataOffset + sizeof(KeyData) * numKeys <= data.size(), false);
+
+	AnimationStreamHeader header = {};
+	header.FourCC = ANIM_STREAM_FOURCC;
+	header.Version = ANIM_STREAM_VERSION;
+	header.NumTracks = numTracks;
+	header.NumKeys = numKeys;
+	header.FPS = animHeader.AnimationFPS > 0 ? static_cast<float>(animHeader.AnimationFPS) : 30.0f;
+	header.KeysPerChunk = (max)(static_cast<uint32_t>(chunkDuration * header.FPS), 1u);
+	header.NumChunks = XUSG_DIV_UP(numKeys, header.KeysPerChunk);
+	header.TrackNameOffset = sizeof(AnimationStreamHeader);
+	header.ChunkTableOffset = header.TrackNameOffset + static_cast<uint64_t>(SDKMesh::MAX_FRAME_NAME) * numTracks;
+
+	// Chunk table; each chunk has one extra key (the next chunk's first, wrapping around)
+	vector<AnimationStreamChunk> chunks(header.NumChunks);
+	auto offset = header.ChunkTableOffset + sizeof(AnimationStreamChunk) * header.NumChunks;
+	for (auto i = 0u; i < header.NumChunks; ++i)
+	{
+		chunks[i].Offset = offset;
+		chunks[i].FirstKey = header.KeysPerChunk * i;
+		chunks[i].NumKeys = (min)(header.KeysPerChunk, numKeys - chunks[i].FirstKey) + 1;
+		offset += sizeof(KeyData) * numTracks * chunks[i].NumKeys;
+	}
+
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, streamFileName, L"wb") == 0 && pFile, false);
+
+	auto success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	for (auto i = 0u; i < numTracks && success; ++i)
+		success = fwrite(pFrameData[i].FrameName, 1, SDKMesh::MAX_FRAME_NAME, pFile) == SDKMesh::MAX_FRAME_NAME;
+	if (success) success = fwrite(chunks.data(), sizeof(AnimationStreamChunk), chunks.size(), pFile) == chunks.size();
+
+	// Key-major within a chunk, so that a chunk is one contiguous read
+	vector<KeyData> keys;
+	for (auto i = 0u; i < header.NumChunks && success; ++i)
+	{
+		keys.resize(static_cast<size_t>(numTracks) * chunks[i].NumKeys);
+		for (auto k = 0u; k < chunks[i].NumKeys; ++k)
+		{
+			const auto key = (chunks[i].FirstKey + k) % numKeys;
+			for (auto j = 0u; j < numTracks; ++j)
+			{
+				const auto pKeys = reinterpret_cast<const KeyData*>(&data[animHeader.AnimationDataOffset + pFrameData[j].DataOffset]);
+				keys[numTracks * k + j] = pKeys[key];
+			}
+		}
+		success = fwrite(keys.data(), sizeof(KeyData), keys.size(), pFile) == keys.size();
+	}
+
+	fclose(pFile);
+
+	return success;
+}
+
+uint32_t StreamedAnimationClip::getChunk(double time, uint32_t& key, float& t) const
+{
+	auto keyTime = fmod(time * m_header.FPS, static_cast<double>(m_header.NumKeys));
+	if (keyTime < 0.0) keyTime += m_header.NumKeys;
+
+	key = (min)(static_cast<uint32_t>(keyTime), m_header.NumKeys - 1);
+	t = static_cast<float>(keyTime - key);
+
+	return key / m_header.KeysPerChunk;
+}
+
+uint8_t StreamedAnimationClip::findSlot(uint32_t chunk) const
+{
+	for (uint8_t i = 0; i < m_numSlots; ++i)
+		if (m_slots[i].Chunk == chunk && m_slots[i].State.load(memory_order_acquire) != SLOT_EMPTY) return i;
+
+	return m_numSlots;
+}
+
+bool StreamedAnimationClip::loadSlot(uint8_t slotIdx)
+{
+	auto& slot = m_slots[slotIdx];
+	slot.State.store(SLOT_LOADING, memory_order_release);
+
+	const auto& chunk = m_chunks[slot.Chunk];
+	slot.Keys.resize(static_cast<size_t>(m_header.NumTracks) * chunk.NumKeys);
+	size_t numRead = 0;
+	{
+		lock_guard<mutex> lock(m_fileMutex);
+		if (_fseeki64(m_pFile, chunk.Offset, SEEK_SET) == 0)
+			numRead = fread(slot.Keys.data(), sizeof(SDKMesh::AnimationData), slot.Keys.size(), m_pFile);
+	}
+
+	if (numRead != slot.Keys.size())
+	{
+		slot.Keys.clear();
+		slot.State.store(SLOT_FAILED, memory_order_release);
+
+		return false;
+	}
+
+	slot.State.store(SLOT_READY, memory_order_release);
+
+	return true;
+}
+
+void StreamedAnimationClip::cancelSlot(uint8_t slotIdx)
+{
+	m_slots[slotIdx].Chunk = UINT32_MAX;
+	m_slots[slotIdx].State.store(SLOT_EMPTY, memory_order_release);
+}
+
+uint8_t StreamedAnimationClip::requestChunk(uint32_t chunk, uint32_t playheadChunk)
+{
+	auto slotIdx = findSlot(chunk);
+	if (slotIdx < m_numSlots) return slotIdx;
+
+	// Victim: an empty slot, else the chunk furthest from the playhead in playback order.
+	// The window ahead of the playhead has at most m_numSlots chunks, so the victim is never
+	// one of them while the requested chunk is not resident.
+	const auto numChunks = m_header.NumChunks;
+	auto maxDistance = 0u;
+	for (uint8_t i = 0; i < m_numSlots; ++i)
+	{
+		const auto& slot = m_slots[i];
+		const auto distance = slot.State.load(memory_order_acquire) == SLOT_EMPTY ? UINT32_MAX :
+			(slot.Chunk + numChunks - playheadChunk) % numChunks;
+		if (slotIdx >= m_numSlots || distance > maxDistance)
+		{
+			slotIdx = i;
+			maxDistance = distance;
+		}
+	}
+
+	// A slot is only retargeted once its previous load has landed
+	auto& slot = m_slots[slotIdx];
+	const auto state = slot.State.load(memory_order_acquire);
+	if (state == SLOT_QUEUED || state == SLOT_LOADING)
+	{
+		m_pStreamer->WaitForCompletion([&slot]()
+		{
+			const auto state = slot.State.load(memory_order_acquire);
+			return state != SLOT_QUEUED && state != SLOT_LOADING;
+		});
+		++m_numStalls;
+	}
+
+	slot.Chunk = chunk;
+	slot.State.store(SLOT_QUEUED, memory_order_release);
+	if (!m_pStreamer || !m_pStreamer->Request(this, slotIdx)) loadSlot(slotIdx);
+
+	return slotIdx;
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include "AnimationBlend.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Streamed clip file: the keys of an .sdkmesh_anim split into time-blocked chunks.
+	// Each chunk repeats the first key of the next one, so it can be sampled on its own.
+	//--------------------------------------------------------------------------------------
+	struct AnimationStreamHeader
+	{
+		uint32_t FourCC;
+		uint32_t Version;
+		uint32_t NumTracks;
+		uint32_t NumKeys;
+		float FPS;
+		uint32_t KeysPerChunk;
+		uint32_t NumChunks;
+		uint32_t Reserved;
+		uint64_t TrackNameOffset;		// char[NumTracks][MAX_FRAME_NAME]
+		uint64_t ChunkTableOffset;		// AnimationStreamChunk[NumChunks]
+	};
+
+	struct AnimationStreamChunk
+	{
+		uint64_t Offset;				// SDKMesh::AnimationData[NumKeys][NumTracks]
+		uint32_t FirstKey;
+		uint32_t NumKeys;
+	};
+
+	class StreamedAnimationClip;
+
+	//--------------------------------------------------------------------------------------
+	// I/O worker shared by the streamed clips
+	//--------------------------------------------------------------------------------------
+	class AnimationStreamer
+	{
+	public:
+		AnimationStreamer();
+		virtual ~AnimationStreamer();
+
+		void Start();
+
+		// Stops the worker; requests still queued are dropped and their slots reset to empty
+		void Stop();
+
+		// Returns false if the streamer is not running, in which case the caller loads the slot
+		bool Request(StreamedAnimationClip* pClip, uint8_t slot);
+		void WaitForCompletion(const std::function<bool()>& isDone);
+
+		using uptr = std::unique_ptr<AnimationStreamer>;
+		using sptr = std::shared_ptr<AnimationStreamer>;
+
+	protected:
+		struct WorkItem
+		{
+			StreamedAnimationClip* pClip;
+			uint8_t Slot;
+		};
+
+		void run();
+
+		std::thread				m_worker;
+		std::mutex				m_mutex;
+		std::condition_variable	m_requestCV;
+		std::condition_variable	m_completionCV;
+		std::deque<WorkItem>	m_requests;
+		bool					m_isRunning;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Streamed animation clip with a small ring of resident chunks
+	//--------------------------------------------------------------------------------------
+	class StreamedAnimationClip
+	{
+	public:
+		StreamedAnimationClip();
+		virtual ~StreamedAnimationClip();
+
+		// The ring holds the chunk under the playhead plus numResidentChunks - 1 prefetched ones
+		bool Open(const wchar_t* fileName, const Skeleton& skeleton,
+			AnimationStreamer* pStreamer, uint8_t numResidentChunks = 3);
+		void Close();
+
+		// Queues the chunks ahead of the playhead; call once per frame before sampling
+		void Prefetch(double time);
+
+		// Blocks only if the chunk at time is not resident, i.e. outside the prefetch window.
+		// Returns false with the bind pose if the chunk failed to load.
+		bool Sample(LocalPose& pose, double time);
+
+		float GetDuration() const { return m_header.NumKeys / m_header.FPS; }
+		size_t GetResidentBytes() const;
+		uint32_t GetNumStalls() const { return m_numStalls; }
+
+		// Converts an .sdkmesh_anim to the streamed format, with chunks of about chunkDuration seconds
+		static bool CreateStreamFile(const wchar_t* animFileName, const wchar_t* streamFileName,
+			float chunkDuration = 1.0f);
+
+		using uptr = std::unique_ptr<StreamedAnimationClip>;
+		using sptr = std::shared_ptr<StreamedAnimationClip>;
+
+	protected:
+		friend class AnimationStreamer;
+
+		enum SlotState : uint8_t
+		{
+			SLOT_EMPTY,
+			SLOT_QUEUED,
+			SLOT_LOADING,
+			SLOT_READY,
+			SLOT_FAILED		// Short read; kept until evicted, so that it is not read every frame
+		};
+
+		struct Slot
+		{
+			std::atomic<uint8_t>	State;
+			uint32_t				Chunk;
+			std::vector<SDKMesh::AnimationData> Keys;
+		};
+
+		uint32_t getChunk(double time, uint32_t& key, float& t) const;
+		uint8_t findSlot(uint32_t chunk) const;
+		bool loadSlot(uint8_t slot);
+		void cancelSlot(uint8_t slot);
+
+		// Assigns the chunk a slot, evicting the one furthest behind the playhead chunk, i.e.
+		// outside the window of resident chunks ahead of it. Returns the slot index.
+		uint8_t requestChunk(uint32_t chunk, uint32_t playheadChunk);
+
+		AnimationStreamHeader				m_header;
+		std::vector<AnimationStreamChunk>	m_chunks;
+		std::vector<uint32_t>				m_boneTracks;	// Track of each bone; UINT32_MAX for the bind pose
+		LocalPose							m_bindPose;
+
+		std::unique_ptr<Slot[]>				m_slots;
+		uint8_t								m_numSlots;
+
+		FILE*								m_pFile;
+		std::mutex							m_fileMutex;
+		AnimationStreamer*					m_pStreamer;
+		uint32_t							m_numStalls;
+	};
+}
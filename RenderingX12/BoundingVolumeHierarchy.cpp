@@ -0,0 +1,602 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <thread>
+#include "BoundingVolumeHierarchy.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static const uint32_t BVH_CACHE_FOURCC = 0x48564258;	// "XBVH"
+static const uint32_t BVH_CACHE_VERSION = 1;
+
+namespace
+{
+	struct CacheHeader
+	{
+		uint32_t FourCC;
+		uint32_t Version;
+		uint32_t NumItems;
+		uint32_t NumNodes;
+		uint64_t Hash;				// Of the items built from
+	};
+
+	// Below this, a node is not worth a thread of its own.
+	const uint32_t PARALLEL_ITEMS = 4096;
+
+	float getHalfArea(FXMVECTOR minPt, FXMVECTOR maxPt)
+	{
+		const auto size = XMVectorMax(maxPt - minPt, XMVectorZero());
+
+		return XMVectorGetX(XMVector3Dot(size, XMVectorSwizzle<1, 2, 0, 3>(size)));
+	}
+
+	// Node and item tests of a traversal without occlusion, for the benchmark
+	struct TestCounts
+	{
+		uint32_t NumNodeTests;
+		uint32_t NumItemTests;
+	};
+
+	TestCounts countTests(const LinearOctree& tree, const FrustumCulling::Frustum& frustum)
+	{
+		TestCounts counts = {};
+		const auto& nodes = tree.GetNodes();
+		for (auto i = 0u; i < tree.GetNumNodes();)
+		{
+			XMFLOAT3 center, extents;
+			tree.GetNodeBounds().Get(i, center, extents);
+			++counts.NumNodeTests;
+
+			const auto visibility = FrustumCulling::ClassifyBox(center, extents, frustum);
+			if (visibility == OctNode::VISIBILITY_INTERSECT) counts.NumItemTests += nodes[i].NumItems;
+			i = visibility == OctNode::VISIBILITY_INTERSECT ? i + 1 : nodes[i].SkipIndex;
+		}
+
+		return counts;
+	}
+
+	TestCounts countTests(const BoundingVolumeHierarchy& bvh, const FrustumCulling::Frustum& frustum)
+	{
+		TestCounts counts = {};
+		const auto& nodes = bvh.GetNodes();
+		for (auto i = 0u; i < bvh.GetNumNodes();)
+		{
+			XMFLOAT3 center, extents;
+			bvh.GetNodeBounds().Get(i, center, extents);
+			++counts.NumNodeTests;
+
+			const auto visibility = FrustumCulling::ClassifyBox(center, extents, frustum);
+			const auto isLeaf = nodes[i].SkipIndex == i + 1;
+			if (visibility == OctNode::VISIBILITY_INTERSECT && isLeaf) counts.NumItemTests += nodes[i].ItemEnd - nodes[i].FirstItem;
+			i = visibility == OctNode::VISIBILITY_INTERSECT ? i + 1 : nodes[i].SkipIndex;
+		}
+
+		return counts;
+	}
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() :
+	m_nodes(0),
+	m_meshIDs(0),
+	m_itemIndices(0),
+	m_hash(0)
+{
+}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy()
+{
+}
+
+void BoundingVolumeHierarchy::CreateTree(const LinearOctree::Item* pItems, uint32_t numItems, uint32_t numThreads)
+{
+	m_nodes.clear();
+	m_meshIDs.clear();
+	m_itemIndices.clear();
+	m_hash = getHash(pItems, numItems);
+	if (numItems == 0) return;
+
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+
+	vector<BuildItem> buildItems(numItems);
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		const auto center = XMLoadFloat3(&pItems[i].Center);
+		const auto extents = XMLoadFloat3(&pItems[i].Extents);
+		XMStoreFloat3(&buildItems[i].MinPt, center - extents);
+		XMStoreFloat3(&buildItems[i].MaxPt, center + extents);
+		buildItems[i].Centroid = pItems[i].Center;
+	}
+
+	m_itemIndices.resize(numItems);
+	iota(m_itemIndices.begin(), m_itemIndices.end(), 0u);
+
+	vector<BuildNode> buildNodes;
+	build(buildNodes, buildItems, 0, numItems, 0, numThreads);
+
+	const auto numNodes = static_cast<uint32_t>(buildNodes.size());
+	m_nodes.resize(numNodes);
+	m_nodeBounds.Resize(numNodes);
+	for (auto i = 0u; i < numNodes; ++i)
+	{
+		const auto& buildNode = buildNodes[i];
+		m_nodes[i] = { buildNode.FirstItem, buildNode.ItemEnd, buildNode.SkipIndex };
+
+		const auto minPt = XMLoadFloat3(&buildNode.MinPt);
+		const auto maxPt = XMLoadFloat3(&buildNode.MaxPt);
+		XMFLOAT3 center, extents;
+		XMStoreFloat3(&center, (minPt + maxPt) * 0.5f);
+		XMStoreFloat3(&extents, (maxPt - minPt) * 0.5f);
+		m_nodeBounds.Set(i, center, extents);
+	}
+
+	setItems(pItems, numItems);
+}
+
+void BoundingVolumeHierarchy::CreateTree(uint32_t numModels, const StaticModel::sptr* pModels,
+	SubsetFlags subsetFlags, uint32_t numThreads)
+{
+	vector<LinearOctree::Item> items;
+	LinearOctree::GetItems(items, numModels, pModels, subsetFlags);
+	CreateTree(items.data(), static_cast<uint32_t>(items.size()), numThreads);
+}
+
+bool BoundingVolumeHierarchy::Save(const wchar_t* fileName) const
+{
+	CacheHeader header = {};
+	header.FourCC = BVH_CACHE_FOURCC;
+	header.Version = BVH_CACHE_VERSION;
+	header.NumItems = static_cast<uint32_t>(m_itemIndices.size());
+	header.NumNodes = GetNumNodes();
+	header.Hash = m_hash;
+
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"wb") == 0 && pFile, false);
+
+	auto success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	if (success) success = fwrite(m_nodes.data(), sizeof(Node), m_nodes.size(), pFile) == m_nodes.size();
+	const vector<float>* pBounds[] =
+	{
+		&m_nodeBounds.CenterX, &m_nodeBounds.CenterY, &m_nodeBounds.CenterZ,
+		&m_nodeBounds.ExtentX, &m_nodeBounds.ExtentY, &m_nodeBounds.ExtentZ
+	};
+	for (const auto pBound : pBounds)
+		if (success) success = fwrite(pBound->data(), sizeof(float), pBound->size(), pFile) == pBound->size();
+	if (success) success = fwrite(m_itemIndices.data(), sizeof(uint32_t), m_itemIndices.size(), pFile) == m_itemIndices.size();
+
+	fclose(pFile);
+
+	return success;
+}
+
+bool BoundingVolumeHierarchy::Load(const wchar_t* fileName, const LinearOctree::Item* pItems, uint32_t numItems)
+{
+	m_nodes.clear();
+	m_meshIDs.clear();
+	m_itemIndices.clear();
+
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0 && pFile, false);
+
+	CacheHeader header;
+	auto success = fread(&header, sizeof(header), 1, pFile) == 1 && header.FourCC == BVH_CACHE_FOURCC &&
+		header.Version == BVH_CACHE_VERSION && header.NumItems == numItems && header.Hash == getHash(pItems, numItems);
+	if (success)
+	{
+		m_nodes.resize(header.NumNodes);
+		m_nodeBounds.Resize(header.NumNodes);
+		m_itemIndices.resize(numItems);
+		success = fread(m_nodes.data(), sizeof(Node), m_nodes.size(), pFile) == m_nodes.size();
+
+		vector<float>* pBounds[] =
+		{
+			&m_nodeBounds.CenterX, &m_nodeBounds.CenterY, &m_nodeBounds.CenterZ,
+			&m_nodeBounds.ExtentX, &m_nodeBounds.ExtentY, &m_nodeBounds.ExtentZ
+		};
+		for (const auto pBound : pBounds)
+			if (success) success = fread(pBound->data(), sizeof(float), pBound->size(), pFile) == pBound->size();
+		if (success) success = fread(m_itemIndices.data(), sizeof(uint32_t), m_itemIndices.size(), pFile) == m_itemIndices.size();
+	}
+
+	fclose(pFile);
+
+	for (const auto index : m_itemIndices) success = success && index < numItems;
+	if (!success)
+	{
+		m_nodes.clear();
+		m_itemIndices.clear();
+
+		return false;
+	}
+
+	setItems(pItems, numItems);
+	m_hash = header.Hash;
+
+	return true;
+}
+
+void BoundingVolumeHierarchy::Sort(vector<XMUINT2>& meshIDQueue, CXMMATRIX viewProj, FXMVECTOR eyePt,
+	bool isNearToFar, bool isAllVisible, const SoftwareOcclusion* pOcclusion) const
+{
+	FrustumCulling::Frustum frustum;
+	FrustumCulling::GetFrustum(frustum, viewProj);
+
+	vector<uint32_t> items;
+	collect(items, frustum, isAllVisible ? 0 : FrustumCulling::ALL_PLANES, pOcclusion);
+
+	vector<pair<float, uint32_t>> order(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		XMFLOAT3 center, extents;
+		m_itemBounds.Get(items[i], center, extents);
+		const auto distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&center) - eyePt));
+		order[i] = make_pair(isNearToFar ? distSq : -distSq, items[i]);
+	}
+	sort(order.begin(), order.end());
+
+	for (const auto& item : order) meshIDQueue.push_back(m_meshIDs[item.second]);
+}
+
+uint64_t BoundingVolumeHierarchy::GetMemorySize() const
+{
+	return sizeof(Node) * m_nodes.size() + sizeof(float) * 6 * (m_nodeBounds.GetCount() + m_itemBounds.GetCount()) +
+		sizeof(XMUINT2) * m_meshIDs.size();
+}
+
+void BoundingVolumeHierarchy::CreateStressItems(vector<LinearOctree::Item>& items, StressScene scene, uint32_t numItems)
+{
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> position(-2000.0f, 2000.0f);
+	uniform_real_distribution<float> height(0.0f, 100.0f);
+	uniform_real_distribution<float> size(0.5f, 10.0f);
+
+	vector<XMFLOAT3> clusters(32);
+	for (auto& cluster : clusters) cluster = XMFLOAT3(position(rng) * 2.0f, height(rng), position(rng) * 2.0f);
+	normal_distribution<float> spread(0.0f, 30.0f);
+
+	items.resize(numItems);
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		auto& item = items[i];
+		item.MeshID = XMUINT2(i / 16, i % 16);
+		switch (scene)
+		{
+		case STRESS_THIN:
+		{
+			// Up to 400 units long and 1 thick, along x or z
+			const auto length = size(rng) * 40.0f;
+			const auto thickness = size(rng) * 0.1f;
+			item.Center = XMFLOAT3(position(rng), height(rng), position(rng));
+			item.Extents = i % 2 ? XMFLOAT3(length, thickness, thickness) : XMFLOAT3(thickness, thickness, length);
+			break;
+		}
+		case STRESS_CLUSTERED:
+		{
+			const auto& cluster = clusters[i % clusters.size()];
+			const auto extent = i % 1000 ? size(rng) : size(rng) * 100.0f;
+			item.Center = XMFLOAT3(cluster.x + spread(rng), cluster.y + spread(rng) * 0.1f, cluster.z + spread(rng));
+			item.Extents = XMFLOAT3(extent, extent, extent);
+			break;
+		}
+		default:
+		{
+			const auto extent = size(rng);
+			item.Center = XMFLOAT3(position(rng), height(rng), position(rng));
+			item.Extents = XMFLOAT3(extent, extent * 0.5f, extent);
+		}
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::Benchmark(BenchmarkResult& result, const LinearOctree::Item* pItems, uint32_t numItems,
+	uint32_t numViews, uint32_t numIterations, float mapSize, float looseCoeff)
+{
+	result = {};
+	XUSG_N_RETURN(numItems > 0 && numViews > 0 && numIterations > 0, );
+
+	auto start = chrono::high_resolution_clock::now();
+	LinearOctree octree;
+	if (mapSize > 0.0f) octree.Init(XMFLOAT3(0.0f, 0.0f, 0.0f), mapSize, looseCoeff);
+	octree.CreateTree(pItems, numItems);
+	result.OctreeBuildMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	result.NumOctreeNodes = octree.GetNumNodes();
+
+	start = chrono::high_resolution_clock::now();
+	BoundingVolumeHierarchy bvh;
+	bvh.CreateTree(pItems, numItems);
+	result.BuildMilliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	result.NumNodes = bvh.GetNumNodes();
+
+	// Views circling the items at half their diameter, looking at the center
+	XMFLOAT3 rootCenter, rootExtents;
+	bvh.GetNodeBounds().Get(0, rootCenter, rootExtents);
+	const auto center = XMLoadFloat3(&rootCenter);
+	const auto radius = (max)((max)(rootExtents.x, rootExtents.y), rootExtents.z);
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, radius * 0.001f, radius * 4.0f);
+	vector<XMMATRIX> viewProjs(numViews);
+	vector<XMVECTOR> eyePts(numViews);
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		const auto angle = XM_2PI * i / numViews;
+		eyePts[i] = center + XMVectorSet(cosf(angle) * radius, radius * 0.1f, sinf(angle) * radius, 0.0f);
+		viewProjs[i] = XMMatrixLookAtLH(eyePts[i], center, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+	}
+
+	const auto query = [&](QueryResult& queryResult, const function<void(vector<XMUINT2>&, uint32_t)>& sort,
+		const function<TestCounts(const FrustumCulling::Frustum&)>& countViewTests)
+	{
+		vector<XMUINT2> queue;
+		for (auto i = 0u; i < numViews; ++i)
+		{
+			FrustumCulling::Frustum frustum;
+			FrustumCulling::GetFrustum(frustum, viewProjs[i]);
+			const auto counts = countViewTests(frustum);
+			queryResult.NumNodeTests += counts.NumNodeTests;
+			queryResult.NumItemTests += counts.NumItemTests;
+
+			queue.clear();
+			sort(queue, i);
+			queryResult.NumVisible += queue.size();
+		}
+		queryResult.NumNodeTests /= numViews;
+		queryResult.NumItemTests /= numViews;
+		queryResult.NumVisible /= numViews;
+
+		const auto start = chrono::high_resolution_clock::now();
+		for (auto n = 0u; n < numIterations; ++n)
+		{
+			for (auto i = 0u; i < numViews; ++i)
+			{
+				queue.clear();
+				sort(queue, i);
+			}
+		}
+		const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+		queryResult.Microseconds = seconds * 1.0e6 / (static_cast<double>(numIterations) * numViews);
+	};
+
+	query(result.Octree, [&](vector<XMUINT2>& queue, uint32_t i) { octree.Sort(queue, viewProjs[i], eyePts[i], true); },
+		[&](const FrustumCulling::Frustum& frustum) { return countTests(octree, frustum); });
+	query(result.Hierarchy, [&](vector<XMUINT2>& queue, uint32_t i) { bvh.Sort(queue, viewProjs[i], eyePts[i], true); },
+		[&](const FrustumCulling::Frustum& frustum) { return countTests(bvh, frustum); });
+
+	assert(result.Octree.NumVisible == result.Hierarchy.NumVisible);
+}
+
+void BoundingVolumeHierarchy::build(vector<BuildNode>& nodes, const vector<BuildItem>& buildItems,
+	uint32_t first, uint32_t last, uint8_t depth, uint32_t numThreads)
+{
+	const auto nodeIdx = static_cast<uint32_t>(nodes.size());
+	const auto numItems = last - first;
+
+	auto minPt = XMVectorReplicate(FLT_MAX);
+	auto maxPt = XMVectorReplicate(-FLT_MAX);
+	auto minCentroid = XMVectorReplicate(FLT_MAX);
+	auto maxCentroid = XMVectorReplicate(-FLT_MAX);
+	for (auto i = first; i < last; ++i)
+	{
+		const auto& buildItem = buildItems[m_itemIndices[i]];
+		const auto centroid = XMLoadFloat3(&buildItem.Centroid);
+		minPt = XMVectorMin(minPt, XMLoadFloat3(&buildItem.MinPt));
+		maxPt = XMVectorMax(maxPt, XMLoadFloat3(&buildItem.MaxPt));
+		minCentroid = XMVectorMin(minCentroid, centroid);
+		maxCentroid = XMVectorMax(maxCentroid, centroid);
+	}
+
+	BuildNode node = {};
+	XMStoreFloat3(&node.MinPt, minPt);
+	XMStoreFloat3(&node.MaxPt, maxPt);
+	node.FirstItem = first;
+	node.ItemEnd = last;
+	node.SkipIndex = nodeIdx + 1;
+	nodes.push_back(node);
+	if (numItems <= 1 || depth >= MAX_DEPTH) return;
+
+	// Split along the longest axis of the centroid bounds
+	XMFLOAT3 centroidSize;
+	XMStoreFloat3(&centroidSize, maxCentroid - minCentroid);
+	const float centroidSizes[] = { centroidSize.x, centroidSize.y, centroidSize.z };
+	const auto axis = static_cast<uint8_t>(max_element(centroidSizes, centroidSizes + 3) - centroidSizes);
+	const auto minCoord = XMVectorGetByIndex(minCentroid, axis);
+	const auto binScale = centroidSizes[axis] > 0.0f ? NUM_BINS / centroidSizes[axis] : 0.0f;
+	const auto getBin = [&](uint32_t index)
+	{
+		const auto& centroid = buildItems[index].Centroid;
+		const float coords[] = { centroid.x, centroid.y, centroid.z };
+
+		return (min)(static_cast<uint32_t>((coords[axis] - minCoord) * binScale), NUM_BINS - 1u);
+	};
+
+	auto mid = first + numItems / 2;
+	if (binScale > 0.0f)
+	{
+		struct Bin
+		{
+			XMVECTOR MinPt;
+			XMVECTOR MaxPt;
+			uint32_t NumItems;
+		};
+
+		Bin bins[NUM_BINS];
+		for (auto& bin : bins) bin = { XMVectorReplicate(FLT_MAX), XMVectorReplicate(-FLT_MAX), 0 };
+		for (auto i = first; i < last; ++i)
+		{
+			const auto& buildItem = buildItems[m_itemIndices[i]];
+			auto& bin = bins[getBin(m_itemIndices[i])];
+			bin.MinPt = XMVectorMin(bin.MinPt, XMLoadFloat3(&buildItem.MinPt));
+			bin.MaxPt = XMVectorMax(bin.MaxPt, XMLoadFloat3(&buildItem.MaxPt));
+			++bin.NumItems;
+		}
+
+		// Areas of the bins right of each plane, swept from the right
+		float rightCosts[NUM_BINS];
+		auto rightMin = XMVectorReplicate(FLT_MAX);
+		auto rightMax = XMVectorReplicate(-FLT_MAX);
+		auto numRight = 0u;
+		for (auto b = NUM_BINS - 1u; b > 0; --b)
+		{
+			rightMin = XMVectorMin(rightMin, bins[b].MinPt);
+			rightMax = XMVectorMax(rightMax, bins[b].MaxPt);
+			numRight += bins[b].NumItems;
+			rightCosts[b] = numRight ? getHalfArea(rightMin, rightMax) * numRight : 0.0f;
+		}
+
+		// Cost of a leaf against one traversal step and the area-weighted item tests of the children
+		auto leftMin = XMVectorReplicate(FLT_MAX);
+		auto leftMax = XMVectorReplicate(-FLT_MAX);
+		auto numLeft = 0u;
+		auto bestCost = FLT_MAX;
+		auto bestSplit = 0u;
+		for (auto b = 1u; b < NUM_BINS; ++b)
+		{
+			leftMin = XMVectorMin(leftMin, bins[b - 1].MinPt);
+			leftMax = XMVectorMax(leftMax, bins[b - 1].MaxPt);
+			numLeft += bins[b - 1].NumItems;
+			if (numLeft == 0 || numLeft == numItems) continue;
+
+			const auto cost = getHalfArea(leftMin, leftMax) * numLeft + rightCosts[b];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		const auto area = getHalfArea(minPt, maxPt);
+		const auto splitCost = area > 0.0f ? 1.0f + bestCost / area : 1.0f;
+		if (numItems <= MAX_LEAF_ITEMS && (bestSplit == 0 || splitCost >= numItems)) return;
+
+		if (bestSplit > 0)
+			mid = static_cast<uint32_t>(partition(m_itemIndices.begin() + first, m_itemIndices.begin() + last,
+				[&](uint32_t index) { return getBin(index) < bestSplit; }) -
+				m_itemIndices.begin());
+	}
+	else if (numItems <= MAX_LEAF_ITEMS) return;	// Coincident centroids
+
+	if (numThreads > 1 && numItems >= PARALLEL_ITEMS)
+	{
+		// The left subtree on another thread, into nodes of its own spliced in after
+		vector<BuildNode> leftNodes, rightNodes;
+		thread worker([&]() { build(leftNodes, buildItems, first, mid, depth + 1, numThreads / 2); });
+		build(rightNodes, buildItems, mid, last, depth + 1, numThreads - numThreads / 2);
+		worker.join();
+
+		auto offset = nodeIdx + 1;
+		for (const auto pSubtree : { &leftNodes, &rightNodes })
+		{
+			for (auto subtreeNode : *pSubtree)
+			{
+				subtreeNode.SkipIndex += offset;
+				nodes.push_back(subtreeNode);
+			}
+			offset += static_cast<uint32_t>(pSubtree->size());
+		}
+	}
+	else
+	{
+		build(nodes, buildItems, first, mid, depth + 1, 1);
+		build(nodes, buildItems, mid, last, depth + 1, 1);
+	}
+
+	nodes[nodeIdx].SkipIndex = static_cast<uint32_t>(nodes.size());
+}
+
+void BoundingVolumeHierarchy::collect(vector<uint32_t>& items, const FrustumCulling::Frustum& frustum,
+	uint8_t planeMask, const SoftwareOcclusion* pOcclusion) const
+{
+	// Plane masks of the open ancestors, with the index ending each subtree
+	struct Ancestor
+	{
+		uint32_t	SkipIndex;
+		uint8_t		PlaneMask;
+	};
+
+	const auto addItem = [&](uint32_t item)
+	{
+		if (pOcclusion)
+		{
+			XMFLOAT3 center, extents;
+			m_itemBounds.Get(item, center, extents);
+			const auto radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+			if (pOcclusion->IsWorthTesting(center, radius) && pOcclusion->IsOccluded(center, extents)) return;
+		}
+
+		items.push_back(item);
+	};
+
+	Ancestor ancestors[MAX_DEPTH + 1];
+	uint8_t depth = 0;
+	const auto numNodes = GetNumNodes();
+	for (auto i = 0u; i < numNodes;)
+	{
+		while (depth > 0 && i >= ancestors[depth - 1].SkipIndex) --depth;
+		const auto parentPlaneMask = depth > 0 ? ancestors[depth - 1].PlaneMask : planeMask;
+
+		const auto& node = m_nodes[i];
+		XMFLOAT3 center, extents;
+		m_nodeBounds.Get(i, center, extents);
+		uint8_t childPlaneMask;
+		const auto visibility = FrustumCulling::ClassifyBox(center, extents, frustum, parentPlaneMask, &childPlaneMask);
+
+		if (visibility == OctNode::VISIBILITY_OUTSIDE || (pOcclusion && pOcclusion->IsOccluded(center, extents)))
+			i = node.SkipIndex;
+		else if (visibility == OctNode::VISIBILITY_INSIDE && !pOcclusion)
+		{
+			for (auto j = node.FirstItem; j < node.ItemEnd; ++j) items.push_back(j);
+			i = node.SkipIndex;
+		}
+		else if (node.SkipIndex == i + 1)
+		{
+			// Leaf
+			if (!childPlaneMask) for (auto j = node.FirstItem; j < node.ItemEnd; ++j) addItem(j);
+			else
+			{
+				OctNode::Visibility visibilities[MAX_LEAF_ITEMS];
+				for (auto j = node.FirstItem; j < node.ItemEnd; j += MAX_LEAF_ITEMS)
+				{
+					const auto count = (min)(node.ItemEnd - j, static_cast<uint32_t>(MAX_LEAF_ITEMS));
+					FrustumCulling::Classify(visibilities, m_itemBounds, j, count, frustum, childPlaneMask);
+					for (auto k = 0u; k < count; ++k)
+						if (visibilities[k] != OctNode::VISIBILITY_OUTSIDE) addItem(j + k);
+				}
+			}
+			++i;
+		}
+		else
+		{
+			ancestors[depth++] = { node.SkipIndex, childPlaneMask };
+			++i;
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::setItems(const LinearOctree::Item* pItems, uint32_t numItems)
+{
+	m_itemBounds.Resize(numItems);
+	m_meshIDs.resize(numItems);
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		const auto& item = pItems[m_itemIndices[i]];
+		m_itemBounds.Set(i, item.Center, item.Extents);
+		m_meshIDs[i] = item.MeshID;
+	}
+}
+
+uint64_t BoundingVolumeHierarchy::getHash(const LinearOctree::Item* pItems, uint32_t numItems)
+{
+	// FNV-1a
+	auto hash = 0xcbf29ce484222325ull;
+	const auto pBytes = reinterpret_cast<const uint8_t*>(pItems);
+	for (size_t i = 0; i < sizeof(LinearOctree::Item) * numItems; ++i)
+	{
+		hash ^= pBytes[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "LinearOctree.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Binary BVH over static meshes, split by the surface area heuristic over binned
+	// centroids. Nodes are flattened in pre-order with skip indices, and the items of a
+	// subtree are contiguous, so it is traversed as LinearOctree is and builds the same
+	// queues without any per-scene cell size or loose coefficient.
+	//--------------------------------------------------------------------------------------
+	class BoundingVolumeHierarchy
+	{
+	public:
+		static const uint8_t MAX_DEPTH = 48;
+		static const uint8_t NUM_BINS = 16;
+		static const uint8_t MAX_LEAF_ITEMS = 16;	// Leaves are split past this even if SAH disagrees
+
+		struct Node
+		{
+			uint32_t	FirstItem;		// Items of the subtree; a leaf has no children
+			uint32_t	ItemEnd;
+			uint32_t	SkipIndex;		// First node after the subtree; the node + 1 for leaves
+		};
+
+		enum StressScene : uint8_t
+		{
+			STRESS_UNIFORM,			// Small meshes scattered over a terrain
+			STRESS_THIN,			// Long thin meshes such as fences, pipes and cables
+			STRESS_CLUSTERED		// Dense clusters far apart, with a few huge meshes
+		};
+
+		// Per traversal, averaged over the views
+		struct QueryResult
+		{
+			double		Microseconds;
+			double		NumNodeTests;
+			double		NumItemTests;
+			double		NumVisible;
+		};
+
+		struct BenchmarkResult
+		{
+			double		OctreeBuildMilliseconds;
+			double		BuildMilliseconds;
+			QueryResult	Octree;
+			QueryResult	Hierarchy;
+			uint32_t	NumOctreeNodes;
+			uint32_t	NumNodes;
+		};
+
+		BoundingVolumeHierarchy();
+		virtual ~BoundingVolumeHierarchy();
+
+		// numThreads of 0 uses all hardware threads; the subtrees of large nodes are built in parallel.
+		void CreateTree(const LinearOctree::Item* pItems, uint32_t numItems, uint32_t numThreads = 0);
+		void CreateTree(uint32_t numModels, const StaticModel::sptr* pModels, SubsetFlags subsetFlags,
+			uint32_t numThreads = 0);
+
+		// The cache records a hash of the items it was built from, and fails to load for others.
+		bool Save(const wchar_t* fileName) const;
+		bool Load(const wchar_t* fileName, const LinearOctree::Item* pItems, uint32_t numItems);
+
+		// Same queue as LinearOctree::Sort
+		void Sort(std::vector<DirectX::XMUINT2>& meshIDQueue, DirectX::CXMMATRIX viewProj,
+			DirectX::FXMVECTOR eyePt, bool isNearToFar, bool isAllVisible = false,
+			const SoftwareOcclusion* pOcclusion = nullptr) const;
+
+		const std::vector<Node>& GetNodes() const { return m_nodes; }
+		const FrustumCulling::Boxes& GetNodeBounds() const { return m_nodeBounds; }
+		const FrustumCulling::Boxes& GetItemBounds() const { return m_itemBounds; }
+		const std::vector<DirectX::XMUINT2>& GetMeshIDs() const { return m_meshIDs; }
+		uint32_t GetNumNodes() const { return static_cast<uint32_t>(m_nodes.size()); }
+		uint64_t GetMemorySize() const;
+
+		static void CreateStressItems(std::vector<LinearOctree::Item>& items, StressScene scene, uint32_t numItems);
+
+		// Builds both structures over the items and times them over views circling the items, as
+		// LinearOctree::Benchmark does. The octree root is the cell of mapSize at the origin, as
+		// the scenes set it, or fitted to the items if mapSize is 0.
+		static void Benchmark(BenchmarkResult& result, const LinearOctree::Item* pItems, uint32_t numItems,
+			uint32_t numViews = 64, uint32_t numIterations = 16, float mapSize = 0.0f, float looseCoeff = 1.0f);
+
+		using uptr = std::unique_ptr<BoundingVolumeHierarchy>;
+		using sptr = std::shared_ptr<BoundingVolumeHierarchy>;
+
+	protected:
+		struct BuildNode
+		{
+			DirectX::XMFLOAT3 MinPt;
+			DirectX::XMFLOAT3 MaxPt;
+			uint32_t	FirstItem;
+			uint32_t	ItemEnd;
+			uint32_t	SkipIndex;		// Relative to the first node of the subtree being built
+		};
+
+		struct BuildItem
+		{
+			DirectX::XMFLOAT3 MinPt;
+			DirectX::XMFLOAT3 MaxPt;
+			DirectX::XMFLOAT3 Centroid;
+		};
+
+		void build(std::vector<BuildNode>& nodes, const std::vector<BuildItem>& buildItems,
+			uint32_t first, uint32_t last, uint8_t depth, uint32_t numThreads);
+		void collect(std::vector<uint32_t>& items, const FrustumCulling::Frustum& frustum, uint8_t planeMask,
+			const SoftwareOcclusion* pOcclusion) const;
+		void setItems(const LinearOctree::Item* pItems, uint32_t numItems);
+
+		static uint64_t getHash(const LinearOctree::Item* pItems, uint32_t numItems);
+
+		std::vector<Node>				m_nodes;
+		FrustumCulling::Boxes			m_nodeBounds;
+		FrustumCulling::Boxes			m_itemBounds;
+		std::vector<DirectX::XMUINT2>	m_meshIDs;
+		std::vector<uint32_t>			m_itemIndices;	// Input item of each item, for the cache
+		uint64_t						m_hash;
+	};
+}
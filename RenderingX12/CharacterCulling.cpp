@@ -0,0 +1,219 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CharacterCulling.h"
+#include "DualQuatSkinning.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static float getMaxScale(FXMMATRIX m)
+{
+	const auto s = XMVectorMax(XMVectorMax(XMVector3LengthSq(m.r[0]), XMVector3LengthSq(m.r[1])), XMVector3LengthSq(m.r[2]));
+
+	return sqrtf(XMVectorGetX(s));
+}
+
+CharacterCulling::CharacterCulling() :
+	m_boneRadii(0),
+	m_stats()
+{
+}
+
+CharacterCulling::~CharacterCulling()
+{
+}
+
+bool CharacterCulling::CreateBoneRadii(const SDKMesh* pMesh, const Skeleton& skeleton)
+{
+	const auto numBones = skeleton.GetNumBones();
+	const auto& layout = DualQuatSkinning::GetDefaultVertexLayout();
+
+	// Bind-pose model matrices and their inverses
+	vector<XMFLOAT4X4> invBindMatrices(numBones);
+	{
+		vector<XMMATRIX> bindMatrices(numBones);
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			bindMatrices[i] = XMLoadFloat4x4(&skeleton.BindLocals[i]);
+			if (skeleton.Parents[i] != UINT32_MAX)
+				bindMatrices[i] = XMMatrixMultiply(bindMatrices[i], bindMatrices[skeleton.Parents[i]]);
+			XMStoreFloat4x4(&invBindMatrices[i], XMMatrixInverse(nullptr, bindMatrices[i]));
+		}
+	}
+
+	m_boneRadii.assign(numBones, -1.0f);
+	const auto numMeshes = pMesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto pMeshData = pMesh->GetMesh(m);
+		if (!pMeshData->NumFrameInfluences) continue;
+		XUSG_N_RETURN(pMesh->GetVertexStride(m, 0) == layout.Stride, false);
+
+		const auto pVertices = pMesh->GetRawVerticesAt(pMeshData->VertexBuffers[0]);
+		const auto numVertices = static_cast<uint32_t>(pMesh->GetNumVertices(m, 0));
+		XUSG_N_RETURN(pVertices, false);
+
+		for (auto i = 0u; i < numVertices; ++i)
+		{
+			const auto pVertex = &pVertices[layout.Stride * i];
+			const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertex[layout.PositionOffset]));
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				const auto influence = pVertex[layout.IndicesOffset + j];
+				if (!pVertex[layout.WeightsOffset + j] || influence >= pMeshData->NumFrameInfluences) continue;
+
+				const auto bone = pMeshData->pFrameInfluences[influence];
+				if (bone >= numBones) continue;
+
+				const auto localPos = XMVector3Transform(pos, XMLoadFloat4x4(&invBindMatrices[bone]));
+				m_boneRadii[bone] = (max)(m_boneRadii[bone], XMVectorGetX(XMVector3Length(localPos)));
+			}
+		}
+	}
+
+	return true;
+}
+
+void CharacterCulling::ComputeClipBound(Bound& bound, const AnimationClip& clip, const Skeleton& skeleton,
+	uint32_t numSubsteps) const
+{
+	AnimationBlender blender;
+	blender.Init(skeleton);
+
+	LocalPose pose;
+	const auto numBones = static_cast<uint32_t>(m_boneRadii.size());
+	vector<XMFLOAT4X4> modelMatrices(skeleton.GetNumBones());
+	vector<XMVECTOR> prevSpheres(numBones);
+	auto minPt = XMVectorReplicate(FLT_MAX);
+	auto maxPt = XMVectorReplicate(-FLT_MAX);
+
+	// Playback loops, so the last sample wraps to the first key and closes the last interval.
+	numSubsteps = (max)(numSubsteps, 1u);
+	const auto numSamples = clip.GetNumKeys() * numSubsteps;
+	const auto sampleRate = static_cast<double>(clip.GetFPS()) * numSubsteps;
+	for (auto n = 0u; n <= numSamples; ++n)
+	{
+		const AnimationBlender::Layer layer = { &clip, nullptr, n / sampleRate, 1.0f };
+		blender.Evaluate(pose, &layer, 1, nullptr, 0);
+		blender.ComputeModelMatrices(modelMatrices.data(), pose);
+
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			if (m_boneRadii[i] < 0.0f) continue;
+
+			const auto m = XMLoadFloat4x4(&modelMatrices[i]);
+			const auto sphere = XMVectorSetW(m.r[3], m_boneRadii[i] * getMaxScale(m));
+			auto r = XMVectorSplatW(sphere);
+			if (n > 0)
+			{
+				// A path from the previous center to this one stays within half its length of
+				// the chord midpoint. Taking that length as up to twice the chord, growing both
+				// ends by the chord length covers the motion in between.
+				const auto& prevSphere = prevSpheres[i];
+				r = XMVectorMax(r, XMVectorSplatW(prevSphere)) + XMVector3Length(sphere - prevSphere);
+				minPt = XMVectorMin(minPt, prevSphere - r);
+				maxPt = XMVectorMax(maxPt, prevSphere + r);
+			}
+			minPt = XMVectorMin(minPt, sphere - r);
+			maxPt = XMVectorMax(maxPt, sphere + r);
+			prevSpheres[i] = sphere;
+		}
+	}
+
+	if (XMVector3Greater(minPt, maxPt)) minPt = maxPt = XMVectorZero();
+	XMStoreFloat3(&bound.Center, (minPt + maxPt) * 0.5f);
+	XMStoreFloat3(&bound.Extents, (maxPt - minPt) * 0.5f);
+}
+
+void CharacterCulling::ComputePoseBound(Bound& bound, const XMFLOAT4X4* pModelMatrices) const
+{
+	auto minPt = XMVectorReplicate(FLT_MAX);
+	auto maxPt = XMVectorReplicate(-FLT_MAX);
+
+	const auto numBones = static_cast<uint32_t>(m_boneRadii.size());
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		if (m_boneRadii[i] < 0.0f) continue;
+
+		const auto m = XMLoadFloat4x4(&pModelMatrices[i]);
+		const auto r = XMVectorReplicate(m_boneRadii[i] * getMaxScale(m));
+		minPt = XMVectorMin(minPt, m.r[3] - r);
+		maxPt = XMVectorMax(maxPt, m.r[3] + r);
+	}
+
+	if (XMVector3Greater(minPt, maxPt)) minPt = maxPt = XMVectorZero();
+	XMStoreFloat3(&bound.Center, (minPt + maxPt) * 0.5f);
+	XMStoreFloat3(&bound.Extents, (maxPt - minPt) * 0.5f);
+}
+
+uint32_t CharacterCulling::Cull(uint32_t* pMasks, const Bound* pWorldBounds, uint32_t numCharacters,
+	const XMMATRIX* pViewProjs, uint8_t numFrusta)
+{
+	assert(numFrusta <= 32);
+	vector<XMVECTOR> planes(6 * numFrusta);
+	for (uint8_t i = 0; i < numFrusta; ++i) GetFrustumPlanes(&planes[6 * i], pViewProjs[i]);
+
+	m_stats = {};
+	m_stats.NumCharacters = numCharacters;
+	for (auto i = 0u; i < numCharacters; ++i)
+	{
+		auto mask = 0u;
+		for (uint8_t j = 0; j < numFrusta; ++j)
+			if (IsVisible(pWorldBounds[i], &planes[6 * j])) mask |= 1u << j;
+		pMasks[i] = mask;
+
+		if (!mask) ++m_stats.NumCulled;
+		else
+		{
+			++m_stats.NumSkinned;
+			if (!(mask & 1)) ++m_stats.NumShadowOnly;
+		}
+	}
+
+	return m_stats.NumSkinned;
+}
+
+CharacterCulling::Bound CharacterCulling::TransformBound(const Bound& bound, FXMMATRIX world)
+{
+	// Extents of a transformed box: |M| * e
+	const auto center = XMVector3Transform(XMLoadFloat3(&bound.Center), world);
+	const auto extents = XMLoadFloat3(&bound.Extents);
+	const auto e = XMVectorAbs(world.r[0]) * XMVectorSplatX(extents) +
+		XMVectorAbs(world.r[1]) * XMVectorSplatY(extents) +
+		XMVectorAbs(world.r[2]) * XMVectorSplatZ(extents);
+
+	Bound result;
+	XMStoreFloat3(&result.Center, center);
+	XMStoreFloat3(&result.Extents, e);
+
+	return result;
+}
+
+void CharacterCulling::GetFrustumPlanes(XMVECTOR planes[6], FXMMATRIX viewProj)
+{
+	// Gribb-Hartmann on the columns of a row-vector matrix, with z in [0, 1]
+	const auto m = XMMatrixTranspose(viewProj);
+	planes[0] = m.r[3] + m.r[0];	// Left
+	planes[1] = m.r[3] - m.r[0];	// Right
+	planes[2] = m.r[3] + m.r[1];	// Bottom
+	planes[3] = m.r[3] - m.r[1];	// Top
+	planes[4] = m.r[2];				// Near
+	planes[5] = m.r[3] - m.r[2];	// Far
+}
+
+bool CharacterCulling::IsVisible(const Bound& bound, const XMVECTOR planes[6])
+{
+	const auto center = XMVectorSetW(XMLoadFloat3(&bound.Center), 1.0f);
+	const auto extents = XMLoadFloat3(&bound.Extents);
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		const auto d = XMVector4Dot(planes[i], center);
+		const auto r = XMVector3Dot(XMVectorAbs(planes[i]), extents);
+		if (XMVector4Less(d + r, XMVectorZero())) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AnimationBlend.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Character culling against the camera and the shadow cascades before skinning
+	//--------------------------------------------------------------------------------------
+	class CharacterCulling
+	{
+	public:
+		struct Bound
+		{
+			DirectX::XMFLOAT3 Center;
+			DirectX::XMFLOAT3 Extents;
+		};
+
+		struct Stats
+		{
+			uint32_t NumCharacters;
+			uint32_t NumSkinned;
+			uint32_t NumCulled;		// Outside every frustum: skinning and draws skipped
+			uint32_t NumShadowOnly;	// Outside the camera, inside at least one cascade
+		};
+
+		CharacterCulling();
+		virtual ~CharacterCulling();
+
+		// Bone-space bounding sphere of the vertices influenced by each bone
+		bool CreateBoneRadii(const SDKMesh* pMesh, const Skeleton& skeleton);
+
+		// Conservative model-space bound over the whole playback of a clip, computed once per
+		// clip from numSubsteps samples per key interval. Between two samples, each bone sphere
+		// is grown by the distance its center moved, which covers any path up to twice that long.
+		void ComputeClipBound(Bound& bound, const AnimationClip& clip, const Skeleton& skeleton,
+			uint32_t numSubsteps = 4) const;
+
+		// Model-space bound from the bone extents of the current pose
+		void ComputePoseBound(Bound& bound, const DirectX::XMFLOAT4X4* pModelMatrices) const;
+
+		// Writes a bit per frustum (0: camera, 1+: shadow cascades) for each character;
+		// a zero mask means the character is neither skinned nor drawn this frame.
+		uint32_t Cull(uint32_t* pMasks, const Bound* pWorldBounds, uint32_t numCharacters,
+			const DirectX::XMMATRIX* pViewProjs, uint8_t numFrusta);
+
+		const Stats& GetStats() const { return m_stats; }
+
+		static Bound TransformBound(const Bound& bound, DirectX::FXMMATRIX world);
+		static void GetFrustumPlanes(DirectX::XMVECTOR planes[6], DirectX::FXMMATRIX viewProj);
+		static bool IsVisible(const Bound& bound, const DirectX::XMVECTOR planes[6]);
+
+	protected:
+		std::vector<float>	m_boneRadii;	// Negative for bones without skinned vertices
+		Stats				m_stats;
+	};
+}
@@ -0,0 +1,483 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "DDSParser.h"
+
+using namespace std;
+using namespace XUSG;
+using namespace XUSG::DDS;
+
+#define DDS_MAGIC		0x20534444	// "DDS "
+#define DDS_FOURCC		0x00000004	// DDPF_FOURCC
+#define DDS_RGB			0x00000040	// DDPF_RGB
+#define DDS_LUMINANCE	0x00020000	// DDPF_LUMINANCE
+#define DDS_ALPHA		0x00000002	// DDPF_ALPHA
+#define DDS_BUMPDUDV	0x00080000	// DDPF_BUMPDUDV
+
+#define DDS_HEADER_FLAGS_VOLUME	0x00800000	// DDSD_DEPTH
+#define DDS_CUBEMAP_ALLFACES	0x0000fc00	// DDSCAPS2_CUBEMAP_ALL
+#define DDS_CUBEMAP				0x00000200	// DDSCAPS2_CUBEMAP
+#define DDS_RESOURCE_MISC_TEXTURECUBE	0x4
+#define DDS_MISC_FLAGS2_ALPHA_MODE_MASK	0x7
+
+#define MAKEFOURCC_DDS(ch0, ch1, ch2, ch3) \
+	(static_cast<uint32_t>(static_cast<uint8_t>(ch0)) | (static_cast<uint32_t>(static_cast<uint8_t>(ch1)) << 8) | \
+	(static_cast<uint32_t>(static_cast<uint8_t>(ch2)) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(ch3)) << 24))
+
+#pragma pack(push, 1)
+struct DDSPixelFormat
+{
+	uint32_t Size;
+	uint32_t Flags;
+	uint32_t FourCC;
+	uint32_t RGBBitCount;
+	uint32_t RBitMask;
+	uint32_t GBitMask;
+	uint32_t BBitMask;
+	uint32_t ABitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t Size;
+	uint32_t Flags;
+	uint32_t Height;
+	uint32_t Width;
+	uint32_t PitchOrLinearSize;
+	uint32_t Depth;
+	uint32_t MipMapCount;
+	uint32_t Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	uint32_t Caps;
+	uint32_t Caps2;
+	uint32_t Caps3;
+	uint32_t Caps4;
+	uint32_t Reserved2;
+};
+
+struct DDSHeaderDXT10
+{
+	uint32_t DXGIFormat;
+	uint32_t ResourceDimension;
+	uint32_t MiscFlag;
+	uint32_t ArraySize;
+	uint32_t MiscFlags2;
+};
+#pragma pack(pop)
+
+static bool isBitMask(const DDSPixelFormat& ddpf, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	return ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a;
+}
+
+// Legacy pixel formats, following the DDSTextureLoader conventions
+static Format getFormat(const DDSPixelFormat& ddpf)
+{
+	if (ddpf.Flags & DDS_RGB)
+	{
+		switch (ddpf.RGBBitCount)
+		{
+		case 32:
+			if (isBitMask(ddpf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)) return Format::R8G8B8A8_UNORM;
+			if (isBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000)) return Format::B8G8R8A8_UNORM;
+			if (isBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0)) return Format::B8G8R8X8_UNORM;
+			if (isBitMask(ddpf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000)) return Format::R10G10B10A2_UNORM;
+			if (isBitMask(ddpf, 0x0000ffff, 0xffff0000, 0, 0)) return Format::R16G16_UNORM;
+			if (isBitMask(ddpf, 0xffffffff, 0, 0, 0)) return Format::R32_FLOAT;
+			break;
+		case 16:
+			if (isBitMask(ddpf, 0x7c00, 0x03e0, 0x001f, 0x8000)) return Format::B5G5R5A1_UNORM;
+			if (isBitMask(ddpf, 0xf800, 0x07e0, 0x001f, 0)) return Format::B5G6R5_UNORM;
+			if (isBitMask(ddpf, 0x0f00, 0x00f0, 0x000f, 0xf000)) return Format::B4G4R4A4_UNORM;
+			if (isBitMask(ddpf, 0x00ff, 0, 0, 0xff00)) return Format::R8G8_UNORM;
+			if (isBitMask(ddpf, 0xffff, 0, 0, 0)) return Format::R16_UNORM;
+			break;
+		case 8:
+			if (isBitMask(ddpf, 0xff, 0, 0, 0)) return Format::R8_UNORM;
+			break;
+		}
+	}
+	else if (ddpf.Flags & DDS_LUMINANCE)
+	{
+		if (ddpf.RGBBitCount == 8 && isBitMask(ddpf, 0xff, 0, 0, 0)) return Format::R8_UNORM;
+		if (ddpf.RGBBitCount == 16 && isBitMask(ddpf, 0xffff, 0, 0, 0)) return Format::R16_UNORM;
+		if (ddpf.RGBBitCount == 16 && isBitMask(ddpf, 0x00ff, 0, 0, 0xff00)) return Format::R8G8_UNORM;
+	}
+	else if (ddpf.Flags & DDS_ALPHA)
+	{
+		if (ddpf.RGBBitCount == 8) return Format::A8_UNORM;
+	}
+	else if (ddpf.Flags & DDS_BUMPDUDV)
+	{
+		if (ddpf.RGBBitCount == 16 && isBitMask(ddpf, 0x00ff, 0xff00, 0, 0)) return Format::R8G8_SNORM;
+		if (ddpf.RGBBitCount == 32 && isBitMask(ddpf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+			return Format::R8G8B8A8_SNORM;
+		if (ddpf.RGBBitCount == 32 && isBitMask(ddpf, 0x0000ffff, 0xffff0000, 0, 0)) return Format::R16G16_SNORM;
+	}
+	else if (ddpf.Flags & DDS_FOURCC)
+	{
+		switch (ddpf.FourCC)
+		{
+		case MAKEFOURCC_DDS('D', 'X', 'T', '1'): return Format::BC1_UNORM;
+		case MAKEFOURCC_DDS('D', 'X', 'T', '2'):
+		case MAKEFOURCC_DDS('D', 'X', 'T', '3'): return Format::BC2_UNORM;
+		case MAKEFOURCC_DDS('D', 'X', 'T', '4'):
+		case MAKEFOURCC_DDS('D', 'X', 'T', '5'): return Format::BC3_UNORM;
+		case MAKEFOURCC_DDS('A', 'T', 'I', '1'):
+		case MAKEFOURCC_DDS('B', 'C', '4', 'U'): return Format::BC4_UNORM;
+		case MAKEFOURCC_DDS('B', 'C', '4', 'S'): return Format::BC4_SNORM;
+		case MAKEFOURCC_DDS('A', 'T', 'I', '2'):
+		case MAKEFOURCC_DDS('B', 'C', '5', 'U'): return Format::BC5_UNORM;
+		case MAKEFOURCC_DDS('B', 'C', '5', 'S'): return Format::BC5_SNORM;
+		case MAKEFOURCC_DDS('R', 'G', 'B', 'G'): return Format::R8G8_B8G8_UNORM;
+		case MAKEFOURCC_DDS('G', 'R', 'G', 'B'): return Format::G8R8_G8B8_UNORM;
+		case 36: return Format::R16G16B16A16_UNORM;
+		case 110: return Format::R16G16B16A16_SNORM;
+		case 111: return Format::R16_FLOAT;
+		case 112: return Format::R16G16_FLOAT;
+		case 113: return Format::R16G16B16A16_FLOAT;
+		case 114: return Format::R32_FLOAT;
+		case 115: return Format::R32G32_FLOAT;
+		case 116: return Format::R32G32B32A32_FLOAT;
+		}
+	}
+
+	return Format::UNKNOWN;
+}
+
+bool Parser::ParseHeader(TextureInfo& info, const uint8_t* pData, size_t dataSize)
+{
+	XUSG_N_RETURN(dataSize >= sizeof(uint32_t) + sizeof(DDSHeader), false);
+	XUSG_N_RETURN(*reinterpret_cast<const uint32_t*>(pData) == DDS_MAGIC, false);
+
+	const auto& header = *reinterpret_cast<const DDSHeader*>(&pData[sizeof(uint32_t)]);
+	XUSG_N_RETURN(header.Size == sizeof(DDSHeader) && header.PixelFormat.Size == sizeof(DDSPixelFormat), false);
+
+	info.Width = header.Width;
+	info.Height = header.Height;
+	info.Depth = header.Depth;
+	info.ArraySize = 1;
+	info.MipLevels = static_cast<uint8_t>((max)(header.MipMapCount, 1u));
+	info.IsCubeMap = false;
+	info.AlphaMode = ALPHA_MODE_UNKNOWN;
+	info.DataOffset = sizeof(uint32_t) + sizeof(DDSHeader);
+
+	const auto isDX10 = (header.PixelFormat.Flags & DDS_FOURCC) && header.PixelFormat.FourCC == MAKEFOURCC_DDS('D', 'X', '1', '0');
+	if (isDX10)
+	{
+		XUSG_N_RETURN(dataSize >= info.DataOffset + sizeof(DDSHeaderDXT10), false);
+		const auto& header10 = *reinterpret_cast<const DDSHeaderDXT10*>(&pData[info.DataOffset]);
+		info.DataOffset += sizeof(DDSHeaderDXT10);
+
+		XUSG_N_RETURN(header10.ArraySize > 0 && header10.DXGIFormat <= static_cast<uint32_t>(Format::B4G4R4A4_UNORM), false);
+		info.Format = static_cast<Format>(header10.DXGIFormat);
+		info.ArraySize = static_cast<uint16_t>(header10.ArraySize);
+		info.AlphaMode = static_cast<AlphaMode>(header10.MiscFlags2 & DDS_MISC_FLAGS2_ALPHA_MODE_MASK);
+
+		switch (header10.ResourceDimension)
+		{
+		case static_cast<uint32_t>(Dimension::TEXTURE1D):
+			info.Dimension = Dimension::TEXTURE1D;
+			info.Height = info.Depth = 1;
+			break;
+		case static_cast<uint32_t>(Dimension::TEXTURE2D):
+			info.Dimension = Dimension::TEXTURE2D;
+			info.Depth = 1;
+			if (header10.MiscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+			{
+				info.IsCubeMap = true;
+				info.ArraySize *= 6;
+			}
+			break;
+		case static_cast<uint32_t>(Dimension::TEXTURE3D):
+			XUSG_N_RETURN(header.Flags & DDS_HEADER_FLAGS_VOLUME, false);
+			XUSG_N_RETURN(info.ArraySize == 1, false);
+			info.Dimension = Dimension::TEXTURE3D;
+			break;
+		default:
+			return false;
+		}
+	}
+	else
+	{
+		info.Format = getFormat(header.PixelFormat);
+		if (header.PixelFormat.Flags & DDS_FOURCC && header.PixelFormat.FourCC == MAKEFOURCC_DDS('D', 'X', 'T', '2'))
+			info.AlphaMode = ALPHA_MODE_PREMULTIPLIED;
+
+		if (header.Flags & DDS_HEADER_FLAGS_VOLUME) info.Dimension = Dimension::TEXTURE3D;
+		else
+		{
+			info.Dimension = Dimension::TEXTURE2D;
+			info.Depth = 1;
+
+			if (header.Caps2 & DDS_CUBEMAP)
+			{
+				// Partial cube maps are not supported
+				XUSG_N_RETURN((header.Caps2 & DDS_CUBEMAP_ALLFACES) == DDS_CUBEMAP_ALLFACES, false);
+				info.IsCubeMap = true;
+				info.ArraySize = 6;
+			}
+		}
+	}
+
+	XUSG_N_RETURN(info.Format != Format::UNKNOWN && info.Width > 0 && info.Height > 0 && info.Depth > 0, false);
+	XUSG_N_RETURN(info.MipLevels <= 16, false);
+
+	return true;
+}
+
+bool Parser::LoadHeader(TextureInfo& info, const wchar_t* fileName, uint64_t* pFileSize)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0, false);
+
+	uint8_t header[MAX_HEADER_SIZE];
+	const auto headerSize = fread(header, 1, sizeof(header), pFile);
+	if (pFileSize)
+	{
+		_fseeki64(pFile, 0, SEEK_END);
+		*pFileSize = static_cast<uint64_t>(_ftelli64(pFile));
+	}
+	fclose(pFile);
+
+	return ParseHeader(info, header, headerSize);
+}
+
+bool Parser::LoadFile(vector<uint8_t>& data, const wchar_t* fileName)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0, false);
+
+	_fseeki64(pFile, 0, SEEK_END);
+	data.resize(static_cast<size_t>(_ftelli64(pFile)));
+	_fseeki64(pFile, 0, SEEK_SET);
+
+	const auto readSize = fread(data.data(), 1, data.size(), pFile);
+	fclose(pFile);
+
+	return readSize == data.size();
+}
+
+bool Parser::SaveFile(const wchar_t* fileName, const vector<uint8_t>& data)
+{
+	const auto tempFileName = wstring(fileName) + L".tmp";
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, tempFileName.c_str(), L"wb") == 0, false);
+	const auto writeSize = fwrite(data.data(), 1, data.size(), pFile);
+	fclose(pFile);
+	XUSG_N_RETURN(writeSize == data.size(), false);
+
+	return MoveFileExW(tempFileName.c_str(), fileName, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+void Parser::WriteHeader(vector<uint8_t>& data, TextureInfo& info)
+{
+	// Always with the DX10 extension, which is the only way to carry sRGB and BC6H/BC7 formats
+	info.DataOffset = MAX_HEADER_SIZE;
+	data.resize(MAX_HEADER_SIZE);
+	*reinterpret_cast<uint32_t*>(data.data()) = DDS_MAGIC;
+
+	uint32_t rowPitch;
+	uint64_t slicePitch;
+	GetSurfaceInfo(info.Width, info.Height, info.Format, &rowPitch, nullptr, &slicePitch);
+
+	auto& header = *reinterpret_cast<DDSHeader*>(&data[sizeof(uint32_t)]);
+	header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;	// DDSD_CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT
+	header.Flags |= IsBlockCompressed(info.Format) ? 0x80000 : 0x8;	// DDSD_LINEARSIZE or DDSD_PITCH
+	header.Height = info.Height;
+	header.Width = info.Width;
+	header.PitchOrLinearSize = IsBlockCompressed(info.Format) ? static_cast<uint32_t>(slicePitch) : rowPitch;
+	header.Depth = info.Depth;
+	header.MipMapCount = info.MipLevels;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDS_FOURCC;
+	header.PixelFormat.FourCC = MAKEFOURCC_DDS('D', 'X', '1', '0');
+	header.Caps = 0x1000 | (info.MipLevels > 1 ? 0x400008 : 0);	// DDSCAPS_TEXTURE, MIPMAP | COMPLEX
+	if (info.IsCubeMap) header.Caps2 = DDS_CUBEMAP | DDS_CUBEMAP_ALLFACES;
+	if (info.Dimension == Dimension::TEXTURE3D) header.Flags |= DDS_HEADER_FLAGS_VOLUME;
+
+	auto& header10 = *reinterpret_cast<DDSHeaderDXT10*>(&data[sizeof(uint32_t) + sizeof(DDSHeader)]);
+	header10 = {};
+	header10.DXGIFormat = static_cast<uint32_t>(info.Format);
+	header10.ResourceDimension = static_cast<uint32_t>(info.Dimension);
+	header10.MiscFlag = info.IsCubeMap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	header10.ArraySize = info.IsCubeMap ? info.ArraySize / 6 : info.ArraySize;
+	header10.MiscFlags2 = info.AlphaMode & DDS_MISC_FLAGS2_ALPHA_MODE_MASK;
+}
+
+bool Parser::GetSubresourceLayouts(vector<SubresourceLayout>& layouts, const TextureInfo& info, uint64_t fileSize)
+{
+	layouts.resize(GetNumSubresources(info));
+
+	auto offset = info.DataOffset;
+	auto subresource = 0u;
+	for (auto i = 0u; i < info.ArraySize; ++i)
+	{
+		auto w = info.Width;
+		auto h = info.Height;
+		auto d = info.Depth;
+
+		for (uint8_t m = 0; m < info.MipLevels; ++m)
+		{
+			auto& layout = layouts[subresource++];
+			layout.Offset = offset;
+			layout.Width = w;
+			layout.Height = h;
+			layout.Depth = d;
+			GetSurfaceInfo(w, h, info.Format, &layout.RowPitch, &layout.NumRows, &layout.SlicePitch);
+			XUSG_N_RETURN(layout.RowPitch > 0, false);
+
+			offset += layout.SlicePitch * d;
+			XUSG_N_RETURN(offset <= fileSize, false);
+
+			w = (max)(w >> 1, 1u);
+			h = (max)(h >> 1, 1u);
+			d = (max)(d >> 1, 1u);
+		}
+	}
+
+	return true;
+}
+
+void Parser::GetSurfaceInfo(uint32_t width, uint32_t height, Format format,
+	uint32_t* pRowPitch, uint32_t* pNumRows, uint64_t* pSlicePitch)
+{
+	uint64_t rowPitch;
+	uint32_t numRows;
+
+	if (IsBlockCompressed(format))
+	{
+		const uint32_t bytesPerBlock = format <= Format::BC1_UNORM_SRGB ||
+			(format >= Format::BC4_TYPELESS && format <= Format::BC4_SNORM) ? 8 : 16;
+		rowPitch = static_cast<uint64_t>(XUSG_DIV_UP(width, 4u)) * bytesPerBlock;
+		numRows = XUSG_DIV_UP(height, 4u);
+	}
+	else if (format == Format::R8G8_B8G8_UNORM || format == Format::G8R8_G8B8_UNORM)
+	{
+		rowPitch = static_cast<uint64_t>(XUSG_DIV_UP(width, 2u)) * 4;
+		numRows = height;
+	}
+	else
+	{
+		const auto bpp = DDS::Loader::BitsPerPixel(format);
+		rowPitch = XUSG_DIV_UP(static_cast<uint64_t>(width) * bpp, 8);
+		numRows = height;
+	}
+
+	if (pRowPitch) *pRowPitch = static_cast<uint32_t>(rowPitch);
+	if (pNumRows) *pNumRows = numRows;
+	if (pSlicePitch) *pSlicePitch = rowPitch * numRows;
+}
+
+bool Parser::CheckHeaders()
+{
+	const auto makeInfo = [](Format format, Dimension dimension, uint32_t width, uint32_t height, uint32_t depth,
+		uint16_t arraySize, uint8_t mipLevels, bool isCubeMap)
+	{
+		TextureInfo info = {};
+		info.Format = format;
+		info.Dimension = dimension;
+		info.Width = width;
+		info.Height = height;
+		info.Depth = depth;
+		info.ArraySize = arraySize;
+		info.MipLevels = mipLevels;
+		info.IsCubeMap = isCubeMap;
+		info.AlphaMode = ALPHA_MODE_STRAIGHT;
+
+		return info;
+	};
+
+	const TextureInfo infos[] =
+	{
+		makeInfo(Format::R8G8B8A8_UNORM, Dimension::TEXTURE1D, 256, 1, 1, 1, 9, false),
+		makeInfo(Format::BC7_UNORM_SRGB, Dimension::TEXTURE2D, 100, 60, 1, 3, 7, false),
+		makeInfo(Format::BC1_UNORM, Dimension::TEXTURE2D, 64, 64, 1, 6, 7, true),
+		makeInfo(Format::R8G8B8A8_UNORM, Dimension::TEXTURE3D, 32, 16, 8, 1, 6, false)
+	};
+
+	vector<uint8_t> data;
+	vector<SubresourceLayout> layouts;
+	for (auto info : infos)
+	{
+		WriteHeader(data, info);
+
+		TextureInfo parsed;
+		for (size_t size = 0; size < data.size(); ++size) XUSG_N_RETURN(!ParseHeader(parsed, data.data(), size), false);
+		XUSG_N_RETURN(ParseHeader(parsed, data.data(), data.size()), false);
+		XUSG_N_RETURN(parsed.Format == info.Format && parsed.Dimension == info.Dimension && parsed.Width == info.Width &&
+			parsed.Height == info.Height && parsed.Depth == info.Depth && parsed.ArraySize == info.ArraySize &&
+			parsed.MipLevels == info.MipLevels && parsed.IsCubeMap == info.IsCubeMap &&
+			parsed.AlphaMode == info.AlphaMode && parsed.DataOffset == MAX_HEADER_SIZE, false);
+
+		// Exactly large enough, then one byte short
+		XUSG_N_RETURN(GetSubresourceLayouts(layouts, parsed), false);
+		const auto fileSize = layouts.back().Offset + layouts.back().SlicePitch * layouts.back().Depth;
+		XUSG_N_RETURN(GetSubresourceLayouts(layouts, parsed, fileSize), false);
+		XUSG_N_RETURN(!GetSubresourceLayouts(layouts, parsed, fileSize - 1), false);
+	}
+
+	// Invalid DX10 fields
+	auto info = infos[1];
+	WriteHeader(data, info);
+	auto& header = *reinterpret_cast<DDSHeader*>(&data[sizeof(uint32_t)]);
+	auto& header10 = *reinterpret_cast<DDSHeaderDXT10*>(&data[sizeof(uint32_t) + sizeof(DDSHeader)]);
+	TextureInfo parsed;
+	const auto rejects = [&](uint32_t& field, uint32_t value)
+	{
+		const auto original = field;
+		field = value;
+		const auto isRejected = !ParseHeader(parsed, data.data(), data.size());
+		field = original;
+
+		return isRejected;
+	};
+	XUSG_N_RETURN(rejects(header10.ArraySize, 0), false);
+	XUSG_N_RETURN(rejects(header10.ResourceDimension, 5), false);
+	XUSG_N_RETURN(rejects(header10.DXGIFormat, static_cast<uint32_t>(Format::B4G4R4A4_UNORM) + 1), false);
+	XUSG_N_RETURN(rejects(header10.DXGIFormat, static_cast<uint32_t>(Format::UNKNOWN)), false);
+	XUSG_N_RETURN(rejects(header10.ResourceDimension, static_cast<uint32_t>(Dimension::TEXTURE3D)), false);
+	XUSG_N_RETURN(rejects(header.Size, sizeof(DDSHeader) - 4), false);
+	XUSG_N_RETURN(rejects(header.MipMapCount, 17), false);
+	XUSG_N_RETURN(rejects(*reinterpret_cast<uint32_t*>(data.data()), 0), false);
+
+	// Legacy DXT1 without the DX10 extension
+	header.PixelFormat.FourCC = MAKEFOURCC_DDS('D', 'X', 'T', '1');
+	data.resize(sizeof(uint32_t) + sizeof(DDSHeader));
+	for (size_t size = 0; size < data.size(); ++size) XUSG_N_RETURN(!ParseHeader(parsed, data.data(), size), false);
+	XUSG_N_RETURN(ParseHeader(parsed, data.data(), data.size()), false);
+	XUSG_N_RETURN(parsed.Format == Format::BC1_UNORM && parsed.Dimension == Dimension::TEXTURE2D &&
+		parsed.ArraySize == 1 && parsed.Width == info.Width && parsed.MipLevels == info.MipLevels &&
+		parsed.DataOffset == data.size(), false);
+
+	return true;
+}
+
+bool Parser::IsBlockCompressed(Format format)
+{
+	return (format >= Format::BC1_TYPELESS && format <= Format::BC5_SNORM) ||
+		(format >= Format::BC6H_TYPELESS && format <= Format::BC7_UNORM_SRGB);
+}
+
+Format Parser::MakeSRGB(Format format)
+{
+	switch (format)
+	{
+	case Format::R8G8B8A8_UNORM: return Format::R8G8B8A8_UNORM_SRGB;
+	case Format::BC1_UNORM: return Format::BC1_UNORM_SRGB;
+	case Format::BC2_UNORM: return Format::BC2_UNORM_SRGB;
+	case Format::BC3_UNORM: return Format::BC3_UNORM_SRGB;
+	case Format::B8G8R8A8_UNORM: return Format::B8G8R8A8_UNORM_SRGB;
+	case Format::B8G8R8X8_UNORM: return Format::B8G8R8X8_UNORM_SRGB;
+	case Format::BC7_UNORM: return Format::BC7_UNORM_SRGB;
+	default: return format;
+	}
+}
+
+uint32_t Parser::GetNumSubresources(const TextureInfo& info)
+{
+	return static_cast<uint32_t>(info.ArraySize) * info.MipLevels;
+}
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	namespace DDS
+	{
+		//--------------------------------------------------------------------------------------
+		// CPU-side DDS header parsing and subresource layout, free of any GPU object
+		//--------------------------------------------------------------------------------------
+		enum class Dimension : uint8_t
+		{
+			TEXTURE1D = 2,
+			TEXTURE2D,
+			TEXTURE3D
+		};
+
+		struct TextureInfo
+		{
+			Format		Format;
+			Dimension	Dimension;
+			uint32_t	Width;
+			uint32_t	Height;
+			uint32_t	Depth;
+			uint16_t	ArraySize;		// Number of faces for cube maps, i.e. 6 per cube
+			uint8_t		MipLevels;
+			bool		IsCubeMap;
+			AlphaMode	AlphaMode;
+			uint64_t	DataOffset;		// Offset of the first texel block from the file start
+		};
+
+		// Tightly packed subresource as stored in the file
+		struct SubresourceLayout
+		{
+			uint64_t	Offset;			// From the file start
+			uint32_t	Width;
+			uint32_t	Height;
+			uint32_t	Depth;
+			uint32_t	RowPitch;		// Bytes per row of blocks
+			uint32_t	NumRows;		// Rows of blocks
+			uint64_t	SlicePitch;
+		};
+
+		class Parser
+		{
+		public:
+			static const uint32_t MAX_HEADER_SIZE = 148;	// Magic + DDS_HEADER + DDS_HEADER_DXT10
+
+			static bool ParseHeader(TextureInfo& info, const uint8_t* pData, size_t dataSize);
+			static bool LoadHeader(TextureInfo& info, const wchar_t* fileName, uint64_t* pFileSize = nullptr);
+
+			// Replaces data with a DX10 header for info, and sets info.DataOffset to its size
+			static void WriteHeader(std::vector<uint8_t>& data, TextureInfo& info);
+
+			// Whole-file I/O for the asset tools. SaveFile writes to a temporary file first and then
+			// replaces fileName, so that a failure never leaves a truncated texture behind.
+			static bool LoadFile(std::vector<uint8_t>& data, const wchar_t* fileName);
+			static bool SaveFile(const wchar_t* fileName, const std::vector<uint8_t>& data);
+
+			// Subresources in D3D order (mip-major within array slices), which is also the file
+			// order; fails if the file is too small to hold all of them.
+			static bool GetSubresourceLayouts(std::vector<SubresourceLayout>& layouts,
+				const TextureInfo& info, uint64_t fileSize = UINT64_MAX);
+
+			static void GetSurfaceInfo(uint32_t width, uint32_t height, Format format,
+				uint32_t* pRowPitch, uint32_t* pNumRows, uint64_t* pSlicePitch);
+
+			static bool IsBlockCompressed(Format format);
+			static Format MakeSRGB(Format format);
+			static uint32_t GetNumSubresources(const TextureInfo& info);
+
+			// DX10 headers of 1D, 2D-array, cube and volume textures and a legacy DXT1 header
+			// parse back as written; every truncation of them, invalid DX10 fields, and files one
+			// byte short of their subresources are rejected.
+			static bool CheckHeaders();
+		};
+	}
+}
@@ -0,0 +1,300 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "DrawQueue.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// Key fields, from the most significant bit. Opaque and alpha-tested: pass, coarse depth,
+	// pipeline, material, depth. Alpha: pass, inverted depth, pipeline, material.
+	const uint8_t PASS_SHIFT = 62;
+	const uint8_t COARSE_DEPTH_SHIFT = 58;
+	const uint8_t PIPELINE_SHIFT = 54;
+	const uint8_t MATERIAL_SHIFT = 30;
+	const uint8_t DEPTH_SHIFT = 6;
+	const uint8_t ALPHA_DEPTH_SHIFT = 38;
+	const uint8_t ALPHA_PIPELINE_SHIFT = 34;
+	const uint8_t ALPHA_MATERIAL_SHIFT = 10;
+
+	const uint8_t DEPTH_BITS = 24;
+	const uint32_t DEPTH_MASK = (1u << DEPTH_BITS) - 1;
+	const uint32_t MATERIAL_MASK = (1u << 24) - 1;
+}
+
+DrawQueue::DrawQueue() :
+	m_meshStates(0),
+	m_meshBases(0),
+	m_draws(0),
+	m_tempDraws(0),
+	m_numCoarseDepthBits(2),
+	m_stats()
+{
+}
+
+DrawQueue::~DrawQueue()
+{
+}
+
+void DrawQueue::Init(uint32_t numModels, const StaticModel::sptr* pModels, uint8_t numCoarseDepthBits)
+{
+	m_numCoarseDepthBits = (min)(numCoarseDepthBits, static_cast<uint8_t>(4));
+	m_meshStates.clear();
+	m_meshBases.resize(numModels);
+
+	// Pipelines as Model::SetPipeline selects them for the base pass
+	const SubsetFlags passFlags[] = { SUBSET_OPAQUE, SUBSET_ALPHA_TEST, SUBSET_ALPHA };
+	auto materialBase = 0u;
+	for (auto i = 0u; i < numModels; ++i)
+	{
+		const auto& mesh = pModels[i]->GetMesh();
+		const auto isTwoSided = pModels[i]->IsTwoSidedAll();
+		const uint8_t pipelines[] =
+		{
+			static_cast<uint8_t>(isTwoSided ? Model::OPAQUE_TWO_SIDED : Model::OPAQUE_FRONT),
+			Model::ALPHA_TEST_TWO_SIDED, Model::ALPHA_TWO_SIDED
+		};
+
+		const auto numMeshes = mesh->GetNumMeshes();
+		m_meshBases[i] = static_cast<uint32_t>(m_meshStates.size());
+		for (auto j = 0u; j < numMeshes; ++j)
+		{
+			MeshState meshState;
+			XMStoreFloat3(&meshState.Center, mesh->GetMeshBBoxCenter(j));
+			for (uint8_t p = 0; p < NUM_PASS; ++p)
+			{
+				meshState.Pipelines[p] = pipelines[p];
+				meshState.Materials[p] = mesh->GetNumSubsets(j, passFlags[p]) > 0 ?
+					materialBase + mesh->GetSubset(j, 0, passFlags[p])->MaterialID : NO_MATERIAL;
+			}
+			m_meshStates.push_back(meshState);
+		}
+
+		materialBase += mesh->GetNumMaterials();
+	}
+}
+
+void DrawQueue::Build(const vector<XMUINT2>& opaqueQueue, const vector<XMUINT2>& alphaQueue,
+	CXMMATRIX viewProj, float zNear, float zFar)
+{
+	const auto start = chrono::high_resolution_clock::now();
+
+	m_draws.clear();
+	addDraws(opaqueQueue, false, viewProj, zNear, zFar);
+	addDraws(alphaQueue, true, viewProj, zNear, zFar);
+	const auto keyTime = chrono::high_resolution_clock::now() - start;
+
+	countStateChanges(m_stats.Unsorted);
+
+	const auto sortStart = chrono::high_resolution_clock::now();
+	radixSort();
+	const auto sortTime = chrono::high_resolution_clock::now() - sortStart;
+
+	m_stats.NumDraws = static_cast<uint32_t>(m_draws.size());
+	m_stats.KeyMilliseconds = chrono::duration<double, milli>(keyTime).count();
+	m_stats.SortMilliseconds = chrono::duration<double, milli>(sortTime).count();
+	countStateChanges(m_stats.Sorted);
+}
+
+SubsetFlags DrawQueue::GetSubsetFlags(Pass pass)
+{
+	static const SubsetFlags subsetFlags[] = { SUBSET_OPAQUE, SUBSET_ALPHA_TEST, SUBSET_ALPHA };
+
+	return subsetFlags[pass];
+}
+
+void DrawQueue::Benchmark(BenchmarkResult& result, uint32_t numMeshes, uint32_t numFrames)
+{
+	result = {};
+	XUSG_N_RETURN(numMeshes > 0 && numFrames > 0, );
+
+	// Models of 8 meshes sharing 4 materials; a tenth of the meshes alpha-tested and a
+	// twentieth blended, a third of the models two-sided
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> position(-2000.0f, 2000.0f);
+	uniform_real_distribution<float> height(0.0f, 100.0f);
+	uniform_int_distribution<uint32_t> material(0, 3);
+	uniform_int_distribution<uint32_t> percent(0, 99);
+
+	const auto numModels = (numMeshes + 7) / 8;
+	DrawQueue drawQueue;
+	drawQueue.m_meshBases.resize(numModels);
+	for (auto i = 0u; i < numModels; ++i)
+	{
+		drawQueue.m_meshBases[i] = i * 8;
+		const auto isTwoSided = percent(rng) < 33;
+		for (auto j = 0u; j < 8; ++j)
+		{
+			MeshState meshState;
+			meshState.Center = XMFLOAT3(position(rng), height(rng), position(rng));
+			meshState.Pipelines[PASS_OPAQUE] = isTwoSided ? Model::OPAQUE_TWO_SIDED : Model::OPAQUE_FRONT;
+			meshState.Pipelines[PASS_ALPHA_TEST] = Model::ALPHA_TEST_TWO_SIDED;
+			meshState.Pipelines[PASS_ALPHA] = Model::ALPHA_TWO_SIDED;
+			meshState.Materials[PASS_OPAQUE] = i * 4 + material(rng);
+			meshState.Materials[PASS_ALPHA_TEST] = percent(rng) < 10 ? i * 4 + material(rng) : NO_MATERIAL;
+			meshState.Materials[PASS_ALPHA] = percent(rng) < 5 ? i * 4 + material(rng) : NO_MATERIAL;
+			drawQueue.m_meshStates.push_back(meshState);
+		}
+	}
+
+	const auto zNear = 1.0f;
+	const auto zFar = 5000.0f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, zNear, zFar);
+	uniform_real_distribution<float> fraction(0.25f, 1.0f);
+	vector<pair<float, XMUINT2>> visible;
+	vector<XMUINT2> queues[2];
+	chrono::duration<double, milli> stdSortTime(0.0);
+	for (auto n = 0u; n < numFrames; ++n)
+	{
+		// Queues as the octree sorts them: opaque near-to-far, alpha far-to-near
+		const auto angle = XM_2PI * n / numFrames;
+		const auto eyePt = XMVectorSet(cosf(angle) * 1500.0f, 150.0f, sinf(angle) * 1500.0f, 0.0f);
+		const auto viewProj = XMMatrixLookAtLH(eyePt, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+		const auto visibleRatio = fraction(rng);
+		visible.clear();
+		for (auto i = 0u; i < numModels * 8; ++i)
+		{
+			if (static_cast<float>(percent(rng)) >= visibleRatio * 100.0f) continue;
+			const auto& center = drawQueue.m_meshStates[i].Center;
+			visible.emplace_back(XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&center) - eyePt)), XMUINT2(i / 8, i % 8));
+		}
+		sort(visible.begin(), visible.end(), [](const pair<float, XMUINT2>& a, const pair<float, XMUINT2>& b)
+			{ return a.first < b.first; });
+
+		queues[0].clear();
+		queues[1].clear();
+		for (const auto& mesh : visible) queues[0].push_back(mesh.second);
+		for (auto it = visible.crbegin(); it != visible.crend(); ++it)
+		{
+			const auto& meshState = drawQueue.getMeshState(it->second);
+			if (meshState.Materials[PASS_ALPHA_TEST] != NO_MATERIAL || meshState.Materials[PASS_ALPHA] != NO_MATERIAL)
+				queues[1].push_back(it->second);
+		}
+
+		drawQueue.Build(queues[0], queues[1], viewProj, zNear, zFar);
+		const auto& stats = drawQueue.GetStats();
+		result.Average.NumDraws += stats.NumDraws;
+		result.Average.KeyMilliseconds += stats.KeyMilliseconds;
+		result.Average.SortMilliseconds += stats.SortMilliseconds;
+		for (const auto& changes : { make_pair(&result.Average.Sorted, &stats.Sorted),
+			make_pair(&result.Average.Unsorted, &stats.Unsorted) })
+		{
+			changes.first->NumPipelineChanges += changes.second->NumPipelineChanges;
+			changes.first->NumMaterialChanges += changes.second->NumMaterialChanges;
+			changes.first->NumModelChanges += changes.second->NumModelChanges;
+		}
+
+		// Reference: the same keys through a comparison sort
+		drawQueue.m_draws.clear();
+		drawQueue.addDraws(queues[0], false, viewProj, zNear, zFar);
+		drawQueue.addDraws(queues[1], true, viewProj, zNear, zFar);
+		const auto start = chrono::high_resolution_clock::now();
+		stable_sort(drawQueue.m_draws.begin(), drawQueue.m_draws.end(), [](const Draw& a, const Draw& b) { return a.Key < b.Key; });
+		stdSortTime += chrono::high_resolution_clock::now() - start;
+	}
+
+	result.Average.NumDraws /= numFrames;
+	result.Average.KeyMilliseconds /= numFrames;
+	result.Average.SortMilliseconds /= numFrames;
+	for (const auto pChanges : { &result.Average.Sorted, &result.Average.Unsorted })
+	{
+		pChanges->NumPipelineChanges /= numFrames;
+		pChanges->NumMaterialChanges /= numFrames;
+		pChanges->NumModelChanges /= numFrames;
+	}
+	result.StdSortMilliseconds = stdSortTime.count() / numFrames;
+}
+
+void DrawQueue::addDraws(const vector<XMUINT2>& queue, bool isAlpha, CXMMATRIX viewProj, float zNear, float zFar)
+{
+	const auto depthScale = static_cast<float>(DEPTH_MASK) / logf(zFar / zNear);
+	const auto coarseShift = DEPTH_BITS - m_numCoarseDepthBits;
+	const auto addDraw = [&](const XMUINT2& meshID, Pass pass, const MeshState& meshState, uint32_t depth)
+	{
+		const auto material = static_cast<uint64_t>(meshState.Materials[pass] & MATERIAL_MASK);
+		const auto pipeline = static_cast<uint64_t>(meshState.Pipelines[pass]);
+		auto key = static_cast<uint64_t>(pass) << PASS_SHIFT;
+		if (pass == PASS_ALPHA)
+			key |= static_cast<uint64_t>(DEPTH_MASK - depth) << ALPHA_DEPTH_SHIFT | pipeline << ALPHA_PIPELINE_SHIFT |
+				material << ALPHA_MATERIAL_SHIFT;
+		else
+		{
+			const auto coarseDepth = m_numCoarseDepthBits ? static_cast<uint64_t>(depth >> coarseShift) : 0;
+			key |= coarseDepth << COARSE_DEPTH_SHIFT | pipeline << PIPELINE_SHIFT | material << MATERIAL_SHIFT |
+				static_cast<uint64_t>(depth) << DEPTH_SHIFT;
+		}
+
+		m_draws.push_back({ key, meshID });
+	};
+
+	for (const auto& meshID : queue)
+	{
+		const auto& meshState = getMeshState(meshID);
+		const auto w = XMVectorGetW(XMVector3Transform(XMLoadFloat3(&meshState.Center), viewProj));
+		const auto z = (min)((max)(w, zNear), zFar);
+		const auto depth = (min)(static_cast<uint32_t>(logf(z / zNear) * depthScale), DEPTH_MASK);
+
+		if (!isAlpha)
+		{
+			if (meshState.Materials[PASS_OPAQUE] != NO_MATERIAL) addDraw(meshID, PASS_OPAQUE, meshState, depth);
+		}
+		else
+		{
+			if (meshState.Materials[PASS_ALPHA_TEST] != NO_MATERIAL) addDraw(meshID, PASS_ALPHA_TEST, meshState, depth);
+			if (meshState.Materials[PASS_ALPHA] != NO_MATERIAL) addDraw(meshID, PASS_ALPHA, meshState, depth);
+		}
+	}
+}
+
+void DrawQueue::countStateChanges(StateChanges& stateChanges) const
+{
+	stateChanges = {};
+	if (m_draws.empty()) return;
+
+	stateChanges = { 1, 1, 1 };
+	for (size_t i = 1; i < m_draws.size(); ++i)
+	{
+		const auto pass = GetPass(m_draws[i]);
+		const auto& meshState = getMeshState(m_draws[i].MeshID);
+		const auto prevPass = GetPass(m_draws[i - 1]);
+		const auto& prevMeshState = getMeshState(m_draws[i - 1].MeshID);
+		if (meshState.Pipelines[pass] != prevMeshState.Pipelines[prevPass]) ++stateChanges.NumPipelineChanges;
+		if (meshState.Materials[pass] != prevMeshState.Materials[prevPass]) ++stateChanges.NumMaterialChanges;
+		if (m_draws[i].MeshID.x != m_draws[i - 1].MeshID.x) ++stateChanges.NumModelChanges;
+	}
+}
+
+void DrawQueue::radixSort()
+{
+	// Histograms of all 8 digits in one pass; digits equal over all keys are skipped.
+	const auto numDraws = m_draws.size();
+	if (numDraws == 0) return;
+
+	uint32_t counts[8][256] = {};
+	for (const auto& draw : m_draws)
+		for (uint8_t d = 0; d < 8; ++d) ++counts[d][(draw.Key >> (8 * d)) & 0xff];
+
+	m_tempDraws.resize(numDraws);
+	for (uint8_t d = 0; d < 8; ++d)
+	{
+		auto& count = counts[d];
+		if (count[(m_draws[0].Key >> (8 * d)) & 0xff] == numDraws) continue;
+
+		uint32_t offsets[256];
+		auto offset = 0u;
+		for (auto b = 0u; b < 256; ++b)
+		{
+			offsets[b] = offset;
+			offset += count[b];
+		}
+
+		for (const auto& draw : m_draws) m_tempDraws[offsets[(draw.Key >> (8 * d)) & 0xff]++] = draw;
+		m_draws.swap(m_tempDraws);
+	}
+}
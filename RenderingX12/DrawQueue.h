@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Draws of the mesh-ID queues, one per mesh and subset pass, ordered by a 64-bit key with
+	// an LSD radix sort. Opaque and alpha-tested draws are keyed by coarse depth, pipeline,
+	// material table, then fine depth, so that state changes are grouped while staying
+	// roughly front-to-back; alpha draws are keyed by depth first, back-to-front.
+	// Scene::Render of the library builds and draws its own queues, so this orders the draws
+	// of models the app owns and renders itself; the scene's models are not reachable.
+	//--------------------------------------------------------------------------------------
+	class DrawQueue
+	{
+	public:
+		enum Pass : uint8_t
+		{
+			PASS_OPAQUE,
+			PASS_ALPHA_TEST,
+			PASS_ALPHA,
+
+			NUM_PASS
+		};
+
+		struct Draw
+		{
+			uint64_t	Key;
+			DirectX::XMUINT2 MeshID;	// Model, mesh
+		};
+
+		// Changes between consecutive draws
+		struct StateChanges
+		{
+			uint32_t	NumPipelineChanges;
+			uint32_t	NumMaterialChanges;		// Material descriptor tables
+			uint32_t	NumModelChanges;		// Per-object descriptor tables
+		};
+
+		struct Stats
+		{
+			uint32_t	NumDraws;
+			StateChanges Sorted;
+			StateChanges Unsorted;				// In the order of the input queues
+			double		KeyMilliseconds;		// Draws and their keys
+			double		SortMilliseconds;		// Radix sort
+		};
+
+		struct BenchmarkResult
+		{
+			Stats		Average;				// Per frame
+			double		StdSortMilliseconds;	// std::sort of the same keys
+		};
+
+		DrawQueue();
+		virtual ~DrawQueue();
+
+		// Pipelines and material tables of every mesh and pass. numCoarseDepthBits (up to 4) of
+		// depth rank above the pipeline; 0 groups opaque draws by state only.
+		void Init(uint32_t numModels, const StaticModel::sptr* pModels, uint8_t numCoarseDepthBits = 2);
+
+		// The meshes of alphaQueue contribute their alpha-tested and alpha subsets. Depth is the
+		// clip w of the mesh bound centers, quantized logarithmically over [zNear, zFar].
+		void Build(const std::vector<DirectX::XMUINT2>& opaqueQueue, const std::vector<DirectX::XMUINT2>& alphaQueue,
+			DirectX::CXMMATRIX viewProj, float zNear, float zFar);
+
+		const std::vector<Draw>& GetDraws() const { return m_draws; }
+		const Stats& GetStats() const { return m_stats; }
+
+		static Pass GetPass(const Draw& draw) { return static_cast<Pass>(draw.Key >> 62); }
+		static SubsetFlags GetSubsetFlags(Pass pass);
+
+		// Sorts 0.25 to 1.0 times numMeshes draws of synthetic models, queued near-to-far, per frame.
+		static void Benchmark(BenchmarkResult& result, uint32_t numMeshes = 20000, uint32_t numFrames = 64);
+
+		using uptr = std::unique_ptr<DrawQueue>;
+		using sptr = std::shared_ptr<DrawQueue>;
+
+	protected:
+		static const uint32_t NO_MATERIAL = UINT32_MAX;
+
+		// A mesh draws the subsets of a pass with the pipeline and material table of its first one.
+		struct MeshState
+		{
+			DirectX::XMFLOAT3 Center;
+			uint32_t	Materials[NUM_PASS];	// Index over all models, NO_MATERIAL if the pass is empty
+			uint8_t		Pipelines[NUM_PASS];	// Model::PipelineIndex
+		};
+
+		void addDraws(const std::vector<DirectX::XMUINT2>& queue, bool isAlpha, DirectX::CXMMATRIX viewProj,
+			float zNear, float zFar);
+		void countStateChanges(StateChanges& stateChanges) const;
+		void radixSort();
+
+		const MeshState& getMeshState(const DirectX::XMUINT2& meshID) const { return m_meshStates[m_meshBases[meshID.x] + meshID.y]; }
+
+		std::vector<MeshState>	m_meshStates;
+		std::vector<uint32_t>	m_meshBases;	// First mesh state of each model
+		std::vector<Draw>		m_draws;
+		std::vector<Draw>		m_tempDraws;
+		uint8_t					m_numCoarseDepthBits;
+		Stats					m_stats;
+	};
+}
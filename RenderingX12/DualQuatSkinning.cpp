@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <random>
+#include "DualQuatSkinning.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// Converts 4 bones at once; each XMVECTOR holds the same element of 4 matrices.
+static void convertBones4(XMVECTOR real[4], XMVECTOR dual[4], XMVECTOR& scale, const XMMATRIX bones[4])
+{
+	// Structure of arrays: rows[i].r[j] holds element (i, j) of the 4 bones
+	XMMATRIX rows[4];
+	for (uint8_t i = 0; i < 4; ++i)
+		rows[i] = XMMatrixTranspose(XMMATRIX(bones[0].r[i], bones[1].r[i], bones[2].r[i], bones[3].r[i]));
+
+	// Extract the per-axis scales and orthonormalize
+	XMVECTOR s[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		auto& r = rows[i].r;
+		s[i] = XMVectorSqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+		const auto rcp = XMVectorReciprocal(s[i]);
+		r[0] *= rcp;
+		r[1] *= rcp;
+		r[2] *= rcp;
+	}
+	scale = (s[0] + s[1] + s[2]) * (1.0f / 3.0f);
+
+	const auto& m00 = rows[0].r[0], & m01 = rows[0].r[1], & m02 = rows[0].r[2];
+	const auto& m10 = rows[1].r[0], & m11 = rows[1].r[1], & m12 = rows[1].r[2];
+	const auto& m20 = rows[2].r[0], & m21 = rows[2].r[1], & m22 = rows[2].r[2];
+	const auto one = XMVectorSplatOne();
+	const auto zero = XMVectorZero();
+
+	// Branch-free variant of XMQuaternionRotationMatrix: evaluate the 4 cases and select
+	const auto selXY = XMVectorGreater(m22, zero);		// false: x or y is the largest; true: z or w
+	const auto selX = XMVectorLess(m00 - m11, zero);	// false: x;  true: y
+	const auto selZ = XMVectorGreater(m00 + m11, zero);	// false: z;  true: w
+
+	const auto tX = one + m00 - m11 - m22;
+	const auto tY = one - m00 + m11 - m22;
+	const auto tZ = one - m00 - m11 + m22;
+	const auto tW = one + m00 + m11 + m22;
+
+	const auto sumXY = m01 + m10, sumZX = m20 + m02, sumYZ = m12 + m21;
+	const auto difYZ = m12 - m21, difZX = m20 - m02, difXY = m01 - m10;
+
+	// Cases x and y
+	auto qx = XMVectorSelect(tX, sumXY, selX);
+	auto qy = XMVectorSelect(sumXY, tY, selX);
+	auto qz = XMVectorSelect(sumZX, sumYZ, selX);
+	auto qw = XMVectorSelect(difYZ, difZX, selX);
+
+	// Cases z and w
+	qx = XMVectorSelect(qx, XMVectorSelect(sumZX, difYZ, selZ), selXY);
+	qy = XMVectorSelect(qy, XMVectorSelect(sumYZ, difZX, selZ), selXY);
+	qz = XMVectorSelect(qz, XMVectorSelect(tZ, difXY, selZ), selXY);
+	qw = XMVectorSelect(qw, XMVectorSelect(difXY, tW, selZ), selXY);
+
+	// Normalize, with w >= 0 to keep the palette in one hemisphere
+	auto norm = XMVectorReciprocal(XMVectorSqrt(qx * qx + qy * qy + qz * qz + qw * qw));
+	norm = XMVectorSelect(norm, -norm, XMVectorLess(qw, zero));
+	qx *= norm;
+	qy *= norm;
+	qz *= norm;
+	qw *= norm;
+
+	// Dual part: 0.5 * (t, 0) * q, with the translation in the unscaled space
+	const auto rcpScale = XMVectorReciprocal(scale);
+	const auto tx = rows[3].r[0] * rcpScale;
+	const auto ty = rows[3].r[1] * rcpScale;
+	const auto tz = rows[3].r[2] * rcpScale;
+	const auto half = XMVectorReplicate(0.5f);
+	const auto dx = half * (qw * tx + ty * qz - tz * qy);
+	const auto dy = half * (qw * ty + tz * qx - tx * qz);
+	const auto dz = half * (qw * tz + tx * qy - ty * qx);
+	const auto dw = -half * (tx * qx + ty * qy + tz * qz);
+
+	// Back to array of structures
+	const auto realAoS = XMMatrixTranspose(XMMATRIX(qx, qy, qz, qw));
+	const auto dualAoS = XMMatrixTranspose(XMMATRIX(dx, dy, dz, dw));
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		real[i] = realAoS.r[i];
+		dual[i] = dualAoS.r[i];
+	}
+}
+
+float DualQuatSkinning::ConvertPalette(DualQuaternion* pDst, const XMFLOAT4X4* pSrc,
+	uint32_t numBones, float* pMaxScaleError)
+{
+	if (!numBones) return 1.0f;
+
+	XMVECTOR real[4], dual[4], scale;
+	XMMATRIX bones[4];
+	auto scaleSum = XMVectorZero();
+	auto scaleMin = XMVectorReplicate(FLT_MAX);
+	auto scaleMax = XMVectorZero();
+
+	for (auto i = 0u; i < numBones; i += 4)
+	{
+		// Pad the last batch with identities
+		const auto n = (min)(numBones - i, 4u);
+		for (auto j = 0u; j < 4; ++j) bones[j] = j < n ? XMLoadFloat4x4(&pSrc[i + j]) : XMMatrixIdentity();
+
+		convertBones4(real, dual, scale, bones);
+
+		for (auto j = 0u; j < n; ++j)
+		{
+			XMStoreFloat4(&pDst[i + j].Real, real[j]);
+			XMStoreFloat4(&pDst[i + j].Dual, dual[j]);
+		}
+
+		const XMVECTORU32 validMask = { { { 0u, n > 1 ? 0u : ~0u, n > 2 ? 0u : ~0u, n > 3 ? 0u : ~0u } } };
+		const auto validScale = XMVectorSelect(scale, XMVectorZero(), validMask);
+		scaleSum += validScale;
+		scaleMax = XMVectorMax(scaleMax, validScale);
+		scaleMin = XMVectorMin(scaleMin, XMVectorSelect(scale, XMVectorReplicate(FLT_MAX), validMask));
+	}
+
+	XMFLOAT4 s, sMin, sMax;
+	XMStoreFloat4(&s, scaleSum);
+	XMStoreFloat4(&sMin, scaleMin);
+	XMStoreFloat4(&sMax, scaleMax);
+	const auto avgScale = (s.x + s.y + s.z + s.w) / numBones;
+
+	if (pMaxScaleError)
+	{
+		const auto minScale = (min)((min)(sMin.x, sMin.y), (min)(sMin.z, sMin.w));
+		const auto maxScale = (max)((max)(sMax.x, sMax.y), (max)(sMax.z, sMax.w));
+		*pMaxScaleError = (max)(maxScale - avgScale, avgScale - minScale);
+	}
+
+	return avgScale;
+}
+
+void DualQuatSkinning::SkinLinearBlend(XMFLOAT3* pDst, const uint8_t* pVertices,
+	uint32_t numVertices, const VertexLayout& layout, const XMFLOAT4X4* pPalette)
+{
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto pVertex = &pVertices[layout.Stride * i];
+		const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertex[layout.PositionOffset]));
+		const auto weights = &pVertex[layout.WeightsOffset];
+		const auto indices = &pVertex[layout.IndicesOffset];
+
+		auto result = XMVectorZero();
+		for (uint8_t j = 0; j < 4; ++j)
+		{
+			if (weights[j] == 0) continue;
+			const auto bone = XMLoadFloat4x4(&pPalette[indices[j]]);
+			result += XMVector3Transform(pos, bone) * (weights[j] / 255.0f);
+		}
+
+		XMStoreFloat3(&pDst[i], result);
+	}
+}
+
+void DualQuatSkinning::SkinDualQuaternion(XMFLOAT3* pDst, const uint8_t* pVertices,
+	uint32_t numVertices, const VertexLayout& layout, const DualQuaternion* pPalette, float scale)
+{
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto pVertex = &pVertices[layout.Stride * i];
+		const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertex[layout.PositionOffset]));
+		const auto pWeights = &pVertex[layout.WeightsOffset];
+		const float weights[] =
+		{
+			pWeights[0] / 255.0f,
+			pWeights[1] / 255.0f,
+			pWeights[2] / 255.0f,
+			pWeights[3] / 255.0f
+		};
+
+		XMVECTOR dual;
+		const auto real = BlendDualQuaternion(dual, pPalette, &pVertex[layout.IndicesOffset], weights);
+		XMStoreFloat3(&pDst[i], TransformPoint(real, dual, pos) * scale);
+	}
+}
+
+XMVECTOR DualQuatSkinning::BlendDualQuaternion(XMVECTOR& dual, const DualQuaternion* pPalette,
+	const uint8_t indices[4], const float weights[4])
+{
+	const auto pivot = XMLoadFloat4(&pPalette[indices[0]].Real);
+	auto real = XMVectorZero();
+	dual = XMVectorZero();
+
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		if (weights[i] <= 0.0f) continue;
+
+		// Shortest path: flip the antipodal influences to the hemisphere of the first one
+		const auto& dq = pPalette[indices[i]];
+		const auto r = XMLoadFloat4(&dq.Real);
+		const auto w = XMVectorGetX(XMQuaternionDot(pivot, r)) < 0.0f ? -weights[i] : weights[i];
+		real += r * w;
+		dual += XMLoadFloat4(&dq.Dual) * w;
+	}
+
+	const auto rcpLen = XMVectorReciprocal(XMVector4Length(real));
+	dual *= rcpLen;
+
+	return real * rcpLen;
+}
+
+XMVECTOR DualQuatSkinning::TransformPoint(FXMVECTOR real, FXMVECTOR dual, FXMVECTOR pos)
+{
+	const auto rw = XMVectorSplatW(real);
+	const auto dw = XMVectorSplatW(dual);
+
+	// Rotation: v + 2r x (r x v + w v)
+	auto result = pos + 2.0f * XMVector3Cross(real, XMVector3Cross(real, pos) + rw * pos);
+
+	// Translation: 2 (w_r d - w_d r + r x d)
+	result += 2.0f * (rw * dual - dw * real + XMVector3Cross(real, dual));
+
+	return result;
+}
+
+SkinningMode DualQuatSkinning::GetSkinningMode(const string& mode)
+{
+	return mode == "DualQuaternion" ? SkinningMode::DUAL_QUATERNION : SkinningMode::LINEAR_BLEND;
+}
+
+void DualQuatSkinning::GetSkinningModes(vector<SkinningMode>& modes, void* pSceneReader)
+{
+	auto& sceneReader = *static_cast<tiny::TinyJson*>(pSceneReader);
+	auto meshesReader = sceneReader.Get<tiny::xarray>("SkinnedMeshes");
+	const auto numMeshes = static_cast<uint32_t>(meshesReader.Count());
+
+	modes.resize(numMeshes);
+	for (auto i = 0u; i < numMeshes; ++i)
+	{
+		meshesReader.Enter(i);
+		modes[i] = GetSkinningMode(meshesReader.Get<string>("Skinning", "LinearBlend"));
+	}
+}
+
+const DualQuatSkinning::VertexLayout& DualQuatSkinning::GetDefaultVertexLayout()
+{
+	// POSITION (float3), BLENDWEIGHT (UBYTE4N), BLENDINDICES (UBYTE4), NORMAL, TEXCOORD, TANGENT
+	static const VertexLayout layout = { 40, 0, 12, 16 };
+
+	return layout;
+}
+
+void DualQuatSkinning::CompareRigid(AccuracyResult& result, uint32_t numBones,
+	uint32_t numVertices, float scale)
+{
+	result = {};
+	XUSG_N_RETURN(numBones > 0 && numBones <= 256 && numVertices > 0, );
+
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	uniform_int_distribution<uint32_t> bone(0, numBones - 1);
+	uniform_int_distribution<uint32_t> numInfluences(1, 4);
+
+	vector<XMFLOAT4X4> palette(numBones);
+	for (auto& matrix : palette)
+	{
+		const auto rotation = XMQuaternionNormalize(XMVectorSet(unit(rng), unit(rng), unit(rng), unit(rng)));
+		const auto translation = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f) * 100.0f;
+		XMStoreFloat4x4(&matrix, XMMatrixAffineTransformation(XMVectorReplicate(scale),
+			XMVectorZero(), rotation, translation));
+	}
+
+	// Split the weight of each vertex over 1 to 4 influences of the same bone
+	const auto& layout = GetDefaultVertexLayout();
+	vector<uint8_t> vertices(layout.Stride * numVertices);
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto pVertex = &vertices[layout.Stride * i];
+		const XMFLOAT3 pos(unit(rng) * 2.0f, unit(rng) * 2.0f, unit(rng) * 2.0f);
+		memcpy(&pVertex[layout.PositionOffset], &pos, sizeof(pos));
+
+		const auto boneIdx = static_cast<uint8_t>(bone(rng));
+		const auto n = numInfluences(rng);
+		auto remaining = 255u;
+		for (auto j = 0u; j < 4; ++j)
+		{
+			const auto weight = j + 1 < n ? remaining / (n - j) : (j < n ? remaining : 0u);
+			pVertex[layout.WeightsOffset + j] = static_cast<uint8_t>(weight);
+			pVertex[layout.IndicesOffset + j] = j < n ? boneIdx : 0;
+			remaining -= weight;
+		}
+	}
+
+	vector<DualQuaternion> dqPalette(numBones);
+	const auto avgScale = ConvertPalette(dqPalette.data(), palette.data(), numBones, &result.MaxScaleError);
+
+	vector<XMFLOAT3> linear(numVertices), dualQuat(numVertices);
+	SkinLinearBlend(linear.data(), vertices.data(), numVertices, layout, palette.data());
+	SkinDualQuaternion(dualQuat.data(), vertices.data(), numVertices, layout, dqPalette.data(), avgScale);
+
+	auto errorSum = 0.0;
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto error = XMVectorGetX(XMVector3Length(XMLoadFloat3(&dualQuat[i]) - XMLoadFloat3(&linear[i])));
+		result.MaxError = (max)(result.MaxError, error);
+		errorSum += error;
+	}
+	result.MeanError = static_cast<float>(errorSum / numVertices);
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Dual-quaternion skinning
+	//--------------------------------------------------------------------------------------
+	enum class SkinningMode : uint8_t
+	{
+		LINEAR_BLEND,
+		DUAL_QUATERNION
+	};
+
+	// A rigid bone transform in 8 floats, half the size of a float4x4 palette entry
+	struct DualQuaternion
+	{
+		DirectX::XMFLOAT4 Real;	// Rotation
+		DirectX::XMFLOAT4 Dual;	// 0.5 * translation * rotation
+	};
+
+	class DualQuatSkinning
+	{
+	public:
+		// Skinned vertex layout of the sdkmesh vertex streams
+		struct VertexLayout
+		{
+			uint32_t Stride;
+			uint32_t PositionOffset;	// float3
+			uint32_t WeightsOffset;		// UBYTE4N
+			uint32_t IndicesOffset;		// UBYTE4
+		};
+
+		struct AccuracyResult
+		{
+			float		MaxError;		// Of the dual-quaternion positions against linear blending
+			float		MeanError;
+			float		MaxScaleError;	// Of ConvertPalette
+		};
+
+		// Converts the bone palette (row-vector float4x4) to dual quaternions, 4 bones per
+		// SIMD iteration. Bone scale is factored out; the shipped rigs bake a uniform scale
+		// that must be reapplied after blending. Returns the average scale of the palette.
+		static float ConvertPalette(DualQuaternion* pDst, const DirectX::XMFLOAT4X4* pSrc,
+			uint32_t numBones, float* pMaxScaleError = nullptr);
+
+		// CPU reference skinning of the vertex positions
+		static void SkinLinearBlend(DirectX::XMFLOAT3* pDst, const uint8_t* pVertices,
+			uint32_t numVertices, const VertexLayout& layout, const DirectX::XMFLOAT4X4* pPalette);
+		static void SkinDualQuaternion(DirectX::XMFLOAT3* pDst, const uint8_t* pVertices,
+			uint32_t numVertices, const VertexLayout& layout, const DualQuaternion* pPalette,
+			float scale = 1.0f);
+
+		static DirectX::XMVECTOR BlendDualQuaternion(DirectX::XMVECTOR& dual, const DualQuaternion* pPalette,
+			const uint8_t indices[4], const float weights[4]);
+		static DirectX::XMVECTOR TransformPoint(DirectX::FXMVECTOR real, DirectX::FXMVECTOR dual,
+			DirectX::FXMVECTOR pos);
+
+		static SkinningMode GetSkinningMode(const std::string& mode);
+
+		// Skinning mode of each SkinnedMeshes entry of the scene: "Skinning" is "LinearBlend"
+		// (default) or "DualQuaternion".
+		static void GetSkinningModes(std::vector<SkinningMode>& modes, void* pSceneReader);
+		static const VertexLayout& GetDefaultVertexLayout();
+
+		// Skins random vertices of a rigid-only rig (every influence of a vertex on the same
+		// bone) with both methods. The bones are random rotations and translations with a
+		// uniform scale, so both methods must agree up to rounding.
+		static void CompareRigid(AccuracyResult& result, uint32_t numBones = 64,
+			uint32_t numVertices = 10000, float scale = 1.0f);
+	};
+}
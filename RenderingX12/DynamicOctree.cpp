@@ -0,0 +1,403 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "DynamicOctree.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+DynamicOctree::DynamicOctree() :
+	m_nodes(0),
+	m_freeNodes(0),
+	m_entries(0),
+	m_freeEntries(0),
+	m_emptyNodes(0),
+	m_center(0.0f, 0.0f, 0.0f),
+	m_diameter(1.0f),
+	m_looseCoeff(1.0f),
+	m_firstOutlier(NULL_INDEX),
+	m_maxDepth(8),
+	m_isUpdating(false),
+	m_stats()
+{
+}
+
+DynamicOctree::~DynamicOctree()
+{
+}
+
+void DynamicOctree::Init(const XMFLOAT3& center, float diameter, float looseCoeff, uint8_t maxDepth)
+{
+	m_center = center;
+	m_diameter = diameter;
+	m_looseCoeff = looseCoeff;
+	m_maxDepth = (min)(maxDepth, LinearOctree::MAX_DEPTH);
+
+	m_nodes.clear();
+	m_freeNodes.clear();
+	m_entries.clear();
+	m_freeEntries.clear();
+	m_emptyNodes.clear();
+	m_firstOutlier = NULL_INDEX;
+	m_stats = {};
+
+	allocateNode(NULL_INDEX, 0);
+}
+
+uint32_t DynamicOctree::Insert(const XMUINT2& meshID, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	uint32_t handle;
+	if (m_freeEntries.empty())
+	{
+		handle = static_cast<uint32_t>(m_entries.size());
+		m_entries.emplace_back();
+	}
+	else
+	{
+		handle = m_freeEntries.back();
+		m_freeEntries.pop_back();
+	}
+
+	auto& entry = m_entries[handle];
+	entry.MeshID = meshID;
+	entry.Center = center;
+	entry.Extents = extents;
+	link(handle, findNode(center, extents));
+	++m_stats.NumEntries;
+
+	return handle;
+}
+
+void DynamicOctree::Insert(uint32_t* pHandles, const LinearOctree::Item* pItems, uint32_t numItems)
+{
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		const auto handle = Insert(pItems[i].MeshID, pItems[i].Center, pItems[i].Extents);
+		if (pHandles) pHandles[i] = handle;
+	}
+}
+
+void DynamicOctree::Insert(uint32_t* pHandles, uint32_t numModels, const StaticModel::sptr* pModels,
+	SubsetFlags subsetFlags)
+{
+	vector<LinearOctree::Item> items;
+	LinearOctree::GetItems(items, numModels, pModels, subsetFlags);
+	Insert(pHandles, items.data(), static_cast<uint32_t>(items.size()));
+}
+
+void DynamicOctree::Remove(uint32_t handle)
+{
+	assert(handle < m_entries.size());
+	const auto node = m_entries[handle].Node;
+	unlink(handle);
+	m_freeEntries.push_back(handle);
+	--m_stats.NumEntries;
+
+	if (node != NULL_INDEX)
+	{
+		if (m_isUpdating) m_emptyNodes.push_back(node);
+		else prune(node);
+	}
+}
+
+void DynamicOctree::Move(uint32_t handle, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	assert(handle < m_entries.size());
+	auto& entry = m_entries[handle];
+	entry.Center = center;
+	entry.Extents = extents;
+	++m_stats.NumMoves;
+
+	// Still within the loose bound of its node
+	const auto node = entry.Node;
+	if (node != NULL_INDEX)
+	{
+		const auto& nodeCenter = m_nodes[node].Center;
+		const auto looseExtent = m_nodes[node].LooseExtent;
+		if (fabsf(center.x - nodeCenter.x) + extents.x <= looseExtent &&
+			fabsf(center.y - nodeCenter.y) + extents.y <= looseExtent &&
+			fabsf(center.z - nodeCenter.z) + extents.z <= looseExtent)
+			return;
+	}
+
+	const auto newNode = findNode(center, extents);
+	if (newNode == node) return;
+
+	unlink(handle);
+	link(handle, newNode);
+	++m_stats.NumRelinks;
+
+	if (node != NULL_INDEX)
+	{
+		if (m_isUpdating) m_emptyNodes.push_back(node);
+		else prune(node);
+	}
+}
+
+void DynamicOctree::Update(const Movement* pMovements, uint32_t numMovements)
+{
+	m_isUpdating = true;
+	for (auto i = 0u; i < numMovements; ++i)
+		Move(pMovements[i].Handle, pMovements[i].Center, pMovements[i].Extents);
+	m_isUpdating = false;
+
+	for (const auto node : m_emptyNodes) prune(node);
+	m_emptyNodes.clear();
+}
+
+void DynamicOctree::Sort(vector<XMUINT2>& meshIDQueue, CXMMATRIX viewProj, FXMVECTOR eyePt, bool isNearToFar) const
+{
+	FrustumCulling::Frustum frustum;
+	FrustumCulling::GetFrustum(frustum, viewProj);
+
+	vector<uint32_t> entries;
+	const auto addEntries = [&](uint32_t firstEntry, uint8_t planeMask)
+	{
+		for (auto i = firstEntry; i != NULL_INDEX; i = m_entries[i].Next)
+		{
+			const auto& entry = m_entries[i];
+			if (!planeMask || FrustumCulling::ClassifyBox(entry.Center, entry.Extents, frustum, planeMask) !=
+				OctNode::VISIBILITY_OUTSIDE)
+				entries.push_back(i);
+		}
+	};
+
+	addEntries(m_firstOutlier, FrustumCulling::ALL_PLANES);
+
+	vector<pair<uint32_t, uint8_t>> stack;	// Node, planes of the parent
+	if (!m_nodes.empty()) stack.emplace_back(0, FrustumCulling::ALL_PLANES);
+	while (!stack.empty())
+	{
+		const auto nodeIdx = stack.back().first;
+		const auto planeMask = stack.back().second;
+		stack.pop_back();
+
+		const auto& node = m_nodes[nodeIdx];
+		uint8_t childPlaneMask;
+		const auto looseExtents = XMFLOAT3(node.LooseExtent, node.LooseExtent, node.LooseExtent);
+		if (FrustumCulling::ClassifyBox(node.Center, looseExtents, frustum, planeMask, &childPlaneMask) ==
+			OctNode::VISIBILITY_OUTSIDE) continue;
+
+		addEntries(node.FirstEntry, childPlaneMask);
+		for (const auto child : node.Children)
+			if (child != NULL_INDEX) stack.emplace_back(child, childPlaneMask);
+	}
+
+	// Ties in distance fall back to the handles, as in LinearOctree::Sort to the items.
+	vector<pair<float, uint32_t>> order(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const auto distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&m_entries[entries[i]].Center) - eyePt));
+		order[i] = make_pair(isNearToFar ? distSq : -distSq, entries[i]);
+	}
+	sort(order.begin(), order.end());
+
+	for (const auto& entry : order) meshIDQueue.push_back(m_entries[entry.second].MeshID);
+}
+
+void DynamicOctree::Benchmark(BenchmarkResult& result, uint32_t numMovingObjects, uint32_t numStaticObjects,
+	uint32_t numFrames, float looseCoeff)
+{
+	result = {};
+	XUSG_N_RETURN(numMovingObjects > 0 && numFrames > 0, );
+
+	const auto halfSize = 2000.0f;
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> position(-halfSize, halfSize);
+	uniform_real_distribution<float> size(0.5f, 5.0f);
+	uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+	const auto numObjects = numMovingObjects + numStaticObjects;
+	vector<LinearOctree::Item> items(numObjects);
+	for (auto i = 0u; i < numObjects; ++i)
+	{
+		auto& item = items[i];
+		item.MeshID = XMUINT2(i, 0);
+		item.Center = XMFLOAT3(position(rng), size(rng) * 4.0f, position(rng));
+		const auto extent = size(rng);
+		item.Extents = XMFLOAT3(extent, extent, extent);
+	}
+
+	DynamicOctree tree;
+	tree.Init(XMFLOAT3(0.0f, 0.0f, 0.0f), halfSize * 2.2f, looseCoeff);
+	vector<uint32_t> handles(numObjects);
+	tree.Insert(handles.data(), items.data(), numObjects);
+
+	// Random walks of up to 3 units per frame, in the scale of a running character
+	vector<XMFLOAT3> velocities(numMovingObjects);
+	for (auto& velocity : velocities) velocity = XMFLOAT3(direction(rng) * 3.0f, 0.0f, direction(rng) * 3.0f);
+
+	vector<Movement> movements(numMovingObjects);
+	vector<XMUINT2> queue;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 3000.0f);
+	chrono::duration<double, milli> updateTime(0.0), sortTime(0.0);
+	for (auto n = 0u; n < numFrames; ++n)
+	{
+		for (auto i = 0u; i < numMovingObjects; ++i)
+		{
+			auto& item = items[i];
+			auto& velocity = velocities[i];
+			if (fabsf(item.Center.x + velocity.x) > halfSize) velocity.x = -velocity.x;
+			if (fabsf(item.Center.z + velocity.z) > halfSize) velocity.z = -velocity.z;
+			item.Center.x += velocity.x;
+			item.Center.z += velocity.z;
+			movements[i] = { handles[i], item.Center, item.Extents };
+		}
+
+		auto start = chrono::high_resolution_clock::now();
+		tree.Update(movements.data(), numMovingObjects);
+		updateTime += chrono::high_resolution_clock::now() - start;
+
+		const auto angle = XM_2PI * n / numFrames;
+		const auto eyePt = XMVectorSet(cosf(angle) * halfSize * 0.5f, 50.0f, sinf(angle) * halfSize * 0.5f, 0.0f);
+		const auto viewProj = XMMatrixLookAtLH(eyePt, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+		start = chrono::high_resolution_clock::now();
+		queue.clear();
+		tree.Sort(queue, viewProj, eyePt, true);
+		sortTime += chrono::high_resolution_clock::now() - start;
+	}
+
+	const auto start = chrono::high_resolution_clock::now();
+	LinearOctree rebuiltTree;
+	rebuiltTree.Init(XMFLOAT3(0.0f, 0.0f, 0.0f), halfSize * 2.2f, looseCoeff);
+	rebuiltTree.CreateTree(items.data(), numObjects);
+	const chrono::duration<double, milli> rebuildTime = chrono::high_resolution_clock::now() - start;
+
+	const auto& stats = tree.GetStats();
+	result.MovesPerSecond = stats.NumMoves / (updateTime.count() * 1.0e-3);
+	result.RelinkRatio = static_cast<double>(stats.NumRelinks) / stats.NumMoves;
+	result.UpdateMilliseconds = updateTime.count() / numFrames;
+	result.SortMilliseconds = sortTime.count() / numFrames;
+	result.RebuildMilliseconds = rebuildTime.count();
+}
+
+uint32_t DynamicOctree::findNode(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	// Outside the loose bound of the root
+	const auto rootExtent = (1.0f + m_looseCoeff) * m_diameter * 0.5f;
+	if (fabsf(center.x - m_center.x) + extents.x > rootExtent ||
+		fabsf(center.y - m_center.y) + extents.y > rootExtent ||
+		fabsf(center.z - m_center.z) + extents.z > rootExtent)
+		return NULL_INDEX;
+
+	// Deepest level where the loose cell of the center holds the extents, as in LinearOctree
+	const auto maxExtent = (max)((max)(extents.x, extents.y), extents.z);
+	uint8_t level = m_maxDepth;
+	while (level > 0 && maxExtent > m_looseCoeff * 0.5f * m_diameter / (1u << level)) --level;
+
+	// A center outside the root cell is only held by the root.
+	const auto halfDiameter = m_diameter * 0.5f;
+	if (fabsf(center.x - m_center.x) >= halfDiameter || fabsf(center.y - m_center.y) >= halfDiameter ||
+		fabsf(center.z - m_center.z) >= halfDiameter) level = 0;
+
+	const auto numCells = static_cast<float>(1u << level);
+	const auto toCell = [&](float x, float rootCenter)
+	{
+		return (min)(static_cast<uint32_t>((max)((x - rootCenter + halfDiameter) / m_diameter * numCells, 0.0f)), (1u << level) - 1);
+	};
+	const uint32_t cell[] = { toCell(center.x, m_center.x), toCell(center.y, m_center.y), toCell(center.z, m_center.z) };
+
+	auto node = 0u;
+	for (uint8_t l = 1; l <= level; ++l)
+	{
+		const auto shift = level - l;
+		const auto octant = static_cast<uint8_t>(((cell[0] >> shift) & 1) | (((cell[1] >> shift) & 1) << 1) |
+			(((cell[2] >> shift) & 1) << 2));
+		auto child = m_nodes[node].Children[octant];
+		if (child == NULL_INDEX) child = allocateNode(node, octant);
+		node = child;
+	}
+
+	return node;
+}
+
+uint32_t DynamicOctree::allocateNode(uint32_t parent, uint8_t octant)
+{
+	uint32_t nodeIdx;
+	if (m_freeNodes.empty())
+	{
+		nodeIdx = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+	else
+	{
+		nodeIdx = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+
+	auto& node = m_nodes[nodeIdx];
+	fill(node.Children, node.Children + 8, NULL_INDEX);
+	node.Parent = parent;
+	node.FirstEntry = NULL_INDEX;
+	node.NumEntries = 0;
+	node.NumChildren = 0;
+	node.Octant = octant;
+
+	if (parent == NULL_INDEX)
+	{
+		node.Center = m_center;
+		node.LooseExtent = (1.0f + m_looseCoeff) * m_diameter * 0.5f;
+	}
+	else
+	{
+		auto& parentNode = m_nodes[parent];
+		const auto offset = parentNode.LooseExtent / (1.0f + m_looseCoeff) * 0.5f;
+		node.Center = XMFLOAT3(parentNode.Center.x + (octant & 1 ? offset : -offset),
+			parentNode.Center.y + (octant & 2 ? offset : -offset), parentNode.Center.z + (octant & 4 ? offset : -offset));
+		node.LooseExtent = parentNode.LooseExtent * 0.5f;
+		parentNode.Children[octant] = nodeIdx;
+		++parentNode.NumChildren;
+	}
+
+	m_stats.NumNodes = static_cast<uint32_t>(m_nodes.size() - m_freeNodes.size());
+	m_stats.NumFreeNodes = static_cast<uint32_t>(m_freeNodes.size());
+
+	return nodeIdx;
+}
+
+void DynamicOctree::link(uint32_t handle, uint32_t node)
+{
+	auto& entry = m_entries[handle];
+	auto& firstEntry = getFirstEntry(node);
+	entry.Node = node;
+	entry.Prev = NULL_INDEX;
+	entry.Next = firstEntry;
+	if (firstEntry != NULL_INDEX) m_entries[firstEntry].Prev = handle;
+	firstEntry = handle;
+
+	if (node != NULL_INDEX) ++m_nodes[node].NumEntries;
+	else ++m_stats.NumOutliers;
+}
+
+void DynamicOctree::unlink(uint32_t handle)
+{
+	const auto& entry = m_entries[handle];
+	if (entry.Prev != NULL_INDEX) m_entries[entry.Prev].Next = entry.Next;
+	else getFirstEntry(entry.Node) = entry.Next;
+	if (entry.Next != NULL_INDEX) m_entries[entry.Next].Prev = entry.Prev;
+
+	if (entry.Node != NULL_INDEX) --m_nodes[entry.Node].NumEntries;
+	else --m_stats.NumOutliers;
+}
+
+void DynamicOctree::prune(uint32_t node)
+{
+	// Release empty leaves up to the root, which stays
+	while (node != 0 && node != NULL_INDEX && m_nodes[node].Parent != NULL_INDEX &&
+		m_nodes[node].NumEntries == 0 && m_nodes[node].NumChildren == 0)
+	{
+		const auto parent = m_nodes[node].Parent;
+		m_nodes[parent].Children[m_nodes[node].Octant] = NULL_INDEX;
+		--m_nodes[parent].NumChildren;
+		m_nodes[node].Parent = NULL_INDEX;
+		m_freeNodes.push_back(node);
+		node = parent;
+	}
+
+	m_stats.NumNodes = static_cast<uint32_t>(m_nodes.size() - m_freeNodes.size());
+	m_stats.NumFreeNodes = static_cast<uint32_t>(m_freeNodes.size());
+}
@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "LinearOctree.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Loose octree of movable entries. Nodes and entries live in pools with free lists and
+	// refer to each other by index; a move that stays within the loose bound of its node only
+	// updates the bound of the entry.
+	//--------------------------------------------------------------------------------------
+	class DynamicOctree
+	{
+	public:
+		static const uint32_t NULL_INDEX = UINT32_MAX;
+
+		struct Movement
+		{
+			uint32_t Handle;
+			DirectX::XMFLOAT3 Center;
+			DirectX::XMFLOAT3 Extents;
+		};
+
+		struct Stats
+		{
+			uint32_t NumNodes;
+			uint32_t NumFreeNodes;		// Pooled for reuse
+			uint32_t NumEntries;
+			uint32_t NumOutliers;		// Entries beyond the loose bound of the root
+			uint64_t NumMoves;			// Since Init
+			uint64_t NumRelinks;		// Moves that changed the node
+		};
+
+		struct BenchmarkResult
+		{
+			double		MovesPerSecond;
+			double		RelinkRatio;			// Of the moves
+			double		UpdateMilliseconds;		// Per frame
+			double		SortMilliseconds;
+			double		RebuildMilliseconds;	// LinearOctree::CreateTree of the same entries
+		};
+
+		DynamicOctree();
+		virtual ~DynamicOctree();
+
+		// Same cells and loose coefficient as LinearOctree::Init
+		void Init(const DirectX::XMFLOAT3& center, float diameter, float looseCoeff = 1.0f, uint8_t maxDepth = 8);
+
+		// Returns the handle of the entry.
+		uint32_t Insert(const DirectX::XMUINT2& meshID, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+		void Insert(uint32_t* pHandles, const LinearOctree::Item* pItems, uint32_t numItems);
+		void Insert(uint32_t* pHandles, uint32_t numModels, const StaticModel::sptr* pModels, SubsetFlags subsetFlags);
+		void Remove(uint32_t handle);
+		void Move(uint32_t handle, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+
+		// Moves many entries, releasing the nodes left empty once at the end.
+		void Update(const Movement* pMovements, uint32_t numMovements);
+
+		// Appends the meshes in the frustum, sorted as LinearOctree::Sort does
+		void Sort(std::vector<DirectX::XMUINT2>& meshIDQueue, DirectX::CXMMATRIX viewProj,
+			DirectX::FXMVECTOR eyePt, bool isNearToFar) const;
+
+		const Stats& GetStats() const { return m_stats; }
+
+		// 10k objects on random walks among static ones, moved every frame, with the loose
+		// coefficient of the scenes
+		static void Benchmark(BenchmarkResult& result, uint32_t numMovingObjects = 10000,
+			uint32_t numStaticObjects = 90000, uint32_t numFrames = 64, float looseCoeff = 0.97f);
+
+		using uptr = std::unique_ptr<DynamicOctree>;
+		using sptr = std::shared_ptr<DynamicOctree>;
+
+	protected:
+		struct Node
+		{
+			uint32_t	Children[8];
+			uint32_t	Parent;
+			uint32_t	FirstEntry;
+			uint32_t	NumEntries;
+			uint8_t		NumChildren;
+			uint8_t		Octant;			// In the parent
+			DirectX::XMFLOAT3 Center;
+			float		LooseExtent;
+		};
+
+		struct Entry
+		{
+			uint32_t	Node;			// NULL_INDEX for outliers
+			uint32_t	Prev;
+			uint32_t	Next;
+			DirectX::XMUINT2 MeshID;
+			DirectX::XMFLOAT3 Center;
+			DirectX::XMFLOAT3 Extents;
+		};
+
+		uint32_t findNode(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+		uint32_t allocateNode(uint32_t parent, uint8_t octant);
+		void link(uint32_t handle, uint32_t node);
+		void unlink(uint32_t handle);
+		void prune(uint32_t node);
+
+		uint32_t& getFirstEntry(uint32_t node) { return node == NULL_INDEX ? m_firstOutlier : m_nodes[node].FirstEntry; }
+
+		std::vector<Node>		m_nodes;
+		std::vector<uint32_t>	m_freeNodes;
+		std::vector<Entry>		m_entries;
+		std::vector<uint32_t>	m_freeEntries;
+		std::vector<uint32_t>	m_emptyNodes;	// To prune at the end of Update
+
+		DirectX::XMFLOAT3		m_center;
+		float					m_diameter;
+		float					m_looseCoeff;
+		uint32_t				m_firstOutlier;
+		uint8_t					m_maxDepth;
+		bool					m_isUpdating;
+		Stats					m_stats;
+	};
+}
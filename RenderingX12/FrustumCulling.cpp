@@ -0,0 +1,290 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include <immintrin.h>
+#include "FrustumCulling.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+#if defined(__AVX2__)
+	const uint32_t SIMD_WIDTH = 8;
+	using vfloat = __m256;
+
+	inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+	inline vfloat splat(float f) { return _mm256_set1_ps(f); }
+	inline vfloat madd(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+	inline uint32_t lessZero(vfloat a) { return _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ)); }
+#else
+	const uint32_t SIMD_WIDTH = 4;
+	using vfloat = __m128;
+
+	inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+	inline vfloat splat(float f) { return _mm_set1_ps(f); }
+	inline vfloat madd(vfloat a, vfloat b, vfloat c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a); }
+	inline uint32_t lessZero(vfloat a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+#endif
+
+	const uint32_t ALL_LANES = (1u << SIMD_WIDTH) - 1;
+}
+
+void FrustumCulling::Boxes::Resize(uint32_t numBoxes)
+{
+	for (auto components : { &CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ })
+		components->resize(numBoxes);
+}
+
+void FrustumCulling::Boxes::Set(uint32_t i, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	CenterX[i] = center.x;
+	CenterY[i] = center.y;
+	CenterZ[i] = center.z;
+	ExtentX[i] = extents.x;
+	ExtentY[i] = extents.y;
+	ExtentZ[i] = extents.z;
+}
+
+void FrustumCulling::Boxes::Get(uint32_t i, XMFLOAT3& center, XMFLOAT3& extents) const
+{
+	center = XMFLOAT3(CenterX[i], CenterY[i], CenterZ[i]);
+	extents = XMFLOAT3(ExtentX[i], ExtentY[i], ExtentZ[i]);
+}
+
+void FrustumCulling::GetFrustum(Frustum& frustum, FXMMATRIX viewProj)
+{
+	// Gribb-Hartmann on the columns of a row-vector matrix, with z in [0, 1]
+	const auto m = XMMatrixTranspose(viewProj);
+	XMStoreFloat4(&frustum.Planes[0], m.r[3] + m.r[0]);	// Left
+	XMStoreFloat4(&frustum.Planes[1], m.r[3] - m.r[0]);	// Right
+	XMStoreFloat4(&frustum.Planes[2], m.r[3] + m.r[1]);	// Bottom
+	XMStoreFloat4(&frustum.Planes[3], m.r[3] - m.r[1]);	// Top
+	XMStoreFloat4(&frustum.Planes[4], m.r[2]);			// Near
+	XMStoreFloat4(&frustum.Planes[5], m.r[3] - m.r[2]);	// Far
+	frustum.Contribution = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void FrustumCulling::SetContribution(Frustum& frustum, FXMMATRIX viewProj, const XMFLOAT2& targetSize, float minPixels)
+{
+	// A sphere of radius r at clip w covers about 2rs / w pixels across, s being the larger
+	// scale from world units to pixels of clip x and y, so it is too small where
+	// r < minPixels * w / 2s, w being linear in the position for perspective and orthographic
+	// projections alike.
+	const auto m = XMMatrixTranspose(viewProj);
+	const auto scaleX = XMVectorGetX(XMVector3Length(m.r[0])) * targetSize.x * 0.5f;
+	const auto scaleY = XMVectorGetX(XMVector3Length(m.r[1])) * targetSize.y * 0.5f;
+	const auto scale = (max)(scaleX, scaleY);
+	if (minPixels > 0.0f && scale > 0.0f)
+		XMStoreFloat4(&frustum.Contribution, m.r[3] * (-0.5f * minPixels / scale));
+	else frustum.Contribution = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+uint8_t FrustumCulling::GetPlaneMask(const Frustum& frustum)
+{
+	const auto& plane = frustum.Contribution;
+	const auto hasContribution = plane.x != 0.0f || plane.y != 0.0f || plane.z != 0.0f || plane.w != 0.0f;
+
+	return hasContribution ? ALL_PLANES | CONTRIBUTION_PLANE : ALL_PLANES;
+}
+
+uint32_t FrustumCulling::Classify(OctNode::Visibility* pVisibilities, const Boxes& boxes, uint32_t first,
+	uint32_t count, const Frustum& frustum, uint8_t planeMask, uint8_t* pPlaneMasks)
+{
+	assert(first + count <= boxes.GetCount());
+
+	// Plane components splatted once; only the planes in the mask are tested.
+	uint8_t planes[6];
+	uint8_t numPlanes = 0;
+	vfloat a[6], b[6], c[6], d[6], absA[6], absB[6], absC[6];
+	for (uint8_t p = 0; p < 6; ++p)
+	{
+		if (!(planeMask & (1 << p))) continue;
+		const auto& plane = frustum.Planes[p];
+		planes[numPlanes] = p;
+		a[numPlanes] = splat(plane.x);
+		b[numPlanes] = splat(plane.y);
+		c[numPlanes] = splat(plane.z);
+		d[numPlanes] = splat(plane.w);
+		absA[numPlanes] = splat(fabsf(plane.x));
+		absB[numPlanes] = splat(fabsf(plane.y));
+		absC[numPlanes] = splat(fabsf(plane.z));
+		++numPlanes;
+	}
+
+	const auto hasContribution = (planeMask & CONTRIBUTION_PLANE) != 0;
+	const auto& contribution = frustum.Contribution;
+	const auto qa = splat(contribution.x);
+	const auto qb = splat(contribution.y);
+	const auto qc = splat(contribution.z);
+	const auto qd = splat(contribution.w);
+	const auto absQa = splat(fabsf(contribution.x));
+	const auto absQb = splat(fabsf(contribution.y));
+	const auto absQc = splat(fabsf(contribution.z));
+
+	auto numVisible = 0u;
+	const auto last = first + count;
+	auto i = first;
+	for (; i + SIMD_WIDTH <= last; i += SIMD_WIDTH)
+	{
+		const auto cx = load(&boxes.CenterX[i]);
+		const auto cy = load(&boxes.CenterY[i]);
+		const auto cz = load(&boxes.CenterZ[i]);
+		const auto ex = load(&boxes.ExtentX[i]);
+		const auto ey = load(&boxes.ExtentY[i]);
+		const auto ez = load(&boxes.ExtentZ[i]);
+
+		// Per plane, a box is outside if even its nearest corner is behind, and straddles it if
+		// its farthest corner is behind.
+		uint32_t outside = 0;
+		uint32_t straddles[6];
+		for (uint8_t j = 0; j < numPlanes && outside != ALL_LANES; ++j)
+		{
+			const auto dist = madd(a[j], cx, madd(b[j], cy, madd(c[j], cz, d[j])));
+			const auto radius = madd(absA[j], ex, madd(absB[j], ey, mul(absC[j], ez)));
+			outside |= lessZero(add(dist, radius));
+			straddles[j] = lessZero(sub(dist, radius));
+		}
+
+		// Boxes in the frustum whose bounding spheres are too small even at their nearest corner
+		uint32_t small = 0;
+		uint32_t straddlesContribution = 0;
+		if (hasContribution && outside != ALL_LANES)
+		{
+			const auto sphere = vsqrt(madd(ex, ex, madd(ey, ey, mul(ez, ez))));
+			const auto dist = add(madd(qa, cx, madd(qb, cy, madd(qc, cz, qd))), sphere);
+			const auto radius = madd(absQa, ex, madd(absQb, ey, mul(absQc, ez)));
+			small = lessZero(add(dist, radius)) & ~outside;
+			straddlesContribution = lessZero(sub(dist, radius));
+		}
+
+		for (auto k = 0u; k < SIMD_WIDTH; ++k)
+		{
+			uint8_t mask = 0;
+			const auto isSmall = (small >> k) & 1;
+			const auto isOutside = ((outside >> k) & 1) | isSmall;
+			if (isSmall) mask = CONTRIBUTION_PLANE;
+			else if (!isOutside)
+			{
+				for (uint8_t j = 0; j < numPlanes; ++j)
+					mask |= ((straddles[j] >> k) & 1) << planes[j];
+				if ((straddlesContribution >> k) & 1) mask |= CONTRIBUTION_PLANE;
+			}
+
+			pVisibilities[i + k - first] = isOutside ? OctNode::VISIBILITY_OUTSIDE :
+				(mask ? OctNode::VISIBILITY_INTERSECT : OctNode::VISIBILITY_INSIDE);
+			if (pPlaneMasks) pPlaneMasks[i + k - first] = mask;
+			numVisible += isOutside ^ 1;
+		}
+	}
+
+	// Remainder
+	const auto offset = i - first;
+	numVisible += ClassifyScalar(&pVisibilities[offset], boxes, i, last - i, frustum,
+		planeMask, pPlaneMasks ? &pPlaneMasks[offset] : nullptr);
+
+	return numVisible;
+}
+
+uint32_t FrustumCulling::ClassifyScalar(OctNode::Visibility* pVisibilities, const Boxes& boxes, uint32_t first,
+	uint32_t count, const Frustum& frustum, uint8_t planeMask, uint8_t* pPlaneMasks)
+{
+	assert(first + count <= boxes.GetCount());
+
+	auto numVisible = 0u;
+	for (auto i = 0u; i < count; ++i)
+	{
+		XMFLOAT3 center, extents;
+		boxes.Get(first + i, center, extents);
+		pVisibilities[i] = ClassifyBox(center, extents, frustum, planeMask, pPlaneMasks ? &pPlaneMasks[i] : nullptr);
+		if (pVisibilities[i] != OctNode::VISIBILITY_OUTSIDE) ++numVisible;
+	}
+
+	return numVisible;
+}
+
+OctNode::Visibility FrustumCulling::ClassifyBox(const XMFLOAT3& center, const XMFLOAT3& extents,
+	const Frustum& frustum, uint8_t planeMask, uint8_t* pPlaneMask, const XMFLOAT2* pRadii)
+{
+	uint8_t mask = 0;
+	for (uint8_t p = 0; p < 6; ++p)
+	{
+		if (!(planeMask & (1 << p))) continue;
+
+		const auto& plane = frustum.Planes[p];
+		const auto dist = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		const auto radius = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (dist + radius < 0.0f)
+		{
+			if (pPlaneMask) *pPlaneMask = 0;
+
+			return OctNode::VISIBILITY_OUTSIDE;
+		}
+
+		if (dist - radius < 0.0f) mask |= 1 << p;
+	}
+
+	if (planeMask & CONTRIBUTION_PLANE)
+	{
+		const auto& plane = frustum.Contribution;
+		const auto dist = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		const auto radius = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		const auto sphere = sqrtf(extents.x * extents.x + extents.y * extents.y + extents.z * extents.z);
+		const auto radii = pRadii ? *pRadii : XMFLOAT2(sphere, sphere);
+		if (dist + radius + radii.y < 0.0f)
+		{
+			if (pPlaneMask) *pPlaneMask = CONTRIBUTION_PLANE;
+
+			return OctNode::VISIBILITY_OUTSIDE;
+		}
+
+		if (dist - radius + radii.x < 0.0f) mask |= CONTRIBUTION_PLANE;
+	}
+
+	if (pPlaneMask) *pPlaneMask = mask;
+
+	return mask ? OctNode::VISIBILITY_INTERSECT : OctNode::VISIBILITY_INSIDE;
+}
+
+double FrustumCulling::Benchmark(bool isSIMD, uint32_t numBoxes, uint32_t numIterations)
+{
+	XUSG_N_RETURN(numBoxes > 0 && numIterations > 0, 0.0);
+
+	// Boxes scattered around a camera at the origin looking down +z
+	Boxes boxes;
+	boxes.Resize(numBoxes);
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> position(-500.0f, 500.0f);
+	uniform_real_distribution<float> size(0.5f, 5.0f);
+	for (auto i = 0u; i < numBoxes; ++i)
+		boxes.Set(i, XMFLOAT3(position(rng), position(rng), position(rng)), XMFLOAT3(size(rng), size(rng), size(rng)));
+
+	const auto view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PI / 3.0f, 16.0f / 9.0f, 1.0f, 1000.0f);
+	Frustum frustum;
+	GetFrustum(frustum, view * proj);
+
+	vector<OctNode::Visibility> visibilities(numBoxes);
+	vector<uint8_t> planeMasks(numBoxes);
+	const auto classify = isSIMD ? Classify : ClassifyScalar;
+	auto numVisible = classify(visibilities.data(), boxes, 0, numBoxes, frustum, ALL_PLANES, planeMasks.data());
+
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < numIterations; ++i)
+		numVisible += classify(visibilities.data(), boxes, 0, numBoxes, frustum, ALL_PLANES, planeMasks.data());
+	const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	return numVisible > 0 ? static_cast<double>(numBoxes) * numIterations / (seconds * 1.0e6) : 0.0;
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Frustum classification of axis-aligned boxes stored as structure of arrays, 8 boxes
+	// per AVX2 instruction (4 with SSE only) against each frustum plane
+	//--------------------------------------------------------------------------------------
+	class FrustumCulling
+	{
+	public:
+		static const uint8_t ALL_PLANES = 0x3f;
+		static const uint8_t CONTRIBUTION_PLANE = 0x40;	// Screen-space size, in plane masks
+		static const uint8_t MAX_FRUSTA = 8;
+
+		struct Boxes
+		{
+			std::vector<float> CenterX;
+			std::vector<float> CenterY;
+			std::vector<float> CenterZ;
+			std::vector<float> ExtentX;
+			std::vector<float> ExtentY;
+			std::vector<float> ExtentZ;
+
+			void Resize(uint32_t numBoxes);
+			void Set(uint32_t i, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+			void Get(uint32_t i, DirectX::XMFLOAT3& center, DirectX::XMFLOAT3& extents) const;
+			uint32_t GetCount() const { return static_cast<uint32_t>(CenterX.size()); }
+		};
+
+		// Plane i as (a, b, c, d), inside where ax + by + cz + d >= 0. The contribution plane
+		// instead culls a bounding sphere of radius r where r + ax + by + cz + d < 0, at every
+		// corner of the box holding it; it is all zero unless set by SetContribution.
+		struct Frustum
+		{
+			DirectX::XMFLOAT4 Planes[6];
+			DirectX::XMFLOAT4 Contribution;
+		};
+
+		static void GetFrustum(Frustum& frustum, DirectX::FXMMATRIX viewProj);
+
+		// Boxes whose bounding spheres cover fewer than minPixels pixels across, in a render
+		// target of targetSize, are culled by the contribution plane; 0 clears it.
+		static void SetContribution(Frustum& frustum, DirectX::FXMMATRIX viewProj,
+			const DirectX::XMFLOAT2& targetSize, float minPixels);
+
+		// ALL_PLANES, with CONTRIBUTION_PLANE if set
+		static uint8_t GetPlaneMask(const Frustum& frustum);
+
+		// Classifies boxes [first, first + count) against the planes in planeMask, as OctNode
+		// does for its nodes. pPlaneMasks, if given, receives the planes each box straddles, so
+		// that the children of a box only test those; INSIDE boxes get 0 and need no further
+		// tests. Boxes OUTSIDE of the contribution plane only get CONTRIBUTION_PLANE, others 0.
+		// Returns the number of boxes not OUTSIDE.
+		static uint32_t Classify(OctNode::Visibility* pVisibilities, const Boxes& boxes, uint32_t first,
+			uint32_t count, const Frustum& frustum, uint8_t planeMask = ALL_PLANES, uint8_t* pPlaneMasks = nullptr);
+
+		// One box at a time; the reference for the SIMD path
+		static uint32_t ClassifyScalar(OctNode::Visibility* pVisibilities, const Boxes& boxes, uint32_t first,
+			uint32_t count, const Frustum& frustum, uint8_t planeMask = ALL_PLANES, uint8_t* pPlaneMasks = nullptr);
+		// pRadii, if given, has the smallest and the largest bounding sphere radius of what the
+		// box holds, so that a node is inside the contribution plane if even its smallest item
+		// is large enough at the farthest corner; the sphere of the box itself by default.
+		static OctNode::Visibility ClassifyBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+			const Frustum& frustum, uint8_t planeMask = ALL_PLANES, uint8_t* pPlaneMask = nullptr,
+			const DirectX::XMFLOAT2* pRadii = nullptr);
+
+		// Classifies random boxes around a camera and returns the throughput in boxes per microsecond
+		static double Benchmark(bool isSIMD, uint32_t numBoxes = 100000, uint32_t numIterations = 64);
+	};
+}
@@ -0,0 +1,671 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include "ScenePreflight.h"
+#include "LinearOctree.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// Spreads the low 10 bits of v to every third bit
+	uint32_t spreadBits(uint32_t v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+
+		return v;
+	}
+
+	uint32_t getMortonCode(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+	}
+
+	// Meshes all in the frustum still take the contribution test.
+	uint8_t getPlaneMask(const FrustumCulling::Frustum& frustum, bool isAllVisible)
+	{
+		const auto planeMask = FrustumCulling::GetPlaneMask(frustum);
+
+		return isAllVisible ? planeMask & FrustumCulling::CONTRIBUTION_PLANE : planeMask;
+	}
+
+	// Reference layout for the benchmark: children allocated one at a time and traversed
+	// recursively through virtual calls, as OctNode does
+	class PointerNode
+	{
+	public:
+		virtual ~PointerNode() {}
+
+		virtual void Traverse(vector<uint32_t>& items, const FrustumCulling::Frustum& frustum,
+			const FrustumCulling::Boxes& itemBounds, uint8_t planeMask) const
+		{
+			uint8_t childPlaneMask;
+			const auto visibility = FrustumCulling::ClassifyBox(Center, Extents, frustum, planeMask, &childPlaneMask);
+			if (visibility == OctNode::VISIBILITY_OUTSIDE) return;
+			if (visibility == OctNode::VISIBILITY_INSIDE) return Gather(items);
+
+			for (const auto item : Items)
+			{
+				XMFLOAT3 center, extents;
+				itemBounds.Get(item, center, extents);
+				if (FrustumCulling::ClassifyBox(center, extents, frustum, childPlaneMask) != OctNode::VISIBILITY_OUTSIDE)
+					items.push_back(item);
+			}
+
+			for (const auto& child : Children)
+				if (child) child->Traverse(items, frustum, itemBounds, childPlaneMask);
+		}
+
+		virtual void Gather(vector<uint32_t>& items) const
+		{
+			items.insert(items.end(), Items.cbegin(), Items.cend());
+			for (const auto& child : Children) if (child) child->Gather(items);
+		}
+
+		XMFLOAT3 Center;
+		XMFLOAT3 Extents;
+		vector<uint32_t> Items;
+		unique_ptr<PointerNode> Children[8];
+	};
+
+	unique_ptr<PointerNode> createPointerNode(const vector<LinearOctree::Node>& nodes,
+		const FrustumCulling::Boxes& nodeBounds, uint32_t i, uint64_t& memorySize)
+	{
+		const auto& node = nodes[i];
+		unique_ptr<PointerNode> pointerNode(new PointerNode);
+		nodeBounds.Get(i, pointerNode->Center, pointerNode->Extents);
+		for (auto j = 0u; j < node.NumItems; ++j) pointerNode->Items.push_back(node.FirstItem + j);
+		memorySize += sizeof(PointerNode) + sizeof(uint32_t) * node.NumItems;
+
+		for (auto child = i + 1; child < node.SkipIndex; child = nodes[child].SkipIndex)
+			pointerNode->Children[nodes[child].Code & 7] = createPointerNode(nodes, nodeBounds, child, memorySize);
+
+		return pointerNode;
+	}
+}
+
+LinearOctree::LinearOctree() :
+	m_nodes(0),
+	m_nodeRadii(0),
+	m_meshIDs(0),
+	m_contribution(),
+	m_center(0.0f, 0.0f, 0.0f),
+	m_diameter(0.0f),
+	m_looseCoeff(1.0f),
+	m_maxDepth(8),
+	m_isInitialized(false)
+{
+}
+
+LinearOctree::~LinearOctree()
+{
+}
+
+void LinearOctree::Init(const XMFLOAT3& center, float diameter, float looseCoeff, uint8_t maxDepth)
+{
+	m_center = center;
+	m_diameter = diameter;
+	m_looseCoeff = looseCoeff;
+	m_maxDepth = (min)(maxDepth, MAX_DEPTH);
+	m_isInitialized = true;
+}
+
+void LinearOctree::CreateTree(const Item* pItems, uint32_t numItems)
+{
+	m_nodes.clear();
+	m_meshIDs.clear();
+	if (numItems == 0) return;
+
+	if (!m_isInitialized)
+	{
+		auto minPt = XMVectorReplicate(FLT_MAX);
+		auto maxPt = XMVectorReplicate(-FLT_MAX);
+		for (auto i = 0u; i < numItems; ++i)
+		{
+			const auto center = XMLoadFloat3(&pItems[i].Center);
+			const auto extents = XMLoadFloat3(&pItems[i].Extents);
+			minPt = XMVectorMin(minPt, center - extents);
+			maxPt = XMVectorMax(maxPt, center + extents);
+		}
+
+		XMFLOAT3 size;
+		XMStoreFloat3(&m_center, (minPt + maxPt) * 0.5f);
+		XMStoreFloat3(&size, maxPt - minPt);
+		m_diameter = (max)((max)((max)(size.x, size.y), size.z), FLT_MIN);
+	}
+
+	// Level and Morton code of the cell of each item. The code is left-aligned to the maximum
+	// depth, so that sorting by it, then by level, yields the pre-order of the tree.
+	struct Placement
+	{
+		uint32_t	Key;
+		uint8_t		Level;
+		uint32_t	Item;
+	};
+
+	const auto rootMin = XMLoadFloat3(&m_center) - XMVectorReplicate(m_diameter * 0.5f);
+	vector<Placement> placements(numItems);
+	for (auto i = 0u; i < numItems; ++i)
+	{
+		const auto& item = pItems[i];
+		const auto maxExtent = (max)((max)(item.Extents.x, item.Extents.y), item.Extents.z);
+
+		uint8_t level = m_maxDepth;
+		while (level > 0 && maxExtent > m_looseCoeff * 0.5f * m_diameter / (1u << level)) --level;
+
+		const auto numCells = 1u << level;
+		const auto cell = (XMLoadFloat3(&item.Center) - rootMin) * (numCells / m_diameter);
+		XMUINT3 cellIdx;
+		XMStoreUInt3(&cellIdx, XMVectorClamp(cell, XMVectorZero(), XMVectorReplicate(numCells - 1.0f)));
+
+		const auto code = getMortonCode(cellIdx.x, cellIdx.y, cellIdx.z);
+		placements[i] = { code << (3 * (m_maxDepth - level)), level, i };
+	}
+
+	sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b)
+	{
+		return a.Key != b.Key ? a.Key < b.Key : (a.Level != b.Level ? a.Level < b.Level : a.Item < b.Item);
+	});
+
+	// Emit the nodes along the path of each item, closing the open nodes that are not on it.
+	vector<uint32_t> parents;
+	vector<uint32_t> path;	// Open nodes from the root
+	const auto closeNode = [&]()
+	{
+		auto& node = m_nodes[path.back()];
+		node.SkipIndex = static_cast<uint32_t>(m_nodes.size());
+		node.ItemEnd = static_cast<uint32_t>(m_meshIDs.size());
+		path.pop_back();
+	};
+
+	m_itemBounds.Resize(numItems);
+	for (const auto& placement : placements)
+	{
+		const auto isOnPath = [&](const Node& node)
+		{
+			return node.Level <= placement.Level && node.Code == placement.Key >> (3 * (m_maxDepth - node.Level));
+		};
+		while (!path.empty() && !isOnPath(m_nodes[path.back()])) closeNode();
+
+		for (auto level = path.empty() ? 0 : m_nodes[path.back()].Level + 1; level <= placement.Level; ++level)
+		{
+			Node node = {};
+			node.FirstItem = static_cast<uint32_t>(m_meshIDs.size());
+			node.Code = placement.Key >> (3 * (m_maxDepth - level));
+			node.Level = static_cast<uint8_t>(level);
+			if (!path.empty()) m_nodes[path.back()].ChildMask |= 1 << (node.Code & 7);
+
+			parents.push_back(path.empty() ? UINT32_MAX : path.back());
+			path.push_back(static_cast<uint32_t>(m_nodes.size()));
+			m_nodes.push_back(node);
+		}
+
+		const auto& item = pItems[placement.Item];
+		m_itemBounds.Set(static_cast<uint32_t>(m_meshIDs.size()), item.Center, item.Extents);
+		m_meshIDs.push_back(item.MeshID);
+		++m_nodes[path.back()].NumItems;
+	}
+	while (!path.empty()) closeNode();
+
+	// Loose cell bounds, grown bottom-up to hold any item clamped into a border cell
+	const auto numNodes = GetNumNodes();
+	vector<XMVECTOR> minPts(numNodes), maxPts(numNodes);
+	m_nodeRadii.resize(numNodes);
+	for (auto i = 0u; i < numNodes; ++i)
+	{
+		const auto& node = m_nodes[i];
+		const auto cellSize = m_diameter / (1u << node.Level);
+
+		// De-interleave the Morton code back to the cell index
+		uint32_t idx[3] = {};
+		for (auto b = 0u; b < node.Level; ++b)
+			for (uint8_t axis = 0; axis < 3; ++axis)
+				idx[axis] |= ((node.Code >> (3 * b + axis)) & 1) << b;
+
+		const auto cellCenter = rootMin + (XMVectorSet(static_cast<float>(idx[0]), static_cast<float>(idx[1]),
+			static_cast<float>(idx[2]), 0.0f) + XMVectorReplicate(0.5f)) * cellSize;
+		const auto looseExtents = XMVectorReplicate(cellSize * (1.0f + m_looseCoeff) * 0.5f);
+		minPts[i] = cellCenter - looseExtents;
+		maxPts[i] = cellCenter + looseExtents;
+		m_nodeRadii[i] = XMFLOAT2(FLT_MAX, 0.0f);
+
+		for (auto j = node.FirstItem; j < node.FirstItem + node.NumItems; ++j)
+		{
+			XMFLOAT3 center, extents;
+			m_itemBounds.Get(j, center, extents);
+			minPts[i] = XMVectorMin(minPts[i], XMLoadFloat3(&center) - XMLoadFloat3(&extents));
+			maxPts[i] = XMVectorMax(maxPts[i], XMLoadFloat3(&center) + XMLoadFloat3(&extents));
+
+			const auto radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+			m_nodeRadii[i].x = (min)(m_nodeRadii[i].x, radius);
+			m_nodeRadii[i].y = (max)(m_nodeRadii[i].y, radius);
+		}
+	}
+
+	m_nodeBounds.Resize(numNodes);
+	for (auto i = numNodes; i-- > 0;)
+	{
+		const auto parent = parents[i];
+		if (parent != UINT32_MAX)
+		{
+			minPts[parent] = XMVectorMin(minPts[parent], minPts[i]);
+			maxPts[parent] = XMVectorMax(maxPts[parent], maxPts[i]);
+			m_nodeRadii[parent].x = (min)(m_nodeRadii[parent].x, m_nodeRadii[i].x);
+			m_nodeRadii[parent].y = (max)(m_nodeRadii[parent].y, m_nodeRadii[i].y);
+		}
+
+		XMFLOAT3 center, extents;
+		XMStoreFloat3(&center, (minPts[i] + maxPts[i]) * 0.5f);
+		XMStoreFloat3(&extents, (maxPts[i] - minPts[i]) * 0.5f);
+		m_nodeBounds.Set(i, center, extents);
+	}
+}
+
+void LinearOctree::CreateTree(uint32_t numModels, const StaticModel::sptr* pModels, SubsetFlags subsetFlags)
+{
+	vector<Item> items;
+	GetItems(items, numModels, pModels, subsetFlags);
+	CreateTree(items.data(), static_cast<uint32_t>(items.size()));
+}
+
+void LinearOctree::GetFrustum(FrustumCulling::Frustum& frustum, CXMMATRIX viewProj, bool isShadow) const
+{
+	FrustumCulling::GetFrustum(frustum, viewProj);
+	if (isShadow)
+		FrustumCulling::SetContribution(frustum, viewProj, XMFLOAT2(m_contribution.ShadowMapSize,
+			m_contribution.ShadowMapSize), m_contribution.MinShadowPixels);
+	else FrustumCulling::SetContribution(frustum, viewProj, m_contribution.ViewportSize, m_contribution.MinPixels);
+}
+
+void LinearOctree::Split(vector<Subtree>& subtrees, vector<uint32_t>& items, const FrustumCulling::Frustum& frustum,
+	uint8_t splitLevel, bool isAllVisible, const SoftwareOcclusion* pOcclusion, uint32_t* pNumCulled) const
+{
+	collect(items, &subtrees, frustum, 0, GetNumNodes(), getPlaneMask(frustum, isAllVisible), splitLevel,
+		pOcclusion, pNumCulled);
+}
+
+void LinearOctree::Collect(vector<uint32_t>& items, const FrustumCulling::Frustum& frustum, const Subtree& subtree,
+	const SoftwareOcclusion* pOcclusion, uint32_t* pNumCulled) const
+{
+	collect(items, nullptr, frustum, subtree.Node, m_nodes[subtree.Node].SkipIndex, subtree.PlaneMask, 0,
+		subtree.IsOcclusionTested ? pOcclusion : nullptr, pNumCulled);
+}
+
+void LinearOctree::Sort(vector<XMUINT2>& meshIDQueue, CXMMATRIX viewProj, FXMVECTOR eyePt,
+	bool isNearToFar, bool isAllVisible, const SoftwareOcclusion* pOcclusion, uint32_t* pNumCulled) const
+{
+	FrustumCulling::Frustum frustum;
+	GetFrustum(frustum, viewProj);
+
+	vector<uint32_t> items;
+	collect(items, nullptr, frustum, 0, GetNumNodes(), getPlaneMask(frustum, isAllVisible), 0, pOcclusion, pNumCulled);
+	sortItems(meshIDQueue, items, eyePt, isNearToFar);
+}
+
+void LinearOctree::Sort(vector<XMUINT2>* pMeshIDQueues, uint8_t numFrusta, const XMMATRIX* pViewProjs,
+	const XMVECTOR* pEyePts, bool isNearToFar, uint32_t* pNumCulled) const
+{
+	XUSG_N_RETURN(numFrusta <= FrustumCulling::MAX_FRUSTA, );
+
+	FrustumCulling::Frustum frusta[FrustumCulling::MAX_FRUSTA];
+	for (uint8_t f = 0; f < numFrusta; ++f) GetFrustum(frusta[f], pViewProjs[f], f > 0);
+
+	vector<uint32_t> items[FrustumCulling::MAX_FRUSTA];
+	Collect(items, frusta, numFrusta, pNumCulled);
+	for (uint8_t f = 0; f < numFrusta; ++f) sortItems(pMeshIDQueues[f], items[f], pEyePts[f], isNearToFar);
+}
+
+void LinearOctree::Collect(vector<uint32_t>* pItems, const FrustumCulling::Frustum* pFrusta, uint8_t numFrusta,
+	uint32_t* pNumCulled) const
+{
+	for (uint8_t f = 0; f < numFrusta; ++f)
+		collect(pItems[f], nullptr, pFrusta[f], 0, GetNumNodes(), FrustumCulling::GetPlaneMask(pFrusta[f]), 0, nullptr,
+			pNumCulled ? &pNumCulled[f] : nullptr);
+}
+
+uint64_t LinearOctree::GetMemorySize() const
+{
+	return sizeof(Node) * m_nodes.size() + sizeof(float) * 6 * (m_nodeBounds.GetCount() + m_itemBounds.GetCount()) +
+		sizeof(XMFLOAT2) * m_nodeRadii.size() + sizeof(XMUINT2) * m_meshIDs.size();
+}
+
+void LinearOctree::GetItems(vector<Item>& items, uint32_t numModels, const StaticModel::sptr* pModels,
+	SubsetFlags subsetFlags)
+{
+	items.clear();
+	for (auto i = 0u; i < numModels; ++i)
+	{
+		const auto& mesh = pModels[i]->GetMesh();
+		const auto numMeshes = mesh->GetNumMeshes();
+		for (auto j = 0u; j < numMeshes; ++j)
+		{
+			if (mesh->GetNumSubsets(j, subsetFlags) == 0) continue;
+
+			Item item;
+			item.MeshID = XMUINT2(i, j);
+			XMStoreFloat3(&item.Center, mesh->GetMeshBBoxCenter(j));
+			XMStoreFloat3(&item.Extents, mesh->GetMeshBBoxExtents(j));
+			items.push_back(item);
+		}
+	}
+}
+
+void LinearOctree::GetItems(vector<Item>& items, void* pSceneReader, float* pMapSize, float* pLooseCoeff)
+{
+	items.clear();
+	XUSG_N_RETURN(pSceneReader, );
+	auto& sceneReader = *static_cast<tiny::TinyJson*>(pSceneReader);
+
+	if (pMapSize) *pMapSize = sceneReader.Get<float>("MapSize", 0.0f);
+	if (pLooseCoeff) *pLooseCoeff = sceneReader.Get<float>("OctreeLooseCoeff", 1.0f);
+
+	// Mesh tables of the static meshes, read once each
+	auto meshesReader = sceneReader.Get<tiny::xarray>("StaticMeshes");
+	vector<vector<SDKMesh::Data>> meshTables(meshesReader.Count());
+	for (size_t i = 0; i < meshTables.size(); ++i)
+	{
+		meshesReader.Enter(static_cast<int>(i));
+		const auto fileName = meshesReader.Get<string>("Mesh");
+		ScenePreflight::ReadMeshes(meshTables[i], wstring(fileName.cbegin(), fileName.cend()).c_str());
+	}
+
+	auto modelsReader = sceneReader.Get<tiny::xarray>("StaticModels");
+	const auto numModels = static_cast<uint32_t>(modelsReader.Count());
+	for (auto i = 0u; i < numModels; ++i)
+	{
+		modelsReader.Enter(i);
+		const auto meshIndex = modelsReader.Get<uint32_t>("MeshIndex", 0);
+		if (meshIndex >= meshTables.size()) continue;
+
+		const auto& meshTable = meshTables[meshIndex];
+		for (size_t j = 0; j < meshTable.size(); ++j)
+		{
+			Item item;
+			item.MeshID = XMUINT2(i, static_cast<uint32_t>(j));
+			item.Center = meshTable[j].BoundingBoxCenter;
+			item.Extents = meshTable[j].BoundingBoxExtents;
+			items.push_back(item);
+		}
+	}
+}
+
+void LinearOctree::Benchmark(BenchmarkResult& result, const Item* pItems, uint32_t numItems,
+	uint32_t numViews, uint32_t numIterations)
+{
+	result = {};
+	XUSG_N_RETURN(numItems > 0 && numViews > 0 && numIterations > 0, );
+
+	LinearOctree tree;
+	tree.CreateTree(pItems, numItems);
+	result.NumNodes = tree.GetNumNodes();
+	result.LinearMemory = tree.GetMemorySize();
+
+	uint64_t pointerMemory = 0;
+	const auto pointerTree = createPointerNode(tree.m_nodes, tree.m_nodeBounds, 0, pointerMemory);
+	result.PointerMemory = pointerMemory + sizeof(float) * 6 * tree.m_itemBounds.GetCount() +
+		sizeof(XMUINT2) * tree.m_meshIDs.size();
+
+	// Views circling the items at half the root diameter, looking at the center
+	const auto center = XMLoadFloat3(&tree.m_center);
+	const auto radius = tree.m_diameter * 0.5f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, radius * 0.001f, radius * 4.0f);
+	vector<FrustumCulling::Frustum> frusta(numViews);
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		const auto angle = XM_2PI * i / numViews;
+		const auto eyePt = center + XMVectorSet(cosf(angle) * radius, radius * 0.1f, sinf(angle) * radius, 0.0f);
+		const auto view = XMMatrixLookAtLH(eyePt, center, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		FrustumCulling::GetFrustum(frusta[i], view * proj);
+	}
+
+	vector<uint32_t> items;
+	items.reserve(numItems);
+	auto numPointerVisible = 0u;
+	auto start = chrono::high_resolution_clock::now();
+	for (auto n = 0u; n < numIterations; ++n)
+	{
+		for (const auto& frustum : frusta)
+		{
+			items.clear();
+			pointerTree->Traverse(items, frustum, tree.m_itemBounds, FrustumCulling::ALL_PLANES);
+			if (n == 0) numPointerVisible += static_cast<uint32_t>(items.size());
+		}
+	}
+	auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	result.PointerMicroseconds = seconds * 1.0e6 / (static_cast<double>(numIterations) * numViews);
+
+	start = chrono::high_resolution_clock::now();
+	for (auto n = 0u; n < numIterations; ++n)
+	{
+		for (const auto& frustum : frusta)
+		{
+			items.clear();
+			tree.collect(items, nullptr, frustum, 0, result.NumNodes, FrustumCulling::ALL_PLANES, 0, nullptr, nullptr);
+			if (n == 0) result.NumVisible += static_cast<uint32_t>(items.size());
+		}
+	}
+	seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	result.LinearMicroseconds = seconds * 1.0e6 / (static_cast<double>(numIterations) * numViews);
+
+	assert(result.NumVisible == numPointerVisible);
+}
+
+void LinearOctree::BenchmarkContribution(ContributionBenchmarkResult& result, const Item* pItems, uint32_t numItems,
+	float minPixels, uint32_t numViews, uint32_t numIterations)
+{
+	result = {};
+	XUSG_N_RETURN(numItems > 0 && numViews > 0 && numIterations > 0, );
+
+	const XMFLOAT2 viewportSize(1920.0f, 1080.0f);
+	const Contribution contribution = { viewportSize, minPixels, 2048.0f, minPixels };
+	LinearOctree tree;
+	tree.CreateTree(pItems, numItems);
+	tree.SetContribution(contribution);
+
+	// Views of Benchmark, with and without the threshold
+	const auto center = XMLoadFloat3(&tree.m_center);
+	const auto radius = tree.m_diameter * 0.5f;
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, viewportSize.x / viewportSize.y, radius * 0.001f, radius * 4.0f);
+	vector<XMMATRIX> viewProjs(numViews);
+	vector<XMVECTOR> eyePts(numViews);
+	vector<FrustumCulling::Frustum> frusta(numViews);
+	vector<FrustumCulling::Frustum> culledFrusta(numViews);
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		const auto angle = XM_2PI * i / numViews;
+		eyePts[i] = center + XMVectorSet(cosf(angle) * radius, radius * 0.1f, sinf(angle) * radius, 0.0f);
+		viewProjs[i] = XMMatrixLookAtLH(eyePts[i], center, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+		FrustumCulling::GetFrustum(frusta[i], viewProjs[i]);
+		tree.GetFrustum(culledFrusta[i], viewProjs[i]);
+	}
+
+	// The meshes kept must be in the frustum, and include all of those there whose bounding
+	// spheres cover the threshold, measured at their centers.
+	const auto pixelScale = XMVectorGetY(proj.r[1]) * viewportSize.y * 0.5f;
+	vector<uint32_t> items, culledItems;
+	auto numCulled = 0u;
+	result.IsConservative = true;
+	result.IsCountBounded = true;
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		items.clear();
+		culledItems.clear();
+		auto numViewCulled = 0u;
+		tree.collect(items, nullptr, frusta[i], 0, tree.GetNumNodes(), FrustumCulling::ALL_PLANES, 0, nullptr, nullptr);
+		tree.collect(culledItems, nullptr, culledFrusta[i], 0, tree.GetNumNodes(),
+			FrustumCulling::GetPlaneMask(culledFrusta[i]), 0, nullptr, &numViewCulled);
+		result.NumVisible += static_cast<double>(items.size());
+		result.NumCulledVisible += static_cast<double>(culledItems.size());
+		if (numViewCulled < items.size() - culledItems.size()) result.IsCountBounded = false;
+		numCulled += numViewCulled;
+
+		sort(items.begin(), items.end());
+		sort(culledItems.begin(), culledItems.end());
+		if (!includes(items.cbegin(), items.cend(), culledItems.cbegin(), culledItems.cend())) result.IsConservative = false;
+		for (const auto& item : items)
+		{
+			XMFLOAT3 itemCenter, extents;
+			tree.m_itemBounds.Get(item, itemCenter, extents);
+			const auto w = XMVectorGetW(XMVector3Transform(XMLoadFloat3(&itemCenter), viewProjs[i]));
+			const auto pixels = 2.0f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents))) * pixelScale / w;
+			if ((w <= 0.0f || pixels >= minPixels * 1.001f) && !binary_search(culledItems.cbegin(), culledItems.cend(), item))
+				result.IsConservative = false;
+		}
+	}
+	result.NumVisible /= numViews;
+	result.NumCulledVisible /= numViews;
+	result.NumCulled = static_cast<double>(numCulled) / numViews;
+
+	// Counting as OctreeSorter does
+	vector<XMUINT2> queue;
+	auto numSortCulled = 0u;
+	queue.reserve(numItems);
+	const auto time = [&]()
+	{
+		const auto start = chrono::high_resolution_clock::now();
+		for (auto n = 0u; n < numIterations; ++n)
+		{
+			for (auto i = 0u; i < numViews; ++i)
+			{
+				queue.clear();
+				tree.Sort(queue, viewProjs[i], eyePts[i], true, false, nullptr, &numSortCulled);
+			}
+		}
+		const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+		return seconds * 1.0e6 / (static_cast<double>(numIterations) * numViews);
+	};
+	result.CulledMicroseconds = time();
+	tree.SetContribution({});
+	result.Microseconds = time();
+}
+
+void LinearOctree::collect(vector<uint32_t>& items, vector<Subtree>* pSubtrees, const FrustumCulling::Frustum& frustum,
+	uint32_t first, uint32_t last, uint8_t planeMask, uint8_t splitLevel, const SoftwareOcclusion* pOcclusion,
+	uint32_t* pNumCulled) const
+{
+	// Plane masks of the open ancestors, with the index ending each subtree and the occlusion
+	// left to test below them, null once a node is in front of every occluder
+	struct Ancestor
+	{
+		uint32_t	SkipIndex;
+		const SoftwareOcclusion* pOcclusion;
+		uint8_t		PlaneMask;
+	};
+
+	const auto addItem = [&](uint32_t item, const SoftwareOcclusion* pItemOcclusion)
+	{
+		if (pItemOcclusion)
+		{
+			XMFLOAT3 center, extents;
+			m_itemBounds.Get(item, center, extents);
+			const auto radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+			if (pItemOcclusion->IsWorthTesting(center, radius) && pItemOcclusion->IsOccluded(center, extents)) return;
+		}
+
+		items.push_back(item);
+	};
+
+	const auto addItems = [&](uint32_t firstItem, uint32_t itemEnd, uint8_t planeMask,
+		const SoftwareOcclusion* pItemOcclusion)
+	{
+		if (!planeMask)
+		{
+			if (pItemOcclusion) for (auto j = firstItem; j < itemEnd; ++j) addItem(j, pItemOcclusion);
+			else for (auto j = firstItem; j < itemEnd; ++j) items.push_back(j);
+
+			return;
+		}
+
+		OctNode::Visibility visibilities[64];
+		uint8_t planeMasks[64];
+		for (auto j = firstItem; j < itemEnd; j += 64)
+		{
+			const auto count = (min)(itemEnd - j, 64u);
+			FrustumCulling::Classify(visibilities, m_itemBounds, j, count, frustum, planeMask, planeMasks);
+			for (auto k = 0u; k < count; ++k)
+			{
+				if (visibilities[k] != OctNode::VISIBILITY_OUTSIDE) addItem(j + k, pItemOcclusion);
+				else if (pNumCulled && planeMasks[k] == FrustumCulling::CONTRIBUTION_PLANE) ++*pNumCulled;
+			}
+		}
+	};
+
+	Ancestor ancestors[MAX_DEPTH + 1];
+	uint8_t depth = 0;
+	for (auto i = first; i < last;)
+	{
+		while (depth > 0 && i >= ancestors[depth - 1].SkipIndex) --depth;
+		const auto parentPlaneMask = depth > 0 ? ancestors[depth - 1].PlaneMask : planeMask;
+		auto pNodeOcclusion = depth > 0 ? ancestors[depth - 1].pOcclusion : pOcclusion;
+
+		const auto& node = m_nodes[i];
+		if (pSubtrees && node.Level >= splitLevel)
+		{
+			pSubtrees->push_back({ i, parentPlaneMask, pNodeOcclusion != nullptr });
+			i = node.SkipIndex;
+			continue;
+		}
+
+		XMFLOAT3 center, extents;
+		m_nodeBounds.Get(i, center, extents);
+		uint8_t childPlaneMask;
+		const auto visibility = FrustumCulling::ClassifyBox(center, extents, frustum, parentPlaneMask, &childPlaneMask,
+			&m_nodeRadii[i]);
+
+		// Items are only tested for occlusion below nodes that are partly occluded.
+		auto occlusion = OctNode::VISIBILITY_INSIDE;
+		if (visibility != OctNode::VISIBILITY_OUTSIDE && pNodeOcclusion)
+		{
+			occlusion = pNodeOcclusion->IsSmall(center, XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)))) ?
+				OctNode::VISIBILITY_INSIDE : pNodeOcclusion->Classify(center, extents);
+			if (occlusion == OctNode::VISIBILITY_INSIDE) pNodeOcclusion = nullptr;
+		}
+
+		if (visibility == OctNode::VISIBILITY_OUTSIDE)
+		{
+			if (pNumCulled && childPlaneMask == FrustumCulling::CONTRIBUTION_PLANE) *pNumCulled += node.ItemEnd - node.FirstItem;
+			i = node.SkipIndex;
+		}
+		else if (occlusion == OctNode::VISIBILITY_OUTSIDE) i = node.SkipIndex;
+		else if ((visibility == OctNode::VISIBILITY_INSIDE || childPlaneMask == FrustumCulling::CONTRIBUTION_PLANE) &&
+			!pSubtrees && !pNodeOcclusion)
+		{
+			// The whole subtree, items being contiguous in pre-order, in batches for their
+			// contribution if still to be tested
+			addItems(node.FirstItem, node.ItemEnd, childPlaneMask, nullptr);
+			i = node.SkipIndex;
+		}
+		else
+		{
+			// When splitting or testing occlusion, inside nodes still descend, with no planes left.
+			addItems(node.FirstItem, node.FirstItem + node.NumItems, childPlaneMask, pNodeOcclusion);
+			ancestors[depth++] = { node.SkipIndex, pNodeOcclusion, childPlaneMask };
+			++i;
+		}
+	}
+}
+
+void LinearOctree::sortItems(vector<XMUINT2>& meshIDQueue, const vector<uint32_t>& items,
+	FXMVECTOR eyePt, bool isNearToFar) const
+{
+	vector<pair<float, uint32_t>> order(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		XMFLOAT3 center, extents;
+		m_itemBounds.Get(items[i], center, extents);
+		const auto distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&center) - eyePt));
+		order[i] = make_pair(isNearToFar ? distSq : -distSq, items[i]);
+	}
+	sort(order.begin(), order.end());
+
+	for (const auto& item : order) meshIDQueue.push_back(m_meshIDs[item.second]);
+}
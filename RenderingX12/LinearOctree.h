@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SoftwareOcclusion.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Loose octree flattened into one array of nodes in Morton pre-order. A node is followed
+	// by its subtree, which ends at its skip index, so traversal is a loop over the array
+	// without pointers, recursion or virtual calls.
+	//--------------------------------------------------------------------------------------
+	class LinearOctree
+	{
+	public:
+		static const uint8_t MAX_DEPTH = 10;	// 30-bit Morton codes
+
+		struct Item
+		{
+			DirectX::XMUINT2 MeshID;			// Model, mesh
+			DirectX::XMFLOAT3 Center;
+			DirectX::XMFLOAT3 Extents;
+		};
+
+		struct Node
+		{
+			uint32_t	FirstItem;		// Items of the node itself, followed by those of its subtree
+			uint32_t	NumItems;
+			uint32_t	ItemEnd;		// End of the items of the subtree
+			uint32_t	SkipIndex;		// First node after the subtree
+			uint32_t	Code;			// Morton code of the cell at its level
+			uint8_t		Level;
+			uint8_t		ChildMask;		// Octants of the children present
+		};
+
+		// Subtree handed out for traversal, with the planes its ancestors straddle and whether
+		// they leave occlusion to test
+		struct Subtree
+		{
+			uint32_t	Node;
+			uint8_t		PlaneMask;
+			bool		IsOcclusionTested;
+		};
+
+		struct BenchmarkResult
+		{
+			double		PointerMicroseconds;	// Per traversal
+			double		LinearMicroseconds;
+			uint64_t	PointerMemory;
+			uint64_t	LinearMemory;
+			uint32_t	NumNodes;
+			uint32_t	NumVisible;				// Summed over the views, identical for both layouts
+		};
+
+		// Meshes whose bounding spheres cover fewer pixels across than the threshold of their
+		// pass are culled; a threshold of 0 disables it, as by default.
+		struct Contribution
+		{
+			DirectX::XMFLOAT2 ViewportSize;
+			float		MinPixels;
+			float		ShadowMapSize;
+			float		MinShadowPixels;		// Shadow cascades
+		};
+
+		struct ContributionBenchmarkResult
+		{
+			double		Microseconds;			// Per Sort, without contribution culling
+			double		CulledMicroseconds;		// Per Sort, with it
+			double		NumVisible;				// Per view, without it
+			double		NumCulledVisible;		// Per view, with it
+			double		NumCulled;				// Per view, as counted by Sort
+			bool		IsConservative;			// Only meshes in the frustum under the threshold culled
+			bool		IsCountBounded;			// Culled count covers the meshes in the frustum not kept
+		};
+
+		LinearOctree();
+		virtual ~LinearOctree();
+
+		// Root cell; node bounds are (1 + looseCoeff) times their cells, looseCoeff being the
+		// OctreeLooseCoeff of the scenes.
+		void Init(const DirectX::XMFLOAT3& center, float diameter, float looseCoeff = 1.0f, uint8_t maxDepth = 8);
+
+		// Each item goes to the deepest cell whose loose bound contains it. Without Init, the root
+		// is fitted to the items.
+		void CreateTree(const Item* pItems, uint32_t numItems);
+		void CreateTree(uint32_t numModels, const StaticModel::sptr* pModels, SubsetFlags subsetFlags);
+
+		void SetContribution(const Contribution& contribution) { m_contribution = contribution; }
+		const Contribution& GetContribution() const { return m_contribution; }
+
+		// Frustum of the view-projection, with the contribution threshold of the camera or the
+		// shadow cascades
+		void GetFrustum(FrustumCulling::Frustum& frustum, DirectX::CXMMATRIX viewProj, bool isShadow = false) const;
+
+		// Appends the meshes in the frustum, sorted by the distance of their bound centers to eyePt.
+		// Nodes and meshes behind the occluders of pOcclusion, if given, are skipped, and so are
+		// those under the contribution threshold of the camera, which are counted in pNumCulled
+		// if given; the subtrees culled whole count all of their meshes, in the frustum or not.
+		void Sort(std::vector<DirectX::XMUINT2>& meshIDQueue, DirectX::CXMMATRIX viewProj,
+			DirectX::FXMVECTOR eyePt, bool isNearToFar, bool isAllVisible = false,
+			const SoftwareOcclusion* pOcclusion = nullptr, uint32_t* pNumCulled = nullptr) const;
+
+		// One queue per frustum, the camera followed by the shadow cascades, from a single
+		// traversal; each queue matches that of Sort with the same view-projection and eye point,
+		// and the cascades take the shadow contribution threshold. pNumCulled, if given, has one
+		// counter per frustum.
+		void Sort(std::vector<DirectX::XMUINT2>* pMeshIDQueues, uint8_t numFrusta, const DirectX::XMMATRIX* pViewProjs,
+			const DirectX::XMVECTOR* pEyePts, bool isNearToFar, uint32_t* pNumCulled = nullptr) const;
+
+		// Traverses the nodes above splitLevel only, appending their visible items, and hands out
+		// the subtrees at splitLevel for Collect, so that they can be traversed in parallel.
+		// Subtrees and items are in pre-order. The contribution plane of the frustum, if set,
+		// culls as in Sort.
+		void Split(std::vector<Subtree>& subtrees, std::vector<uint32_t>& items, const FrustumCulling::Frustum& frustum,
+			uint8_t splitLevel, bool isAllVisible = false, const SoftwareOcclusion* pOcclusion = nullptr,
+			uint32_t* pNumCulled = nullptr) const;
+		void Collect(std::vector<uint32_t>& items, const FrustumCulling::Frustum& frustum, const Subtree& subtree,
+			const SoftwareOcclusion* pOcclusion = nullptr, uint32_t* pNumCulled = nullptr) const;
+
+		// Items in each of numFrusta frusta, one traversal per frustum as Sort does.
+		void Collect(std::vector<uint32_t>* pItems, const FrustumCulling::Frustum* pFrusta, uint8_t numFrusta,
+			uint32_t* pNumCulled = nullptr) const;
+
+		const std::vector<Node>& GetNodes() const { return m_nodes; }
+		const FrustumCulling::Boxes& GetNodeBounds() const { return m_nodeBounds; }
+		const FrustumCulling::Boxes& GetItemBounds() const { return m_itemBounds; }
+		const std::vector<DirectX::XMUINT2>& GetMeshIDs() const { return m_meshIDs; }
+		uint32_t GetNumNodes() const { return static_cast<uint32_t>(m_nodes.size()); }
+		uint64_t GetMemorySize() const;
+
+		// Bounds of the meshes with subsets of the flags, as OctNode::CreateTree selects them
+		static void GetItems(std::vector<Item>& items, uint32_t numModels, const StaticModel::sptr* pModels,
+			SubsetFlags subsetFlags);
+
+		// Bounds of the meshes of the static models of a scene (a tiny::TinyJson reader), read
+		// from the mesh tables of their files without loading them; one item per mesh, all
+		// subsets, with the models where their meshes place them as in the shipped scenes. The root
+		// diameter (MapSize, 0 if unset) and loose coefficient of the scene go to pMapSize and
+		// pLooseCoeff, if given.
+		static void GetItems(std::vector<Item>& items, void* pSceneReader, float* pMapSize = nullptr,
+			float* pLooseCoeff = nullptr);
+
+		// Times this layout against a pointer-based octree of the same nodes, traversed
+		// recursively with virtual calls, over views circling the items.
+		static void Benchmark(BenchmarkResult& result, const Item* pItems, uint32_t numItems,
+			uint32_t numViews = 64, uint32_t numIterations = 16);
+
+		// Times Sort over the views of Benchmark without and with a contribution threshold of
+		// minPixels in a 1920x1080 viewport, and checks the meshes culled against their
+		// projected bounding spheres.
+		static void BenchmarkContribution(ContributionBenchmarkResult& result, const Item* pItems, uint32_t numItems,
+			float minPixels = 2.0f, uint32_t numViews = 64, uint32_t numIterations = 16);
+
+		using uptr = std::unique_ptr<LinearOctree>;
+		using sptr = std::shared_ptr<LinearOctree>;
+
+	protected:
+		void collect(std::vector<uint32_t>& items, std::vector<Subtree>* pSubtrees, const FrustumCulling::Frustum& frustum,
+			uint32_t first, uint32_t last, uint8_t planeMask, uint8_t splitLevel, const SoftwareOcclusion* pOcclusion,
+			uint32_t* pNumCulled) const;
+		void sortItems(std::vector<DirectX::XMUINT2>& meshIDQueue, const std::vector<uint32_t>& items,
+			DirectX::FXMVECTOR eyePt, bool isNearToFar) const;
+
+		std::vector<Node>				m_nodes;
+		FrustumCulling::Boxes			m_nodeBounds;
+		FrustumCulling::Boxes			m_itemBounds;
+		std::vector<DirectX::XMFLOAT2>	m_nodeRadii;	// Smallest and largest item sphere of each subtree
+		std::vector<DirectX::XMUINT2>	m_meshIDs;
+
+		Contribution					m_contribution;
+
+		DirectX::XMFLOAT3				m_center;
+		float							m_diameter;
+		float							m_looseCoeff;
+		uint8_t							m_maxDepth;
+		bool							m_isInitialized;
+	};
+}
@@ -0,0 +1,447 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <emmintrin.h>
+#include "TextureEncoder.h"
+#include "MipGenerator.h"
+
+using namespace std;
+using namespace XUSG;
+
+using Filter = MipGenerator::Filter;
+
+namespace
+{
+	const uint32_t LINEAR_TO_SRGB_STEPS = 4096;
+	const uint8_t MAX_FILTER_TAPS = 6;
+	const float KAISER_ALPHA = 4.0f;
+	const float KAISER_RADIUS = 3.0f;		// Source texels each side
+
+	// Colors are weighted by lerp(floor, 1, alpha), so that fully transparent areas still
+	// average their own colors instead of fading to black. The weight is affine in alpha,
+	// so it is recovered from the filtered alpha when storing.
+	const float MIN_ALPHA_WEIGHT = 1.0f / 256.0f;
+
+	float getAlphaWeight(float alpha)
+	{
+		return MIN_ALPHA_WEIGHT + (1.0f - MIN_ALPHA_WEIGHT) * alpha;
+	}
+
+	struct FilterKernel
+	{
+		float Weights[MAX_FILTER_TAPS];
+		uint8_t NumTaps;
+	};
+
+	struct ColorTables
+	{
+		float SRGBToLinear[256];
+		uint8_t LinearToSRGB[LINEAR_TO_SRGB_STEPS];
+	};
+
+	const ColorTables& getColorTables()
+	{
+		static const auto tables = []()
+		{
+			ColorTables tables;
+			for (auto i = 0u; i < 256; ++i)
+			{
+				const auto c = i / 255.0f;
+				tables.SRGBToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (auto i = 0u; i < LINEAR_TO_SRGB_STEPS; ++i)
+			{
+				const auto c = i / static_cast<float>(LINEAR_TO_SRGB_STEPS - 1);
+				const auto s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+				tables.LinearToSRGB[i] = static_cast<uint8_t>(s * 255.0f + 0.5f);
+			}
+
+			return tables;
+		}();
+
+		return tables;
+	}
+
+	// Zeroth-order modified Bessel function of the first kind
+	float besselI0(float x)
+	{
+		auto sum = 1.0f;
+		auto term = 1.0f;
+		for (auto k = 1u; k < 32; ++k)
+		{
+			const auto t = x / (2.0f * k);
+			term *= t * t;
+			sum += term;
+			if (term < sum * 1.0e-8f) break;
+		}
+
+		return sum;
+	}
+
+	// 2:1 decimation kernels with taps at half-texel offsets from the destination center.
+	// Kaiser is a windowed sinc over KAISER_RADIUS source texels each side.
+	const FilterKernel& getKernel(Filter filter)
+	{
+		static const FilterKernel boxKernel = { { 0.5f, 0.5f }, 2 };
+		static const auto kaiserKernel = []()
+		{
+			const auto pi = 3.14159265f;
+			const auto alpha = KAISER_ALPHA;
+			const auto radius = KAISER_RADIUS;
+
+			FilterKernel kernel = {};
+			kernel.NumTaps = MAX_FILTER_TAPS;
+
+			auto sum = 0.0f;
+			for (uint8_t i = 0; i < kernel.NumTaps; ++i)
+			{
+				const auto d = i - (kernel.NumTaps - 1) * 0.5f;
+				const auto x = pi * d * 0.5f;
+				const auto r = d / radius;
+				kernel.Weights[i] = sinf(x) / x * besselI0(alpha * sqrtf(1.0f - r * r)) / besselI0(alpha);
+				sum += kernel.Weights[i];
+			}
+
+			for (auto& weight : kernel.Weights) weight /= sum;
+
+			return kernel;
+		}();
+
+		return filter == Filter::BOX ? boxKernel : kaiserKernel;
+	}
+
+	// The filter and its parameters in tenths, for cache file names
+	wstring getFilterName(Filter filter)
+	{
+		if (filter == Filter::BOX) return L".box";
+
+		return L".kaiser.r" + to_wstring(lroundf(KAISER_RADIUS * 10.0f)) + L".alpha" + to_wstring(lroundf(KAISER_ALPHA * 10.0f));
+	}
+
+	void parallelFor(uint32_t count, uint32_t numThreads, const function<void(uint32_t)>& func)
+	{
+		atomic<uint32_t> next(0);
+		const auto process = [&]()
+		{
+			for (auto n = next++; n < count; n = next++) func(n);
+		};
+
+		numThreads = (min)(numThreads, count);
+
+		vector<thread> workers;
+		for (auto i = 1u; i < numThreads; ++i) workers.emplace_back(process);
+		process();
+		for (auto& worker : workers) worker.join();
+	}
+
+	// Filters and decimates one row of RGBA float texels, with clamped addressing
+	void downsampleRow(float* pDst, const float* pSrc, uint32_t srcWidth, uint32_t dstWidth, const FilterKernel& kernel)
+	{
+		const auto first = 1 - static_cast<int>(kernel.NumTaps / 2);
+		const auto maxX = static_cast<int>(srcWidth) - 1;
+		for (auto x = 0u; x < dstWidth; ++x)
+		{
+			auto sum = _mm_setzero_ps();
+			const auto x0 = 2 * static_cast<int>(x) + first;
+			for (uint8_t i = 0; i < kernel.NumTaps; ++i)
+			{
+				const auto sx = (min)((max)(x0 + i, 0), maxX);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&pSrc[4 * sx]), _mm_set1_ps(kernel.Weights[i])));
+			}
+			_mm_storeu_ps(&pDst[4 * x], sum);
+		}
+	}
+
+	// Vertical pass: combines the filtered source rows for one destination row
+	void downsampleColumn(float* pDst, const float* pSrc, uint32_t width, uint32_t srcHeight,
+		uint32_t y, const FilterKernel& kernel)
+	{
+		const auto first = 1 - static_cast<int>(kernel.NumTaps / 2);
+		const auto maxY = static_cast<int>(srcHeight) - 1;
+		const auto rowSize = 4 * static_cast<size_t>(width);
+		const auto y0 = 2 * static_cast<int>(y) + first;
+
+		for (size_t i = 0; i < rowSize; i += 4) _mm_storeu_ps(&pDst[i], _mm_setzero_ps());
+		for (uint8_t i = 0; i < kernel.NumTaps; ++i)
+		{
+			const auto sy = (min)((max)(y0 + i, 0), maxY);
+			const auto pRow = &pSrc[rowSize * sy];
+			const auto weight = _mm_set1_ps(kernel.Weights[i]);
+			for (size_t j = 0; j < rowSize; j += 4)
+				_mm_storeu_ps(&pDst[j], _mm_add_ps(_mm_loadu_ps(&pDst[j]), _mm_mul_ps(_mm_loadu_ps(&pRow[j]), weight)));
+		}
+	}
+
+	// Scale on alpha that keeps the alpha-test coverage of a mip at the target, by bisection
+	float fitAlphaScale(const float* pTexels, size_t numTexels, float alphaReference, float targetCoverage)
+	{
+		auto low = 0.0f;
+		auto high = 4.0f;
+		for (auto i = 0u; i < 10; ++i)
+		{
+			const auto scale = 0.5f * (low + high);
+			if (MipGenerator::ComputeAlphaCoverage(pTexels, numTexels, alphaReference, scale) < targetCoverage) low = scale;
+			else high = scale;
+		}
+
+		return 0.5f * (low + high);
+	}
+
+	void storeImage(TextureDecoder::Image& image, const float* pTexels, uint32_t width, uint32_t height,
+		bool isSRGB, bool isAlphaWeighted, float alphaScale)
+	{
+		const auto& tables = getColorTables();
+		image.Format = Format::R8G8B8A8_UNORM;
+		image.Width = width;
+		image.Height = height;
+		image.RowPitch = 4 * width;
+		image.Pixels.resize(static_cast<size_t>(image.RowPitch) * height);
+
+		const auto zero = _mm_setzero_ps();
+		const auto one = _mm_set1_ps(1.0f);
+		const auto numTexels = static_cast<size_t>(width) * height;
+		for (size_t i = 0; i < numTexels; ++i)
+		{
+			auto texel = _mm_loadu_ps(&pTexels[4 * i]);
+			const auto alpha = pTexels[4 * i + 3];
+			if (isAlphaWeighted) texel = _mm_mul_ps(texel, _mm_set1_ps(1.0f / (max)(getAlphaWeight(alpha), MIN_ALPHA_WEIGHT)));
+			texel = _mm_min_ps(_mm_max_ps(texel, zero), one);
+
+			alignas(16) float c[4];
+			_mm_store_ps(c, texel);
+			const auto pDst = &image.Pixels[4 * i];
+			for (uint8_t j = 0; j < 3; ++j)
+				pDst[j] = isSRGB ? tables.LinearToSRGB[static_cast<uint32_t>(c[j] * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)] :
+					static_cast<uint8_t>(c[j] * 255.0f + 0.5f);
+			pDst[3] = static_cast<uint8_t>((min)((max)(alpha * alphaScale, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	bool isSRGBFormat(Format format)
+	{
+		switch (format)
+		{
+		case Format::R8G8B8A8_UNORM_SRGB:
+		case Format::B8G8R8A8_UNORM_SRGB:
+		case Format::B8G8R8X8_UNORM_SRGB:
+		case Format::BC1_UNORM_SRGB:
+		case Format::BC2_UNORM_SRGB:
+		case Format::BC3_UNORM_SRGB:
+		case Format::BC7_UNORM_SRGB:
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Mip generator
+//--------------------------------------------------------------------------------------
+
+bool MipGenerator::Generate(vector<TextureDecoder::Image>& mips, uint8_t numMips, Filter filter,
+	bool isSRGB, float alphaReference, uint32_t numThreads)
+{
+	XUSG_N_RETURN(!mips.empty() && mips[0].Format == Format::R8G8B8A8_UNORM, false);
+	XUSG_N_RETURN(numMips <= GetFullMipLevels(mips[0].Width, mips[0].Height), false);
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+
+	const auto& tables = getColorTables();
+	const auto& kernel = getKernel(filter);
+	const auto& source = mips[0];
+	auto width = source.Width;
+	auto height = source.Height;
+
+	// Convert to linear float, with colors weighted by alpha when there is any, so that
+	// the colors of transparent texels do not bleed into the coarser mips.
+	auto hasAlpha = false;
+	for (size_t i = 3; i < source.Pixels.size() && !hasAlpha; i += 4) hasAlpha = source.Pixels[i] < 255;
+
+	vector<float> texels(4 * static_cast<size_t>(width) * height);
+	parallelFor(height, numThreads, [&](uint32_t y)
+	{
+		const auto pSrc = &source.Pixels[static_cast<size_t>(source.RowPitch) * y];
+		const auto pDst = &texels[4 * static_cast<size_t>(width) * y];
+		for (auto x = 0u; x < width; ++x)
+		{
+			const auto alpha = pSrc[4 * x + 3] / 255.0f;
+			const auto weight = hasAlpha ? getAlphaWeight(alpha) : 1.0f;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto c = pSrc[4 * x + j];
+				pDst[4 * x + j] = (isSRGB ? tables.SRGBToLinear[c] : c / 255.0f) * weight;
+			}
+			pDst[4 * x + 3] = alpha;
+		}
+	});
+
+	const auto useCoverage = hasAlpha && alphaReference > 0.0f;
+	const auto targetCoverage = useCoverage ? ComputeAlphaCoverage(texels.data(), texels.size() / 4, alphaReference) : 1.0f;
+
+	// Each mip is filtered from the previous one in float, and the alpha scale is only
+	// applied when storing, so that it does not compound down the chain.
+	mips.resize(numMips);
+	vector<float> filtered;
+	vector<float> nextTexels;
+	for (uint8_t level = 1; level < numMips; ++level)
+	{
+		const auto dstWidth = (max)(width >> 1, 1u);
+		const auto dstHeight = (max)(height >> 1, 1u);
+
+		filtered.resize(4 * static_cast<size_t>(dstWidth) * height);
+		parallelFor(height, numThreads, [&](uint32_t y)
+		{
+			downsampleRow(&filtered[4 * static_cast<size_t>(dstWidth) * y],
+				&texels[4 * static_cast<size_t>(width) * y], width, dstWidth, kernel);
+		});
+
+		nextTexels.resize(4 * static_cast<size_t>(dstWidth) * dstHeight);
+		parallelFor(dstHeight, numThreads, [&](uint32_t y)
+		{
+			downsampleColumn(&nextTexels[4 * static_cast<size_t>(dstWidth) * y],
+				filtered.data(), dstWidth, height, y, kernel);
+		});
+
+		texels.swap(nextTexels);
+		width = dstWidth;
+		height = dstHeight;
+
+		const auto alphaScale = useCoverage ? fitAlphaScale(texels.data(), texels.size() / 4,
+			alphaReference, targetCoverage) : 1.0f;
+		storeImage(mips[level], texels.data(), width, height, isSRGB, hasAlpha, alphaScale);
+	}
+
+	return true;
+}
+
+bool MipGenerator::GenerateFile(const wchar_t* dstFileName, const wchar_t* srcFileName, bool isSRGB,
+	float alphaReference, Filter filter, uint32_t numThreads)
+{
+	vector<uint8_t> data;
+	XUSG_N_RETURN(DDS::Parser::LoadFile(data, srcFileName), false);
+
+	DDS::TextureInfo info;
+	XUSG_N_RETURN(DDS::Parser::ParseHeader(info, data.data(), data.size()), false);
+	XUSG_N_RETURN(info.Dimension != DDS::Dimension::TEXTURE3D, false);
+	XUSG_N_RETURN(TextureDecoder::GetDecodedFormat(info.Format) == Format::R8G8B8A8_UNORM, false);
+
+	vector<TextureDecoder::Image> images;
+	XUSG_N_RETURN(TextureDecoder::Decode(images, info, data.data(), data.size(), numThreads), false);
+
+	isSRGB = isSRGB || isSRGBFormat(info.Format);
+
+	// Generate the chains from the top mip of each array slice.
+	const auto numMips = GetFullMipLevels(info.Width, info.Height);
+	vector<vector<TextureDecoder::Image>> chains(info.ArraySize);
+	for (auto i = 0u; i < info.ArraySize; ++i)
+	{
+		chains[i].resize(1);
+		chains[i][0] = move(images[i * info.MipLevels]);
+		XUSG_N_RETURN(Generate(chains[i], numMips, filter, isSRGB, alphaReference, numThreads), false);
+	}
+
+	// The generated levels of all slices as an R8G8B8A8 texture from firstMip down
+	const auto getRGBAFile = [&](vector<uint8_t>& rgbaFile, DDS::TextureInfo& rgbaInfo, uint8_t firstMip)
+	{
+		rgbaInfo = info;
+		rgbaInfo.Format = isSRGB ? Format::R8G8B8A8_UNORM_SRGB : Format::R8G8B8A8_UNORM;
+		rgbaInfo.Width = (max)(info.Width >> firstMip, 1u);
+		rgbaInfo.Height = (max)(info.Height >> firstMip, 1u);
+		rgbaInfo.MipLevels = numMips - firstMip;
+		DDS::Parser::WriteHeader(rgbaFile, rgbaInfo);
+		for (const auto& chain : chains)
+			for (auto m = firstMip; m < numMips; ++m)
+				rgbaFile.insert(rgbaFile.end(), chain[m].Pixels.cbegin(), chain[m].Pixels.cend());
+	};
+
+	// BC sources keep the blocks of their top mips as they are, and the generated levels are
+	// encoded to the same format where the encoder supports it; others stay uncompressed.
+	vector<uint8_t> ddsFile;
+	if (DDS::Parser::IsBlockCompressed(info.Format) && numMips > 1)
+	{
+		vector<uint8_t> rgbaFile, encodedFile;
+		DDS::TextureInfo rgbaInfo, encodedInfo;
+		vector<DDS::SubresourceLayout> layouts, encodedLayouts;
+		getRGBAFile(rgbaFile, rgbaInfo, 1);
+		if (TextureEncoder::Encode(encodedFile, rgbaInfo, rgbaFile.data(), rgbaFile.size(), info.Format,
+			TextureEncoder::Quality::NORMAL, srcFileName, nullptr, numThreads) &&
+			DDS::Parser::ParseHeader(encodedInfo, encodedFile.data(), encodedFile.size()) &&
+			DDS::Parser::GetSubresourceLayouts(encodedLayouts, encodedInfo, encodedFile.size()) &&
+			DDS::Parser::GetSubresourceLayouts(layouts, info, data.size()))
+		{
+			auto dstInfo = info;
+			dstInfo.MipLevels = numMips;
+			DDS::Parser::WriteHeader(ddsFile, dstInfo);
+			for (auto i = 0u; i < info.ArraySize; ++i)
+			{
+				const auto& top = layouts[i * info.MipLevels];
+				ddsFile.insert(ddsFile.end(), data.cbegin() + top.Offset, data.cbegin() + top.Offset + top.SlicePitch);
+				for (auto m = 0u; m + 1u < numMips; ++m)
+				{
+					const auto& layout = encodedLayouts[i * (numMips - 1) + m];
+					ddsFile.insert(ddsFile.end(), encodedFile.cbegin() + layout.Offset,
+						encodedFile.cbegin() + layout.Offset + layout.SlicePitch);
+				}
+			}
+		}
+	}
+
+	if (ddsFile.empty())
+	{
+		DDS::TextureInfo rgbaInfo;
+		getRGBAFile(ddsFile, rgbaInfo, 0);
+	}
+
+	return DDS::Parser::SaveFile(dstFileName, ddsFile);
+}
+
+wstring MipGenerator::GetCachedFile(const wchar_t* fileName, const wchar_t* cacheDirectory,
+	bool isSRGB, float alphaReference, Filter filter)
+{
+	DDS::TextureInfo info;
+	if (!DDS::Parser::LoadHeader(info, fileName) || info.Dimension == DDS::Dimension::TEXTURE3D ||
+		info.MipLevels >= GetFullMipLevels(info.Width, info.Height) ||
+		TextureDecoder::GetDecodedFormat(info.Format) != Format::R8G8B8A8_UNORM)
+		return fileName;
+
+	// Flatten the source path into the cache file name, followed by the generation settings
+	// that change the output: color space, the alpha reference in 8-bit steps, and the filter.
+	wstring cacheName = fileName;
+	replace_if(cacheName.begin(), cacheName.end(), [](wchar_t c) { return c == L'/' || c == L'\\' || c == L':'; }, L'_');
+	cacheName += isSRGB ? L".srgb" : L".linear";
+	if (alphaReference > 0.0f) cacheName += L".a" + to_wstring(lroundf((min)(alphaReference, 1.0f) * 255.0f));
+	cacheName += getFilterName(filter);
+	const auto cacheFileName = wstring(cacheDirectory) + L"/" + cacheName + L".dds";
+
+	// Reuse the cached file unless the source has changed since.
+	struct _stat64 srcStat, cacheStat;
+	if (_wstat64(fileName, &srcStat) == 0 && _wstat64(cacheFileName.c_str(), &cacheStat) == 0 &&
+		cacheStat.st_mtime >= srcStat.st_mtime)
+		return cacheFileName;
+
+	CreateDirectoryW(cacheDirectory, nullptr);
+
+	return GenerateFile(cacheFileName.c_str(), fileName, isSRGB, alphaReference, filter) ? cacheFileName : fileName;
+}
+
+uint8_t MipGenerator::GetFullMipLevels(uint32_t width, uint32_t height)
+{
+	uint8_t numMips = 1;
+	for (auto size = (max)(width, height); size > 1; size >>= 1) ++numMips;
+
+	return numMips;
+}
+
+float MipGenerator::ComputeAlphaCoverage(const float* pTexels, size_t numTexels, float alphaReference, float scale)
+{
+	size_t numCovered = 0;
+	for (size_t i = 0; i < numTexels; ++i)
+		if (pTexels[4 * i + 3] * scale >= alphaReference) ++numCovered;
+
+	return numTexels > 0 ? static_cast<float>(numCovered) / numTexels : 0.0f;
+}
@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "TextureDecoder.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// CPU mip-chain generation for textures shipped without mips. Filtering runs in linear
+	// space on alpha-weighted colors, with SSE and a thread per band of rows; the results
+	// go into an asset cache so that each texture is only processed once.
+	//--------------------------------------------------------------------------------------
+	class MipGenerator
+	{
+	public:
+		enum class Filter : uint8_t
+		{
+			BOX,
+			KAISER
+		};
+
+		// Fills mips 1 to numMips - 1 from mips[0], an R8G8B8A8 image. A positive alphaReference
+		// keeps the fraction of texels passing that alpha test the same in every mip.
+		static bool Generate(std::vector<TextureDecoder::Image>& mips, uint8_t numMips, Filter filter = Filter::KAISER,
+			bool isSRGB = false, float alphaReference = 0.0f, uint32_t numThreads = 0);
+
+		// Rebuilds a DDS file with full mip chains for all array slices. BC sources the encoder
+		// supports keep their top mips verbatim and get the other levels encoded in the same
+		// format; others are stored in R8G8B8A8. Pass the alpha-test reference of alpha-tested
+		// materials only; other textures with alpha keep their filtered alpha.
+		static bool GenerateFile(const wchar_t* dstFileName, const wchar_t* srcFileName, bool isSRGB,
+			float alphaReference = 0.0f, Filter filter = Filter::KAISER, uint32_t numThreads = 0);
+
+		// Returns fileName if the texture has a full mip chain, or else the cached copy with one,
+		// generated when missing or older than the source. The cache file name records isSRGB,
+		// alphaReference and the filter with its parameters, so that each combination has its own
+		// copy.
+		static std::wstring GetCachedFile(const wchar_t* fileName, const wchar_t* cacheDirectory,
+			bool isSRGB, float alphaReference = 0.0f, Filter filter = Filter::KAISER);
+
+		static uint8_t GetFullMipLevels(uint32_t width, uint32_t height);
+
+		// Fraction of texels of an RGBA float image with alpha * scale >= alphaReference
+		static float ComputeAlphaCoverage(const float* pTexels, size_t numTexels, float alphaReference,
+			float scale = 1.0f);
+	};
+}
@@ -0,0 +1,350 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "MipStreamer.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+static uint8_t getMinMip(uint32_t size, uint8_t mipLevels, uint32_t maxSize)
+{
+	uint8_t mip = 0;
+	if (maxSize > 0) while (mip + 1 < mipLevels && (size >> mip) > maxSize) ++mip;
+
+	return mip;
+}
+
+MipStreamer::MipStreamer() :
+	m_pStreamer(nullptr),
+	m_pResidency(nullptr),
+	m_tailSize(64),
+	m_maxRequestsPerUpdate(4),
+	m_downgradeDelay(60)
+{
+}
+
+MipStreamer::~MipStreamer()
+{
+}
+
+bool MipStreamer::Init(TextureStreamer* pStreamer, uint32_t tailSize, uint32_t maxRequestsPerUpdate,
+	uint32_t downgradeDelay)
+{
+	XUSG_N_RETURN(pStreamer && tailSize > 0 && maxRequestsPerUpdate > 0, false);
+
+	m_pStreamer = pStreamer;
+	m_tailSize = tailSize;
+	m_maxRequestsPerUpdate = maxRequestsPerUpdate;
+	m_downgradeDelay = downgradeDelay;
+	m_requests.resize(maxRequestsPerUpdate);
+
+	return true;
+}
+
+uint32_t MipStreamer::AddTexture(const wchar_t* fileName, bool forceSRGB, uint32_t maxSize,
+	float alphaReference)
+{
+	const auto filePath = m_mipCacheDirectory.empty() ? wstring(fileName) :
+		MipGenerator::GetCachedFile(fileName, m_mipCacheDirectory.c_str(), forceSRGB, alphaReference);
+	fileName = filePath.c_str();
+
+	DDS::TextureInfo info;
+	XUSG_N_RETURN(DDS::Parser::LoadHeader(info, fileName), UINT32_MAX);
+
+	Entry entry = {};
+	entry.FileName = fileName;
+	entry.IsSRGB = forceSRGB;
+	for (uint8_t m = 0; m < info.MipLevels; ++m)
+		if (TextureStreamer::IsValidTopMip(info, m)) entry.ValidMipMask |= 1 << m;
+	XUSG_N_RETURN(entry.ValidMipMask, UINT32_MAX);
+
+	TextureDesc desc = {};
+	desc.Size = (max)(info.Width, info.Height);
+	desc.MipLevels = info.MipLevels;
+
+	// The tail is the most detailed valid mip within the tail size, or else the coarsest valid one.
+	desc.TailMip = UINT8_MAX;
+	for (uint8_t m = 0; m < info.MipLevels; ++m)
+	{
+		if (!(entry.ValidMipMask & (1 << m))) continue;
+		if (desc.TailMip == UINT8_MAX || (desc.Size >> desc.TailMip) > m_tailSize) desc.TailMip = m;
+	}
+
+	const auto texture = static_cast<uint32_t>(m_textures.size());
+	m_textures.push_back(move(entry));
+	m_descs.push_back(desc);
+	m_desiredMips.push_back(desc.TailMip);
+	m_targetMips.push_back(desc.TailMip);
+	m_residentMips.push_back(desc.TailMip);
+	m_pending.push_back(0);
+	SetMaxSize(texture, maxSize);
+
+	// Mip tails are queued ahead of any higher mip, so that the first frame can render with them.
+	auto& newEntry = m_textures.back();
+	if (!m_pStreamer->CreateTexture(fileName, newEntry.Texture, forceSRGB, &newEntry.RequestId,
+		fileName, nullptr, desc.TailMip))
+	{
+		m_textures.pop_back();
+		m_descs.pop_back();
+		m_desiredMips.pop_back();
+		m_targetMips.pop_back();
+		m_residentMips.pop_back();
+		m_pending.pop_back();
+
+		return UINT32_MAX;
+	}
+
+	if (m_pResidency)
+	{
+		assert(m_pResidency->GetNumTextures() == texture);
+		m_pResidency->AddTexture(info, desc.TailMip, desc.TailMip, newEntry.ValidMipMask);
+	}
+
+	return texture;
+}
+
+void MipStreamer::AddUsage(uint32_t texture, const XMFLOAT3& center, float radius, float uvScale)
+{
+	assert(texture < m_textures.size());
+	m_usages.push_back({ center, radius, uvScale, texture });
+}
+
+void MipStreamer::ClearUsages()
+{
+	m_usages.clear();
+}
+
+void MipStreamer::SetMaxSize(uint32_t texture, uint32_t maxSize)
+{
+	auto& desc = m_descs[texture];
+	desc.MinMip = getValidMip(texture, (min)(getMinMip(desc.Size, desc.MipLevels, maxSize), desc.TailMip));
+}
+
+void MipStreamer::Update(uint64_t frame, FXMVECTOR eyePt, float projScale)
+{
+	m_updatedTextures.clear();
+	if (m_pResidency) m_pResidency->Update(frame);
+
+	// Release the replaced textures once the GPU can no longer reference them.
+	while (!m_retired.empty() && m_retired.front().first + RETIRE_LATENCY <= frame) m_retired.pop_front();
+
+	// Swap in the completed requests
+	const auto numTextures = GetNumTextures();
+	for (auto i = 0u; i < numTextures; ++i)
+	{
+		if (!m_pending[i]) continue;
+
+		auto& entry = m_textures[i];
+		if (!m_pStreamer->IsReady(entry.RequestId)) continue;
+
+		m_retired.emplace_back(frame, move(entry.Texture));
+		entry.Texture = move(entry.PendingTexture);
+		m_residentMips[i] = entry.PendingMip;
+		m_pending[i] = 0;
+		m_updatedTextures.push_back(i);
+	}
+
+	// Move the targets: finer immediately, coarser only after a delay
+	ComputeDesiredMips(m_desiredMips.data(), m_descs.data(), numTextures, m_usages.data(),
+		static_cast<uint32_t>(m_usages.size()), eyePt, projScale);
+	for (auto i = 0u; i < numTextures; ++i)
+	{
+		auto& entry = m_textures[i];
+		const auto desiredMip = getValidMip(i, m_desiredMips[i]);
+
+		if (m_pResidency && desiredMip < m_descs[i].TailMip) m_pResidency->Touch(i, frame);
+
+		if (desiredMip < m_targetMips[i])
+		{
+			m_targetMips[i] = m_pResidency ? m_pResidency->Request(i, desiredMip, frame) : desiredMip;
+			entry.NumCoarserFrames = 0;
+		}
+		else if (desiredMip > m_targetMips[i])
+		{
+			if (++entry.NumCoarserFrames >= m_downgradeDelay)
+			{
+				m_targetMips[i] = desiredMip;
+				entry.NumCoarserFrames = 0;
+				if (m_pResidency) m_pResidency->Release(i, desiredMip);
+			}
+		}
+		else entry.NumCoarserFrames = 0;
+	}
+
+	// Follow the evictions made to fit the budget
+	if (m_pResidency)
+	{
+		for (const auto& i : m_pResidency->GetEvictedTextures())
+		{
+			m_targetMips[i] = (max)(m_targetMips[i], m_pResidency->GetResidentMip(i));
+			m_textures[i].NumCoarserFrames = 0;
+		}
+	}
+
+	const auto numRequests = SelectRequests(m_requests.data(), m_maxRequestsPerUpdate, m_targetMips.data(),
+		m_residentMips.data(), m_pending.data(), numTextures);
+	for (auto i = 0u; i < numRequests; ++i)
+	{
+		const auto texture = m_requests[i];
+		auto& entry = m_textures[texture];
+		entry.PendingMip = m_targetMips[texture];
+		if (m_pStreamer->CreateTexture(entry.FileName.c_str(), entry.PendingTexture, entry.IsSRGB,
+			&entry.RequestId, entry.FileName.c_str(), nullptr, entry.PendingMip))
+			m_pending[texture] = 1;
+		else m_targetMips[texture] = m_residentMips[texture];
+	}
+}
+
+void MipStreamer::ComputeDesiredMips(uint8_t* pMips, const TextureDesc* pTextures, uint32_t numTextures,
+	const Usage* pUsages, uint32_t numUsages, FXMVECTOR eyePt, float projScale)
+{
+	for (auto i = 0u; i < numTextures; ++i) pMips[i] = pTextures[i].TailMip;
+
+	for (auto i = 0u; i < numUsages; ++i)
+	{
+		const auto& usage = pUsages[i];
+		const auto& desc = pTextures[usage.Texture];
+		const auto dist = XMVectorGetX(XMVector3Length(XMLoadFloat3(&usage.Center) - eyePt));
+
+		uint8_t mip = desc.MinMip;
+		if (dist > usage.Radius)
+		{
+			// Texels across the bound over the pixels it covers on screen
+			const auto pixels = 2.0f * usage.Radius * projScale / dist;
+			const auto ratio = pixels > 0.0f ? desc.Size * usage.UVScale / pixels : FLT_MAX;
+			if (ratio > 1.0f)
+			{
+				const auto level = static_cast<uint32_t>((min)(floorf(log2f(ratio)), 255.0f));
+				mip = static_cast<uint8_t>((min)((max)(level, static_cast<uint32_t>(desc.MinMip)),
+					static_cast<uint32_t>(desc.TailMip)));
+			}
+		}
+
+		pMips[usage.Texture] = (min)(pMips[usage.Texture], mip);
+	}
+}
+
+uint32_t MipStreamer::SelectRequests(uint32_t* pRequests, uint32_t maxRequests, const uint8_t* pTargetMips,
+	const uint8_t* pResidentMips, const uint8_t* pPending, uint32_t numTextures)
+{
+	// Keys order by upgrade first, then by mip deficit, then by lower index; a min-heap keeps the
+	// best maxRequests of them.
+	vector<uint64_t> heap;
+	heap.reserve(maxRequests);
+	for (auto i = 0u; i < numTextures; ++i)
+	{
+		if (pPending[i] || pTargetMips[i] == pResidentMips[i]) continue;
+
+		const auto isUpgrade = pTargetMips[i] < pResidentMips[i];
+		const uint64_t score = isUpgrade ? 0x100u + pResidentMips[i] - pTargetMips[i] : pTargetMips[i] - pResidentMips[i];
+		const auto key = (score << 32) | (UINT32_MAX - i);
+
+		if (heap.size() < maxRequests)
+		{
+			heap.push_back(key);
+			push_heap(heap.begin(), heap.end(), greater<uint64_t>());
+		}
+		else if (key > heap.front())
+		{
+			pop_heap(heap.begin(), heap.end(), greater<uint64_t>());
+			heap.back() = key;
+			push_heap(heap.begin(), heap.end(), greater<uint64_t>());
+		}
+	}
+
+	sort(heap.begin(), heap.end(), greater<uint64_t>());
+	const auto numRequests = static_cast<uint32_t>(heap.size());
+	for (auto i = 0u; i < numRequests; ++i) pRequests[i] = UINT32_MAX - static_cast<uint32_t>(heap[i]);
+
+	return numRequests;
+}
+
+void MipStreamer::Benchmark(BenchmarkResult& result, uint32_t numTextures, uint32_t usagesPerTexture,
+	uint32_t numFrames, uint32_t maxRequests)
+{
+	result = {};
+	XUSG_N_RETURN(numTextures > 0 && usagesPerTexture > 0 && numFrames > 0 && maxRequests > 0, );
+
+	mt19937 rng(0x5eed);
+	uniform_int_distribution<uint32_t> sizeLog2(8, 12);
+	uniform_real_distribution<float> position(-2000.0f, 2000.0f);
+	uniform_real_distribution<float> radius(1.0f, 50.0f);
+	uniform_real_distribution<float> uvScale(0.5f, 8.0f);
+
+	vector<TextureDesc> descs(numTextures);
+	for (auto& desc : descs)
+	{
+		const auto mipLevels = sizeLog2(rng) + 1;
+		desc.Size = 1u << (mipLevels - 1);
+		desc.MipLevels = static_cast<uint8_t>(mipLevels);
+		desc.MinMip = 0;
+		desc.TailMip = static_cast<uint8_t>(mipLevels - 7);	// 64 texels
+	}
+
+	const auto numUsages = numTextures * usagesPerTexture;
+	vector<Usage> usages(numUsages);
+	for (auto i = 0u; i < numUsages; ++i)
+	{
+		auto& usage = usages[i];
+		usage.Center = XMFLOAT3(position(rng), position(rng) * 0.05f, position(rng));
+		usage.Radius = radius(rng);
+		usage.UVScale = uvScale(rng);
+		usage.Texture = i % numTextures;
+	}
+
+	// Viewport height 1080 with a 45-degree vertical field of view
+	const auto projScale = 1080.0f * 0.5f / tanf(XM_PIDIV4 * 0.5f);
+
+	vector<uint8_t> desiredMips(numTextures), residentMips(numTextures), pending(numTextures, 0);
+	vector<uint32_t> requests(maxRequests);
+	const auto run = [&](vector<uint32_t>& requestLog)
+	{
+		chrono::duration<double, milli> desiredTime(0.0), selectTime(0.0);
+		for (auto i = 0u; i < numTextures; ++i) residentMips[i] = descs[i].TailMip;
+
+		for (auto n = 0u; n < numFrames; ++n)
+		{
+			const auto angle = XM_2PI * n / numFrames;
+			const auto eyePt = XMVectorSet(cosf(angle) * 1500.0f, 20.0f, sinf(angle) * 1500.0f, 0.0f);
+
+			auto start = chrono::high_resolution_clock::now();
+			ComputeDesiredMips(desiredMips.data(), descs.data(), numTextures, usages.data(), numUsages, eyePt, projScale);
+			desiredTime += chrono::high_resolution_clock::now() - start;
+
+			start = chrono::high_resolution_clock::now();
+			const auto numRequests = SelectRequests(requests.data(), maxRequests, desiredMips.data(),
+				residentMips.data(), pending.data(), numTextures);
+			selectTime += chrono::high_resolution_clock::now() - start;
+
+			for (auto i = 0u; i < numRequests; ++i)
+			{
+				const auto texture = requests[i];
+				residentMips[texture] = desiredMips[texture];
+				requestLog.push_back(texture);
+				requestLog.push_back(desiredMips[texture]);
+			}
+		}
+
+		result.DesiredMilliseconds = desiredTime.count() / numFrames;
+		result.SelectMilliseconds = selectTime.count() / numFrames;
+	};
+
+	vector<uint32_t> requestLogs[2];
+	run(requestLogs[1]);
+	run(requestLogs[0]);
+
+	result.NumRequests = static_cast<uint32_t>(requestLogs[0].size() / 2);
+	result.IsDeterministic = requestLogs[0] == requestLogs[1];
+}
+
+uint8_t MipStreamer::getValidMip(uint32_t texture, uint8_t mip) const
+{
+	const auto mask = m_textures[texture].ValidMipMask;
+	for (auto m = static_cast<int>(mip); m >= 0; --m) if (mask & (1 << m)) return static_cast<uint8_t>(m);
+
+	return 0;
+}
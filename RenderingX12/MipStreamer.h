@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
+#include "MipGenerator.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Progressive texture loading: the mip tail is loaded up front, and the resident top mip
+	// then follows the projected screen-space size of the meshes using each texture.
+	//--------------------------------------------------------------------------------------
+	class MipStreamer
+	{
+	public:
+		struct TextureDesc
+		{
+			uint32_t	Size;			// Larger dimension of mip 0
+			uint8_t		MipLevels;
+			uint8_t		MinMip;			// Most detailed mip allowed by the max size
+			uint8_t		TailMip;		// Always resident
+			uint8_t		Reserved;
+		};
+
+		// World-space bound of a mesh subset sampling the texture
+		struct Usage
+		{
+			DirectX::XMFLOAT3 Center;
+			float		Radius;
+			float		UVScale;		// Texture repeats across the bound
+			uint32_t	Texture;
+		};
+
+		struct BenchmarkResult
+		{
+			double		DesiredMilliseconds;	// ComputeDesiredMips per frame
+			double		SelectMilliseconds;		// SelectRequests per frame
+			uint32_t	NumRequests;			// Over all frames
+			bool		IsDeterministic;		// A second run issued the same requests in the same order
+		};
+
+		MipStreamer();
+		virtual ~MipStreamer();
+
+		bool Init(TextureStreamer* pStreamer, uint32_t tailSize = 64,
+			uint32_t maxRequestsPerUpdate = 4, uint32_t downgradeDelay = 60);
+
+		// Optional memory budget; set before adding textures
+		void SetResidency(TextureResidency* pResidency) { m_pResidency = pResidency; }
+
+		// Textures lacking a full mip chain are then loaded from generated copies in this directory
+		void SetMipCache(const wchar_t* cacheDirectory) { m_mipCacheDirectory = cacheDirectory ? cacheDirectory : L""; }
+
+		// Queues the mip tail of the texture and returns its index, or UINT32_MAX on failure.
+		// alphaReference is the alpha-test reference of alpha-tested materials, 0 otherwise.
+		uint32_t AddTexture(const wchar_t* fileName, bool forceSRGB = false, uint32_t maxSize = 0,
+			float alphaReference = 0.0f);
+		void AddUsage(uint32_t texture, const DirectX::XMFLOAT3& center, float radius, float uvScale = 1.0f);
+		void ClearUsages();
+
+		// Per-texture limit on the larger dimension; 0 for the full resolution
+		void SetMaxSize(uint32_t texture, uint32_t maxSize);
+
+		// projScale is the viewport height times proj._22 / 2, i.e. pixels per unit at distance 1
+		void Update(uint64_t frame, DirectX::FXMVECTOR eyePt, float projScale);
+
+		const Texture::sptr& GetTexture(uint32_t texture) const { return m_textures[texture].Texture; }
+		uint8_t GetResidentMip(uint32_t texture) const { return m_residentMips[texture]; }
+		uint8_t GetTargetMip(uint32_t texture) const { return m_targetMips[texture]; }
+		uint32_t GetNumTextures() const { return static_cast<uint32_t>(m_textures.size()); }
+
+		// Textures swapped by the last update; their descriptors need recreating
+		const std::vector<uint32_t>& GetUpdatedTextures() const { return m_updatedTextures; }
+
+		// Most detailed mip wanted by each texture, from the closest of its usages
+		static void ComputeDesiredMips(uint8_t* pMips, const TextureDesc* pTextures, uint32_t numTextures,
+			const Usage* pUsages, uint32_t numUsages, DirectX::FXMVECTOR eyePt, float projScale);
+
+		// Picks up to maxRequests textures whose target differs from their resident mip; the
+		// largest deficit comes first and ties go to the lower index.
+		static uint32_t SelectRequests(uint32_t* pRequests, uint32_t maxRequests, const uint8_t* pTargetMips,
+			const uint8_t* pResidentMips, const uint8_t* pPending, uint32_t numTextures);
+
+		// Runs the priority computation over synthetic textures of 256 to 4096 texels and their
+		// usages, along a camera orbit; requests complete at once.
+		static void Benchmark(BenchmarkResult& result, uint32_t numTextures = 10000, uint32_t usagesPerTexture = 4,
+			uint32_t numFrames = 64, uint32_t maxRequests = 16);
+
+		using uptr = std::unique_ptr<MipStreamer>;
+		using sptr = std::shared_ptr<MipStreamer>;
+
+	protected:
+		static const uint8_t RETIRE_LATENCY = 3;
+
+		struct Entry
+		{
+			std::wstring	FileName;
+			Texture::sptr	Texture;
+			Texture::sptr	PendingTexture;
+			uint64_t		RequestId;
+			uint32_t		NumCoarserFrames;
+			uint16_t		ValidMipMask;	// Mips usable as mip 0 of a texture
+			uint8_t			PendingMip;
+			bool			IsSRGB;
+		};
+
+		uint8_t getValidMip(uint32_t texture, uint8_t mip) const;
+
+		TextureStreamer*			m_pStreamer;
+		TextureResidency*			m_pResidency;
+		std::vector<Entry>			m_textures;
+		std::vector<TextureDesc>	m_descs;
+		std::vector<Usage>			m_usages;
+		std::vector<uint8_t>		m_desiredMips;
+		std::vector<uint8_t>		m_targetMips;
+		std::vector<uint8_t>		m_residentMips;
+		std::vector<uint8_t>		m_pending;		// Non-zero while a request is in flight
+		std::vector<uint32_t>		m_requests;
+		std::vector<uint32_t>		m_updatedTextures;
+		std::deque<std::pair<uint64_t, Texture::sptr>> m_retired;
+		std::wstring				m_mipCacheDirectory;
+
+		uint32_t					m_tailSize;
+		uint32_t					m_maxRequestsPerUpdate;
+		uint32_t					m_downgradeDelay;
+	};
+}
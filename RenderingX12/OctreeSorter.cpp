@@ -0,0 +1,278 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "OctreeSorter.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+OctreeSorter::OctreeSorter() :
+	m_workers(0),
+	m_pFunc(nullptr),
+	m_next(0),
+	m_count(0),
+	m_numBusy(0),
+	m_generation(0),
+	m_isQuitting(false),
+	m_runs(0),
+	m_numCulled(),
+	m_splitLevel(3)
+{
+}
+
+OctreeSorter::~OctreeSorter()
+{
+	stop();
+}
+
+void OctreeSorter::Init(uint32_t numThreads, uint8_t splitLevel)
+{
+	stop();
+
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+	m_splitLevel = splitLevel;
+	m_isQuitting = false;
+	for (auto i = 1u; i < numThreads; ++i) m_workers.emplace_back(&OctreeSorter::run, this);
+}
+
+void OctreeSorter::Sort(vector<XMUINT2>& opaqueQueue, vector<XMUINT2>& alphaQueue,
+	const LinearOctree* pOpaqueTree, const LinearOctree* pAlphaTree, CXMMATRIX viewProj,
+	FXMVECTOR eyePt, bool isAlphaQueueN2F, bool isAllVisible, const SoftwareOcclusion* pOcclusion)
+{
+	// One run for the items above the split level of each tree, then one per subtree
+	const LinearOctree* pTrees[] = { pOpaqueTree, pAlphaTree };
+	FrustumCulling::Frustum frusta[2];
+	uint32_t runBegins[3] = {};
+	auto numRuns = 0u;
+	for (uint8_t t = 0; t < 2; ++t)
+	{
+		runBegins[t] = numRuns;
+		if (pTrees[t] && pTrees[t]->GetNumNodes() > 0)
+		{
+			if (m_runs.size() <= numRuns) m_runs.resize(numRuns + 1);
+			m_runs[numRuns].Items.clear();
+			m_runs[numRuns].NumCulled = 0;
+			m_subtrees.clear();
+			pTrees[t]->GetFrustum(frusta[t], viewProj);
+			pTrees[t]->Split(m_subtrees, m_runs[numRuns].Items, frusta[t], m_splitLevel, isAllVisible, pOcclusion,
+				&m_runs[numRuns].NumCulled);
+
+			if (m_runs.size() < numRuns + 1 + m_subtrees.size()) m_runs.resize(numRuns + 1 + m_subtrees.size());
+			m_runs[numRuns++].Subtree = { UINT32_MAX, 0, false };
+			for (const auto& subtree : m_subtrees) m_runs[numRuns++].Subtree = subtree;
+			for (auto i = runBegins[t]; i < numRuns; ++i)
+			{
+				m_runs[i].pTree = pTrees[t];
+				m_runs[i].IsNearToFar = t == 0 || isAlphaQueueN2F;
+			}
+		}
+	}
+	runBegins[2] = numRuns;
+
+	// Traverse and sort each run
+	const function<void(uint32_t)> sortRun = [&](uint32_t i)
+	{
+		auto& run = m_runs[i];
+		if (run.Subtree.Node != UINT32_MAX)
+		{
+			run.Items.clear();
+			run.NumCulled = 0;
+			run.pTree->Collect(run.Items, frusta[run.pTree == pAlphaTree], run.Subtree, pOcclusion, &run.NumCulled);
+		}
+
+		const auto& itemBounds = run.pTree->GetItemBounds();
+		run.SortItems.resize(run.Items.size());
+		for (size_t j = 0; j < run.Items.size(); ++j)
+		{
+			const auto item = run.Items[j];
+			const auto center = XMVectorSet(itemBounds.CenterX[item], itemBounds.CenterY[item], itemBounds.CenterZ[item], 0.0f);
+			const auto distSq = XMVectorGetX(XMVector3LengthSq(center - eyePt));
+			run.SortItems[j] = SortItem(run.IsNearToFar ? distSq : -distSq, item);
+		}
+		sort(run.SortItems.begin(), run.SortItems.end());
+	};
+	dispatch(numRuns, sortRun);
+
+	// Merge the runs of each tree pairwise, in rounds of doubling stride
+	auto stride = 1u;
+	const function<void(uint32_t)> mergeRuns = [&](uint32_t i)
+	{
+		auto& run = m_runs[m_merges[i]];
+		const auto& other = m_runs[m_merges[i] + stride];
+		run.Merged.resize(run.SortItems.size() + other.SortItems.size());
+		merge(run.SortItems.cbegin(), run.SortItems.cend(), other.SortItems.cbegin(), other.SortItems.cend(), run.Merged.begin());
+		run.SortItems.swap(run.Merged);
+	};
+
+	for (;; stride *= 2)
+	{
+		m_merges.clear();
+		for (uint8_t t = 0; t < 2; ++t)
+			for (auto i = runBegins[t]; i + stride < runBegins[t + 1]; i += stride * 2)
+				m_merges.push_back(i);
+		if (m_merges.empty()) break;
+
+		dispatch(static_cast<uint32_t>(m_merges.size()), mergeRuns);
+	}
+
+	vector<XMUINT2>* pQueues[] = { &opaqueQueue, &alphaQueue };
+	for (uint8_t t = 0; t < 2; ++t)
+	{
+		m_numCulled[t] = 0;
+		for (auto i = runBegins[t]; i < runBegins[t + 1]; ++i) m_numCulled[t] += m_runs[i].NumCulled;
+		if (runBegins[t] == runBegins[t + 1]) continue;
+
+		const auto& meshIDs = pTrees[t]->GetMeshIDs();
+		const auto& sortItems = m_runs[runBegins[t]].SortItems;
+		auto& queue = *pQueues[t];
+		const auto offset = queue.size();
+		queue.resize(offset + sortItems.size());
+		for (size_t j = 0; j < sortItems.size(); ++j) queue[offset + j] = meshIDs[sortItems[j].second];
+	}
+}
+
+void OctreeSorter::Benchmark(vector<ScalingResult>& results, uint32_t numMeshes, uint32_t numViews, uint32_t numIterations)
+{
+	results.clear();
+	XUSG_N_RETURN(numMeshes > 0 && numViews > 0 && numIterations > 0, );
+
+	// Meshes scattered over a terrain-sized area, with a few large ones
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> position(-2000.0f, 2000.0f);
+	uniform_real_distribution<float> height(0.0f, 100.0f);
+	uniform_real_distribution<float> size(0.5f, 10.0f);
+	uniform_real_distribution<float> largeSize(20.0f, 200.0f);
+	vector<LinearOctree::Item> items[2];
+	for (auto i = 0u; i < numMeshes; ++i)
+	{
+		LinearOctree::Item item;
+		item.MeshID = XMUINT2(i / 16, i % 16);
+		item.Center = XMFLOAT3(position(rng), height(rng), position(rng));
+		const auto extent = i % 64 ? size(rng) : largeSize(rng);
+		item.Extents = XMFLOAT3(extent, extent * 0.5f, extent);
+		items[i % 10 ? 0 : 1].push_back(item);
+	}
+
+	LinearOctree trees[2];
+	for (uint8_t t = 0; t < 2; ++t)
+	{
+		trees[t].Init(XMFLOAT3(0.0f, 0.0f, 0.0f), 4400.0f);
+		trees[t].CreateTree(items[t].data(), static_cast<uint32_t>(items[t].size()));
+	}
+
+	vector<XMMATRIX> viewProjs(numViews);
+	vector<XMVECTOR> eyePts(numViews);
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 5000.0f);
+	for (auto i = 0u; i < numViews; ++i)
+	{
+		const auto angle = XM_2PI * i / numViews;
+		eyePts[i] = XMVectorSet(cosf(angle) * 1500.0f, 150.0f, sinf(angle) * 1500.0f, 0.0f);
+		viewProjs[i] = XMMatrixLookAtLH(eyePts[i], XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+	}
+
+	const auto maxThreads = (max)(thread::hardware_concurrency(), 1u);
+	vector<vector<XMUINT2>> referenceQueues(numViews * 2);
+	vector<XMUINT2> queues[2];
+	for (auto numThreads = 1u;; numThreads = (min)(numThreads * 2, maxThreads))
+	{
+		OctreeSorter sorter;
+		sorter.Init(numThreads);
+
+		ScalingResult result = { numThreads, 0.0, 1.0, true };
+		for (auto i = 0u; i < numViews; ++i)
+		{
+			queues[0].clear();
+			queues[1].clear();
+			sorter.Sort(queues[0], queues[1], &trees[0], &trees[1], viewProjs[i], eyePts[i]);
+			for (uint8_t t = 0; t < 2; ++t)
+			{
+				auto& referenceQueue = referenceQueues[i * 2 + t];
+				if (numThreads == 1) referenceQueue = queues[t];
+				else if (queues[t].size() != referenceQueue.size() || !equal(queues[t].cbegin(), queues[t].cend(),
+					referenceQueue.cbegin(), [](const XMUINT2& a, const XMUINT2& b) { return a.x == b.x && a.y == b.y; }))
+					result.IsDeterministic = false;
+			}
+		}
+
+		const auto start = chrono::high_resolution_clock::now();
+		for (auto n = 0u; n < numIterations; ++n)
+		{
+			for (auto i = 0u; i < numViews; ++i)
+			{
+				queues[0].clear();
+				queues[1].clear();
+				sorter.Sort(queues[0], queues[1], &trees[0], &trees[1], viewProjs[i], eyePts[i]);
+			}
+		}
+		const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+		result.Microseconds = seconds * 1.0e6 / (static_cast<double>(numIterations) * numViews);
+		if (!results.empty()) result.Speedup = results[0].Microseconds / result.Microseconds;
+		results.push_back(result);
+
+		if (numThreads >= maxThreads) break;
+	}
+}
+
+void OctreeSorter::dispatch(uint32_t count, const function<void(uint32_t)>& func)
+{
+	if (m_workers.empty() || count <= 1)
+	{
+		for (auto i = 0u; i < count; ++i) func(i);
+
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_pFunc = &func;
+		m_count = count;
+		m_next = 0;
+		m_numBusy = static_cast<uint32_t>(m_workers.size());
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	for (auto i = m_next++; i < count; i = m_next++) func(i);
+
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_numBusy == 0; });
+}
+
+void OctreeSorter::run()
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		const function<void(uint32_t)>* pFunc;
+		uint32_t count;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_isQuitting || m_generation != generation; });
+			if (m_isQuitting) return;
+			generation = m_generation;
+			pFunc = m_pFunc;
+			count = m_count;
+		}
+
+		for (auto i = m_next++; i < count; i = m_next++) (*pFunc)(i);
+
+		lock_guard<mutex> lock(m_mutex);
+		if (--m_numBusy == 0) m_done.notify_one();
+	}
+}
+
+void OctreeSorter::stop()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isQuitting = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& worker : m_workers) worker.join();
+	m_workers.clear();
+}
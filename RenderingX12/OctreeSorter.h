@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "LinearOctree.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Builds the opaque and alpha mesh-ID queues of linear octrees on a pool of persistent
+	// workers. The subtrees at the split level are traversed and sorted independently, then
+	// merged pairwise; ties in distance fall back to the item order, so the queues match
+	// those of LinearOctree::Sort for any number of threads.
+	//--------------------------------------------------------------------------------------
+	class OctreeSorter
+	{
+	public:
+		struct ScalingResult
+		{
+			uint32_t	NumThreads;
+			double		Microseconds;	// Per Sort of both queues
+			double		Speedup;		// Over one thread
+			bool		IsDeterministic;	// Queues identical to the single-threaded ones
+		};
+
+		OctreeSorter();
+		virtual ~OctreeSorter();
+
+		// numThreads of 0 uses all hardware threads, the calling one included.
+		void Init(uint32_t numThreads = 0, uint8_t splitLevel = 3);
+
+		// Either tree may be null. The opaque queue is near-to-far; the alpha queue far-to-near
+		// unless isAlphaQueueN2F. pOcclusion, if given, is shared read-only by the workers. Each
+		// tree culls with its camera contribution threshold.
+		void Sort(std::vector<DirectX::XMUINT2>& opaqueQueue, std::vector<DirectX::XMUINT2>& alphaQueue,
+			const LinearOctree* pOpaqueTree, const LinearOctree* pAlphaTree, DirectX::CXMMATRIX viewProj,
+			DirectX::FXMVECTOR eyePt, bool isAlphaQueueN2F = false, bool isAllVisible = false,
+			const SoftwareOcclusion* pOcclusion = nullptr);
+
+		uint32_t GetNumThreads() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+		// Meshes culled for their contribution in the last Sort, per queue
+		uint32_t GetNumOpaqueCulled() const { return m_numCulled[0]; }
+		uint32_t GetNumAlphaCulled() const { return m_numCulled[1]; }
+
+		// Sorts synthetic scenes of numMeshes, one tenth of them alpha, with 1, 2, 4... threads
+		// up to all hardware threads.
+		static void Benchmark(std::vector<ScalingResult>& results, uint32_t numMeshes = 100000,
+			uint32_t numViews = 16, uint32_t numIterations = 8);
+
+		using uptr = std::unique_ptr<OctreeSorter>;
+		using sptr = std::shared_ptr<OctreeSorter>;
+
+	protected:
+		using SortItem = std::pair<float, uint32_t>;	// Signed squared distance, item
+
+		struct Run
+		{
+			const LinearOctree* pTree;
+			LinearOctree::Subtree Subtree;		// Node of UINT32_MAX for the items above the split level
+			std::vector<uint32_t> Items;
+			std::vector<SortItem> SortItems;
+			std::vector<SortItem> Merged;
+			uint32_t NumCulled;
+			bool IsNearToFar;
+		};
+
+		void dispatch(uint32_t count, const std::function<void(uint32_t)>& func);
+		void run();
+		void stop();
+
+		std::vector<std::thread>	m_workers;
+		std::mutex					m_mutex;
+		std::condition_variable		m_wake;
+		std::condition_variable		m_done;
+		const std::function<void(uint32_t)>* m_pFunc;
+		std::atomic<uint32_t>		m_next;
+		uint32_t					m_count;
+		uint32_t					m_numBusy;
+		uint64_t					m_generation;
+		bool						m_isQuitting;
+
+		std::vector<Run>			m_runs;
+		std::vector<LinearOctree::Subtree> m_subtrees;
+		std::vector<uint32_t>		m_merges;
+		uint32_t					m_numCulled[2];
+		uint8_t						m_splitLevel;
+	};
+}
@@ -35,6 +35,11 @@ RenderingX::RenderingX(uint32_t width, uint32_t height, const wstring& name) :
 	m_isTracking(false),
 	m_mousePt(),
 	m_sceneFile(L"Assets/Scene.json"),
+	m_compressTextures(false),
+	m_textureQuality(TextureEncoder::Quality::NORMAL),
+	m_preflight(false),
+	m_benchmarkSpatialIndex(false),
+	m_reportSkinningModes(false),
 	m_readBuffer(nullptr),
 	m_rowPitch(0),
 	m_screenShot(0)
@@ -166,6 +171,20 @@ void RenderingX::LoadAssets()
 	XUSG_N_RETURN(pCommandList->Create(m_device.get(), 0, CommandListType::DIRECT,
 		m_commandAllocators[m_frameIndex].get(), nullptr), ThrowIfFailed(E_FAIL));
 
+	// Asset-processing step: compressed copies of the uncompressed DDS assets go to a separate
+	// tree, to replace the shipped ones when packaging; the shipped assets are never modified.
+	if (m_compressTextures)
+	{
+		TextureEncoder::Stats stats = {};
+		const auto numFiles = TextureEncoder::ProcessDirectory(L"Assets", L"CompressedAssets",
+			m_textureQuality, &stats);
+
+		char buff[256];
+		sprintf_s(buff, "Compressed %u textures to CompressedAssets: %.2f MB saved, PSNR %.2f dB, %.2f MPixels/s\n", numFiles,
+			(stats.SourceBytes - stats.EncodedBytes) / (1024.0 * 1024.0), stats.GetPSNR(), stats.GetMPixelsPerSecond());
+		OutputDebugStringA(buff);
+	}
+
 	// Load scene asset
 	vector<Resource::uptr> uploaders;
 	{
@@ -178,6 +197,49 @@ void RenderingX::LoadAssets()
 		tiny::TinyJson sceneReader;
 		sceneReader.ReadJson(sceneString);
 
+		// Check the referenced files from their headers before committing any GPU memory
+		if (m_preflight)
+		{
+			ScenePreflight preflight;
+			preflight.Run(&sceneReader);
+			OutputDebugStringW(preflight.GetSummary().c_str());
+		}
+
+		// The BVH against the octree over the mesh bounds of the static models. Both are
+		// app-side: the library scene culls and sorts with its own OctNode internally.
+		if (m_benchmarkSpatialIndex)
+		{
+			vector<LinearOctree::Item> items;
+			float mapSize, looseCoeff;
+			LinearOctree::GetItems(items, &sceneReader, &mapSize, &looseCoeff);
+
+			BoundingVolumeHierarchy::BenchmarkResult result;
+			BoundingVolumeHierarchy::Benchmark(result, items.data(), static_cast<uint32_t>(items.size()),
+				64, 16, mapSize, looseCoeff);
+
+			char buff[512];
+			sprintf_s(buff, "Spatial index over %zu static meshes: build %.2f ms (octree %.2f ms); "
+				"query %.1f us, %.0f node and %.0f item tests (octree %.1f us, %.0f and %.0f); %.0f visible\n",
+				items.size(), result.BuildMilliseconds, result.OctreeBuildMilliseconds,
+				result.Hierarchy.Microseconds, result.Hierarchy.NumNodeTests, result.Hierarchy.NumItemTests,
+				result.Octree.Microseconds, result.Octree.NumNodeTests, result.Octree.NumItemTests,
+				result.Hierarchy.NumVisible);
+			OutputDebugStringA(buff);
+		}
+
+		// Skinning mode per skinned mesh. The character skinning pass is built into the
+		// library and always blends linearly, so dual-quaternion selections are only reported.
+		if (m_reportSkinningModes)
+		{
+			DualQuatSkinning::GetSkinningModes(m_skinningModes, &sceneReader);
+			for (size_t i = 0; i < m_skinningModes.size(); ++i)
+			{
+				if (m_skinningModes[i] != SkinningMode::DUAL_QUATERNION) continue;
+				OutputDebugStringA(("SkinnedMeshes[" + to_string(i) +
+					"]: dual-quaternion skinning is not supported by the library skinning pass\n").c_str());
+			}
+		}
+
 		// Create scene
 		m_scene = Scene::MakeUnique(Api);
 		//m_scene->SetRenderTarget(m_rtHDR, m_depth);
@@ -578,6 +640,20 @@ void RenderingX::ParseCommandLineArgs(wchar_t* argv[], int argc)
 			if (hasNextArgValue(i)) m_sceneFile = argv[++i];
 		}
 		else if (isArgMatched(i, L"noIBL")) m_useIBL = false;
+		else if (isArgMatched(i, L"compressTextures"))
+		{
+			m_compressTextures = true;
+			if (hasNextArgValue(i))
+			{
+				const auto quality = str_tolower(argv[++i]);
+				if (quality == L"fast") m_textureQuality = TextureEncoder::Quality::FAST;
+				else if (quality == L"high") m_textureQuality = TextureEncoder::Quality::HIGH;
+				else m_textureQuality = TextureEncoder::Quality::NORMAL;
+			}
+		}
+		else if (isArgMatched(i, L"preflight")) m_preflight = true;
+		else if (isArgMatched(i, L"benchmarkSpatialIndex")) m_benchmarkSpatialIndex = true;
+		else if (isArgMatched(i, L"skinningModes")) m_reportSkinningModes = true;
 	}
 }
 
@@ -14,6 +14,10 @@
 #include "DXFramework.h"
 #include "StepTimer.h"
 #include "Advanced/XUSGAdvanced.h"
+#include "TextureEncoder.h"
+#include "ScenePreflight.h"
+#include "DualQuatSkinning.h"
+#include "BoundingVolumeHierarchy.h"
 
 using namespace DirectX;
 
@@ -117,6 +121,12 @@ private:
 
 	// User external settings
 	std::wstring m_sceneFile;
+	bool m_compressTextures;
+	XUSG::TextureEncoder::Quality m_textureQuality;
+	bool m_preflight;
+	bool m_benchmarkSpatialIndex;
+	bool m_reportSkinningModes;
+	std::vector<XUSG::SkinningMode> m_skinningModes;
 
 	// Screen-shot helpers and state
 	XUSG::Buffer::uptr	m_readBuffer;
@@ -0,0 +1,319 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "ScenePreflight.h"
+
+using namespace std;
+using namespace XUSG;
+
+namespace
+{
+	const uint32_t SDKMESH_FILE_VERSION = 101;
+
+	// File header of the sdkmesh format, which SDKMesh reads internally
+#pragma pack(push, 8)
+	struct MeshFileHeader
+	{
+		uint32_t Version;
+		uint8_t IsBigEndian;
+		uint64_t HeaderSize;
+		uint64_t NonBufferDataSize;
+		uint64_t BufferDataSize;
+		uint32_t NumVertexBuffers;
+		uint32_t NumIndexBuffers;
+		uint32_t NumMeshes;
+		uint32_t NumTotalSubsets;
+		uint32_t NumFrames;
+		uint32_t NumMaterials;
+		uint64_t VertexStreamHeadersOffset;
+		uint64_t IndexStreamHeadersOffset;
+		uint64_t MeshDataOffset;
+		uint64_t SubsetDataOffset;
+		uint64_t FrameDataOffset;
+		uint64_t MaterialDataOffset;
+	};
+#pragma pack(pop)
+
+	// Opens a file and gets its size, or marks the report missing
+	FILE* openFile(ScenePreflight::FileReport& report)
+	{
+		FILE* pFile;
+		if (_wfopen_s(&pFile, report.FileName.c_str(), L"rb") != 0)
+		{
+			report.Status = ScenePreflight::Status::MISSING;
+
+			return nullptr;
+		}
+
+		_fseeki64(pFile, 0, SEEK_END);
+		report.FileSize = static_cast<uint64_t>(_ftelli64(pFile));
+		_fseeki64(pFile, 0, SEEK_SET);
+
+		return pFile;
+	}
+
+	bool readBytes(FILE* pFile, void* pData, size_t size, uint64_t offset = 0)
+	{
+		_fseeki64(pFile, static_cast<int64_t>(offset), SEEK_SET);
+
+		return fread(pData, 1, size, pFile) == size;
+	}
+
+	void setError(ScenePreflight::FileReport& report, const char* error)
+	{
+		report.Status = ScenePreflight::Status::MALFORMED;
+		report.Error = error;
+	}
+
+	void parallelFor(size_t first, size_t last, uint32_t numThreads, const function<void(size_t)>& func)
+	{
+		atomic<size_t> next(first);
+		const auto process = [&]()
+		{
+			for (auto n = next++; n < last; n = next++) func(n);
+		};
+
+		numThreads = static_cast<uint32_t>((min)(static_cast<size_t>(numThreads), last - first));
+
+		vector<thread> workers;
+		for (auto i = 1u; i < numThreads; ++i) workers.emplace_back(process);
+		process();
+		for (auto& worker : workers) worker.join();
+	}
+
+	const wchar_t* getFormatName(Format format)
+	{
+		switch (format)
+		{
+		case Format::R8G8B8A8_UNORM: return L"R8G8B8A8_UNORM";
+		case Format::R8G8B8A8_UNORM_SRGB: return L"R8G8B8A8_UNORM_SRGB";
+		case Format::B8G8R8A8_UNORM: return L"B8G8R8A8_UNORM";
+		case Format::R16G16B16A16_FLOAT: return L"R16G16B16A16_FLOAT";
+		case Format::R32G32B32A32_FLOAT: return L"R32G32B32A32_FLOAT";
+		case Format::BC1_UNORM: return L"BC1_UNORM";
+		case Format::BC1_UNORM_SRGB: return L"BC1_UNORM_SRGB";
+		case Format::BC2_UNORM: return L"BC2_UNORM";
+		case Format::BC3_UNORM: return L"BC3_UNORM";
+		case Format::BC3_UNORM_SRGB: return L"BC3_UNORM_SRGB";
+		case Format::BC4_UNORM: return L"BC4_UNORM";
+		case Format::BC5_UNORM: return L"BC5_UNORM";
+		case Format::BC6H_UF16: return L"BC6H_UF16";
+		case Format::BC6H_SF16: return L"BC6H_SF16";
+		case Format::BC7_UNORM: return L"BC7_UNORM";
+		case Format::BC7_UNORM_SRGB: return L"BC7_UNORM_SRGB";
+		default: return nullptr;
+		}
+	}
+}
+
+ScenePreflight::ScenePreflight() :
+	m_reports(0),
+	m_stats()
+{
+}
+
+ScenePreflight::~ScenePreflight()
+{
+}
+
+bool ScenePreflight::Run(void* pSceneReader, uint32_t numThreads)
+{
+	XUSG_N_RETURN(pSceneReader, false);
+	auto& sceneReader = *static_cast<tiny::TinyJson*>(pSceneReader);
+	const auto start = chrono::high_resolution_clock::now();
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+
+	m_reports.clear();
+	const auto addFile = [this](const wstring& fileName, FileType type)
+	{
+		if (fileName.empty()) return;
+		for (const auto& report : m_reports) if (report.FileName == fileName) return;
+
+		FileReport report = {};
+		report.FileName = fileName;
+		report.Type = type;
+		m_reports.push_back(report);
+	};
+	const auto toWString = [](const string& str) { return wstring(str.cbegin(), str.cend()); };
+
+	for (const auto key : { "StaticMeshes", "SkinnedMeshes" })
+	{
+		auto meshesReader = sceneReader.Get<tiny::xarray>(key);
+		const auto numMeshes = static_cast<uint32_t>(meshesReader.Count());
+		for (auto i = 0u; i < numMeshes; ++i)
+		{
+			meshesReader.Enter(i);
+			addFile(toWString(meshesReader.Get<string>("Mesh")), FileType::MESH);
+			addFile(toWString(meshesReader.Get<string>("Anim")), FileType::ANIMATION);
+		}
+	}
+	addFile(toWString(sceneReader.Get<string>("SkyTexture")), FileType::TEXTURE);
+
+	// Scene files first, then the material textures found in the meshes
+	const auto numSceneFiles = m_reports.size();
+	vector<vector<wstring>> textureFileNames(numSceneFiles);
+	parallelFor(0, numSceneFiles, numThreads, [&](size_t i)
+	{
+		auto& report = m_reports[i];
+		switch (report.Type)
+		{
+		case FileType::MESH: ScanMesh(report, &textureFileNames[i]); break;
+		case FileType::ANIMATION: ScanAnimation(report); break;
+		default: ScanTexture(report);
+		}
+	});
+
+	for (const auto& fileNames : textureFileNames)
+		for (const auto& fileName : fileNames) addFile(fileName, FileType::TEXTURE);
+	parallelFor(numSceneFiles, m_reports.size(), numThreads, [this](size_t i) { ScanTexture(m_reports[i]); });
+
+	m_stats = {};
+	for (const auto& report : m_reports)
+	{
+		++m_stats.NumFiles;
+		if (report.Status == Status::MISSING) ++m_stats.NumMissing;
+		else if (report.Status == Status::MALFORMED) ++m_stats.NumMalformed;
+		else if (report.Type == FileType::TEXTURE) m_stats.TextureMemory += report.MemorySize;
+		else m_stats.MeshMemory += report.MemorySize;
+	}
+	m_stats.Milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	return m_stats.NumMissing == 0 && m_stats.NumMalformed == 0;
+}
+
+wstring ScenePreflight::GetSummary() const
+{
+	const auto toMB = [](uint64_t size) { return size / (1024.0 * 1024.0); };
+	wstringstream summary;
+	summary << fixed << setprecision(2);
+
+	for (const auto& report : m_reports)
+	{
+		if (report.Status == Status::MISSING) summary << L"Missing: " << report.FileName << L"\n";
+		else if (report.Status == Status::MALFORMED)
+			summary << L"Malformed: " << report.FileName << L" (" << report.Error << L")\n";
+	}
+
+	// Texture memory per format
+	map<Format, pair<uint32_t, uint64_t>> formats;
+	for (const auto& report : m_reports)
+	{
+		if (report.Type != FileType::TEXTURE || report.Status != Status::OK) continue;
+		auto& format = formats[report.TextureInfo.Format];
+		++format.first;
+		format.second += report.MemorySize;
+	}
+
+	for (const auto& format : formats)
+	{
+		const auto name = getFormatName(format.first);
+		if (name) summary << name;
+		else summary << L"Format " << static_cast<uint32_t>(format.first);
+		summary << L": " << format.second.first << L" textures, " << toMB(format.second.second) << L" MB\n";
+	}
+
+	summary << L"Pre-flight: " << m_stats.NumFiles << L" files, " << m_stats.NumMissing << L" missing, " <<
+		m_stats.NumMalformed << L" malformed; textures " << toMB(m_stats.TextureMemory) << L" MB, meshes " <<
+		toMB(m_stats.MeshMemory) << L" MB; " << m_stats.Milliseconds << L" ms\n";
+
+	return summary.str();
+}
+
+void ScenePreflight::ScanMesh(FileReport& report, vector<wstring>* pTextureFileNames)
+{
+	const auto pFile = openFile(report);
+	if (!pFile) return;
+
+	MeshFileHeader header;
+	if (!readBytes(pFile, &header, sizeof(MeshFileHeader))) setError(report, "truncated header");
+	else if (header.Version != SDKMESH_FILE_VERSION || header.IsBigEndian) setError(report, "unsupported version");
+	else if (header.HeaderSize + header.NonBufferDataSize + header.BufferDataSize > report.FileSize)
+		setError(report, "truncated data");
+	else if (header.MaterialDataOffset + sizeof(SDKMesh::Material) * header.NumMaterials >
+		header.HeaderSize + header.NonBufferDataSize) setError(report, "material data out of range");
+	else
+	{
+		report.MemorySize = header.BufferDataSize;
+		report.NumMaterials = header.NumMaterials;
+
+		vector<SDKMesh::Material> materials(header.NumMaterials);
+		if (!readBytes(pFile, materials.data(), sizeof(SDKMesh::Material) * materials.size(), header.MaterialDataOffset))
+			setError(report, "truncated materials");
+		else if (pTextureFileNames)
+		{
+			// Material textures are looked up in the directory of the mesh.
+			const auto& fileName = report.FileName;
+			const auto pos = fileName.find_last_of(L"\\/");
+			const auto directory = pos != wstring::npos ? fileName.substr(0, pos + 1) : wstring();
+
+			for (const auto& material : materials)
+			{
+				for (const auto name : { material.AlbedoTexture, material.NormalTexture, material.SpecularTexture })
+				{
+					const auto length = strnlen(name, SDKMesh::MAX_TEXTURE_NAME);
+					if (length > 0) pTextureFileNames->push_back(directory + wstring(name, name + length));
+				}
+			}
+		}
+	}
+
+	fclose(pFile);
+}
+
+bool ScenePreflight::ReadMeshes(vector<SDKMesh::Data>& meshes, const wchar_t* fileName)
+{
+	FileReport report = {};
+	report.FileName = fileName;
+	const auto pFile = openFile(report);
+	XUSG_N_RETURN(pFile, false);
+
+	MeshFileHeader header;
+	auto success = readBytes(pFile, &header, sizeof(MeshFileHeader)) && header.Version == SDKMESH_FILE_VERSION &&
+		!header.IsBigEndian && header.MeshDataOffset + sizeof(SDKMesh::Data) * header.NumMeshes <= report.FileSize;
+	if (success)
+	{
+		meshes.resize(header.NumMeshes);
+		success = readBytes(pFile, meshes.data(), sizeof(SDKMesh::Data) * meshes.size(), header.MeshDataOffset);
+	}
+	fclose(pFile);
+
+	if (!success) meshes.clear();
+
+	return success;
+}
+
+void ScenePreflight::ScanAnimation(FileReport& report)
+{
+	const auto pFile = openFile(report);
+	if (!pFile) return;
+
+	SDKMesh::AnimationFileHeader header;
+	if (!readBytes(pFile, &header, sizeof(SDKMesh::AnimationFileHeader))) setError(report, "truncated header");
+	else if (header.Version != SDKMESH_FILE_VERSION || header.IsBigEndian) setError(report, "unsupported version");
+	else if (header.AnimationDataOffset + header.AnimationDataSize > report.FileSize) setError(report, "truncated data");
+	else report.MemorySize = header.AnimationDataSize;
+
+	fclose(pFile);
+}
+
+void ScenePreflight::ScanTexture(FileReport& report)
+{
+	const auto pFile = openFile(report);
+	if (!pFile) return;
+
+	// Files without the DX10 extension may be shorter than the largest header.
+	uint8_t header[DDS::Parser::MAX_HEADER_SIZE];
+	const auto headerSize = static_cast<size_t>((min)(report.FileSize, static_cast<uint64_t>(sizeof(header))));
+	const auto isRead = readBytes(pFile, header, headerSize);
+	fclose(pFile);
+
+	vector<DDS::SubresourceLayout> layouts;
+	if (!isRead || !DDS::Parser::ParseHeader(report.TextureInfo, header, headerSize)) setError(report, "invalid header");
+	else if (!DDS::Parser::GetSubresourceLayouts(layouts, report.TextureInfo, report.FileSize))
+		setError(report, "truncated data");
+	else for (const auto& layout : layouts) report.MemorySize += layout.SlicePitch * layout.Depth;
+}
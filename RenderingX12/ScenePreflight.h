@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Scene pre-flight: reads only the headers of the meshes, animations and textures a scene
+	// references, across threads, to report missing or malformed files and the texture memory
+	// needed before anything is loaded. No GPU object is created.
+	//--------------------------------------------------------------------------------------
+	class ScenePreflight
+	{
+	public:
+		enum class FileType : uint8_t
+		{
+			MESH,
+			ANIMATION,
+			TEXTURE
+		};
+
+		enum class Status : uint8_t
+		{
+			OK,
+			MISSING,
+			MALFORMED
+		};
+
+		struct FileReport
+		{
+			std::wstring	FileName;
+			FileType		Type;
+			Status			Status;
+			const char*		Error;			// Reason when malformed
+			uint64_t		FileSize;
+			uint64_t		MemorySize;		// Data of all texture subresources, mesh buffers or animation keys
+			DDS::TextureInfo TextureInfo;	// Textures only
+			uint32_t		NumMaterials;	// Meshes only
+		};
+
+		struct Stats
+		{
+			uint32_t	NumFiles;
+			uint32_t	NumMissing;
+			uint32_t	NumMalformed;
+			uint64_t	TextureMemory;
+			uint64_t	MeshMemory;
+			double		Milliseconds;
+		};
+
+		ScenePreflight();
+		virtual ~ScenePreflight();
+
+		// Scans the files referenced by a scene (a tiny::TinyJson reader); textures are looked up
+		// next to the meshes using them. Returns false if any file is missing or malformed.
+		bool Run(void* pSceneReader, uint32_t numThreads = 0);
+
+		const std::vector<FileReport>& GetReports() const { return m_reports; }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Errors, then the texture memory per format and the totals, one line each
+		std::wstring GetSummary() const;
+
+		// Header checks of single files; a mesh also lists the texture files of its materials.
+		static void ScanMesh(FileReport& report, std::vector<std::wstring>* pTextureFileNames = nullptr);
+		static void ScanAnimation(FileReport& report);
+		static void ScanTexture(FileReport& report);
+
+		// Mesh table of an sdkmesh file, bounding boxes included, read without the buffers
+		static bool ReadMeshes(std::vector<SDKMesh::Data>& meshes, const wchar_t* fileName);
+
+		using uptr = std::unique_ptr<ScenePreflight>;
+		using sptr = std::shared_ptr<ScenePreflight>;
+
+	protected:
+		std::vector<FileReport> m_reports;
+		Stats m_stats;
+	};
+}
@@ -0,0 +1,489 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <immintrin.h>
+#include "SoftwareOcclusion.h"
+#include "LinearOctree.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+#if defined(__AVX2__)
+	const uint32_t SIMD_WIDTH = 8;
+	using vfloat = __m256;
+
+	inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void store(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+	inline vfloat splat(float f) { return _mm256_set1_ps(f); }
+	inline vfloat madd(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+	inline vfloat geZero(vfloat a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ); }
+	inline vfloat vand(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+	inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+	inline bool any(vfloat mask) { return _mm256_movemask_ps(mask) != 0; }
+	inline vfloat laneOffsets() { return _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f); }
+#else
+	const uint32_t SIMD_WIDTH = 4;
+	using vfloat = __m128;
+
+	inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+	inline void store(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+	inline vfloat splat(float f) { return _mm_set1_ps(f); }
+	inline vfloat madd(vfloat a, vfloat b, vfloat c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+	inline vfloat geZero(vfloat a) { return _mm_cmpge_ps(a, _mm_setzero_ps()); }
+	inline vfloat vand(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+	inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	inline bool any(vfloat mask) { return _mm_movemask_ps(mask) != 0; }
+	inline vfloat laneOffsets() { return _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); }
+#endif
+
+	XMFLOAT4 lerp(const XMFLOAT4& a, const XMFLOAT4& b, float t)
+	{
+		return XMFLOAT4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+	}
+}
+
+SoftwareOcclusion::SoftwareOcclusion() :
+	m_levels(0),
+	m_minLevels(0),
+	m_clipPositions(0),
+	m_width(0),
+	m_height(0),
+	m_minTestTexels(0.0f),
+	m_texelScale(0.0f),
+	m_stats()
+{
+	XMStoreFloat4x4(&m_viewProj, XMMatrixIdentity());
+}
+
+SoftwareOcclusion::~SoftwareOcclusion()
+{
+}
+
+bool SoftwareOcclusion::Init(uint32_t width, uint32_t height, float minTestTexels)
+{
+	XUSG_N_RETURN(width > 0 && height > 0, false);
+
+	m_width = (width + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	m_height = height;
+	m_minTestTexels = minTestTexels;
+
+	// Down to 1x1
+	uint8_t numLevels = 1;
+	while ((max)(m_width, m_height) >> numLevels) ++numLevels;
+	m_levels.resize(numLevels);
+	m_minLevels.resize(numLevels);
+	for (uint8_t i = 0; i < numLevels; ++i) m_levels[i].assign(GetWidth(i) * GetHeight(i), 1.0f);
+	for (uint8_t i = 1; i < numLevels; ++i) m_minLevels[i].assign(GetWidth(i) * GetHeight(i), 1.0f);
+
+	return true;
+}
+
+void SoftwareOcclusion::Begin(CXMMATRIX viewProj)
+{
+	XMStoreFloat4x4(&m_viewProj, viewProj);
+	FrustumCulling::GetFrustum(m_frustum, viewProj);
+	m_texelScale = (max)(XMVectorGetX(XMVector3Length(XMVectorSet(m_viewProj._11, m_viewProj._21, m_viewProj._31, 0.0f))) * m_width,
+		XMVectorGetX(XMVector3Length(XMVectorSet(m_viewProj._12, m_viewProj._22, m_viewProj._32, 0.0f))) * m_height) * 0.5f;
+	for (auto& level : m_levels) fill(level.begin(), level.end(), 1.0f);
+	m_stats = {};
+}
+
+void SoftwareOcclusion::Rasterize(const Occluder& occluder, CXMMATRIX world)
+{
+	// World-space bound of the occluder against the frustum
+	XMFLOAT3 center, extents;
+	XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&occluder.Center), world));
+	XMStoreFloat3(&extents, XMVectorAbs(world.r[0]) * occluder.Extents.x +
+		XMVectorAbs(world.r[1]) * occluder.Extents.y + XMVectorAbs(world.r[2]) * occluder.Extents.z);
+	if (FrustumCulling::ClassifyBox(center, extents, m_frustum) == OctNode::VISIBILITY_OUTSIDE) return;
+
+	const auto transform = world * XMLoadFloat4x4(&m_viewProj);
+	const auto numVertices = occluder.Vertices.size();
+	m_clipPositions.resize(numVertices);
+	for (size_t i = 0; i < numVertices; ++i)
+		XMStoreFloat4(&m_clipPositions[i], XMVector3Transform(XMLoadFloat3(&occluder.Vertices[i]), transform));
+
+	const auto numTriangles = occluder.Indices.size() / 3;
+	for (size_t i = 0; i < numTriangles; ++i)
+	{
+		const XMFLOAT4 v[] =
+		{
+			m_clipPositions[occluder.Indices[i * 3]],
+			m_clipPositions[occluder.Indices[i * 3 + 1]],
+			m_clipPositions[occluder.Indices[i * 3 + 2]]
+		};
+
+		// Trivial rejection against the side and near planes
+		if ((v[0].x > v[0].w && v[1].x > v[1].w && v[2].x > v[2].w) ||
+			(v[0].x < -v[0].w && v[1].x < -v[1].w && v[2].x < -v[2].w) ||
+			(v[0].y > v[0].w && v[1].y > v[1].w && v[2].y > v[2].w) ||
+			(v[0].y < -v[0].w && v[1].y < -v[1].w && v[2].y < -v[2].w) ||
+			(v[0].z < 0.0f && v[1].z < 0.0f && v[2].z < 0.0f))
+			continue;
+
+		if (v[0].z >= 0.0f && v[1].z >= 0.0f && v[2].z >= 0.0f) rasterizeTriangle(v);
+		else
+		{
+			// Clip against the near plane, z >= 0, into a triangle or a quad
+			XMFLOAT4 polygon[4];
+			uint8_t numPolygonVertices = 0;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto& a = v[j];
+				const auto& b = v[(j + 1) % 3];
+				if (a.z >= 0.0f) polygon[numPolygonVertices++] = a;
+				if ((a.z >= 0.0f) != (b.z >= 0.0f)) polygon[numPolygonVertices++] = lerp(a, b, a.z / (a.z - b.z));
+			}
+
+			for (uint8_t j = 2; j < numPolygonVertices; ++j)
+			{
+				const XMFLOAT4 triangle[] = { polygon[0], polygon[j - 1], polygon[j] };
+				rasterizeTriangle(triangle);
+			}
+		}
+	}
+
+	++m_stats.NumOccluders;
+}
+
+void SoftwareOcclusion::End()
+{
+	const auto numLevels = GetNumLevels();
+	for (uint8_t i = 1; i < numLevels; ++i)
+	{
+		const auto& src = m_levels[i - 1];
+		const auto& minSrc = i > 1 ? m_minLevels[i - 1] : src;
+		auto& dst = m_levels[i];
+		auto& minDst = m_minLevels[i];
+		const auto srcWidth = GetWidth(i - 1);
+		const auto srcHeight = GetHeight(i - 1);
+		const auto width = GetWidth(i);
+		const auto height = GetHeight(i);
+		for (auto y = 0u; y < height; ++y)
+		{
+			const auto y0 = (min)(y * 2, srcHeight - 1);
+			const auto y1 = (min)(y * 2 + 1, srcHeight - 1);
+			for (auto x = 0u; x < width; ++x)
+			{
+				const auto x0 = (min)(x * 2, srcWidth - 1);
+				const auto x1 = (min)(x * 2 + 1, srcWidth - 1);
+				dst[width * y + x] = (max)((max)(src[srcWidth * y0 + x0], src[srcWidth * y0 + x1]),
+					(max)(src[srcWidth * y1 + x0], src[srcWidth * y1 + x1]));
+				minDst[width * y + x] = (min)((min)(minSrc[srcWidth * y0 + x0], minSrc[srcWidth * y0 + x1]),
+					(min)(minSrc[srcWidth * y1 + x0], minSrc[srcWidth * y1 + x1]));
+			}
+		}
+	}
+}
+
+OctNode::Visibility SoftwareOcclusion::Classify(const XMFLOAT3& center, const XMFLOAT3& extents) const
+{
+	if (m_levels.empty()) return OctNode::VISIBILITY_INSIDE;
+
+	// Screen rectangle and nearest depth of the corners
+	// The corners in clip space are the center plus or minus each scaled axis.
+	const auto viewProj = XMLoadFloat4x4(&m_viewProj);
+	const auto c = XMVector3Transform(XMLoadFloat3(&center), viewProj);
+	const XMVECTOR axes[] = { viewProj.r[0] * extents.x, viewProj.r[1] * extents.y, viewProj.r[2] * extents.z };
+	auto minPt = XMVectorReplicate(FLT_MAX);
+	auto maxPt = XMVectorReplicate(-FLT_MAX);
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		const auto corner = (i & 1 ? c + axes[0] : c - axes[0]) + (i & 2 ? axes[1] : -axes[1]) + (i & 4 ? axes[2] : -axes[2]);
+		if (XMVectorGetZ(corner) < 0.0f) return OctNode::VISIBILITY_INTERSECT;
+
+		const auto p = corner * XMVectorSet(1.0f, -1.0f, 1.0f, 0.0f) / XMVectorSplatW(corner);
+		minPt = XMVectorMin(minPt, p);
+		maxPt = XMVectorMax(maxPt, p);
+	}
+
+	XMFLOAT3 rectMin, rectMax;
+	XMStoreFloat3(&rectMin, minPt);
+	XMStoreFloat3(&rectMax, maxPt);
+	if (rectMax.x < -1.0f || rectMin.x > 1.0f || rectMax.y < -1.0f || rectMin.y > 1.0f) return OctNode::VISIBILITY_INSIDE;
+
+	const auto toPixels = [](float ndc, uint32_t size)
+	{
+		return static_cast<int32_t>(floorf((ndc * 0.5f + 0.5f) * size));
+	};
+	const auto x0 = (max)(toPixels(rectMin.x, m_width), 0);
+	const auto x1 = (min)(toPixels(rectMax.x, m_width), static_cast<int32_t>(m_width) - 1);
+	const auto y0 = (max)(toPixels(rectMin.y, m_height), 0);
+	const auto y1 = (min)(toPixels(rectMax.y, m_height), static_cast<int32_t>(m_height) - 1);
+
+	// The level where the rectangle spans at most 3x3 texels
+	uint8_t level = 0;
+	const auto size = (max)(x1 - x0, y1 - y0);
+	while ((size >> level) > 2 && level + 1 < GetNumLevels()) ++level;
+
+	const auto& depth = m_levels[level];
+	const auto& minDepths = level > 0 ? m_minLevels[level] : depth;
+	const auto width = GetWidth(level);
+	auto maxDepth = 0.0f;
+	auto minDepth = 1.0f;
+	for (auto y = y0 >> level; y <= y1 >> level; ++y)
+	{
+		for (auto x = x0 >> level; x <= x1 >> level; ++x)
+		{
+			maxDepth = (max)(depth[width * y + x], maxDepth);
+			minDepth = (min)(minDepths[width * y + x], minDepth);
+		}
+	}
+
+	if (rectMin.z > maxDepth) return OctNode::VISIBILITY_OUTSIDE;
+
+	return rectMax.z < minDepth ? OctNode::VISIBILITY_INSIDE : OctNode::VISIBILITY_INTERSECT;
+}
+
+bool SoftwareOcclusion::IsSmall(const XMFLOAT3& center, float radius) const
+{
+	const auto w = getClipW(center);
+
+	return w > radius && radius * m_texelScale < m_minTestTexels * w;
+}
+
+bool SoftwareOcclusion::IsWorthTesting(const XMFLOAT3& center, float radius) const
+{
+	const auto w = getClipW(center);
+
+	return w > radius && radius * m_texelScale >= m_minTestTexels * w;
+}
+
+bool SoftwareOcclusion::CreateOccluder(Occluder& occluder, const SDKMesh* pMesh, uint32_t maxTriangles,
+	SubsetFlags subsetFlags)
+{
+	XUSG_N_RETURN(pMesh, false);
+
+	struct Triangle
+	{
+		float Area;
+		XMFLOAT3 Vertices[3];
+	};
+
+	vector<Triangle> triangles;
+	const auto numMeshes = pMesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto pMeshData = pMesh->GetMesh(m);
+		const auto pVertices = pMesh->GetRawVerticesAt(pMeshData->VertexBuffers[0]);
+		const auto pIndices = pMesh->GetRawIndicesAt(pMeshData->IndexBuffer);
+		XUSG_N_RETURN(pVertices && pIndices, false);
+
+		const auto stride = pMesh->GetVertexStride(m, 0);
+		const auto numVertices = pMesh->GetNumVertices(m, 0);
+		const auto is32Bit = pMesh->GetIndexType(m) == SDKMesh::IT_32BIT;
+		const auto numSubsets = pMesh->GetNumSubsets(m, subsetFlags);
+		for (auto s = 0u; s < numSubsets; ++s)
+		{
+			const auto pSubset = pMesh->GetSubset(m, s, subsetFlags);
+			if (pSubset->PrimitiveType != SDKMesh::PT_TRIANGLE_LIST) continue;
+
+			for (auto i = pSubset->IndexStart; i + 2 < pSubset->IndexStart + pSubset->IndexCount; i += 3)
+			{
+				Triangle triangle;
+				auto isValid = true;
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					const auto index = pSubset->VertexStart + (is32Bit ? reinterpret_cast<const uint32_t*>(pIndices)[i + j] :
+						reinterpret_cast<const uint16_t*>(pIndices)[i + j]);
+					isValid = isValid && index < numVertices;
+					if (isValid) triangle.Vertices[j] = *reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * index]);
+				}
+				if (!isValid) continue;
+
+				const auto v0 = XMLoadFloat3(&triangle.Vertices[0]);
+				const auto edge1 = XMLoadFloat3(&triangle.Vertices[1]) - v0;
+				const auto edge2 = XMLoadFloat3(&triangle.Vertices[2]) - v0;
+				triangle.Area = XMVectorGetX(XMVector3Length(XMVector3Cross(edge1, edge2)));
+				triangles.push_back(triangle);
+			}
+		}
+	}
+
+	const auto numTriangles = (min)(static_cast<uint32_t>(triangles.size()), maxTriangles);
+	partial_sort(triangles.begin(), triangles.begin() + numTriangles, triangles.end(),
+		[](const Triangle& a, const Triangle& b) { return a.Area > b.Area; });
+
+	occluder.Vertices.resize(numTriangles * 3);
+	occluder.Indices.resize(numTriangles * 3);
+	auto minPt = XMVectorReplicate(FLT_MAX);
+	auto maxPt = XMVectorReplicate(-FLT_MAX);
+	for (auto i = 0u; i < numTriangles * 3; ++i)
+	{
+		occluder.Vertices[i] = triangles[i / 3].Vertices[i % 3];
+		occluder.Indices[i] = i;
+		minPt = XMVectorMin(minPt, XMLoadFloat3(&occluder.Vertices[i]));
+		maxPt = XMVectorMax(maxPt, XMLoadFloat3(&occluder.Vertices[i]));
+	}
+
+	if (numTriangles == 0) minPt = maxPt = XMVectorZero();
+	XMStoreFloat3(&occluder.Center, (minPt + maxPt) * 0.5f);
+	XMStoreFloat3(&occluder.Extents, (maxPt - minPt) * 0.5f);
+
+	return true;
+}
+
+void SoftwareOcclusion::CreateBoxOccluder(Occluder& occluder, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	static const uint32_t indices[] =
+	{
+		0, 1, 3, 0, 3, 2,	4, 6, 7, 4, 7, 5,	// -x, +x
+		0, 4, 5, 0, 5, 1,	2, 3, 7, 2, 7, 6,	// -y, +y
+		0, 2, 6, 0, 6, 4,	1, 5, 7, 1, 7, 3	// -z, +z
+	};
+
+	occluder.Vertices.resize(8);
+	for (uint8_t i = 0; i < 8; ++i)
+		occluder.Vertices[i] = XMFLOAT3(center.x + (i & 4 ? extents.x : -extents.x),
+			center.y + (i & 2 ? extents.y : -extents.y), center.z + (i & 1 ? extents.z : -extents.z));
+	occluder.Indices.assign(indices, indices + sizeof(indices) / sizeof(uint32_t));
+	occluder.Center = center;
+	occluder.Extents = extents;
+}
+
+bool SoftwareOcclusion::LoadCameraPath(vector<CameraKey>& cameraPath, const wchar_t* fileName)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"r") == 0 && pFile, false);
+
+	cameraPath.clear();
+	CameraKey key;
+	while (fscanf_s(pFile, "%f %f %f %f %f %f", &key.EyePt.x, &key.EyePt.y, &key.EyePt.z,
+		&key.LookAtPt.x, &key.LookAtPt.y, &key.LookAtPt.z) == 6)
+		cameraPath.push_back(key);
+	fclose(pFile);
+
+	return !cameraPath.empty();
+}
+
+void SoftwareOcclusion::Benchmark(BenchmarkResult& result, const LinearOctree& tree, const Occluder* pOccluders,
+	uint32_t numOccluders, const CameraKey* pCameraPath, uint32_t numKeys, CXMMATRIX proj)
+{
+	result = {};
+	XUSG_N_RETURN(numKeys > 0, );
+
+	SoftwareOcclusion occlusion;
+	occlusion.Init();
+
+	vector<XMUINT2> queue;
+	chrono::duration<double, milli> rasterTime(0.0), frustumSortTime(0.0), occlusionSortTime(0.0);
+	for (auto i = 0u; i < numKeys; ++i)
+	{
+		const auto eyePt = XMLoadFloat3(&pCameraPath[i].EyePt);
+		const auto view = XMMatrixLookAtLH(eyePt, XMLoadFloat3(&pCameraPath[i].LookAtPt), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const auto viewProj = view * proj;
+
+		auto start = chrono::high_resolution_clock::now();
+		queue.clear();
+		tree.Sort(queue, viewProj, eyePt, true);
+		frustumSortTime += chrono::high_resolution_clock::now() - start;
+		result.NumFrustumDraws += queue.size();
+
+		start = chrono::high_resolution_clock::now();
+		occlusion.Begin(viewProj);
+		for (auto j = 0u; j < numOccluders; ++j) occlusion.Rasterize(pOccluders[j]);
+		occlusion.End();
+		rasterTime += chrono::high_resolution_clock::now() - start;
+
+		start = chrono::high_resolution_clock::now();
+		queue.clear();
+		tree.Sort(queue, viewProj, eyePt, true, false, &occlusion);
+		occlusionSortTime += chrono::high_resolution_clock::now() - start;
+		result.NumOcclusionDraws += queue.size();
+	}
+
+	result.NumFrames = numKeys;
+	result.RasterMilliseconds = rasterTime.count() / numKeys;
+	result.FrustumSortMilliseconds = frustumSortTime.count() / numKeys;
+	result.OcclusionSortMilliseconds = occlusionSortTime.count() / numKeys;
+}
+
+void SoftwareOcclusion::rasterizeTriangle(const XMFLOAT4* pClipPositions)
+{
+	// Screen positions with depth; z / w is linear in screen space.
+	XMFLOAT3 v[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto& p = pClipPositions[i];
+		const auto invW = 1.0f / p.w;
+		v[i] = XMFLOAT3((p.x * invW * 0.5f + 0.5f) * m_width, (0.5f - p.y * invW * 0.5f) * m_height, p.z * invW);
+	}
+
+	auto area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+	if (fabsf(area) < 1.0e-8f) return;
+	if (area < 0.0f)
+	{
+		swap(v[1], v[2]);
+		area = -area;
+	}
+
+	// Edge functions ax + by + c, non-negative inside; depth as a plane over the screen
+	float a[3], b[3], c[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto& p0 = v[(i + 1) % 3];
+		const auto& p1 = v[(i + 2) % 3];
+		a[i] = p0.y - p1.y;
+		b[i] = p1.x - p0.x;
+		c[i] = -(a[i] * p0.x + b[i] * p0.y);
+	}
+
+	const auto invArea = 1.0f / area;
+	const auto za = (a[0] * v[0].z + a[1] * v[1].z + a[2] * v[2].z) * invArea;
+	const auto zb = (b[0] * v[0].z + b[1] * v[1].z + b[2] * v[2].z) * invArea;
+	auto zc = (c[0] * v[0].z + c[1] * v[1].z + c[2] * v[2].z) * invArea;
+
+	// Conservative inward: only pixels entirely inside the triangle are written, at the
+	// farthest depth of the triangle over them, so that the buffer never occludes more than
+	// the occluders do.
+	for (uint8_t i = 0; i < 3; ++i) c[i] -= (fabsf(a[i]) + fabsf(b[i])) * 0.5f;
+	zc += (fabsf(za) + fabsf(zb)) * 0.5f;
+
+	const auto minX = (max)(floorf((min)((min)(v[0].x, v[1].x), v[2].x)), 0.0f);
+	const auto maxX = (min)(ceilf((max)((max)(v[0].x, v[1].x), v[2].x)), static_cast<float>(m_width));
+	const auto minY = (max)(floorf((min)((min)(v[0].y, v[1].y), v[2].y)), 0.0f);
+	const auto maxY = (min)(ceilf((max)((max)(v[0].y, v[1].y), v[2].y)), static_cast<float>(m_height));
+	if (minX >= maxX || minY >= maxY) return;
+
+	const auto x0 = static_cast<uint32_t>(minX) / SIMD_WIDTH * SIMD_WIDTH;
+	const auto x1 = static_cast<uint32_t>(maxX);
+	const auto y0 = static_cast<uint32_t>(minY);
+	const auto y1 = static_cast<uint32_t>(maxY);
+
+	const vfloat va[] = { splat(a[0]), splat(a[1]), splat(a[2]) };
+	const auto vza = splat(za);
+	const auto step = splat(static_cast<float>(SIMD_WIDTH));
+	auto& depth = m_levels[0];
+	for (auto y = y0; y < y1; ++y)
+	{
+		const auto py = y + 0.5f;
+		const vfloat rowEdges[] =
+		{
+			splat(b[0] * py + c[0]), splat(b[1] * py + c[1]), splat(b[2] * py + c[2])
+		};
+		const auto rowDepth = splat(zb * py + zc);
+
+		auto px = add(splat(static_cast<float>(x0)), laneOffsets());
+		for (auto x = x0; x < x1; x += SIMD_WIDTH, px = add(px, step))
+		{
+			const auto mask = vand(vand(geZero(madd(va[0], px, rowEdges[0])), geZero(madd(va[1], px, rowEdges[1]))),
+				geZero(madd(va[2], px, rowEdges[2])));
+			if (!any(mask)) continue;
+
+			const auto pDepth = &depth[m_width * y + x];
+			const auto dst = load(pDepth);
+			store(pDepth, select(mask, vmin(dst, madd(vza, px, rowDepth)), dst));
+		}
+	}
+
+	++m_stats.NumTriangles;
+}
@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrustumCulling.h"
+
+namespace XUSG
+{
+	class LinearOctree;
+
+	//--------------------------------------------------------------------------------------
+	// Occlusion culling on the CPU: a few occluders are rasterized with SIMD into a small
+	// depth buffer each frame, and boxes are tested against the maximum-depth pyramid of it
+	//--------------------------------------------------------------------------------------
+	class SoftwareOcclusion
+	{
+	public:
+		// Triangle list in the space of the world matrix given to Rasterize
+		struct Occluder
+		{
+			std::vector<DirectX::XMFLOAT3> Vertices;
+			std::vector<uint32_t> Indices;
+			DirectX::XMFLOAT3 Center;
+			DirectX::XMFLOAT3 Extents;
+		};
+
+		struct Stats
+		{
+			uint32_t NumOccluders;		// Rasterized since Begin, after frustum rejection
+			uint32_t NumTriangles;
+		};
+
+		struct CameraKey
+		{
+			DirectX::XMFLOAT3 EyePt;
+			DirectX::XMFLOAT3 LookAtPt;
+		};
+
+		struct BenchmarkResult
+		{
+			uint32_t	NumFrames;
+			uint64_t	NumFrustumDraws;		// Summed over the frames
+			uint64_t	NumOcclusionDraws;		// Left after occlusion culling
+			double		RasterMilliseconds;		// Per frame, occluders and depth pyramid
+			double		FrustumSortMilliseconds;
+			double		OcclusionSortMilliseconds;
+		};
+
+		SoftwareOcclusion();
+		virtual ~SoftwareOcclusion();
+
+		// The width is rounded up to a multiple of the SIMD width. Boxes spanning fewer than
+		// minTestTexels of the buffer are not worth testing.
+		bool Init(uint32_t width = 256, uint32_t height = 128, float minTestTexels = 8.0f);
+
+		// Clears the depth to the far plane; Rasterize the occluders, then End builds the pyramid.
+		void Begin(DirectX::CXMMATRIX viewProj);
+		void Rasterize(const Occluder& occluder, DirectX::CXMMATRIX world = DirectX::XMMatrixIdentity());
+		void End();
+
+		// Outside if the box is behind the occluders everywhere it covers, inside if it is in front
+		// of them everywhere or off the screen, so that nothing within it can be occluded. Boxes
+		// crossing the near plane intersect. Thread-safe between End and Begin.
+		OctNode::Visibility Classify(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents) const;
+		bool IsOccluded(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents) const
+		{
+			return Classify(center, extents) == OctNode::VISIBILITY_OUTSIDE;
+		}
+
+		// From the clip w of the center alone: small boxes lie in front of the eye and span fewer
+		// than minTestTexels, so that everything within them costs less to draw than to test;
+		// boxes worth testing are neither small nor reaching the eye.
+		bool IsSmall(const DirectX::XMFLOAT3& center, float radius) const;
+		bool IsWorthTesting(const DirectX::XMFLOAT3& center, float radius) const;
+
+		const float* GetDepth(uint8_t level = 0) const { return m_levels[level].data(); }
+		uint32_t GetWidth(uint8_t level = 0) const { return (std::max)(m_width >> level, 1u); }
+		uint32_t GetHeight(uint8_t level = 0) const { return (std::max)(m_height >> level, 1u); }
+		uint8_t GetNumLevels() const { return static_cast<uint8_t>(m_levels.size()); }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Proxy of the largest triangles of the subsets of a model, which never occludes more
+		// than the model itself
+		static bool CreateOccluder(Occluder& occluder, const SDKMesh* pMesh, uint32_t maxTriangles = 256,
+			SubsetFlags subsetFlags = SUBSET_OPAQUE);
+		static void CreateBoxOccluder(Occluder& occluder, const DirectX::XMFLOAT3& center,
+			const DirectX::XMFLOAT3& extents);
+
+		// Text file of one key per line: eye x, y, z, then look-at x, y, z
+		static bool LoadCameraPath(std::vector<CameraKey>& cameraPath, const wchar_t* fileName);
+
+		// Sorts the tree at each key of the camera path with frustum culling only, then with the
+		// occluders as well, and reports the draws left and the time per frame.
+		static void Benchmark(BenchmarkResult& result, const LinearOctree& tree, const Occluder* pOccluders,
+			uint32_t numOccluders, const CameraKey* pCameraPath, uint32_t numKeys, DirectX::CXMMATRIX proj);
+
+		using uptr = std::unique_ptr<SoftwareOcclusion>;
+		using sptr = std::shared_ptr<SoftwareOcclusion>;
+
+	protected:
+		void rasterizeTriangle(const DirectX::XMFLOAT4* pClipPositions);
+
+		float getClipW(const DirectX::XMFLOAT3& pos) const
+		{
+			return pos.x * m_viewProj._14 + pos.y * m_viewProj._24 + pos.z * m_viewProj._34 + m_viewProj._44;
+		}
+
+		std::vector<std::vector<float>> m_levels;	// Depth, then the maximum of each 2x2 below
+		std::vector<std::vector<float>> m_minLevels;	// Minimum of each 2x2 below; the first is unused
+		std::vector<DirectX::XMFLOAT4> m_clipPositions;
+
+		DirectX::XMFLOAT4X4	m_viewProj;
+		FrustumCulling::Frustum m_frustum;
+		uint32_t			m_width;
+		uint32_t			m_height;
+		float				m_minTestTexels;
+		float				m_texelScale;		// Texels per unit of radius at a clip w of 1
+		Stats				m_stats;
+	};
+}
@@ -0,0 +1,249 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <array>
+#include <set>
+#include "TextureArrayPacker.h"
+
+using namespace std;
+using namespace XUSG;
+
+namespace
+{
+	bool isSameGroup(const TextureArrayPacker::TextureDesc& a, const TextureArrayPacker::TextureDesc& b)
+	{
+		return a.Format == b.Format && a.Width == b.Width && a.Height == b.Height &&
+			a.MipLevels == b.MipLevels && a.IsSRGB == b.IsSRGB;
+	}
+
+	bool isGroupLess(const TextureArrayPacker::TextureDesc& a, const TextureArrayPacker::TextureDesc& b)
+	{
+		if (a.Format != b.Format) return a.Format < b.Format;
+		if (a.Width != b.Width) return a.Width < b.Width;
+		if (a.Height != b.Height) return a.Height < b.Height;
+		if (a.MipLevels != b.MipLevels) return a.MipLevels < b.MipLevels;
+
+		return a.IsSRGB < b.IsSRGB;
+	}
+}
+
+TextureArrayPacker::TextureArrayPacker() :
+	m_materialPlacements(0),
+	m_resourceFileNames(0),
+	m_stats()
+{
+}
+
+TextureArrayPacker::~TextureArrayPacker()
+{
+}
+
+bool TextureArrayPacker::Pack(const SDKMesh* pMesh, const wchar_t* textureDirectory, const wchar_t* outputDirectory,
+	uint16_t maxArraySize)
+{
+	XUSG_N_RETURN(pMesh && maxArraySize > 0, false);
+
+	// Collect the distinct material textures, keyed by file and color space.
+	vector<wstring> fileNames;
+	vector<TextureDesc> textures;
+	const auto numMaterials = pMesh->GetNumMaterials();
+	vector<uint32_t> materialTextures(NUM_SLOTS * numMaterials, UINT32_MAX);
+	for (auto i = 0u; i < numMaterials; ++i)
+	{
+		const auto pMaterial = pMesh->GetMaterial(i);
+		const char* names[NUM_SLOTS] = { pMaterial->AlbedoTexture, pMaterial->NormalTexture, pMaterial->SpecularTexture };
+		for (uint8_t slot = 0; slot < NUM_SLOTS; ++slot)
+		{
+			if (!names[slot][0]) continue;
+
+			const auto fileName = wstring(textureDirectory) + L"/" + wstring(names[slot], names[slot] + strlen(names[slot]));
+			const auto isSRGB = slot == ALBEDO;
+
+			auto texture = 0u;
+			while (texture < textures.size() && (fileNames[texture] != fileName || textures[texture].IsSRGB != isSRGB)) ++texture;
+			if (texture == textures.size())
+			{
+				DDS::TextureInfo info;
+				TextureDesc desc = {};
+				desc.IsSRGB = isSRGB;
+				if (DDS::Parser::LoadHeader(info, fileName.c_str()))
+				{
+					desc.Format = info.Format;
+					desc.Width = info.Width;
+					desc.Height = info.Height;
+					desc.MipLevels = info.MipLevels;
+					desc.IsPackable = info.Dimension == DDS::Dimension::TEXTURE2D && info.ArraySize == 1 && !info.IsCubeMap;
+				}
+				fileNames.push_back(fileName);
+				textures.push_back(desc);
+			}
+			materialTextures[NUM_SLOTS * i + slot] = texture;
+		}
+	}
+
+	// Subsets in mesh order, as StaticModel::Render draws them
+	vector<uint32_t> drawMaterials;
+	const auto numMeshes = pMesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto numSubsets = pMesh->GetNumSubsets(m);
+		for (auto s = 0u; s < numSubsets; ++s) drawMaterials.push_back(pMesh->GetSubset(m, s)->MaterialID);
+	}
+
+	const auto numTextures = static_cast<uint32_t>(textures.size());
+	vector<Placement> placements(numTextures);
+	const auto numResources = PlanArrays(placements.data(), textures.data(), numTextures, maxArraySize, &m_stats.NumArrays);
+
+	// Write the arrays; standalone textures keep their source files.
+	vector<vector<wstring>> arraySources(m_stats.NumArrays);
+	m_resourceFileNames.resize(numResources);
+	for (auto i = 0u; i < numTextures; ++i)
+	{
+		const auto& placement = placements[i];
+		if (placement.Resource < m_stats.NumArrays)
+		{
+			auto& sources = arraySources[placement.Resource];
+			if (sources.size() <= placement.Slice) sources.resize(placement.Slice + 1);
+			sources[placement.Slice] = fileNames[i];
+		}
+		else m_resourceFileNames[placement.Resource] = fileNames[i];
+	}
+
+	m_stats.NumTextures = numTextures;
+	m_stats.NumPackedTextures = 0;
+	for (auto i = 0u; i < m_stats.NumArrays; ++i)
+	{
+		m_resourceFileNames[i] = wstring(outputDirectory) + L"/TextureArray" + to_wstring(i) + L".dds";
+		XUSG_N_RETURN(WriteArray(m_resourceFileNames[i].c_str(), arraySources[i].data(),
+			static_cast<uint32_t>(arraySources[i].size())), false);
+		m_stats.NumPackedTextures += static_cast<uint32_t>(arraySources[i].size());
+	}
+
+	// Rewrite the materials to array slices.
+	m_materialPlacements.resize(materialTextures.size());
+	for (size_t i = 0; i < materialTextures.size(); ++i)
+		m_materialPlacements[i] = materialTextures[i] != UINT32_MAX ? placements[materialTextures[i]] : Placement{ UINT32_MAX, 0 };
+
+	const auto numDraws = static_cast<uint32_t>(drawMaterials.size());
+	m_stats.NumTablesBefore = CountTables(materialTextures.data(), numMaterials, nullptr,
+		drawMaterials.data(), numDraws, &m_stats.NumSwitchesBefore);
+	m_stats.NumTablesAfter = CountTables(materialTextures.data(), numMaterials, placements.data(),
+		drawMaterials.data(), numDraws, &m_stats.NumSwitchesAfter);
+
+	return true;
+}
+
+uint32_t TextureArrayPacker::PlanArrays(Placement* pPlacements, const TextureDesc* pTextures, uint32_t numTextures,
+	uint16_t maxArraySize, uint32_t* pNumArrays)
+{
+	assert(maxArraySize > 0);
+
+	// Stable sort by group, so that slices follow the texture order within each group
+	vector<uint32_t> order;
+	for (auto i = 0u; i < numTextures; ++i) if (pTextures[i].IsPackable) order.push_back(i);
+	stable_sort(order.begin(), order.end(), [pTextures](uint32_t a, uint32_t b)
+	{
+		return isGroupLess(pTextures[a], pTextures[b]);
+	});
+
+	vector<bool> isPacked(numTextures, false);
+	auto numArrays = 0u;
+	for (size_t first = 0; first < order.size();)
+	{
+		auto last = first + 1;
+		while (last < order.size() && isSameGroup(pTextures[order[first]], pTextures[order[last]])) ++last;
+
+		// Split into arrays of up to maxArraySize, where a lone remainder stays standalone.
+		for (auto i = first; i < last; i += maxArraySize)
+		{
+			const auto count = (min)(static_cast<size_t>(maxArraySize), last - i);
+			if (count < 2) break;
+
+			for (size_t j = 0; j < count; ++j)
+			{
+				pPlacements[order[i + j]] = { numArrays, static_cast<uint16_t>(j) };
+				isPacked[order[i + j]] = true;
+			}
+			++numArrays;
+		}
+		first = last;
+	}
+
+	auto numResources = numArrays;
+	for (auto i = 0u; i < numTextures; ++i)
+		if (!isPacked[i]) pPlacements[i] = { numResources++, 0 };
+
+	if (pNumArrays) *pNumArrays = numArrays;
+
+	return numResources;
+}
+
+uint32_t TextureArrayPacker::CountTables(const uint32_t* pMaterialTextures, uint32_t numMaterials,
+	const Placement* pPlacements, const uint32_t* pDrawMaterials, uint32_t numDraws, uint32_t* pNumSwitches)
+{
+	using Table = array<uint32_t, NUM_SLOTS>;
+	const auto getTable = [&](uint32_t material)
+	{
+		Table table;
+		for (uint8_t slot = 0; slot < NUM_SLOTS; ++slot)
+		{
+			const auto texture = pMaterialTextures[NUM_SLOTS * material + slot];
+			table[slot] = pPlacements && texture != UINT32_MAX ? pPlacements[texture].Resource : texture;
+		}
+
+		return table;
+	};
+
+	set<Table> tables;
+	for (auto i = 0u; i < numMaterials; ++i) tables.insert(getTable(i));
+
+	if (pNumSwitches)
+	{
+		*pNumSwitches = 0;
+		Table current;
+		for (auto i = 0u; i < numDraws; ++i)
+		{
+			const auto table = getTable(pDrawMaterials[i]);
+			if (i == 0 || table != current) ++*pNumSwitches;
+			current = table;
+		}
+	}
+
+	return static_cast<uint32_t>(tables.size());
+}
+
+bool TextureArrayPacker::WriteArray(const wchar_t* dstFileName, const wstring* pSrcFileNames, uint32_t numSrcFiles)
+{
+	XUSG_N_RETURN(numSrcFiles > 0 && numSrcFiles <= UINT16_MAX, false);
+
+	vector<uint8_t> ddsFile;
+	DDS::TextureInfo arrayInfo = {};
+	vector<uint8_t> data;
+	for (auto i = 0u; i < numSrcFiles; ++i)
+	{
+		DDS::TextureInfo info;
+		vector<DDS::SubresourceLayout> layouts;
+		XUSG_N_RETURN(DDS::Parser::LoadFile(data, pSrcFileNames[i].c_str()), false);
+		XUSG_N_RETURN(DDS::Parser::ParseHeader(info, data.data(), data.size()), false);
+		XUSG_N_RETURN(info.Dimension == DDS::Dimension::TEXTURE2D && info.ArraySize == 1 && !info.IsCubeMap, false);
+		XUSG_N_RETURN(DDS::Parser::GetSubresourceLayouts(layouts, info, data.size()), false);
+
+		if (i == 0)
+		{
+			arrayInfo = info;
+			arrayInfo.ArraySize = static_cast<uint16_t>(numSrcFiles);
+			DDS::Parser::WriteHeader(ddsFile, arrayInfo);
+		}
+		else XUSG_N_RETURN(info.Format == arrayInfo.Format && info.Width == arrayInfo.Width &&
+			info.Height == arrayInfo.Height && info.MipLevels == arrayInfo.MipLevels, false);
+
+		// Each slice is a whole mip chain, as laid out in a single-texture file
+		const auto& last = layouts.back();
+		const auto pBegin = &data[static_cast<size_t>(info.DataOffset)];
+		const auto pEnd = &data[0] + static_cast<size_t>(last.Offset + last.SlicePitch * last.Depth);
+		ddsFile.insert(ddsFile.end(), pBegin, pEnd);
+	}
+
+	return DDS::Parser::SaveFile(dstFileName, ddsFile);
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Asset-time packing of same-format, same-size material textures into Texture2DArrays.
+	// Materials then refer to an array and a slice, so subsets whose textures share arrays
+	// also share one descriptor table and draw without switching tables.
+	//--------------------------------------------------------------------------------------
+	class TextureArrayPacker
+	{
+	public:
+		enum Slot : uint8_t
+		{
+			ALBEDO,
+			NORMAL,
+			SPECULAR,
+
+			NUM_SLOTS
+		};
+
+		struct TextureDesc
+		{
+			Format		Format;
+			uint32_t	Width;
+			uint32_t	Height;
+			uint8_t		MipLevels;
+			bool		IsSRGB;			// Albedo textures are loaded as sRGB, so they never share with the others
+			bool		IsPackable;		// Single 2D textures only
+		};
+
+		// Resource indexes the packed resources: the arrays first, then the standalone textures
+		struct Placement
+		{
+			uint32_t	Resource;
+			uint16_t	Slice;
+		};
+
+		struct Stats
+		{
+			uint32_t	NumTextures;
+			uint32_t	NumArrays;
+			uint32_t	NumPackedTextures;	// Textures moved into arrays
+			uint32_t	NumTablesBefore;	// Distinct material descriptor tables
+			uint32_t	NumTablesAfter;
+			uint32_t	NumSwitchesBefore;	// Table changes when drawing the subsets in order
+			uint32_t	NumSwitchesAfter;
+		};
+
+		TextureArrayPacker();
+		virtual ~TextureArrayPacker();
+
+		// Packs the material textures of a mesh, writing the arrays to outputDirectory
+		bool Pack(const SDKMesh* pMesh, const wchar_t* textureDirectory, const wchar_t* outputDirectory,
+			uint16_t maxArraySize = 64);
+
+		// Placement of a material texture; Resource is UINT32_MAX when the slot is unbound
+		const Placement& GetPlacement(uint32_t material, Slot slot) const { return m_materialPlacements[NUM_SLOTS * material + slot]; }
+		const std::vector<std::wstring>& GetResourceFileNames() const { return m_resourceFileNames; }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Groups textures with the same format, size, mip count and color space into arrays of up to
+		// maxArraySize slices, in a deterministic order; a texture without partners stays standalone.
+		// Returns the number of resources, with the number of arrays in pNumArrays.
+		static uint32_t PlanArrays(Placement* pPlacements, const TextureDesc* pTextures, uint32_t numTextures,
+			uint16_t maxArraySize, uint32_t* pNumArrays = nullptr);
+
+		// Counts the distinct descriptor tables of materials, given NUM_SLOTS texture indices per
+		// material (UINT32_MAX for none), and the table switches over the draws. Tables are of
+		// textures if pPlacements is null, or else of the resources they are placed in.
+		static uint32_t CountTables(const uint32_t* pMaterialTextures, uint32_t numMaterials, const Placement* pPlacements,
+			const uint32_t* pDrawMaterials = nullptr, uint32_t numDraws = 0, uint32_t* pNumSwitches = nullptr);
+
+		// Concatenates DDS files of identical layout into one texture array
+		static bool WriteArray(const wchar_t* dstFileName, const std::wstring* pSrcFileNames, uint32_t numSrcFiles);
+
+		using uptr = std::unique_ptr<TextureArrayPacker>;
+		using sptr = std::shared_ptr<TextureArrayPacker>;
+
+	protected:
+		std::vector<Placement>		m_materialPlacements;
+		std::vector<std::wstring>	m_resourceFileNames;
+		Stats						m_stats;
+	};
+}
@@ -0,0 +1,1115 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <emmintrin.h>
+#include <DirectXPackedVector.h>
+#include "TextureDecoder.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace XUSG;
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Little-endian reader over a 128-bit block
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* pBlock) : m_pos(0)
+		{
+			memcpy(m_bits, pBlock, sizeof(m_bits));
+		}
+
+		uint32_t Read(uint32_t numBits)
+		{
+			if (!numBits) return 0;
+
+			const auto i = m_pos >> 6;
+			const auto shift = m_pos & 63;
+			auto value = m_bits[i] >> shift;
+			if (shift + numBits > 64 && i < 1) value |= m_bits[i + 1] << (64 - shift);
+			m_pos += numBits;
+
+			return static_cast<uint32_t>(value & ((1ull << numBits) - 1));
+		}
+
+		uint32_t GetPosition() const { return m_pos; }
+		void SetPosition(uint32_t pos) { m_pos = pos; }
+
+	protected:
+		uint64_t m_bits[2];
+		uint32_t m_pos;
+	};
+
+	const uint8_t g_weights2[] = { 0, 21, 43, 64 };
+	const uint8_t g_weights3[] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const uint8_t g_weights4[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Subset of each texel for the 2-subset partitions, one bit per texel
+	const uint16_t g_partitions2[64] =
+	{
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+	};
+
+	// Subset of each texel for the 3-subset partitions, two bits per texel
+	const uint32_t g_partitions3[64] =
+	{
+		0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+		0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+		0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+		0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+		0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+		0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+		0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+		0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+	};
+
+	const uint8_t g_anchors2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+	};
+
+	const uint8_t g_anchors3[2][64] =
+	{
+		{
+			3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+			3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+			8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+			3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+		},
+		{
+			15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+			15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+			15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+			15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+		}
+	};
+
+	inline uint8_t getSubset(uint8_t numSubsets, uint8_t partition, uint8_t texel)
+	{
+		switch (numSubsets)
+		{
+		case 2: return (g_partitions2[partition] >> texel) & 1;
+		case 3: return (g_partitions3[partition] >> (2 * texel)) & 3;
+		default: return 0;
+		}
+	}
+
+	inline bool isAnchor(uint8_t numSubsets, uint8_t partition, uint8_t texel)
+	{
+		if (texel == 0) return true;
+
+		switch (numSubsets)
+		{
+		case 2: return texel == g_anchors2[partition];
+		case 3: return texel == g_anchors3[0][partition] || texel == g_anchors3[1][partition];
+		default: return false;
+		}
+	}
+
+	inline uint8_t expand565(uint32_t v, uint32_t bits)
+	{
+		return static_cast<uint8_t>((v << (8 - bits)) | (v >> (2 * bits - 8)));
+	}
+
+	inline float halfToFloat(uint16_t h)
+	{
+		return XMConvertHalfToFloat(h);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// BC1-BC5
+	//--------------------------------------------------------------------------------------
+
+	// Color palette of a BC1 block, interpolated for 4 channels at once
+	void decodeColorPalette(uint32_t palette[4], uint16_t c0, uint16_t c1, bool allowPunchThrough)
+	{
+		const uint32_t rgb0 = expand565(c0 >> 11, 5) | (expand565((c0 >> 5) & 0x3f, 6) << 8) |
+			(expand565(c0 & 0x1f, 5) << 16) | 0xff000000;
+		const uint32_t rgb1 = expand565(c1 >> 11, 5) | (expand565((c1 >> 5) & 0x3f, 6) << 8) |
+			(expand565(c1 & 0x1f, 5) << 16) | 0xff000000;
+
+		const auto zero = _mm_setzero_si128();
+		const auto e0 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(rgb0)), zero);
+		const auto e1 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(rgb1)), zero);
+
+		// (2 * e0 + e1) / 3 and (e0 + 2 * e1) / 3 in two 16-bit lanes of 4, or the midpoint
+		__m128i mixed;
+		if (c0 > c1 || !allowPunchThrough)
+		{
+			const auto lo = _mm_add_epi16(_mm_add_epi16(e0, e0), e1);
+			const auto hi = _mm_add_epi16(_mm_add_epi16(e1, e1), e0);
+			mixed = _mm_mulhi_epu16(_mm_unpacklo_epi64(lo, hi), _mm_set1_epi16(21846));
+		}
+		else
+		{
+			const auto mid = _mm_srli_epi16(_mm_add_epi16(e0, e1), 1);
+			mixed = _mm_unpacklo_epi64(mid, zero);
+		}
+
+		const auto packed = _mm_packus_epi16(mixed, zero);
+		palette[0] = rgb0;
+		palette[1] = rgb1;
+		palette[2] = static_cast<uint32_t>(_mm_cvtsi128_si32(packed));
+		palette[3] = c0 > c1 || !allowPunchThrough ? static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(packed, 4))) : 0;
+	}
+
+	void decodeColorBlock(uint32_t* pTexels, const uint8_t* pBlock, bool allowPunchThrough)
+	{
+		uint16_t c0, c1;
+		uint32_t indices;
+		memcpy(&c0, pBlock, sizeof(uint16_t));
+		memcpy(&c1, &pBlock[2], sizeof(uint16_t));
+		memcpy(&indices, &pBlock[4], sizeof(uint32_t));
+
+		uint32_t palette[4];
+		decodeColorPalette(palette, c0, c1, allowPunchThrough);
+		for (uint8_t i = 0; i < 16; ++i) pTexels[i] = palette[(indices >> (2 * i)) & 3];
+	}
+
+	// 8 interpolated values of a BC3/BC4/BC5 channel
+	template<typename T>
+	void decodeChannelBlock(T* pValues, const uint8_t* pBlock, uint32_t stride)
+	{
+		const int e0 = static_cast<T>(pBlock[0]);
+		const int e1 = static_cast<T>(pBlock[1]);
+
+		int palette[8] = { e0, e1 };
+		if (e0 > e1) for (auto i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+		else
+		{
+			for (auto i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+			palette[6] = is_signed<T>::value ? -127 : 0;
+			palette[7] = is_signed<T>::value ? 127 : 255;
+		}
+
+		uint64_t indices = 0;
+		memcpy(&indices, &pBlock[2], 6);
+		for (uint8_t i = 0; i < 16; ++i) pValues[stride * i] = static_cast<T>(palette[(indices >> (3 * i)) & 7]);
+	}
+
+	void decodeBC1(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeColorBlock(static_cast<uint32_t*>(pTexels), pBlock, true);
+	}
+
+	void decodeBC2(void* pTexels, const uint8_t* pBlock)
+	{
+		const auto pColors = static_cast<uint32_t*>(pTexels);
+		decodeColorBlock(pColors, &pBlock[8], false);
+
+		uint64_t alphas;
+		memcpy(&alphas, pBlock, sizeof(uint64_t));
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto a = static_cast<uint32_t>((alphas >> (4 * i)) & 0xf);
+			pColors[i] = (pColors[i] & 0x00ffffff) | ((a | (a << 4)) << 24);
+		}
+	}
+
+	void decodeBC3(void* pTexels, const uint8_t* pBlock)
+	{
+		const auto pColors = static_cast<uint32_t*>(pTexels);
+		decodeColorBlock(pColors, &pBlock[8], false);
+		decodeChannelBlock(&static_cast<uint8_t*>(pTexels)[3], pBlock, 4);
+	}
+
+	void decodeBC4U(void* pTexels, const uint8_t* pBlock)
+	{
+		const auto pColors = static_cast<uint32_t*>(pTexels);
+		for (uint8_t i = 0; i < 16; ++i) pColors[i] = 0xff000000;
+		decodeChannelBlock(static_cast<uint8_t*>(pTexels), pBlock, 4);
+	}
+
+	void decodeBC5U(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeBC4U(pTexels, pBlock);
+		decodeChannelBlock(&static_cast<uint8_t*>(pTexels)[1], &pBlock[8], 4);
+	}
+
+	void decodeSignedChannels(float* pTexels, const uint8_t* pBlock, uint8_t numChannels)
+	{
+		int8_t values[2][16];
+		for (uint8_t c = 0; c < numChannels; ++c)
+			decodeChannelBlock(values[c], &pBlock[8 * c], 1);
+
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto pTexel = &pTexels[4 * i];
+			for (uint8_t c = 0; c < 4; ++c)
+				pTexel[c] = c < numChannels ? (max)(values[c][i], static_cast<int8_t>(-127)) / 127.0f : (c == 3 ? 1.0f : 0.0f);
+		}
+	}
+
+	void decodeBC4S(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeSignedChannels(static_cast<float*>(pTexels), pBlock, 1);
+	}
+
+	void decodeBC5S(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeSignedChannels(static_cast<float*>(pTexels), pBlock, 2);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// BC7
+	//--------------------------------------------------------------------------------------
+
+	struct BC7Mode
+	{
+		uint8_t NumSubsets;
+		uint8_t PartitionBits;
+		uint8_t RotationBits;
+		uint8_t IndexSelectionBits;
+		uint8_t ColorBits;
+		uint8_t AlphaBits;
+		uint8_t EndpointPBits;
+		uint8_t SharedPBits;
+		uint8_t IndexBits;
+		uint8_t IndexBits2;
+	};
+
+	const BC7Mode g_bc7Modes[] =
+	{
+		{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+	};
+
+	// Interpolates 4 channels of 2 palette entries per iteration
+	void interpolatePalette(uint32_t* pPalette, uint32_t e0, uint32_t e1, const uint8_t* pWeights, uint8_t numEntries)
+	{
+		const auto zero = _mm_setzero_si128();
+		const auto v0 = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(e0)), zero);
+		const auto v1 = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(e1)), zero);
+		const auto rounding = _mm_set1_epi16(32);
+
+		for (uint8_t i = 0; i < numEntries; i += 2)
+		{
+			const auto w1 = _mm_unpacklo_epi64(_mm_set1_epi16(pWeights[i]), _mm_set1_epi16(pWeights[i + 1]));
+			const auto w0 = _mm_sub_epi16(_mm_set1_epi16(64), w1);
+			auto v = _mm_add_epi16(_mm_mullo_epi16(v0, w0), _mm_mullo_epi16(v1, w1));
+			v = _mm_srli_epi16(_mm_add_epi16(v, rounding), 6);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&pPalette[i]), _mm_packus_epi16(v, zero));
+		}
+	}
+
+	void decodeBC7(void* pTexels, const uint8_t* pBlock)
+	{
+		const auto pColors = static_cast<uint32_t*>(pTexels);
+
+		uint8_t m = 0;
+		while (m < 8 && !(pBlock[0] & (1 << m))) ++m;
+		if (m >= 8)
+		{
+			// Reserved mode
+			for (uint8_t i = 0; i < 16; ++i) pColors[i] = 0;
+			return;
+		}
+
+		const auto& mode = g_bc7Modes[m];
+		BitReader bits(pBlock);
+		bits.Read(m + 1);
+
+		const auto partition = static_cast<uint8_t>(bits.Read(mode.PartitionBits));
+		const auto rotation = bits.Read(mode.RotationBits);
+		const auto indexSelection = bits.Read(mode.IndexSelectionBits);
+
+		// Endpoints: all reds, then greens, blues and alphas
+		const uint8_t numEndpoints = mode.NumSubsets * 2;
+		uint8_t endpoints[6][4];
+		for (uint8_t c = 0; c < 3; ++c)
+			for (uint8_t e = 0; e < numEndpoints; ++e)
+				endpoints[e][c] = static_cast<uint8_t>(bits.Read(mode.ColorBits));
+		for (uint8_t e = 0; e < numEndpoints; ++e)
+			endpoints[e][3] = static_cast<uint8_t>(bits.Read(mode.AlphaBits));
+
+		// P-bits, then expansion to 8 bits
+		uint8_t pBits[6] = {};
+		if (mode.EndpointPBits) for (uint8_t e = 0; e < numEndpoints; ++e) pBits[e] = static_cast<uint8_t>(bits.Read(1));
+		if (mode.SharedPBits) for (uint8_t s = 0; s < mode.NumSubsets; ++s) pBits[2 * s] = pBits[2 * s + 1] = static_cast<uint8_t>(bits.Read(1));
+		const auto hasPBits = mode.EndpointPBits || mode.SharedPBits;
+
+		uint32_t colors[6];
+		for (uint8_t e = 0; e < numEndpoints; ++e)
+		{
+			uint8_t rgba[4];
+			for (uint8_t c = 0; c < 4; ++c)
+			{
+				const auto precision = c < 3 ? mode.ColorBits : mode.AlphaBits;
+				if (!precision)
+				{
+					rgba[c] = 255;
+					continue;
+				}
+
+				auto v = static_cast<uint32_t>(endpoints[e][c]);
+				auto n = static_cast<uint32_t>(precision);
+				if (hasPBits)
+				{
+					v = (v << 1) | pBits[e];
+					++n;
+				}
+				v <<= 8 - n;
+				rgba[c] = static_cast<uint8_t>(v | (v >> n));
+			}
+			memcpy(&colors[e], rgba, sizeof(uint32_t));
+		}
+
+		// Indices
+		uint8_t indices[16], indices2[16];
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto numBits = mode.IndexBits - (isAnchor(mode.NumSubsets, partition, i) ? 1 : 0);
+			indices[i] = static_cast<uint8_t>(bits.Read(numBits));
+		}
+		if (mode.IndexBits2)
+			for (uint8_t i = 0; i < 16; ++i)
+				indices2[i] = static_cast<uint8_t>(bits.Read(mode.IndexBits2 - (i ? 0 : 1)));
+
+		const auto getWeights = [](uint8_t numBits)
+		{
+			return numBits == 2 ? g_weights2 : (numBits == 3 ? g_weights3 : g_weights4);
+		};
+
+		if (mode.IndexBits2)
+		{
+			// Separate color and alpha indices
+			const auto colorBits = indexSelection ? mode.IndexBits2 : mode.IndexBits;
+			const auto alphaBits = indexSelection ? mode.IndexBits : mode.IndexBits2;
+			const auto pColorIndices = indexSelection ? indices2 : indices;
+			const auto pAlphaIndices = indexSelection ? indices : indices2;
+
+			uint32_t colorPalette[16], alphaPalette[16];
+			interpolatePalette(colorPalette, colors[0], colors[1], getWeights(colorBits), 1 << colorBits);
+			interpolatePalette(alphaPalette, colors[0], colors[1], getWeights(alphaBits), 1 << alphaBits);
+			for (uint8_t i = 0; i < 16; ++i)
+				pColors[i] = (colorPalette[pColorIndices[i]] & 0x00ffffff) | (alphaPalette[pAlphaIndices[i]] & 0xff000000);
+		}
+		else
+		{
+			uint32_t palettes[3][16];
+			for (uint8_t s = 0; s < mode.NumSubsets; ++s)
+				interpolatePalette(palettes[s], colors[2 * s], colors[2 * s + 1], getWeights(mode.IndexBits), 1 << mode.IndexBits);
+			for (uint8_t i = 0; i < 16; ++i)
+				pColors[i] = palettes[getSubset(mode.NumSubsets, partition, i)][indices[i]];
+		}
+
+		if (rotation)
+		{
+			const auto shift = 8 * (rotation - 1);
+			for (uint8_t i = 0; i < 16; ++i)
+			{
+				const auto c = pColors[i];
+				const auto a = c >> 24;
+				const auto x = (c >> shift) & 0xff;
+				pColors[i] = (c & ~((0xffu << shift) | 0xff000000)) | (a << shift) | (x << 24);
+			}
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// BC6H
+	//--------------------------------------------------------------------------------------
+
+	enum BC6HField : uint8_t
+	{
+		NA,	// Mode bits
+		RW, GW, BW, RX, GX, BX, RY, GY, BY, RZ, GZ, BZ, D
+	};
+
+	// A run of bits of a field, streamed from the bit First towards the bit Last
+	struct BC6HSegment
+	{
+		uint8_t Field;
+		uint8_t First;
+		uint8_t Last;
+	};
+
+	struct BC6HMode
+	{
+		uint8_t ModeBits;
+		uint8_t Value;
+		uint8_t NumSubsets;
+		bool IsTransformed;
+		uint8_t EndpointBits;
+		uint8_t DeltaBits[3];
+		BC6HSegment Segments[32];	// Terminated by a segment of NA
+	};
+
+	const BC6HMode g_bc6hModes[] =
+	{
+		{ 2, 0x00, 2, true, 10, { 5, 5, 5 }, {
+			{ GY, 4, 4 }, { BY, 4, 4 }, { BZ, 4, 4 }, { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 },
+			{ RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 },
+			{ BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 }, { RZ, 0, 4 },
+			{ BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 2, 0x01, 2, true, 7, { 6, 6, 6 }, {
+			{ GY, 5, 5 }, { GZ, 4, 5 }, { RW, 0, 6 }, { BZ, 0, 1 }, { BY, 4, 4 }, { GW, 0, 6 },
+			{ BY, 5, 5 }, { BZ, 2, 2 }, { GY, 4, 4 }, { BW, 0, 6 }, { BZ, 3, 3 }, { BZ, 5, 5 },
+			{ BZ, 4, 4 }, { RX, 0, 5 }, { GY, 0, 3 }, { GX, 0, 5 }, { GZ, 0, 3 }, { BX, 0, 5 },
+			{ BY, 0, 3 }, { RY, 0, 5 }, { RZ, 0, 5 }, { D, 0, 4 } } },
+		{ 5, 0x02, 2, true, 11, { 5, 4, 4 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 4 }, { RW, 10, 10 }, { GY, 0, 3 },
+			{ GX, 0, 3 }, { GW, 10, 10 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 3 }, { BW, 10, 10 },
+			{ BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 },
+			{ D, 0, 4 } } },
+		{ 5, 0x06, 2, true, 11, { 4, 5, 4 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 10, 10 }, { GZ, 4, 4 },
+			{ GY, 0, 3 }, { GX, 0, 4 }, { GW, 10, 10 }, { GZ, 0, 3 }, { BX, 0, 3 }, { BW, 10, 10 },
+			{ BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 3 }, { BZ, 0, 0 }, { BZ, 2, 2 }, { RZ, 0, 3 },
+			{ GY, 4, 4 }, { BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 5, 0x0a, 2, true, 11, { 4, 4, 5 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 10, 10 }, { BY, 4, 4 },
+			{ GY, 0, 3 }, { GX, 0, 3 }, { GW, 10, 10 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 4 },
+			{ BW, 10, 10 }, { BY, 0, 3 }, { RY, 0, 3 }, { BZ, 1, 2 }, { RZ, 0, 3 }, { BZ, 4, 4 },
+			{ BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 5, 0x0e, 2, true, 9, { 5, 5, 5 }, {
+			{ RW, 0, 8 }, { BY, 4, 4 }, { GW, 0, 8 }, { GY, 4, 4 }, { BW, 0, 8 }, { BZ, 4, 4 },
+			{ RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 },
+			{ BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 }, { RZ, 0, 4 },
+			{ BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 5, 0x12, 2, true, 8, { 6, 5, 5 }, {
+			{ RW, 0, 7 }, { GZ, 4, 4 }, { BY, 4, 4 }, { GW, 0, 7 }, { BZ, 2, 2 }, { GY, 4, 4 },
+			{ BW, 0, 7 }, { BZ, 3, 4 }, { RX, 0, 5 }, { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 },
+			{ GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 5 }, { RZ, 0, 5 },
+			{ D, 0, 4 } } },
+		{ 5, 0x16, 2, true, 8, { 5, 6, 5 }, {
+			{ RW, 0, 7 }, { BZ, 0, 0 }, { BY, 4, 4 }, { GW, 0, 7 }, { GY, 5, 5 }, { GY, 4, 4 },
+			{ BW, 0, 7 }, { GZ, 5, 5 }, { BZ, 4, 4 }, { RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 },
+			{ GX, 0, 5 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 },
+			{ BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 5, 0x1a, 2, true, 8, { 5, 5, 6 }, {
+			{ RW, 0, 7 }, { BZ, 1, 1 }, { BY, 4, 4 }, { GW, 0, 7 }, { BY, 5, 5 }, { GY, 4, 4 },
+			{ BW, 0, 7 }, { BZ, 5, 4 }, { RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 4 },
+			{ BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 5 }, { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 },
+			{ RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 } } },
+		{ 5, 0x1e, 2, false, 6, { 6, 6, 6 }, {
+			{ RW, 0, 5 }, { GZ, 4, 4 }, { BZ, 0, 1 }, { BY, 4, 4 }, { GW, 0, 5 }, { GY, 5, 5 },
+			{ BY, 5, 5 }, { BZ, 2, 2 }, { GY, 4, 4 }, { BW, 0, 5 }, { GZ, 5, 5 }, { BZ, 3, 3 },
+			{ BZ, 5, 5 }, { BZ, 4, 4 }, { RX, 0, 5 }, { GY, 0, 3 }, { GX, 0, 5 }, { GZ, 0, 3 },
+			{ BX, 0, 5 }, { BY, 0, 3 }, { RY, 0, 5 }, { RZ, 0, 5 }, { D, 0, 4 } } },
+		{ 5, 0x03, 1, false, 10, { 10, 10, 10 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 9 }, { GX, 0, 9 }, { BX, 0, 9 } } },
+		{ 5, 0x07, 1, true, 11, { 9, 9, 9 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 8 }, { RW, 10, 10 }, { GX, 0, 8 },
+			{ GW, 10, 10 }, { BX, 0, 8 }, { BW, 10, 10 } } },
+		{ 5, 0x0b, 1, true, 12, { 8, 8, 8 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 7 }, { RW, 11, 10 }, { GX, 0, 7 },
+			{ GW, 11, 10 }, { BX, 0, 7 }, { BW, 11, 10 } } },
+		{ 5, 0x0f, 1, true, 16, { 4, 4, 4 }, {
+			{ RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 15, 10 }, { GX, 0, 3 },
+			{ GW, 15, 10 }, { BX, 0, 3 }, { BW, 15, 10 } } }
+	};
+
+	inline int signExtend(int v, uint32_t numBits)
+	{
+		return (v & (1 << (numBits - 1))) ? v - (1 << numBits) : v;
+	}
+
+	inline int unquantize(int v, uint32_t numBits, bool isSigned)
+	{
+		if (!isSigned)
+		{
+			if (numBits >= 15 || v == 0) return v;
+			if (v == (1 << numBits) - 1) return 0xffff;
+
+			return ((v << 16) + 0x8000) >> numBits;
+		}
+
+		if (numBits >= 16) return v;
+
+		const auto s = v < 0;
+		auto u = s ? -v : v;
+		if (u == 0) return 0;
+		if (u >= (1 << (numBits - 1)) - 1) u = 0x7fff;
+		else u = ((u << 15) + 0x4000) >> (numBits - 1);
+
+		return s ? -u : u;
+	}
+
+	inline float finishUnquantize(int v, bool isSigned)
+	{
+		if (!isSigned) return halfToFloat(static_cast<uint16_t>((v * 31) >> 6));
+
+		const auto h = v < 0 ? 0x8000 | ((-v * 31) >> 5) : (v * 31) >> 5;
+
+		return halfToFloat(static_cast<uint16_t>(h));
+	}
+
+	void decodeBC6H(float* pTexels, const uint8_t* pBlock, bool isSigned)
+	{
+		// Mode
+		auto modeValue = static_cast<uint32_t>(pBlock[0] & 0x3);
+		if (modeValue > 1) modeValue = pBlock[0] & 0x1f;
+
+		const BC6HMode* pMode = nullptr;
+		for (const auto& mode : g_bc6hModes)
+		{
+			if (mode.Value == modeValue)
+			{
+				pMode = &mode;
+				break;
+			}
+		}
+
+		if (!pMode)
+		{
+			// Reserved modes decode to black
+			for (uint8_t i = 0; i < 16; ++i)
+			{
+				pTexels[4 * i] = pTexels[4 * i + 1] = pTexels[4 * i + 2] = 0.0f;
+				pTexels[4 * i + 3] = 1.0f;
+			}
+			return;
+		}
+
+		BitReader bits(pBlock);
+		bits.Read(pMode->ModeBits);
+
+		int fields[D + 1] = {};
+		for (const auto& segment : pMode->Segments)
+		{
+			if (segment.Field == NA) break;
+
+			const int step = segment.First <= segment.Last ? 1 : -1;
+			for (int b = segment.First; ; b += step)
+			{
+				fields[segment.Field] |= bits.Read(1) << b;
+				if (b == segment.Last) break;
+			}
+		}
+
+		// Endpoints: (W, X) for subset 0 and (Y, Z) for subset 1
+		const uint8_t numEndpoints = pMode->NumSubsets * 2;
+		const auto epb = pMode->EndpointBits;
+		int endpoints[4][3];
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			const auto w = fields[RW + c];
+			endpoints[0][c] = isSigned ? signExtend(w, epb) : w;
+			for (uint8_t e = 1; e < numEndpoints; ++e)
+			{
+				const auto v = fields[RW + 3 * e + c];
+				if (pMode->IsTransformed)
+				{
+					const auto sum = (w + signExtend(v, pMode->DeltaBits[c])) & ((1 << epb) - 1);
+					endpoints[e][c] = isSigned ? signExtend(sum, epb) : sum;
+				}
+				else endpoints[e][c] = isSigned ? signExtend(v, epb) : v;
+			}
+		}
+
+		for (uint8_t e = 0; e < numEndpoints; ++e)
+			for (uint8_t c = 0; c < 3; ++c)
+				endpoints[e][c] = unquantize(endpoints[e][c], epb, isSigned);
+
+		// Indices
+		const auto partition = static_cast<uint8_t>(fields[D]);
+		const uint8_t indexBits = pMode->NumSubsets > 1 ? 3 : 4;
+		const auto pWeights = indexBits == 3 ? g_weights3 : g_weights4;
+		bits.SetPosition(128 - (pMode->NumSubsets > 1 ? 46 : 63));
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto index = bits.Read(indexBits - (isAnchor(pMode->NumSubsets, partition, i) ? 1 : 0));
+			const auto subset = getSubset(pMode->NumSubsets, partition, i);
+			const auto w = static_cast<int>(pWeights[index]);
+			const auto& e0 = endpoints[2 * subset];
+			const auto& e1 = endpoints[2 * subset + 1];
+
+			const auto pTexel = &pTexels[4 * i];
+			for (uint8_t c = 0; c < 3; ++c)
+				pTexel[c] = finishUnquantize(((64 - w) * e0[c] + w * e1[c] + 32) >> 6, isSigned);
+			pTexel[3] = 1.0f;
+		}
+	}
+
+	void decodeBC6HU(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeBC6H(static_cast<float*>(pTexels), pBlock, false);
+	}
+
+	void decodeBC6HS(void* pTexels, const uint8_t* pBlock)
+	{
+		decodeBC6H(static_cast<float*>(pTexels), pBlock, true);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Uncompressed formats, one texel at a time
+	//--------------------------------------------------------------------------------------
+
+	template<typename T>
+	inline T load(const uint8_t* pSrc)
+	{
+		T v;
+		memcpy(&v, pSrc, sizeof(T));
+
+		return v;
+	}
+
+	inline uint8_t unpack(uint32_t v, uint32_t shift, uint32_t bits)
+	{
+		return expand565((v >> shift) & ((1 << bits) - 1), bits);
+	}
+
+	void decodeTexel8(uint8_t* pDst, const uint8_t* pSrc, Format format)
+	{
+		switch (format)
+		{
+		case Format::R8G8B8A8_TYPELESS:
+		case Format::R8G8B8A8_UNORM:
+		case Format::R8G8B8A8_UNORM_SRGB:
+			memcpy(pDst, pSrc, 4);
+			break;
+		case Format::B8G8R8A8_TYPELESS:
+		case Format::B8G8R8A8_UNORM:
+		case Format::B8G8R8A8_UNORM_SRGB:
+			pDst[0] = pSrc[2], pDst[1] = pSrc[1], pDst[2] = pSrc[0], pDst[3] = pSrc[3];
+			break;
+		case Format::B8G8R8X8_TYPELESS:
+		case Format::B8G8R8X8_UNORM:
+		case Format::B8G8R8X8_UNORM_SRGB:
+			pDst[0] = pSrc[2], pDst[1] = pSrc[1], pDst[2] = pSrc[0], pDst[3] = 255;
+			break;
+		case Format::R8G8_UNORM:
+			pDst[0] = pSrc[0], pDst[1] = pSrc[1], pDst[2] = 0, pDst[3] = 255;
+			break;
+		case Format::R8_UNORM:
+			pDst[0] = pSrc[0], pDst[1] = pDst[2] = 0, pDst[3] = 255;
+			break;
+		case Format::A8_UNORM:
+			pDst[0] = pDst[1] = pDst[2] = 0, pDst[3] = pSrc[0];
+			break;
+		case Format::B5G6R5_UNORM:
+		{
+			const auto v = load<uint16_t>(pSrc);
+			pDst[0] = unpack(v, 11, 5), pDst[1] = unpack(v, 5, 6), pDst[2] = unpack(v, 0, 5), pDst[3] = 255;
+			break;
+		}
+		case Format::B5G5R5A1_UNORM:
+		{
+			const auto v = load<uint16_t>(pSrc);
+			pDst[0] = unpack(v, 10, 5), pDst[1] = unpack(v, 5, 5), pDst[2] = unpack(v, 0, 5);
+			pDst[3] = v & 0x8000 ? 255 : 0;
+			break;
+		}
+		case Format::B4G4R4A4_UNORM:
+		{
+			const auto v = load<uint16_t>(pSrc);
+			pDst[0] = unpack(v, 8, 4), pDst[1] = unpack(v, 4, 4), pDst[2] = unpack(v, 0, 4), pDst[3] = unpack(v, 12, 4);
+			break;
+		}
+		default:
+			memset(pDst, 0, 4);
+		}
+	}
+
+	void decodeTexel32F(float* pDst, const uint8_t* pSrc, Format format)
+	{
+		pDst[0] = pDst[1] = pDst[2] = 0.0f;
+		pDst[3] = 1.0f;
+
+		switch (format)
+		{
+		case Format::R32G32B32A32_FLOAT:
+			memcpy(pDst, pSrc, sizeof(float[4]));
+			break;
+		case Format::R32G32B32_FLOAT:
+			memcpy(pDst, pSrc, sizeof(float[3]));
+			break;
+		case Format::R32G32_FLOAT:
+			memcpy(pDst, pSrc, sizeof(float[2]));
+			break;
+		case Format::R32_FLOAT:
+			memcpy(pDst, pSrc, sizeof(float));
+			break;
+		case Format::R16G16B16A16_FLOAT:
+			for (uint8_t c = 0; c < 4; ++c) pDst[c] = halfToFloat(load<uint16_t>(&pSrc[2 * c]));
+			break;
+		case Format::R16G16_FLOAT:
+			for (uint8_t c = 0; c < 2; ++c) pDst[c] = halfToFloat(load<uint16_t>(&pSrc[2 * c]));
+			break;
+		case Format::R16_FLOAT:
+			pDst[0] = halfToFloat(load<uint16_t>(pSrc));
+			break;
+		case Format::R16G16B16A16_UNORM:
+			for (uint8_t c = 0; c < 4; ++c) pDst[c] = load<uint16_t>(&pSrc[2 * c]) / 65535.0f;
+			break;
+		case Format::R16G16_UNORM:
+			for (uint8_t c = 0; c < 2; ++c) pDst[c] = load<uint16_t>(&pSrc[2 * c]) / 65535.0f;
+			break;
+		case Format::R16_UNORM:
+			pDst[0] = load<uint16_t>(pSrc) / 65535.0f;
+			break;
+		case Format::R16G16B16A16_SNORM:
+			for (uint8_t c = 0; c < 4; ++c) pDst[c] = (max)(load<int16_t>(&pSrc[2 * c]) / 32767.0f, -1.0f);
+			break;
+		case Format::R16G16_SNORM:
+			for (uint8_t c = 0; c < 2; ++c) pDst[c] = (max)(load<int16_t>(&pSrc[2 * c]) / 32767.0f, -1.0f);
+			break;
+		case Format::R8G8B8A8_SNORM:
+			for (uint8_t c = 0; c < 4; ++c) pDst[c] = (max)(static_cast<int8_t>(pSrc[c]) / 127.0f, -1.0f);
+			break;
+		case Format::R8G8_SNORM:
+			for (uint8_t c = 0; c < 2; ++c) pDst[c] = (max)(static_cast<int8_t>(pSrc[c]) / 127.0f, -1.0f);
+			break;
+		case Format::R10G10B10A2_UNORM:
+		{
+			const auto v = load<uint32_t>(pSrc);
+			for (uint8_t c = 0; c < 3; ++c) pDst[c] = ((v >> (10 * c)) & 0x3ff) / 1023.0f;
+			pDst[3] = (v >> 30) / 3.0f;
+			break;
+		}
+		case Format::R11G11B10_FLOAT:
+		{
+			XMFLOAT3PK packed;
+			memcpy(&packed, pSrc, sizeof(uint32_t));
+			XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(pDst), XMLoadFloat3PK(&packed));
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	using BlockDecoder = void (*)(void*, const uint8_t*);
+
+	BlockDecoder getBlockDecoder(Format format)
+	{
+		switch (format)
+		{
+		case Format::BC1_TYPELESS:
+		case Format::BC1_UNORM:
+		case Format::BC1_UNORM_SRGB:
+			return decodeBC1;
+		case Format::BC2_TYPELESS:
+		case Format::BC2_UNORM:
+		case Format::BC2_UNORM_SRGB:
+			return decodeBC2;
+		case Format::BC3_TYPELESS:
+		case Format::BC3_UNORM:
+		case Format::BC3_UNORM_SRGB:
+			return decodeBC3;
+		case Format::BC4_TYPELESS:
+		case Format::BC4_UNORM:
+			return decodeBC4U;
+		case Format::BC4_SNORM:
+			return decodeBC4S;
+		case Format::BC5_TYPELESS:
+		case Format::BC5_UNORM:
+			return decodeBC5U;
+		case Format::BC5_SNORM:
+			return decodeBC5S;
+		case Format::BC6H_TYPELESS:
+		case Format::BC6H_UF16:
+			return decodeBC6HU;
+		case Format::BC6H_SF16:
+			return decodeBC6HS;
+		case Format::BC7_TYPELESS:
+		case Format::BC7_UNORM:
+		case Format::BC7_UNORM_SRGB:
+			return decodeBC7;
+		default:
+			return nullptr;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Texture decoder
+//--------------------------------------------------------------------------------------
+
+bool TextureDecoder::DecodeFile(vector<Image>& images, const wchar_t* fileName,
+	DDS::TextureInfo* pInfo, uint32_t numThreads)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0, false);
+
+	_fseeki64(pFile, 0, SEEK_END);
+	const auto fileSize = static_cast<size_t>(_ftelli64(pFile));
+	_fseeki64(pFile, 0, SEEK_SET);
+
+	vector<uint8_t> data(fileSize);
+	const auto readSize = fread(data.data(), 1, fileSize, pFile);
+	fclose(pFile);
+	XUSG_N_RETURN(readSize == fileSize, false);
+
+	DDS::TextureInfo info;
+	XUSG_N_RETURN(DDS::Parser::ParseHeader(info, data.data(), data.size()), false);
+	if (pInfo) *pInfo = info;
+
+	return Decode(images, info, data.data(), data.size(), numThreads);
+}
+
+bool TextureDecoder::Decode(vector<Image>& images, const DDS::TextureInfo& info,
+	const uint8_t* pData, size_t dataSize, uint32_t numThreads)
+{
+	XUSG_N_RETURN(IsSupported(info.Format), false);
+
+	vector<DDS::SubresourceLayout> layouts;
+	XUSG_N_RETURN(DDS::Parser::GetSubresourceLayouts(layouts, info, dataSize), false);
+
+	// Volume slices are stacked vertically in each image.
+	const auto decodedFormat = GetDecodedFormat(info.Format);
+	const uint32_t texelSize = decodedFormat == Format::R8G8B8A8_UNORM ? 4 : 16;
+	const auto numSubresources = static_cast<uint32_t>(layouts.size());
+	images.resize(numSubresources);
+	for (auto i = 0u; i < numSubresources; ++i)
+	{
+		const auto& layout = layouts[i];
+		auto& image = images[i];
+		image.Format = decodedFormat;
+		image.Width = layout.Width;
+		image.Height = layout.Height * layout.Depth;
+		image.RowPitch = texelSize * layout.Width;
+		image.Pixels.resize(static_cast<size_t>(image.RowPitch) * image.Height);
+	}
+
+	// Work items are bands of block rows, so that the large mips spread across the threads as well.
+	struct WorkItem
+	{
+		uint32_t Subresource;
+		uint32_t Slice;
+		uint32_t FirstRow;
+		uint32_t NumRows;
+	};
+
+	const auto isBC = DDS::Parser::IsBlockCompressed(info.Format);
+	const auto rowsPerItem = isBC ? 16u : 64u;
+	vector<WorkItem> items;
+	for (auto i = 0u; i < numSubresources; ++i)
+		for (auto z = 0u; z < layouts[i].Depth; ++z)
+			for (auto row = 0u; row < layouts[i].NumRows; row += rowsPerItem)
+				items.push_back({ i, z, row, (min)(rowsPerItem, layouts[i].NumRows - row) });
+
+	atomic<uint32_t> nextItem(0);
+	atomic<bool> success(true);
+	const auto process = [&]()
+	{
+		for (auto n = nextItem++; n < items.size(); n = nextItem++)
+		{
+			const auto& item = items[n];
+			const auto& layout = layouts[item.Subresource];
+			auto& image = images[item.Subresource];
+			const auto pDst = &image.Pixels[static_cast<size_t>(image.RowPitch) * layout.Height * item.Slice];
+			const auto pSrc = &pData[layout.Offset + layout.SlicePitch * item.Slice];
+			if (!DecodeSurface(pDst, image.RowPitch, pSrc, layout.RowPitch, layout.Width, layout.Height,
+				info.Format, item.FirstRow, item.NumRows))
+				success = false;
+		}
+	};
+
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+	numThreads = (min)(numThreads, static_cast<uint32_t>(items.size()));
+
+	vector<thread> workers;
+	for (auto i = 1u; i < numThreads; ++i) workers.emplace_back(process);
+	process();
+	for (auto& worker : workers) worker.join();
+
+	return success;
+}
+
+bool TextureDecoder::DecodeSurface(uint8_t* pDst, uint32_t dstRowPitch, const uint8_t* pSrc, uint32_t srcRowPitch,
+	uint32_t width, uint32_t height, Format format, uint32_t firstRow, uint32_t numRows)
+{
+	const auto decodedFormat = GetDecodedFormat(format);
+	XUSG_N_RETURN(decodedFormat != Format::UNKNOWN, false);
+	const uint32_t texelSize = decodedFormat == Format::R8G8B8A8_UNORM ? 4 : 16;
+
+	const auto decodeBlock = getBlockDecoder(format);
+	if (decodeBlock)
+	{
+		const auto blockSize = format <= Format::BC1_UNORM_SRGB || (format >= Format::BC4_TYPELESS &&
+			format <= Format::BC4_SNORM) ? 8u : 16u;
+		const auto numBlocksX = XUSG_DIV_UP(width, 4u);
+		const auto endRow = (min)(XUSG_DIV_UP(height, 4u), numRows == UINT32_MAX ? UINT32_MAX : firstRow + numRows);
+
+		alignas(16) float texels[16 * 4];
+		for (auto by = firstRow; by < endRow; ++by)
+		{
+			const auto pSrcRow = &pSrc[static_cast<size_t>(srcRowPitch) * by];
+			const auto rows = (min)(4u, height - 4 * by);
+			for (auto bx = 0u; bx < numBlocksX; ++bx)
+			{
+				decodeBlock(texels, &pSrcRow[blockSize * bx]);
+
+				// Blocks over the edge of the surface are clipped.
+				const auto columns = (min)(4u, width - 4 * bx);
+				const auto pTexels = reinterpret_cast<const uint8_t*>(texels);
+				for (auto y = 0u; y < rows; ++y)
+					memcpy(&pDst[static_cast<size_t>(dstRowPitch) * (4 * by + y) + texelSize * 4 * bx],
+						&pTexels[texelSize * 4 * y], texelSize * columns);
+			}
+		}
+
+		return true;
+	}
+
+	const auto bpp = static_cast<uint32_t>(DDS::Loader::BitsPerPixel(format));
+	XUSG_N_RETURN(bpp >= 8, false);
+
+	const auto texelBytes = bpp / 8;
+	const auto endRow = numRows == UINT32_MAX ? height : (min)(height, firstRow + numRows);
+	for (auto y = firstRow; y < endRow; ++y)
+	{
+		const auto pSrcRow = &pSrc[static_cast<size_t>(srcRowPitch) * y];
+		const auto pDstRow = &pDst[static_cast<size_t>(dstRowPitch) * y];
+		if (texelSize == 4)
+			for (auto x = 0u; x < width; ++x) decodeTexel8(&pDstRow[4 * x], &pSrcRow[texelBytes * x], format);
+		else for (auto x = 0u; x < width; ++x)
+			decodeTexel32F(reinterpret_cast<float*>(&pDstRow[16 * x]), &pSrcRow[texelBytes * x], format);
+	}
+
+	return true;
+}
+
+bool TextureDecoder::DecodeBlock(void* pTexels, const uint8_t* pBlock, Format format)
+{
+	const auto decodeBlock = getBlockDecoder(format);
+	XUSG_N_RETURN(decodeBlock, false);
+	decodeBlock(pTexels, pBlock);
+
+	return true;
+}
+
+Format TextureDecoder::GetDecodedFormat(Format format)
+{
+	switch (format)
+	{
+	case Format::BC1_TYPELESS:
+	case Format::BC1_UNORM:
+	case Format::BC1_UNORM_SRGB:
+	case Format::BC2_TYPELESS:
+	case Format::BC2_UNORM:
+	case Format::BC2_UNORM_SRGB:
+	case Format::BC3_TYPELESS:
+	case Format::BC3_UNORM:
+	case Format::BC3_UNORM_SRGB:
+	case Format::BC4_TYPELESS:
+	case Format::BC4_UNORM:
+	case Format::BC5_TYPELESS:
+	case Format::BC5_UNORM:
+	case Format::BC7_TYPELESS:
+	case Format::BC7_UNORM:
+	case Format::BC7_UNORM_SRGB:
+	case Format::R8G8B8A8_TYPELESS:
+	case Format::R8G8B8A8_UNORM:
+	case Format::R8G8B8A8_UNORM_SRGB:
+	case Format::B8G8R8A8_TYPELESS:
+	case Format::B8G8R8A8_UNORM:
+	case Format::B8G8R8A8_UNORM_SRGB:
+	case Format::B8G8R8X8_TYPELESS:
+	case Format::B8G8R8X8_UNORM:
+	case Format::B8G8R8X8_UNORM_SRGB:
+	case Format::R8G8_UNORM:
+	case Format::R8_UNORM:
+	case Format::A8_UNORM:
+	case Format::B5G6R5_UNORM:
+	case Format::B5G5R5A1_UNORM:
+	case Format::B4G4R4A4_UNORM:
+		return Format::R8G8B8A8_UNORM;
+	case Format::BC4_SNORM:
+	case Format::BC5_SNORM:
+	case Format::BC6H_TYPELESS:
+	case Format::BC6H_UF16:
+	case Format::BC6H_SF16:
+	case Format::R32G32B32A32_FLOAT:
+	case Format::R32G32B32_FLOAT:
+	case Format::R32G32_FLOAT:
+	case Format::R32_FLOAT:
+	case Format::R16G16B16A16_FLOAT:
+	case Format::R16G16_FLOAT:
+	case Format::R16_FLOAT:
+	case Format::R16G16B16A16_UNORM:
+	case Format::R16G16_UNORM:
+	case Format::R16_UNORM:
+	case Format::R16G16B16A16_SNORM:
+	case Format::R16G16_SNORM:
+	case Format::R8G8B8A8_SNORM:
+	case Format::R8G8_SNORM:
+	case Format::R10G10B10A2_UNORM:
+	case Format::R11G11B10_FLOAT:
+		return Format::R32G32B32A32_FLOAT;
+	default:
+		return Format::UNKNOWN;
+	}
+}
+
+bool TextureDecoder::IsSupported(Format format)
+{
+	return GetDecodedFormat(format) != Format::UNKNOWN;
+}
+
+uint8_t TextureDecoder::GetSubset(uint8_t numSubsets, uint8_t partition, uint8_t texel)
+{
+	return getSubset(numSubsets, partition, texel);
+}
+
+bool TextureDecoder::IsAnchor(uint8_t numSubsets, uint8_t partition, uint8_t texel)
+{
+	return isAnchor(numSubsets, partition, texel);
+}
+
+const uint8_t* TextureDecoder::GetWeights(uint8_t numIndexBits)
+{
+	return numIndexBits == 2 ? g_weights2 : (numIndexBits == 3 ? g_weights3 : g_weights4);
+}
+
+double TextureDecoder::Benchmark(Format format, uint32_t width, uint32_t height,
+	uint32_t numIterations, uint32_t numThreads)
+{
+	XUSG_N_RETURN(IsSupported(format) && numIterations > 0, 0.0);
+
+	DDS::TextureInfo info = {};
+	info.Format = format;
+	info.Dimension = DDS::Dimension::TEXTURE2D;
+	info.Width = width;
+	info.Height = height;
+	info.Depth = 1;
+	info.ArraySize = 1;
+	info.MipLevels = 1;
+
+	uint32_t rowPitch, numRows;
+	uint64_t slicePitch;
+	DDS::Parser::GetSurfaceInfo(width, height, format, &rowPitch, &numRows, &slicePitch);
+
+	// Random blocks exercise every mode and partition of BC6H and BC7.
+	vector<uint8_t> data(static_cast<size_t>(slicePitch));
+	mt19937 rng(0x5eed);
+	for (auto& byte : data) byte = static_cast<uint8_t>(rng());
+
+	vector<Image> images;
+	Decode(images, info, data.data(), data.size(), numThreads);
+
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < numIterations; ++i) Decode(images, info, data.data(), data.size(), numThreads);
+	const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	return static_cast<double>(width) * height * numIterations / (seconds * 1.0e6);
+}
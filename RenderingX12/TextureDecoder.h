@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// CPU decoder for the DDS formats accepted by DDS::Loader, for headless reference
+	// rendering, texture diffs and thumbnails. Normalized formats decode to R8G8B8A8_UNORM
+	// (sRGB values are kept as encoded), and the others to R32G32B32A32_FLOAT.
+	//--------------------------------------------------------------------------------------
+	class TextureDecoder
+	{
+	public:
+		struct Image
+		{
+			Format		Format;
+			uint32_t	Width;
+			uint32_t	Height;
+			uint32_t	RowPitch;
+			std::vector<uint8_t> Pixels;
+		};
+
+		// Images in subresource order; numThreads of 0 uses all hardware threads.
+		static bool DecodeFile(std::vector<Image>& images, const wchar_t* fileName,
+			DDS::TextureInfo* pInfo = nullptr, uint32_t numThreads = 0);
+		static bool Decode(std::vector<Image>& images, const DDS::TextureInfo& info,
+			const uint8_t* pData, size_t dataSize, uint32_t numThreads = 0);
+
+		// Decodes block rows [firstRow, firstRow + numRows) of a surface
+		static bool DecodeSurface(uint8_t* pDst, uint32_t dstRowPitch, const uint8_t* pSrc, uint32_t srcRowPitch,
+			uint32_t width, uint32_t height, Format format, uint32_t firstRow = 0, uint32_t numRows = UINT32_MAX);
+
+		// 16 texels in row-major order, as R8G8B8A8 or R32G32B32A32_FLOAT per GetDecodedFormat
+		static bool DecodeBlock(void* pTexels, const uint8_t* pBlock, Format format);
+
+		static Format GetDecodedFormat(Format format);
+		static bool IsSupported(Format format);
+
+		// BC6H/BC7 partition tables and index weights (out of 64), shared with the encoder
+		static uint8_t GetSubset(uint8_t numSubsets, uint8_t partition, uint8_t texel);
+		static bool IsAnchor(uint8_t numSubsets, uint8_t partition, uint8_t texel);
+		static const uint8_t* GetWeights(uint8_t numIndexBits);
+
+		// Decodes a surface of random blocks and returns the throughput in MPixels per second
+		static double Benchmark(Format format, uint32_t width = 2048, uint32_t height = 2048,
+			uint32_t numIterations = 8, uint32_t numThreads = 0);
+	};
+}
@@ -0,0 +1,1197 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <emmintrin.h>
+#include "TextureDecoder.h"
+#include "TextureEncoder.h"
+
+using namespace std;
+using namespace XUSG;
+
+using Quality = TextureEncoder::Quality;
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	class BitWriter
+	{
+	public:
+		BitWriter() : m_bits(), m_pos(0) {}
+
+		void Write(uint32_t value, uint32_t numBits)
+		{
+			for (auto i = 0u; i < numBits; ++i, ++m_pos)
+				m_bits[m_pos >> 6] |= static_cast<uint64_t>((value >> i) & 1) << (m_pos & 63);
+		}
+
+		void Store(uint8_t* pBlock) const { memcpy(pBlock, m_bits, sizeof(m_bits)); }
+
+	protected:
+		uint64_t m_bits[2];
+		uint32_t m_pos;
+	};
+
+	inline uint8_t getChannel(uint32_t texel, uint8_t channel)
+	{
+		return static_cast<uint8_t>(texel >> (8 * channel));
+	}
+
+	inline float saturate255(float v)
+	{
+		return (min)((max)(v, 0.0f), 255.0f);
+	}
+
+	// Nearest palette entry of 4 texels at a time in the channels of channelMask, and its squared error
+	void selectIndices(uint8_t indices[16], uint32_t errors[16], const uint32_t texels[16],
+		const uint32_t* pPalette, uint8_t numEntries, uint32_t channelMask)
+	{
+		const auto zero = _mm_setzero_si128();
+		const auto weights = _mm_and_si128(_mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(channelMask)), zero),
+			_mm_set1_epi16(1));
+
+		for (uint8_t i = 0; i < 16; i += 4)
+		{
+			const auto t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&texels[i]));
+			const auto t01 = _mm_unpacklo_epi8(t, zero);
+			const auto t23 = _mm_unpackhi_epi8(t, zero);
+
+			auto bestError = _mm_set1_epi32(INT32_MAX);
+			auto bestIndex = zero;
+			for (uint8_t j = 0; j < numEntries; ++j)
+			{
+				const auto p = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(pPalette[j])), zero);
+				const auto d01 = _mm_mullo_epi16(_mm_sub_epi16(t01, p), weights);
+				const auto d23 = _mm_mullo_epi16(_mm_sub_epi16(t23, p), weights);
+
+				// (RG, BA) sums of each texel, then added pairwise
+				const auto e01 = _mm_castsi128_ps(_mm_madd_epi16(d01, d01));
+				const auto e23 = _mm_castsi128_ps(_mm_madd_epi16(d23, d23));
+				const auto error = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(e01, e23, _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(e01, e23, _MM_SHUFFLE(3, 1, 3, 1))));
+
+				const auto isBetter = _mm_cmplt_epi32(error, bestError);
+				bestError = _mm_or_si128(_mm_and_si128(isBetter, error), _mm_andnot_si128(isBetter, bestError));
+				bestIndex = _mm_or_si128(_mm_and_si128(isBetter, _mm_set1_epi32(j)), _mm_andnot_si128(isBetter, bestIndex));
+			}
+
+			alignas(16) uint32_t best[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&errors[i]), bestError);
+			_mm_store_si128(reinterpret_cast<__m128i*>(best), bestIndex);
+			for (uint8_t k = 0; k < 4; ++k) indices[i + k] = static_cast<uint8_t>(best[k]);
+		}
+	}
+
+	inline uint32_t sumErrors(const uint32_t errors[16], uint16_t texelMask)
+	{
+		uint32_t error = 0;
+		for (uint8_t i = 0; i < 16; ++i) if (texelMask & (1 << i)) error += errors[i];
+
+		return error;
+	}
+
+	// Endpoints spanning the texels of texelMask along their principal axis, or their bounding box at
+	// fast quality; channels from numChannels on are opaque.
+	void fitEndpoints(float e0[4], float e1[4], const uint32_t texels[16], uint16_t texelMask,
+		uint8_t numChannels, Quality quality)
+	{
+		float x[16][4];
+		float mean[4] = {}, lo[4] = { 255.0f, 255.0f, 255.0f, 255.0f }, hi[4] = {};
+		uint8_t n = 0;
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			if (!(texelMask & (1 << i))) continue;
+
+			for (uint8_t c = 0; c < numChannels; ++c)
+			{
+				x[n][c] = getChannel(texels[i], c);
+				mean[c] += x[n][c];
+				lo[c] = (min)(lo[c], x[n][c]);
+				hi[c] = (max)(hi[c], x[n][c]);
+			}
+			++n;
+		}
+
+		for (uint8_t c = numChannels; c < 4; ++c) e0[c] = e1[c] = 255.0f;
+		if (!n)
+		{
+			for (uint8_t c = 0; c < numChannels; ++c) e0[c] = e1[c] = 0.0f;
+			return;
+		}
+
+		float cov[4][4] = {};
+		for (uint8_t c = 0; c < numChannels; ++c) mean[c] /= n;
+		for (uint8_t i = 0; i < n; ++i)
+			for (uint8_t a = 0; a < numChannels; ++a)
+				for (uint8_t b = a; b < numChannels; ++b)
+					cov[a][b] += (x[i][a] - mean[a]) * (x[i][b] - mean[b]);
+		for (uint8_t a = 0; a < numChannels; ++a)
+			for (uint8_t b = 0; b < a; ++b) cov[a][b] = cov[b][a];
+
+		uint8_t k = 0;
+		for (uint8_t c = 1; c < numChannels; ++c) if (cov[c][c] > cov[k][k]) k = c;
+
+		if (quality == Quality::FAST)
+		{
+			// Box inset by 1/16 of its extent, with the diagonal flipped to follow the covariances
+			for (uint8_t c = 0; c < numChannels; ++c)
+			{
+				const auto inset = (hi[c] - lo[c]) / 16.0f;
+				e0[c] = lo[c] + inset;
+				e1[c] = hi[c] - inset;
+				if (cov[k][c] < 0.0f) swap(e0[c], e1[c]);
+			}
+
+			return;
+		}
+
+		// Power iteration from the channel of the largest variance
+		float axis[4] = {};
+		axis[k] = 1.0f;
+		for (uint8_t iter = 0; iter < 8; ++iter)
+		{
+			float v[4] = {};
+			auto scale = 0.0f;
+			for (uint8_t a = 0; a < numChannels; ++a)
+			{
+				for (uint8_t b = 0; b < numChannels; ++b) v[a] += cov[a][b] * axis[b];
+				scale = (max)(scale, fabsf(v[a]));
+			}
+			if (scale <= 0.0f) break;
+			for (uint8_t a = 0; a < numChannels; ++a) axis[a] = v[a] / scale;
+		}
+
+		auto lenSq = 0.0f;
+		for (uint8_t c = 0; c < numChannels; ++c) lenSq += axis[c] * axis[c];
+		const auto invLen = 1.0f / sqrtf(lenSq);
+
+		auto tMin = FLT_MAX, tMax = -FLT_MAX;
+		for (uint8_t i = 0; i < n; ++i)
+		{
+			auto t = 0.0f;
+			for (uint8_t c = 0; c < numChannels; ++c) t += (x[i][c] - mean[c]) * axis[c] * invLen;
+			tMin = (min)(tMin, t);
+			tMax = (max)(tMax, t);
+		}
+
+		for (uint8_t c = 0; c < numChannels; ++c)
+		{
+			e0[c] = saturate255(mean[c] + tMin * axis[c] * invLen);
+			e1[c] = saturate255(mean[c] + tMax * axis[c] * invLen);
+		}
+	}
+
+	// Least-squares endpoints for the chosen indices, with the index weights out of 64
+	bool refineEndpoints(float e0[4], float e1[4], const uint32_t texels[16], uint16_t texelMask,
+		const uint8_t indices[16], const uint8_t* pWeights, uint8_t numChannels)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			if (!(texelMask & (1 << i))) continue;
+
+			const auto w = pWeights[indices[i]] / 64.0f;
+			const auto a = 1.0f - w;
+			aa += a * a;
+			ab += a * w;
+			bb += w * w;
+			for (uint8_t c = 0; c < numChannels; ++c)
+			{
+				ax[c] += a * getChannel(texels[i], c);
+				bx[c] += w * getChannel(texels[i], c);
+			}
+		}
+
+		const auto det = aa * bb - ab * ab;
+		if (fabsf(det) < 1.0e-4f) return false;
+
+		for (uint8_t c = 0; c < numChannels; ++c)
+		{
+			e0[c] = saturate255((ax[c] * bb - bx[c] * ab) / det);
+			e1[c] = saturate255((bx[c] * aa - ax[c] * ab) / det);
+		}
+
+		return true;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// BC1/BC3 color and BC3/BC4/BC5 channel blocks
+	//--------------------------------------------------------------------------------------
+
+	// BC1 index weights out of 64, in palette order
+	const uint8_t g_weights4Color[] = { 0, 64, 21, 43 };
+	const uint8_t g_weights3Color[] = { 0, 64, 32 };
+
+	inline uint16_t to565(const float c[4])
+	{
+		const auto r = static_cast<uint32_t>(c[0] * 31.0f / 255.0f + 0.5f);
+		const auto g = static_cast<uint32_t>(c[1] * 63.0f / 255.0f + 0.5f);
+		const auto b = static_cast<uint32_t>(c[2] * 31.0f / 255.0f + 0.5f);
+
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	inline uint32_t from565(uint16_t c)
+	{
+		const auto r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+
+		return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xff000000;
+	}
+
+	// Same palette as the decoder
+	void buildColorPalette(uint32_t palette[4], uint16_t c0, uint16_t c1, bool isFourColor)
+	{
+		const auto a = from565(c0), b = from565(c1);
+		palette[0] = a;
+		palette[1] = b;
+		palette[2] = palette[3] = 0xff000000;
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			const auto ca = static_cast<uint32_t>(getChannel(a, c)), cb = static_cast<uint32_t>(getChannel(b, c));
+			if (isFourColor)
+			{
+				palette[2] |= ((2 * ca + cb) / 3) << (8 * c);
+				palette[3] |= ((ca + 2 * cb) / 3) << (8 * c);
+			}
+			else palette[2] |= ((ca + cb) / 2) << (8 * c);
+		}
+		if (!isFourColor) palette[3] = 0;
+	}
+
+	// Returns the squared RGB error over the texels of texelMask
+	uint32_t encodeColor(uint16_t& c0, uint16_t& c1, uint8_t indices[16], const uint32_t texels[16],
+		uint16_t texelMask, bool isFourColor, Quality quality)
+	{
+		float e0[4], e1[4];
+		fitEndpoints(e0, e1, texels, texelMask, 3, quality);
+
+		auto bestError = UINT32_MAX;
+		const auto numIterations = quality == Quality::HIGH ? 3 : 1;
+		for (auto n = 0; n < numIterations; ++n)
+		{
+			const auto q0 = to565(e0), q1 = to565(e1);
+			uint32_t palette[4], errors[16];
+			uint8_t candidates[16];
+			buildColorPalette(palette, q0, q1, isFourColor);
+			selectIndices(candidates, errors, texels, palette, isFourColor ? 4 : 3, 0x00ffffff);
+
+			const auto error = sumErrors(errors, texelMask);
+			if (error < bestError)
+			{
+				bestError = error;
+				c0 = q0;
+				c1 = q1;
+				memcpy(indices, candidates, sizeof(candidates));
+			}
+
+			if (!error || !refineEndpoints(e0, e1, texels, texelMask, candidates,
+				isFourColor ? g_weights4Color : g_weights3Color, 3))
+				break;
+		}
+
+		return bestError;
+	}
+
+	void writeColorBlock(uint8_t* pBlock, uint16_t c0, uint16_t c1, const uint8_t indices[16], bool isFourColor)
+	{
+		// 4-color mode needs c0 > c1, and 3-color mode c0 <= c1.
+		static const uint8_t swapped4[] = { 1, 0, 3, 2 };
+		static const uint8_t swapped3[] = { 1, 0, 2, 3 };
+		const auto needSwap = isFourColor ? c0 < c1 : c0 > c1;
+
+		uint32_t bits = 0;
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto index = needSwap ? (isFourColor ? swapped4 : swapped3)[indices[i]] : indices[i];
+			bits |= static_cast<uint32_t>(index) << (2 * i);
+		}
+		if (needSwap) swap(c0, c1);
+
+		memcpy(pBlock, &c0, sizeof(uint16_t));
+		memcpy(&pBlock[2], &c1, sizeof(uint16_t));
+		memcpy(&pBlock[4], &bits, sizeof(uint32_t));
+	}
+
+	void encodeBC1(uint8_t* pBlock, const uint32_t texels[16], Quality quality)
+	{
+		uint16_t opaqueMask = 0;
+		for (uint8_t i = 0; i < 16; ++i) if (getChannel(texels[i], 3) >= 128) opaqueMask |= 1 << i;
+
+		uint16_t c0 = 0, c1 = 0;
+		uint8_t indices[16];
+		if (opaqueMask == 0xffff)
+		{
+			const auto error = encodeColor(c0, c1, indices, texels, opaqueMask, true, quality);
+			writeColorBlock(pBlock, c0, c1, indices, true);
+
+			// 3-color mode is occasionally closer for nearly flat blocks.
+			if (quality == Quality::HIGH && error)
+			{
+				if (encodeColor(c0, c1, indices, texels, opaqueMask, false, quality) < error)
+					writeColorBlock(pBlock, c0, c1, indices, false);
+			}
+
+			return;
+		}
+
+		// Punch-through alpha in 3-color mode
+		if (opaqueMask) encodeColor(c0, c1, indices, texels, opaqueMask, false, quality);
+		for (uint8_t i = 0; i < 16; ++i) if (!(opaqueMask & (1 << i))) indices[i] = 3;
+		writeColorBlock(pBlock, c0, c1, indices, false);
+	}
+
+	// Same palette as the decoder
+	void buildChannelPalette(int palette[8], int e0, int e1)
+	{
+		palette[0] = e0;
+		palette[1] = e1;
+		if (e0 > e1) for (auto i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+		else
+		{
+			for (auto i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	uint32_t encodeChannelCandidate(uint64_t& indices, const uint8_t values[16], int e0, int e1)
+	{
+		int palette[8];
+		buildChannelPalette(palette, e0, e1);
+
+		uint32_t error = 0;
+		indices = 0;
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			uint32_t best = 0, bestError = UINT32_MAX;
+			for (uint32_t j = 0; j < 8; ++j)
+			{
+				const auto d = palette[j] - values[i];
+				const auto e = static_cast<uint32_t>(d * d);
+				if (e < bestError)
+				{
+					bestError = e;
+					best = j;
+				}
+			}
+			error += bestError;
+			indices |= static_cast<uint64_t>(best) << (3 * i);
+		}
+
+		return error;
+	}
+
+	// BC4 block of one channel; returns the squared error
+	uint32_t encodeChannel(uint8_t* pBlock, const uint8_t values[16], Quality quality)
+	{
+		int lo = 255, hi = 0, innerLo = 255, innerHi = 0;
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			lo = (min)(lo, static_cast<int>(values[i]));
+			hi = (max)(hi, static_cast<int>(values[i]));
+			if (values[i] > 0 && values[i] < 255)
+			{
+				innerLo = (min)(innerLo, static_cast<int>(values[i]));
+				innerHi = (max)(innerHi, static_cast<int>(values[i]));
+			}
+		}
+
+		// 8-value mode over the full range, and 6-value mode when the extremes are exactly 0 or 255
+		pair<int, int> candidates[8];
+		uint8_t numCandidates = 0;
+		candidates[numCandidates++] = make_pair(hi, lo);
+		if (quality != Quality::FAST && innerLo <= innerHi && (lo == 0 || hi == 255))
+			candidates[numCandidates++] = make_pair(innerLo, innerHi);
+		if (quality == Quality::HIGH && hi - lo > 8)
+		{
+			for (auto inset = 1; inset <= 2; ++inset)
+			{
+				candidates[numCandidates++] = make_pair(hi - inset, lo);
+				candidates[numCandidates++] = make_pair(hi, lo + inset);
+				candidates[numCandidates++] = make_pair(hi - inset, lo + inset);
+			}
+		}
+
+		auto bestError = UINT32_MAX;
+		for (uint8_t i = 0; i < numCandidates; ++i)
+		{
+			uint64_t indices;
+			const auto error = encodeChannelCandidate(indices, values, candidates[i].first, candidates[i].second);
+			if (error < bestError)
+			{
+				bestError = error;
+				pBlock[0] = static_cast<uint8_t>(candidates[i].first);
+				pBlock[1] = static_cast<uint8_t>(candidates[i].second);
+				memcpy(&pBlock[2], &indices, 6);
+			}
+		}
+
+		return bestError;
+	}
+
+	void encodeChannel(uint8_t* pBlock, const uint32_t texels[16], uint8_t channel, Quality quality)
+	{
+		uint8_t values[16];
+		for (uint8_t i = 0; i < 16; ++i) values[i] = getChannel(texels[i], channel);
+		encodeChannel(pBlock, values, quality);
+	}
+
+	//--------------------------------------------------------------------------------------
+	// BC7
+	//--------------------------------------------------------------------------------------
+
+	enum PBitType : uint8_t
+	{
+		PBIT_NONE,
+		PBIT_ENDPOINT,
+		PBIT_SHARED
+	};
+
+	struct BC7Mode
+	{
+		uint8_t NumSubsets;
+		uint8_t PartitionBits;
+		uint8_t ColorBits;
+		uint8_t AlphaBits;
+		uint8_t PBits;
+		uint8_t IndexBits;
+	};
+
+	// Modes with a single index set; modes 4 and 5 keep separate alpha indices.
+	const BC7Mode g_bc7Modes[] =
+	{
+		{ 3, 4, 4, 0, PBIT_ENDPOINT, 3 },
+		{ 2, 6, 6, 0, PBIT_SHARED, 3 },
+		{ 3, 6, 5, 0, PBIT_NONE, 2 },
+		{ 2, 6, 7, 0, PBIT_ENDPOINT, 2 },
+		{ 1, 0, 5, 6, PBIT_NONE, 2 },
+		{ 1, 0, 7, 8, PBIT_NONE, 2 },
+		{ 1, 0, 7, 7, PBIT_ENDPOINT, 4 },
+		{ 2, 6, 5, 5, PBIT_ENDPOINT, 2 }
+	};
+
+	// Expands a quantized value with its p-bit to 8 bits, as the decoder does
+	inline uint8_t expandBC7(uint32_t q, uint32_t p, uint32_t numBits, bool hasPBit)
+	{
+		auto v = q, n = numBits;
+		if (hasPBit)
+		{
+			v = (v << 1) | p;
+			++n;
+		}
+		v <<= 8 - n;
+
+		return static_cast<uint8_t>(v | (v >> n));
+	}
+
+	inline uint32_t quantizeBC7(float v, uint32_t p, uint32_t numBits, bool hasPBit, uint32_t& error)
+	{
+		const auto maxQ = static_cast<int>((1u << numBits) - 1);
+		const auto n = numBits + (hasPBit ? 1 : 0);
+		auto estimate = v / 255.0f * ((1u << n) - 1);
+		if (hasPBit) estimate = (estimate - p) / 2.0f;
+
+		const auto q0 = static_cast<int>(estimate + 0.5f);
+		auto best = 0;
+		error = UINT32_MAX;
+		for (auto q = (max)(q0 - 1, 0); q <= (min)(q0 + 1, maxQ); ++q)
+		{
+			const auto d = static_cast<int>(expandBC7(q, p, numBits, hasPBit)) - static_cast<int>(v + 0.5f);
+			if (static_cast<uint32_t>(d * d) < error)
+			{
+				error = static_cast<uint32_t>(d * d);
+				best = q;
+			}
+		}
+
+		return static_cast<uint32_t>(best);
+	}
+
+	// Quantizes an endpoint pair, choosing the p-bits of the least error
+	void quantizeEndpoints(uint8_t q[2][4], uint8_t p[2], uint32_t colors[2], const float e0[4],
+		const float e1[4], const BC7Mode& mode)
+	{
+		const auto hasPBit = mode.PBits != PBIT_NONE;
+		const auto numPBits = hasPBit ? 2u : 1u;
+		const float* endpoints[] = { e0, e1 };
+
+		uint32_t errors[2][2];
+		uint8_t quantized[2][2][4];
+		for (uint8_t e = 0; e < 2; ++e)
+		{
+			for (auto pBit = 0u; pBit < numPBits; ++pBit)
+			{
+				errors[e][pBit] = 0;
+				for (uint8_t c = 0; c < 4; ++c)
+				{
+					const auto numBits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+					uint32_t error = 0;
+					quantized[e][pBit][c] = numBits ? static_cast<uint8_t>(quantizeBC7(endpoints[e][c], pBit,
+						numBits, hasPBit, error)) : 0;
+					errors[e][pBit] += error;
+				}
+			}
+		}
+
+		if (mode.PBits == PBIT_SHARED)
+			p[0] = p[1] = errors[0][1] + errors[1][1] < errors[0][0] + errors[1][0] ? 1 : 0;
+		else for (uint8_t e = 0; e < 2; ++e) p[e] = hasPBit && errors[e][1] < errors[e][0] ? 1 : 0;
+
+		for (uint8_t e = 0; e < 2; ++e)
+		{
+			memcpy(q[e], quantized[e][p[e]], sizeof(q[e]));
+
+			uint8_t rgba[4];
+			for (uint8_t c = 0; c < 4; ++c)
+			{
+				const auto numBits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+				rgba[c] = numBits ? expandBC7(q[e][c], p[e], numBits, hasPBit) : 255;
+			}
+			memcpy(&colors[e], rgba, sizeof(uint32_t));
+		}
+	}
+
+	// Same interpolation as the decoder
+	void interpolatePalette(uint32_t* pPalette, uint32_t c0, uint32_t c1, const uint8_t* pWeights, uint8_t numEntries)
+	{
+		for (uint8_t i = 0; i < numEntries; ++i)
+		{
+			const auto w = static_cast<uint32_t>(pWeights[i]);
+			pPalette[i] = 0;
+			for (uint8_t c = 0; c < 4; ++c)
+			{
+				const auto v = (getChannel(c0, c) * (64 - w) + getChannel(c1, c) * w + 32) >> 6;
+				pPalette[i] |= v << (8 * c);
+			}
+		}
+	}
+
+	// Encodes the modes of a single index set; returns the squared error.
+	uint32_t encodeBC7Mode(uint8_t* pBlock, const uint32_t texels[16], uint8_t m, uint8_t partition, Quality quality)
+	{
+		const auto& mode = g_bc7Modes[m];
+		const auto pWeights = TextureDecoder::GetWeights(mode.IndexBits);
+		const uint8_t numEntries = 1 << mode.IndexBits;
+		const uint8_t numChannels = mode.AlphaBits ? 4 : 3;
+		const auto numIterations = quality == Quality::HIGH ? 3 : 1;
+
+		uint16_t masks[3] = {};
+		for (uint8_t i = 0; i < 16; ++i) masks[TextureDecoder::GetSubset(mode.NumSubsets, partition, i)] |= 1 << i;
+
+		uint8_t q[3][2][4], p[3][2], indices[16];
+		uint32_t totalError = 0;
+		for (uint8_t s = 0; s < mode.NumSubsets; ++s)
+		{
+			float e0[4], e1[4];
+			fitEndpoints(e0, e1, texels, masks[s], numChannels, quality);
+
+			auto bestError = UINT32_MAX;
+			for (auto n = 0; n < numIterations; ++n)
+			{
+				uint8_t qs[2][4], ps[2], candidates[16];
+				uint32_t colors[2], palette[16], errors[16];
+				quantizeEndpoints(qs, ps, colors, e0, e1, mode);
+				interpolatePalette(palette, colors[0], colors[1], pWeights, numEntries);
+				selectIndices(candidates, errors, texels, palette, numEntries, 0xffffffff);
+
+				const auto error = sumErrors(errors, masks[s]);
+				if (error < bestError)
+				{
+					bestError = error;
+					memcpy(q[s], qs, sizeof(qs));
+					memcpy(p[s], ps, sizeof(ps));
+					for (uint8_t i = 0; i < 16; ++i) if (masks[s] & (1 << i)) indices[i] = candidates[i];
+				}
+
+				if (!error || !refineEndpoints(e0, e1, texels, masks[s], candidates, pWeights, numChannels)) break;
+			}
+			totalError += bestError;
+		}
+
+		// The most significant index bit of each anchor texel is implicitly zero; the weights are
+		// symmetric, so swapping the endpoints and inverting the indices gives the same texels.
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			if (!TextureDecoder::IsAnchor(mode.NumSubsets, partition, i) || indices[i] < numEntries / 2) continue;
+
+			const auto s = TextureDecoder::GetSubset(mode.NumSubsets, partition, i);
+			swap(q[s][0], q[s][1]);
+			swap(p[s][0], p[s][1]);
+			for (uint8_t j = 0; j < 16; ++j) if (masks[s] & (1 << j)) indices[j] = numEntries - 1 - indices[j];
+		}
+
+		BitWriter bits;
+		bits.Write(1 << m, m + 1);
+		bits.Write(partition, mode.PartitionBits);
+		for (uint8_t c = 0; c < 4; ++c)
+		{
+			const auto numBits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+			for (uint8_t s = 0; s < mode.NumSubsets; ++s)
+				for (uint8_t e = 0; e < 2; ++e) bits.Write(q[s][e][c], numBits);
+		}
+
+		if (mode.PBits == PBIT_ENDPOINT)
+			for (uint8_t s = 0; s < mode.NumSubsets; ++s)
+				for (uint8_t e = 0; e < 2; ++e) bits.Write(p[s][e], 1);
+		else if (mode.PBits == PBIT_SHARED)
+			for (uint8_t s = 0; s < mode.NumSubsets; ++s) bits.Write(p[s][0], 1);
+
+		for (uint8_t i = 0; i < 16; ++i)
+			bits.Write(indices[i], mode.IndexBits - (TextureDecoder::IsAnchor(mode.NumSubsets, partition, i) ? 1 : 0));
+		bits.Store(pBlock);
+
+		return totalError;
+	}
+
+	// Mode 5 without rotation: RGB and alpha with separate 2-bit indices
+	uint32_t encodeBC7Mode5(uint8_t* pBlock, const uint32_t texels[16], Quality quality)
+	{
+		const auto& mode = g_bc7Modes[5];
+		const auto pWeights = TextureDecoder::GetWeights(2);
+		const auto numIterations = quality == Quality::HIGH ? 3 : 1;
+
+		float e0[4], e1[4];
+		fitEndpoints(e0, e1, texels, 0xffff, 3, quality);
+
+		uint8_t q[2][3] = {}, colorIndices[16];
+		auto colorError = UINT32_MAX;
+		for (auto n = 0; n < numIterations; ++n)
+		{
+			uint32_t colors[2] = {}, error;
+			uint8_t qs[2][3];
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				qs[0][c] = static_cast<uint8_t>(quantizeBC7(e0[c], 0, mode.ColorBits, false, error));
+				qs[1][c] = static_cast<uint8_t>(quantizeBC7(e1[c], 0, mode.ColorBits, false, error));
+				colors[0] |= expandBC7(qs[0][c], 0, mode.ColorBits, false) << (8 * c);
+				colors[1] |= expandBC7(qs[1][c], 0, mode.ColorBits, false) << (8 * c);
+			}
+
+			uint32_t palette[4], errors[16];
+			uint8_t candidates[16];
+			interpolatePalette(palette, colors[0], colors[1], pWeights, 4);
+			selectIndices(candidates, errors, texels, palette, 4, 0x00ffffff);
+
+			error = sumErrors(errors, 0xffff);
+			if (error < colorError)
+			{
+				colorError = error;
+				memcpy(q, qs, sizeof(qs));
+				memcpy(colorIndices, candidates, sizeof(candidates));
+			}
+
+			if (!error || !refineEndpoints(e0, e1, texels, 0xffff, candidates, pWeights, 3)) break;
+		}
+
+		// Alpha endpoints are stored at full precision.
+		uint8_t a[2] = { 255, 0 }, alphaIndices[16];
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			a[0] = (min)(a[0], getChannel(texels[i], 3));
+			a[1] = (max)(a[1], getChannel(texels[i], 3));
+		}
+
+		uint32_t alphaPalette[4], alphaError = 0;
+		interpolatePalette(alphaPalette, static_cast<uint32_t>(a[0]) << 24, static_cast<uint32_t>(a[1]) << 24, pWeights, 4);
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			const auto alpha = static_cast<int>(getChannel(texels[i], 3));
+			auto bestError = INT32_MAX;
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				const auto d = static_cast<int>(getChannel(alphaPalette[j], 3)) - alpha;
+				if (d * d < bestError)
+				{
+					bestError = d * d;
+					alphaIndices[i] = j;
+				}
+			}
+			alphaError += bestError;
+		}
+
+		// Anchor texel 0 of each index set
+		if (colorIndices[0] >= 2)
+		{
+			swap(q[0], q[1]);
+			for (auto& index : colorIndices) index = 3 - index;
+		}
+
+		if (alphaIndices[0] >= 2)
+		{
+			swap(a[0], a[1]);
+			for (auto& index : alphaIndices) index = 3 - index;
+		}
+
+		BitWriter bits;
+		bits.Write(1 << 5, 6);
+		bits.Write(0, 2);
+		for (uint8_t c = 0; c < 3; ++c)
+			for (uint8_t e = 0; e < 2; ++e) bits.Write(q[e][c], mode.ColorBits);
+		for (uint8_t e = 0; e < 2; ++e) bits.Write(a[e], mode.AlphaBits);
+		for (uint8_t i = 0; i < 16; ++i) bits.Write(colorIndices[i], i ? 2 : 1);
+		for (uint8_t i = 0; i < 16; ++i) bits.Write(alphaIndices[i], i ? 2 : 1);
+		bits.Store(pBlock);
+
+		return colorError + alphaError;
+	}
+
+	// Ranks the partitions by the residual of their subsets about the bounding-box diagonals,
+	// and returns the best numCandidates of them.
+	uint8_t selectPartitions(uint8_t* pPartitions, uint8_t numCandidates, const uint32_t texels[16],
+		const BC7Mode& mode, uint8_t numChannels)
+	{
+		const auto numPartitions = 1u << mode.PartitionBits;
+		vector<pair<float, uint8_t>> ranks(numPartitions);
+		for (auto part = 0u; part < numPartitions; ++part)
+		{
+			auto residual = 0.0f;
+			for (uint8_t s = 0; s < mode.NumSubsets; ++s)
+			{
+				float lo[4] = { 255.0f, 255.0f, 255.0f, 255.0f }, hi[4] = {};
+				for (uint8_t i = 0; i < 16; ++i)
+				{
+					if (TextureDecoder::GetSubset(mode.NumSubsets, static_cast<uint8_t>(part), i) != s) continue;
+					for (uint8_t c = 0; c < numChannels; ++c)
+					{
+						lo[c] = (min)(lo[c], static_cast<float>(getChannel(texels[i], c)));
+						hi[c] = (max)(hi[c], static_cast<float>(getChannel(texels[i], c)));
+					}
+				}
+
+				float axis[4] = {}, lenSq = 0.0f;
+				for (uint8_t c = 0; c < numChannels; ++c)
+				{
+					axis[c] = hi[c] - lo[c];
+					lenSq += axis[c] * axis[c];
+				}
+
+				for (uint8_t i = 0; i < 16; ++i)
+				{
+					if (TextureDecoder::GetSubset(mode.NumSubsets, static_cast<uint8_t>(part), i) != s) continue;
+
+					float d[4], dSq = 0.0f, t = 0.0f;
+					for (uint8_t c = 0; c < numChannels; ++c)
+					{
+						d[c] = getChannel(texels[i], c) - lo[c];
+						dSq += d[c] * d[c];
+						t += d[c] * axis[c];
+					}
+					residual += lenSq > 0.0f ? dSq - t * t / lenSq : dSq;
+				}
+			}
+			ranks[part] = make_pair(residual, static_cast<uint8_t>(part));
+		}
+
+		numCandidates = static_cast<uint8_t>((min)(static_cast<uint32_t>(numCandidates), numPartitions));
+		partial_sort(ranks.begin(), ranks.begin() + numCandidates, ranks.end());
+		for (uint8_t i = 0; i < numCandidates; ++i) pPartitions[i] = ranks[i].second;
+
+		return numCandidates;
+	}
+
+	void encodeBC7(uint8_t* pBlock, const uint32_t texels[16], Quality quality)
+	{
+		auto isOpaque = true;
+		for (uint8_t i = 0; i < 16; ++i) isOpaque = isOpaque && getChannel(texels[i], 3) == 255;
+
+		auto bestError = encodeBC7Mode(pBlock, texels, 6, 0, quality);
+		if (quality == Quality::FAST || !bestError) return;
+
+		uint8_t block[16];
+		const auto tryMode = [&](uint32_t error)
+		{
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(pBlock, block, sizeof(block));
+			}
+		};
+
+		if (!isOpaque) tryMode(encodeBC7Mode5(block, texels, quality));
+
+		// Partitioned modes; those without alpha only for opaque blocks
+		static const uint8_t normalModes[] = { 1 };
+		static const uint8_t highModes[] = { 1, 3, 0, 2 };
+		static const uint8_t highAlphaModes[] = { 7 };
+		const uint8_t* pModes = nullptr;
+		uint8_t numModes = 0;
+		if (quality == Quality::HIGH)
+		{
+			pModes = isOpaque ? highModes : highAlphaModes;
+			numModes = static_cast<uint8_t>(isOpaque ? sizeof(highModes) : sizeof(highAlphaModes));
+		}
+		else if (isOpaque)
+		{
+			pModes = normalModes;
+			numModes = static_cast<uint8_t>(sizeof(normalModes));
+		}
+
+		for (uint8_t i = 0; i < numModes && bestError; ++i)
+		{
+			const auto m = pModes[i];
+			const auto& mode = g_bc7Modes[m];
+			uint8_t partitions[4];
+			const uint8_t numCandidates = quality == Quality::HIGH ? (mode.NumSubsets > 2 ? 2 : 4) : 1;
+			const auto n = selectPartitions(partitions, numCandidates, texels, mode, mode.AlphaBits ? 4 : 3);
+			for (uint8_t j = 0; j < n && bestError; ++j) tryMode(encodeBC7Mode(block, texels, m, partitions[j], quality));
+		}
+	}
+
+	uint32_t getBlockSize(Format format)
+	{
+		switch (format)
+		{
+		case Format::BC1_UNORM:
+		case Format::BC1_UNORM_SRGB:
+		case Format::BC4_UNORM:
+			return 8;
+		case Format::BC3_UNORM:
+		case Format::BC3_UNORM_SRGB:
+		case Format::BC5_UNORM:
+		case Format::BC7_UNORM:
+		case Format::BC7_UNORM_SRGB:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// Channels compared for the PSNR
+	uint32_t getChannelMask(Format format)
+	{
+		switch (format)
+		{
+		case Format::BC4_UNORM: return 0x000000ff;
+		case Format::BC5_UNORM: return 0x0000ffff;
+		default: return 0xffffffff;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Texture encoder
+//--------------------------------------------------------------------------------------
+
+double TextureEncoder::Stats::GetPSNR() const
+{
+	const auto mse = NumSamples > 0 ? SquaredError / NumSamples : 0.0;
+
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+bool TextureEncoder::Encode(vector<uint8_t>& ddsFile, const DDS::TextureInfo& info, const uint8_t* pData,
+	size_t dataSize, Format format, Quality quality, const wchar_t* fileName, Stats* pStats, uint32_t numThreads)
+{
+	XUSG_N_RETURN(IsEncodable(info.Format), false);
+
+	const auto start = chrono::high_resolution_clock::now();
+	vector<TextureDecoder::Image> images;
+	XUSG_N_RETURN(TextureDecoder::Decode(images, info, pData, dataSize, numThreads), false);
+
+	if (format == Format::UNKNOWN)
+	{
+		// Normal maps are opaque XYZ; an unused alpha must not punch through BC1.
+		const auto isNormalMap = IsNormalMap(fileName);
+		auto hasAlpha = false;
+		for (auto& image : images)
+		{
+			for (size_t i = 3; i < image.Pixels.size(); i += 4)
+			{
+				if (isNormalMap) image.Pixels[i] = 255;
+				else if ((hasAlpha = image.Pixels[i] < 255)) break;
+			}
+		}
+		format = SelectFormat(fileName, info.Format, hasAlpha, quality);
+	}
+	const auto blockSize = getBlockSize(format);
+	XUSG_N_RETURN(blockSize > 0, false);
+
+	auto encodedInfo = info;
+	encodedInfo.Format = format;
+	DDS::Parser::WriteHeader(ddsFile, encodedInfo);
+
+	vector<DDS::SubresourceLayout> layouts;
+	XUSG_N_RETURN(DDS::Parser::GetSubresourceLayouts(layouts, encodedInfo), false);
+	ddsFile.resize(static_cast<size_t>(layouts.back().Offset + layouts.back().SlicePitch * layouts.back().Depth));
+
+	// Work items are bands of block rows, as in the decoder.
+	struct WorkItem
+	{
+		uint32_t Subresource;
+		uint32_t Slice;
+		uint32_t FirstRow;
+		uint32_t NumRows;
+	};
+
+	const auto rowsPerItem = quality == Quality::HIGH ? 4u : 16u;
+	const auto numSubresources = static_cast<uint32_t>(layouts.size());
+	vector<WorkItem> items;
+	for (auto i = 0u; i < numSubresources; ++i)
+		for (auto z = 0u; z < layouts[i].Depth; ++z)
+			for (auto row = 0u; row < layouts[i].NumRows; row += rowsPerItem)
+				items.push_back({ i, z, row, (min)(rowsPerItem, layouts[i].NumRows - row) });
+
+	atomic<uint32_t> nextItem(0);
+	const auto process = [&]()
+	{
+		for (auto n = nextItem++; n < items.size(); n = nextItem++)
+		{
+			const auto& item = items[n];
+			const auto& layout = layouts[item.Subresource];
+			const auto& image = images[item.Subresource];
+			const auto pSrc = &image.Pixels[static_cast<size_t>(image.RowPitch) * layout.Height * item.Slice];
+			const auto pDst = &ddsFile[static_cast<size_t>(layout.Offset + layout.SlicePitch * item.Slice)];
+			EncodeSurface(pDst, layout.RowPitch, pSrc, image.RowPitch, layout.Width, layout.Height,
+				format, quality, item.FirstRow, item.NumRows);
+		}
+	};
+
+	if (!numThreads) numThreads = (max)(thread::hardware_concurrency(), 1u);
+	numThreads = (min)(numThreads, static_cast<uint32_t>(items.size()));
+
+	vector<thread> workers;
+	for (auto i = 1u; i < numThreads; ++i) workers.emplace_back(process);
+	process();
+	for (auto& worker : workers) worker.join();
+
+	const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	if (pStats)
+	{
+		// Compare the decoded result against the source.
+		vector<TextureDecoder::Image> decodedImages;
+		XUSG_N_RETURN(TextureDecoder::Decode(decodedImages, encodedInfo, ddsFile.data(), ddsFile.size(), numThreads), false);
+
+		const auto channelMask = getChannelMask(format);
+		for (auto i = 0u; i < numSubresources; ++i)
+		{
+			const auto& src = images[i].Pixels;
+			const auto& dst = decodedImages[i].Pixels;
+			for (size_t j = 0; j < src.size(); ++j)
+			{
+				if (!(channelMask & (0xff << (8 * (j & 3))))) continue;
+
+				const double d = static_cast<int>(src[j]) - static_cast<int>(dst[j]);
+				pStats->SquaredError += d * d;
+				++pStats->NumSamples;
+			}
+			pStats->NumPixels += static_cast<uint64_t>(layouts[i].Width) * layouts[i].Height * layouts[i].Depth;
+		}
+
+		pStats->SourceBytes += dataSize - info.DataOffset;
+		pStats->EncodedBytes += ddsFile.size() - encodedInfo.DataOffset;
+		pStats->EncodeSeconds += seconds;
+	}
+
+	return true;
+}
+
+bool TextureEncoder::EncodeFile(const wchar_t* dstFileName, const wchar_t* srcFileName, Format format,
+	Quality quality, Stats* pStats, uint32_t numThreads)
+{
+	vector<uint8_t> data;
+	XUSG_N_RETURN(DDS::Parser::LoadFile(data, srcFileName), false);
+
+	DDS::TextureInfo info;
+	XUSG_N_RETURN(DDS::Parser::ParseHeader(info, data.data(), data.size()), false);
+
+	vector<uint8_t> ddsFile;
+	XUSG_N_RETURN(Encode(ddsFile, info, data.data(), data.size(), format, quality,
+		srcFileName, pStats, numThreads), false);
+
+	return DDS::Parser::SaveFile(dstFileName, ddsFile);
+}
+
+uint32_t TextureEncoder::ProcessDirectory(const wchar_t* srcDirectory, const wchar_t* dstDirectory,
+	Quality quality, Stats* pStats, uint32_t numThreads)
+{
+	const wstring srcPath = srcDirectory;
+	const wstring dstPath = dstDirectory;
+	WIN32_FIND_DATAW findData;
+	const auto hFind = FindFirstFileW((srcPath + L"/*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE) return 0;
+
+	auto numFiles = 0u;
+	do
+	{
+		const wstring name = findData.cFileName;
+		if (name == L"." || name == L"..") continue;
+
+		const auto srcFileName = srcPath + L"/" + name;
+		const auto dstFileName = dstPath + L"/" + name;
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			numFiles += ProcessDirectory(srcFileName.c_str(), dstFileName.c_str(), quality, pStats, numThreads);
+			continue;
+		}
+
+		auto extension = name.size() > 4 ? name.substr(name.size() - 4) : wstring();
+		transform(extension.begin(), extension.end(), extension.begin(), [](wchar_t c) { return towlower(c); });
+		if (extension != L".dds") continue;
+
+		// Compressed textures are left as they are.
+		DDS::TextureInfo info;
+		if (!DDS::Parser::LoadHeader(info, srcFileName.c_str()) || !IsEncodable(info.Format)) continue;
+
+		// Keep the copy unless the source has changed since.
+		struct _stat64 srcStat, dstStat;
+		if (_wstat64(srcFileName.c_str(), &srcStat) == 0 && _wstat64(dstFileName.c_str(), &dstStat) == 0 &&
+			dstStat.st_mtime >= srcStat.st_mtime)
+			continue;
+
+		CreateDirectoryW(dstPath.c_str(), nullptr);
+		if (EncodeFile(dstFileName.c_str(), srcFileName.c_str(), Format::UNKNOWN, quality, pStats, numThreads))
+			++numFiles;
+	} while (FindNextFileW(hFind, &findData));
+	FindClose(hFind);
+
+	return numFiles;
+}
+
+bool TextureEncoder::EncodeSurface(uint8_t* pDst, uint32_t dstRowPitch, const uint8_t* pSrc, uint32_t srcRowPitch,
+	uint32_t width, uint32_t height, Format format, Quality quality, uint32_t firstRow, uint32_t numRows)
+{
+	const auto blockSize = getBlockSize(format);
+	XUSG_N_RETURN(blockSize > 0, false);
+
+	const auto numBlocksX = XUSG_DIV_UP(width, 4u);
+	const auto endRow = (min)(XUSG_DIV_UP(height, 4u), numRows == UINT32_MAX ? UINT32_MAX : firstRow + numRows);
+	for (auto by = firstRow; by < endRow; ++by)
+	{
+		for (auto bx = 0u; bx < numBlocksX; ++bx)
+		{
+			// Blocks over the edge of the surface repeat the edge texels.
+			uint8_t texels[16 * 4];
+			for (auto y = 0u; y < 4; ++y)
+			{
+				const auto sy = (min)(4 * by + y, height - 1);
+				for (auto x = 0u; x < 4; ++x)
+				{
+					const auto sx = (min)(4 * bx + x, width - 1);
+					memcpy(&texels[4 * (4 * y + x)], &pSrc[static_cast<size_t>(srcRowPitch) * sy + 4 * sx], 4);
+				}
+			}
+
+			EncodeBlock(&pDst[static_cast<size_t>(dstRowPitch) * by + blockSize * bx], texels, format, quality);
+		}
+	}
+
+	return true;
+}
+
+bool TextureEncoder::EncodeBlock(uint8_t* pBlock, const uint8_t* pTexels, Format format, Quality quality)
+{
+	uint32_t texels[16];
+	memcpy(texels, pTexels, sizeof(texels));
+
+	switch (format)
+	{
+	case Format::BC1_UNORM:
+	case Format::BC1_UNORM_SRGB:
+		encodeBC1(pBlock, texels, quality);
+		break;
+	case Format::BC3_UNORM:
+	case Format::BC3_UNORM_SRGB:
+	{
+		uint16_t c0, c1;
+		uint8_t indices[16];
+		encodeChannel(pBlock, texels, 3, quality);
+		encodeColor(c0, c1, indices, texels, 0xffff, true, quality);
+		writeColorBlock(&pBlock[8], c0, c1, indices, true);
+		break;
+	}
+	case Format::BC4_UNORM:
+		encodeChannel(pBlock, texels, 0, quality);
+		break;
+	case Format::BC5_UNORM:
+		encodeChannel(pBlock, texels, 0, quality);
+		encodeChannel(&pBlock[8], texels, 1, quality);
+		break;
+	case Format::BC7_UNORM:
+	case Format::BC7_UNORM_SRGB:
+		encodeBC7(pBlock, texels, quality);
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+Format TextureEncoder::SelectFormat(const wchar_t* fileName, Format srcFormat, bool hasAlpha, Quality quality)
+{
+	// The shaders reconstruct no Z, so normal maps keep 3 linear channels as the shipped ones do.
+	if (IsNormalMap(fileName)) return quality == Quality::HIGH ? Format::BC7_UNORM : Format::BC1_UNORM;
+
+	const auto format = quality == Quality::HIGH ? Format::BC7_UNORM : (hasAlpha ? Format::BC3_UNORM : Format::BC1_UNORM);
+	const auto isSRGB = srcFormat == Format::R8G8B8A8_UNORM_SRGB || srcFormat == Format::B8G8R8A8_UNORM_SRGB ||
+		srcFormat == Format::B8G8R8X8_UNORM_SRGB;
+
+	return isSRGB ? DDS::Parser::MakeSRGB(format) : format;
+}
+
+bool TextureEncoder::IsNormalMap(const wchar_t* fileName)
+{
+	const wstring name = fileName ? fileName : L"";
+	const auto dot = name.find_last_of(L'.');
+
+	return dot != wstring::npos && dot > 0 && name[dot - 1] == L'N';
+}
+
+bool TextureEncoder::IsEncodable(Format srcFormat)
+{
+	return !DDS::Parser::IsBlockCompressed(srcFormat) &&
+		TextureDecoder::GetDecodedFormat(srcFormat) == Format::R8G8B8A8_UNORM;
+}
+
+bool TextureEncoder::Benchmark(Stats& stats, Format format, Quality quality, uint32_t width,
+	uint32_t height, uint32_t numThreads)
+{
+	DDS::TextureInfo info = {};
+	info.Format = Format::R8G8B8A8_UNORM;
+	info.Dimension = DDS::Dimension::TEXTURE2D;
+	info.Width = width;
+	info.Height = height;
+	info.Depth = 1;
+	info.ArraySize = 1;
+	info.MipLevels = 1;
+
+	// Gradients with noise and hard edges, standing in for photographic content
+	vector<uint8_t> data;
+	DDS::Parser::WriteHeader(data, info);
+	data.resize(static_cast<size_t>(info.DataOffset) + 4ull * width * height);
+
+	// BC1 is meant for opaque textures, as its alpha is punch-through only.
+	const auto isOpaque = format == Format::BC1_UNORM || format == Format::BC1_UNORM_SRGB;
+	mt19937 rng(0x5eed);
+	const auto pTexels = &data[static_cast<size_t>(info.DataOffset)];
+	for (auto y = 0u; y < height; ++y)
+	{
+		for (auto x = 0u; x < width; ++x)
+		{
+			const auto noise = static_cast<int>(rng() % 17) - 8;
+			const auto edge = ((x / 37) + (y / 53)) % 3 == 0 ? 96 : 0;
+			const int rgba[] =
+			{
+				static_cast<int>(255 * x / width) + noise,
+				static_cast<int>(255 * y / height) - noise + edge,
+				static_cast<int>(128 + 127 * sinf(0.05f * (x + y))) + noise / 2,
+				isOpaque ? 255 : static_cast<int>(255 * (x + y) / (width + height)) | 0x0f
+			};
+			for (uint8_t c = 0; c < 4; ++c)
+				pTexels[4 * (static_cast<size_t>(width) * y + x) + c] = static_cast<uint8_t>((min)((max)(rgba[c], 0), 255));
+		}
+	}
+
+	stats = {};
+	vector<uint8_t> ddsFile;
+
+	return Encode(ddsFile, info, data.data(), data.size(), format, quality, nullptr, &stats, numThreads);
+}
@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Offline BC1/BC3/BC5/BC7 encoder for uncompressed 8-bit DDS textures, so that the
+	// loader receives compressed mips. Blocks are encoded in parallel, with SSE2 index
+	// selection; the presets trade encode time for quality.
+	//--------------------------------------------------------------------------------------
+	class TextureEncoder
+	{
+	public:
+		enum class Quality : uint8_t
+		{
+			FAST,		// Bounding-box endpoints; BC7 mode 6 only
+			NORMAL,		// Principal-axis endpoints; BC7 modes 1, 5 and 6
+			HIGH		// Least-squares refinement; BC7 partition search over modes 0-3 and 5-7
+		};
+
+		struct Stats
+		{
+			uint64_t	NumPixels;
+			uint64_t	SourceBytes;
+			uint64_t	EncodedBytes;
+			double		EncodeSeconds;
+			double		SquaredError;	// Over the encoded channels of all mips
+			uint64_t	NumSamples;
+
+			double GetPSNR() const;
+			double GetMPixelsPerSecond() const { return EncodeSeconds > 0.0 ? NumPixels / (EncodeSeconds * 1.0e6) : 0.0; }
+		};
+
+		// Builds a complete DDS file; a format of UNKNOWN selects one with SelectFormat.
+		static bool Encode(std::vector<uint8_t>& ddsFile, const DDS::TextureInfo& info, const uint8_t* pData,
+			size_t dataSize, Format format, Quality quality, const wchar_t* fileName = nullptr,
+			Stats* pStats = nullptr, uint32_t numThreads = 0);
+		static bool EncodeFile(const wchar_t* dstFileName, const wchar_t* srcFileName, Format format,
+			Quality quality, Stats* pStats = nullptr, uint32_t numThreads = 0);
+
+		// Asset-processing step: writes compressed copies of the uncompressed DDS files under
+		// srcDirectory to the same relative paths under dstDirectory, and returns how many were
+		// compressed. Sources are never modified, and copies newer than their sources are kept.
+		// pStats accumulates over the files.
+		static uint32_t ProcessDirectory(const wchar_t* srcDirectory, const wchar_t* dstDirectory,
+			Quality quality, Stats* pStats = nullptr, uint32_t numThreads = 0);
+
+		// Encodes block rows [firstRow, firstRow + numRows) of an R8G8B8A8 surface
+		static bool EncodeSurface(uint8_t* pDst, uint32_t dstRowPitch, const uint8_t* pSrc, uint32_t srcRowPitch,
+			uint32_t width, uint32_t height, Format format, Quality quality,
+			uint32_t firstRow = 0, uint32_t numRows = UINT32_MAX);
+
+		// 16 R8G8B8A8 texels in row-major order
+		static bool EncodeBlock(uint8_t* pBlock, const uint8_t* pTexels, Format format, Quality quality);
+
+		// Normal maps (named *N.dds) go to linear BC1 with XYZ, as shipped, ignoring alpha; textures
+		// with alpha go to BC3, others to BC1, or all to BC7 at high quality. sRGB sources keep sRGB
+		// formats.
+		static Format SelectFormat(const wchar_t* fileName, Format srcFormat, bool hasAlpha, Quality quality);
+		static bool IsNormalMap(const wchar_t* fileName);
+		static bool IsEncodable(Format srcFormat);
+
+		// Encodes a synthetic surface and returns the PSNR and throughput in pStats
+		static bool Benchmark(Stats& stats, Format format, Quality quality, uint32_t width = 1024,
+			uint32_t height = 1024, uint32_t numThreads = 0);
+	};
+}
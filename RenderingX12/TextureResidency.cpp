@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TextureResidency.h"
+
+using namespace std;
+using namespace XUSG;
+
+TextureResidency::TextureResidency() :
+	m_textures(),
+	m_lru(),
+	m_evictedTextures(),
+	m_stats()
+{
+}
+
+TextureResidency::~TextureResidency()
+{
+}
+
+void TextureResidency::Init(uint64_t budgetBytes)
+{
+	m_textures.clear();
+	m_lru.clear();
+	m_evictedTextures.clear();
+	m_stats = {};
+	m_stats.BudgetBytes = budgetBytes;
+}
+
+void TextureResidency::SetBudget(uint64_t budgetBytes)
+{
+	m_stats.BudgetBytes = budgetBytes;
+}
+
+uint32_t TextureResidency::AddTexture(const DDS::TextureInfo& info, uint8_t residentMip, uint8_t floorMip,
+	uint16_t validMipMask)
+{
+	assert(info.MipLevels <= MAX_MIPS);
+	assert(residentMip <= floorMip && floorMip < info.MipLevels);
+
+	Entry entry = {};
+	entry.BytesFrom[info.MipLevels] = 0;
+	for (auto m = info.MipLevels; m > 0; --m)
+		entry.BytesFrom[m - 1] = entry.BytesFrom[m] + GetMipSize(info, static_cast<uint8_t>(m - 1));
+	entry.ValidMipMask = validMipMask | (1 << floorMip) | (1 << residentMip);
+	entry.ResidentMip = floorMip;
+	entry.FloorMip = floorMip;
+
+	const auto texture = GetNumTextures();
+	m_textures.push_back(entry);
+	m_stats.ResidentBytes += entry.BytesFrom[floorMip];
+	setResidentMip(texture, residentMip);
+
+	return texture;
+}
+
+void TextureResidency::Touch(uint32_t texture, uint64_t frame)
+{
+	auto& entry = m_textures[texture];
+	if (entry.LastUsedFrame == frame) return;
+
+	const auto isEvictable = m_lru.erase(LRUKey(entry.LastUsedFrame, texture)) > 0;
+	entry.LastUsedFrame = frame;
+	if (isEvictable) m_lru.emplace(frame, texture);
+}
+
+uint8_t TextureResidency::Request(uint32_t texture, uint8_t mip, uint64_t frame)
+{
+	Touch(texture, frame);
+
+	const auto& entry = m_textures[texture];
+	if (mip >= entry.ResidentMip) return entry.ResidentMip;
+
+	// Evict the other textures not used in this frame, least recently used first.
+	const auto bytes = entry.BytesFrom[mip] - entry.BytesFrom[entry.ResidentMip];
+	if (m_stats.ResidentBytes + bytes > m_stats.BudgetBytes)
+		evict(m_stats.ResidentBytes + bytes - m_stats.BudgetBytes, frame, false);
+
+	// Settle for the most detailed mip that fits.
+	auto grantedMip = mip;
+	while (grantedMip < entry.ResidentMip && m_stats.ResidentBytes + entry.BytesFrom[grantedMip] -
+		entry.BytesFrom[entry.ResidentMip] > m_stats.BudgetBytes)
+		while (++grantedMip < entry.ResidentMip && !(entry.ValidMipMask & (1 << grantedMip)));
+
+	if (grantedMip != mip) ++m_stats.NumDeniedRequests;
+	if (grantedMip < entry.ResidentMip) setResidentMip(texture, grantedMip);
+
+	return entry.ResidentMip;
+}
+
+void TextureResidency::Release(uint32_t texture, uint8_t mip)
+{
+	if (mip > m_textures[texture].ResidentMip) setResidentMip(texture, mip);
+}
+
+void TextureResidency::Update(uint64_t frame)
+{
+	m_evictedTextures.clear();
+
+	if (m_stats.ResidentBytes > m_stats.BudgetBytes)
+	{
+		++m_stats.NumOverBudgetFrames;
+		evict(m_stats.ResidentBytes - m_stats.BudgetBytes, frame, true);
+	}
+}
+
+uint64_t TextureResidency::GetResidentBytes(uint32_t texture) const
+{
+	const auto& entry = m_textures[texture];
+
+	return entry.BytesFrom[entry.ResidentMip];
+}
+
+uint64_t TextureResidency::GetMipSize(const DDS::TextureInfo& info, uint8_t mip)
+{
+	const uint64_t width = (max)(info.Width >> mip, 1u);
+	const uint64_t height = (max)(info.Height >> mip, 1u);
+	const uint64_t depth = (max)(info.Depth >> mip, 1u);
+	const auto bpp = DDS::Loader::BitsPerPixel(info.Format);
+
+	uint64_t sliceSize;
+	if (DDS::Parser::IsBlockCompressed(info.Format))
+		sliceSize = XUSG_DIV_UP(width, 4) * XUSG_DIV_UP(height, 4) * (16 * bpp / 8);
+	else sliceSize = XUSG_DIV_UP(width * bpp, 8) * height;
+
+	return sliceSize * depth * info.ArraySize;
+}
+
+bool TextureResidency::Check()
+{
+	static const uint8_t NUM_TEXTURES = 4;
+
+	// 64x64 RGBA8 textures of 7 mips, kept down to mip 2: 16 KB for mip 0, 4 KB for mip 1 and
+	// 1364 bytes below
+	DDS::TextureInfo info = {};
+	info.Format = Format::R8G8B8A8_UNORM;
+	info.Dimension = DDS::Dimension::TEXTURE2D;
+	info.Width = 64;
+	info.Height = 64;
+	info.Depth = 1;
+	info.ArraySize = 1;
+	info.MipLevels = 7;
+
+	TextureResidency residency;
+	residency.Init(64 << 10);
+	for (uint8_t i = 0; i < NUM_TEXTURES; ++i) XUSG_N_RETURN(residency.AddTexture(info, 2, 2) == i, false);
+	XUSG_N_RETURN(residency.GetStats().ResidentBytes == 1364 * NUM_TEXTURES, false);
+
+	// Per frame: the budget, the requests in the order of the feedback with the mips they are
+	// granted, the textures evicted by Update and the requests in order, and the resident mips
+	struct Request
+	{
+		uint32_t	Texture;
+		uint8_t		Mip;
+		uint8_t		GrantedMip;
+	};
+
+	struct Frame
+	{
+		uint64_t	BudgetBytes;
+		uint32_t	NumRequests;
+		Request		Requests[2];
+		uint32_t	NumEvicted;
+		uint32_t	Evicted[3];
+		uint8_t		ResidentMips[NUM_TEXTURES];
+	};
+
+	static const Frame frames[] =
+	{
+		// Room for everything
+		{ 64 << 10, 2, { { 0, 0, 0 }, { 1, 0, 0 } }, 0, {}, { 0, 0, 2, 2 } },
+		{ 64 << 10, 2, { { 1, 0, 0 }, { 2, 1, 1 } }, 0, {}, { 0, 0, 1, 2 } },
+		// The top mip of the least recently used texture makes room.
+		{ 64 << 10, 1, { { 3, 0, 0 } }, 1, { 0 }, { 1, 0, 1, 0 } },
+		// A lower budget evicts down to the floor of 0 before 1, then 3 makes room for 2.
+		{ 32 << 10, 1, { { 2, 0, 0 } }, 3, { 0, 1, 3 }, { 2, 2, 0, 1 } },
+		// Nothing fits: everything is evicted to its floor and requests are denied.
+		{ 0, 1, { { 0, 0, 2 } }, 2, { 3, 2 }, { 2, 2, 2, 2 } }
+	};
+
+	auto frame = 0ull;
+	for (const auto& f : frames)
+	{
+		residency.SetBudget(f.BudgetBytes);
+		residency.Update(++frame);
+		for (auto i = 0u; i < f.NumRequests; ++i)
+		{
+			const auto& request = f.Requests[i];
+			XUSG_N_RETURN(residency.Request(request.Texture, request.Mip, frame) == request.GrantedMip, false);
+		}
+
+		const auto& evicted = residency.GetEvictedTextures();
+		XUSG_N_RETURN(evicted.size() == f.NumEvicted && equal(evicted.cbegin(), evicted.cend(), f.Evicted), false);
+
+		uint64_t residentBytes = 0;
+		for (uint8_t i = 0; i < NUM_TEXTURES; ++i)
+		{
+			XUSG_N_RETURN(residency.GetResidentMip(i) == f.ResidentMips[i], false);
+			residentBytes += residency.GetResidentBytes(i);
+		}
+		XUSG_N_RETURN(residency.GetStats().ResidentBytes == residentBytes, false);
+	}
+
+	const auto& stats = residency.GetStats();
+	XUSG_N_RETURN(stats.PeakBytes == 54608 && stats.NumEvictedMips == 8 && stats.EvictedBytes == 81920 &&
+		stats.NumDeniedRequests == 1 && stats.NumOverBudgetFrames == 2, false);
+
+	return true;
+}
+
+uint64_t TextureResidency::evict(uint64_t bytes, uint64_t frame, bool evictCurrent)
+{
+	uint64_t freedBytes = 0;
+	while (freedBytes < bytes && !m_lru.empty())
+	{
+		// The set is ordered by the last-used frame, so the current frame only remains at the end.
+		const auto key = *m_lru.begin();
+		if (key.first >= frame && !evictCurrent) break;
+
+		const auto texture = key.second;
+		const auto& entry = m_textures[texture];
+		const auto mip = getNextEvictableMip(texture);
+		const auto mipBytes = entry.BytesFrom[entry.ResidentMip] - entry.BytesFrom[mip];
+		m_stats.NumEvictedMips += mip - entry.ResidentMip;
+		m_stats.EvictedBytes += mipBytes;
+		freedBytes += mipBytes;
+		setResidentMip(texture, mip);
+
+		if (find(m_evictedTextures.cbegin(), m_evictedTextures.cend(), texture) == m_evictedTextures.cend())
+			m_evictedTextures.push_back(texture);
+	}
+
+	return freedBytes;
+}
+
+void TextureResidency::setResidentMip(uint32_t texture, uint8_t mip)
+{
+	auto& entry = m_textures[texture];
+	m_stats.ResidentBytes = m_stats.ResidentBytes - entry.BytesFrom[entry.ResidentMip] + entry.BytesFrom[mip];
+	m_stats.PeakBytes = (max)(m_stats.PeakBytes, m_stats.ResidentBytes);
+
+	const LRUKey key(entry.LastUsedFrame, texture);
+	entry.ResidentMip = mip;
+	if (getNextEvictableMip(texture) != UINT8_MAX) m_lru.insert(key);
+	else m_lru.erase(key);
+}
+
+uint8_t TextureResidency::getNextEvictableMip(uint32_t texture) const
+{
+	const auto& entry = m_textures[texture];
+	for (auto m = entry.ResidentMip + 1; m <= entry.FloorMip; ++m)
+		if (entry.ValidMipMask & (1 << m)) return static_cast<uint8_t>(m);
+
+	return UINT8_MAX;
+}
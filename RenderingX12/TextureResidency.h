@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <set>
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Texture memory budget: tracks the resident mips of each texture and evicts the top
+	// mips of the least recently used textures first. Pure bookkeeping, no GPU objects.
+	//--------------------------------------------------------------------------------------
+	class TextureResidency
+	{
+	public:
+		struct Stats
+		{
+			uint64_t BudgetBytes;
+			uint64_t ResidentBytes;
+			uint64_t PeakBytes;
+			uint64_t EvictedBytes;
+			uint32_t NumEvictedMips;
+			uint32_t NumDeniedRequests;		// Requests granted at a coarser mip, or not at all
+			uint32_t NumOverBudgetFrames;
+		};
+
+		TextureResidency();
+		virtual ~TextureResidency();
+
+		void Init(uint64_t budgetBytes);
+		void SetBudget(uint64_t budgetBytes);
+
+		// floorMip is never evicted; validMipMask restricts the mips a texture may start at.
+		uint32_t AddTexture(const DDS::TextureInfo& info, uint8_t residentMip, uint8_t floorMip,
+			uint16_t validMipMask = 0xffff);
+
+		void Touch(uint32_t texture, uint64_t frame);
+
+		// Makes room for the texture from mip on, evicting textures not used in this frame;
+		// returns the resident mip granted, which may be coarser than asked.
+		uint8_t Request(uint32_t texture, uint8_t mip, uint64_t frame);
+
+		// Lowers the detail voluntarily
+		void Release(uint32_t texture, uint8_t mip);
+
+		// Enforces the budget, e.g. after it has been lowered; textures used in this frame go last.
+		void Update(uint64_t frame);
+
+		uint8_t GetResidentMip(uint32_t texture) const { return m_textures[texture].ResidentMip; }
+		uint64_t GetResidentBytes(uint32_t texture) const;
+		uint64_t GetLastUsedFrame(uint32_t texture) const { return m_textures[texture].LastUsedFrame; }
+		uint32_t GetNumTextures() const { return static_cast<uint32_t>(m_textures.size()); }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Textures evicted since the last Update
+		const std::vector<uint32_t>& GetEvictedTextures() const { return m_evictedTextures; }
+
+		// Exact size of one mip over all array slices
+		static uint64_t GetMipSize(const DDS::TextureInfo& info, uint8_t mip);
+
+		// Scripted frames of budget changes and mip requests over four textures: the mips
+		// granted, the textures evicted in order, the resident mips and the counters match.
+		static bool Check();
+
+		using uptr = std::unique_ptr<TextureResidency>;
+		using sptr = std::shared_ptr<TextureResidency>;
+
+	protected:
+		static const uint8_t MAX_MIPS = 16;
+
+		struct Entry
+		{
+			uint64_t	BytesFrom[MAX_MIPS + 1];	// Bytes of the mip chain from each mip on
+			uint64_t	LastUsedFrame;
+			uint16_t	ValidMipMask;
+			uint8_t		ResidentMip;
+			uint8_t		FloorMip;
+		};
+
+		using LRUKey = std::pair<uint64_t, uint32_t>;	// Last-used frame, texture
+
+		uint64_t evict(uint64_t bytes, uint64_t frame, bool evictCurrent);
+		void setResidentMip(uint32_t texture, uint8_t mip);
+		uint8_t getNextEvictableMip(uint32_t texture) const;
+
+		std::vector<Entry>		m_textures;
+		std::set<LRUKey>		m_lru;			// Textures that still have mips above their floor
+		std::vector<uint32_t>	m_evictedTextures;
+		Stats					m_stats;
+	};
+}
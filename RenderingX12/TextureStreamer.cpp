@@ -0,0 +1,505 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <random>
+#include "TextureStreamer.h"
+
+using namespace std;
+using namespace XUSG;
+
+//--------------------------------------------------------------------------------------
+// Staging ring
+//--------------------------------------------------------------------------------------
+
+StagingRing::StagingRing() :
+	m_retirements(),
+	m_size(0),
+	m_head(0),
+	m_tail(0)
+{
+}
+
+StagingRing::~StagingRing()
+{
+}
+
+void StagingRing::Init(uint64_t size)
+{
+	m_retirements.clear();
+	m_size = size;
+	m_head = 0;
+	m_tail = 0;
+}
+
+bool StagingRing::Allocate(uint64_t& offset, uint64_t size, uint64_t alignment)
+{
+	XUSG_N_RETURN(size <= m_size, false);
+
+	// An empty ring starts over, so that any request that fits succeeds.
+	if (m_head == m_tail) m_head = m_tail = 0;
+
+	auto start = XUSG_DIV_UP(m_head, alignment) * alignment;
+
+	// An allocation never straddles the end of the ring; the remainder is padding.
+	if (start % m_size + size > m_size) start = XUSG_DIV_UP(start, m_size) * m_size;
+	if (start + size - m_tail > m_size) return false;
+
+	offset = start % m_size;
+	m_head = start + size;
+
+	return true;
+}
+
+void StagingRing::Retire(uint64_t fenceValue)
+{
+	if (m_retirements.empty() ? m_head > m_tail : m_head > m_retirements.back().Head)
+		m_retirements.push_back({ fenceValue, m_head });
+}
+
+void StagingRing::Reclaim(uint64_t completedFenceValue)
+{
+	while (!m_retirements.empty() && m_retirements.front().FenceValue <= completedFenceValue)
+	{
+		m_tail = m_retirements.front().Head;
+		m_retirements.pop_front();
+	}
+}
+
+uint64_t StagingRing::GetOldestFenceValue() const
+{
+	return m_retirements.empty() ? 0 : m_retirements.front().FenceValue;
+}
+
+bool StagingRing::Check(uint32_t numAllocations, uint64_t size)
+{
+	StagingRing ring;
+	uint64_t offset;
+
+	// Wrapping: the remainder past the head is skipped, and the ring refuses what it cannot hold.
+	ring.Init(100);
+	XUSG_N_RETURN(ring.Allocate(offset, 40, 1) && offset == 0, false);
+	ring.Retire(1);
+	XUSG_N_RETURN(ring.Allocate(offset, 40, 1) && offset == 40, false);
+	ring.Retire(2);
+	ring.Reclaim(1);
+	XUSG_N_RETURN(ring.Allocate(offset, 30, 1) && offset == 0, false);
+	XUSG_N_RETURN(!ring.Allocate(offset, 20, 1) && ring.GetUsedSize() == 90, false);
+	ring.Retire(3);
+	ring.Reclaim(3);
+	XUSG_N_RETURN(ring.GetUsedSize() == 0 && ring.GetOldestFenceValue() == 0, false);
+
+	// Empty with the head at 60: a request of 70 must not wait for a reclaim that never comes.
+	ring.Init(100);
+	XUSG_N_RETURN(ring.Allocate(offset, 60, 1), false);
+	ring.Retire(1);
+	ring.Reclaim(1);
+	XUSG_N_RETURN(ring.Allocate(offset, 70, 1) && offset == 0, false);
+	XUSG_N_RETURN(!ring.Allocate(offset, 101, 1), false);
+
+	// Random traffic with two batches in flight
+	struct Live
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t FenceValue;
+	};
+
+	mt19937 rng(0x5eed);
+	uniform_int_distribution<uint64_t> sizes(1, size / 4);
+	uniform_int_distribution<uint32_t> alignmentBits(0, 9);
+	uniform_int_distribution<uint32_t> batchSizes(1, 16);
+
+	ring.Init(size);
+	deque<Live> lives;
+	uint64_t fenceValue = 1;
+	auto batchSize = batchSizes(rng);
+	for (auto i = 0u; i < numAllocations; ++i)
+	{
+		const auto allocSize = sizes(rng);
+		const auto alignment = 1ull << alignmentBits(rng);
+		const auto isAllocated = ring.Allocate(offset, allocSize, alignment);
+		if (isAllocated)
+		{
+			XUSG_N_RETURN(offset % alignment == 0 && offset + allocSize <= size, false);
+			for (const auto& live : lives)
+				XUSG_N_RETURN(offset + allocSize <= live.Offset || live.Offset + live.Size <= offset, false);
+			lives.push_back({ offset, allocSize, fenceValue });
+		}
+		else XUSG_N_RETURN(ring.GetUsedSize() > 0, false);
+
+		// A refused request ends the batch, as the streamer submits before waiting.
+		if (--batchSize == 0 || !isAllocated)
+		{
+			ring.Retire(fenceValue);
+			if (fenceValue > 2)
+			{
+				ring.Reclaim(fenceValue - 2);
+				while (!lives.empty() && lives.front().FenceValue <= fenceValue - 2) lives.pop_front();
+			}
+			++fenceValue;
+			batchSize = batchSizes(rng);
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Texture streamer
+//--------------------------------------------------------------------------------------
+
+TextureStreamer::TextureStreamer() :
+	m_pDevice(nullptr),
+	m_pStagingData(nullptr),
+	m_api(API::DIRECTX_12),
+	m_chunkSize(0),
+	m_allocatorFenceValues(),
+	m_fenceValue(0),
+	m_allocatorIndex(0),
+	m_numBatchCopies(0),
+	m_fenceEvent(nullptr),
+	m_numPending(0),
+	m_requestId(0),
+	m_completedRequestId(0),
+	m_lastSubmittedValue(0),
+	m_isRunning(false)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	Stop();
+}
+
+bool TextureStreamer::Init(const Device* pDevice, uint64_t stagingSize, uint64_t chunkSize, API api)
+{
+	XUSG_N_RETURN(!m_isRunning, false);
+	XUSG_N_RETURN(chunkSize > 0 && stagingSize >= 2 * chunkSize, false);
+
+	m_pDevice = pDevice;
+	m_api = api;
+	m_chunkSize = chunkSize;
+
+	m_copyQueue = CommandQueue::MakeUnique(api);
+	XUSG_N_RETURN(m_copyQueue->Create(pDevice, CommandListType::COPY, CommandQueueFlag::NONE,
+		0, 0, L"StreamingCopyQueue"), false);
+
+	for (uint8_t n = 0; n < NUM_ALLOCATORS; ++n)
+	{
+		m_commandAllocators[n] = CommandAllocator::MakeUnique(api);
+		XUSG_N_RETURN(m_commandAllocators[n]->Create(pDevice, CommandListType::COPY,
+			(L"StreamingCommandAllocator" + to_wstring(n)).c_str()), false);
+		m_allocatorFenceValues[n] = 0;
+	}
+
+	m_commandList = CommandList::MakeUnique(api);
+	XUSG_N_RETURN(m_commandList->Create(pDevice, 0, CommandListType::COPY,
+		m_commandAllocators[0].get(), nullptr, L"StreamingCommandList"), false);
+	m_allocatorIndex = 0;
+	m_numBatchCopies = 0;
+
+	m_fenceValue = 0;
+	m_fence = Fence::MakeUnique(api);
+	XUSG_N_RETURN(m_fence->Create(pDevice, m_fenceValue, FenceFlag::NONE, L"StreamingFence"), false);
+	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	XUSG_N_RETURN(m_fenceEvent, false);
+
+	// Persistently mapped; the worker is the only writer.
+	m_staging = Buffer::MakeUnique(api);
+	XUSG_N_RETURN(m_staging->Create(pDevice, static_cast<size_t>(stagingSize), ResourceFlag::NONE,
+		MemoryType::UPLOAD, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"StreamingStaging"), false);
+	m_pStagingData = static_cast<uint8_t*>(m_staging->Map());
+	XUSG_N_RETURN(m_pStagingData, false);
+	m_stagingRing.Init(stagingSize);
+
+	m_requestId = 0;
+	m_completedRequestId = 0;
+	m_lastSubmittedValue = 0;
+	m_isRunning = true;
+	m_worker = thread(&TextureStreamer::run, this);
+
+	return true;
+}
+
+void TextureStreamer::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!m_isRunning) return;
+		m_isRunning = false;
+	}
+	m_jobCV.notify_all();
+	if (m_worker.joinable()) m_worker.join();
+
+	// The copy queue may still be reading the staging buffer.
+	waitForFence(m_fenceValue);
+	CloseHandle(m_fenceEvent);
+	m_fenceEvent = nullptr;
+}
+
+bool TextureStreamer::CreateTexture(const wchar_t* fileName, Texture::sptr& texture, bool forceSRGB,
+	uint64_t* pRequestId, const wchar_t* name, DDS::AlphaMode* pAlphaMode, uint8_t mostDetailedMip)
+{
+	XUSG_N_RETURN(m_isRunning, false);
+
+	// Only the header is read here; the texels are left to the worker.
+	DDS::TextureInfo info;
+	uint64_t fileSize;
+	vector<DDS::SubresourceLayout> layouts;
+	XUSG_N_RETURN(DDS::Parser::LoadHeader(info, fileName, &fileSize), false);
+	XUSG_N_RETURN(DDS::Parser::GetSubresourceLayouts(layouts, info, fileSize), false);
+
+	// Volume textures are left to DDS::Loader.
+	XUSG_N_RETURN(info.Dimension != DDS::Dimension::TEXTURE3D, false);
+	XUSG_N_RETURN(IsValidTopMip(info, mostDetailedMip), false);
+
+	Job job;
+	const uint8_t numMips = info.MipLevels - mostDetailedMip;
+	job.Layouts.reserve(static_cast<size_t>(info.ArraySize) * numMips);
+	for (auto i = 0u; i < info.ArraySize; ++i)
+		for (auto m = mostDetailedMip; m < info.MipLevels; ++m)
+			job.Layouts.push_back(layouts[info.MipLevels * i + m]);
+
+	const auto& topLayout = job.Layouts[0];
+	const auto format = forceSRGB ? DDS::Parser::MakeSRGB(info.Format) : info.Format;
+	texture = Texture::MakeShared(m_api);
+	XUSG_N_RETURN(texture->Create(m_pDevice, topLayout.Width, topLayout.Height, format, info.ArraySize,
+		ResourceFlag::NONE, numMips, 1, info.IsCubeMap, MemoryFlag::NONE, name), false);
+	if (pAlphaMode) *pAlphaMode = info.AlphaMode;
+
+	job.FileName = fileName;
+	job.Texture = texture;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		job.RequestId = ++m_requestId;
+		if (pRequestId) *pRequestId = job.RequestId;
+		m_jobs.push_back(move(job));
+		++m_numPending;
+	}
+	m_jobCV.notify_one();
+
+	return true;
+}
+
+bool TextureStreamer::IsReady(uint64_t requestId)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if (requestId <= m_completedRequestId) return true;
+
+	const auto completedValue = m_fence->GetCompletedValue();
+	while (!m_submitted.empty() && m_submitted.front().second <= completedValue)
+	{
+		m_completedRequestId = m_submitted.front().first;
+		m_submitted.pop_front();
+	}
+
+	return requestId <= m_completedRequestId;
+}
+
+void TextureStreamer::Flush()
+{
+	uint64_t fenceValue;
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_flushCV.wait(lock, [this] { return !m_numPending || !m_isRunning; });
+		fenceValue = m_lastSubmittedValue;
+	}
+
+	if (m_fence->GetCompletedValue() < fenceValue)
+	{
+		const auto hEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		if (hEvent && m_fence->SetEventOnCompletion(fenceValue, hEvent))
+			WaitForSingleObject(hEvent, INFINITE);
+		if (hEvent) CloseHandle(hEvent);
+	}
+}
+
+bool TextureStreamer::IsValidTopMip(const DDS::TextureInfo& info, uint8_t mip)
+{
+	if (mip >= info.MipLevels) return false;
+
+	// Block-compressed textures need block-aligned dimensions at mip 0.
+	const auto width = (max)(info.Width >> mip, 1u);
+	const auto height = (max)(info.Height >> mip, 1u);
+
+	return !DDS::Parser::IsBlockCompressed(info.Format) || (width % 4 == 0 && height % 4 == 0);
+}
+
+void TextureStreamer::PlanChunks(vector<CopyChunk>& chunks, const vector<DDS::SubresourceLayout>& layouts,
+	uint64_t maxChunkSize)
+{
+	chunks.clear();
+
+	const auto numSubresources = static_cast<uint32_t>(layouts.size());
+	for (auto i = 0u; i < numSubresources; ++i)
+	{
+		const auto& layout = layouts[i];
+		const auto stagingRowPitch = XUSG_DIV_UP(layout.RowPitch, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT) *
+			D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+		const auto rowsPerChunk = static_cast<uint32_t>((max<uint64_t>)(maxChunkSize / stagingRowPitch, 1));
+
+		for (auto z = 0u; z < layout.Depth; ++z)
+		{
+			for (auto row = 0u; row < layout.NumRows; row += rowsPerChunk)
+			{
+				CopyChunk chunk;
+				chunk.Subresource = i;
+				chunk.Slice = z;
+				chunk.FirstRow = row;
+				chunk.NumRows = (min)(rowsPerChunk, layout.NumRows - row);
+				chunk.SrcOffset = layout.Offset + layout.SlicePitch * z + static_cast<uint64_t>(layout.RowPitch) * row;
+				chunk.SrcRowPitch = layout.RowPitch;
+				chunk.StagingRowPitch = stagingRowPitch;
+				chunk.StagingSize = static_cast<uint64_t>(stagingRowPitch) * chunk.NumRows;
+				chunks.push_back(chunk);
+			}
+		}
+	}
+}
+
+void TextureStreamer::run()
+{
+	while (true)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobCV.wait(lock, [this] { return !m_jobs.empty() || !m_isRunning; });
+			if (!m_isRunning) break;
+			job = move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		if (!processJob(job))
+			OutputDebugStringW((L"Failed to stream " + job.FileName + L"\n").c_str());
+
+		// Submit at the end of every job, so that small textures become ready without waiting for
+		// the ring to fill up.
+		submitBatch();
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_submitted.emplace_back(job.RequestId, m_fenceValue);
+			m_lastSubmittedValue = m_fenceValue;
+			--m_numPending;
+		}
+		m_flushCV.notify_all();
+	}
+
+	submitBatch();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_lastSubmittedValue = m_fenceValue;
+	}
+	m_flushCV.notify_all();
+}
+
+bool TextureStreamer::processJob(Job& job)
+{
+	FILE* pFile;
+	XUSG_N_RETURN(_wfopen_s(&pFile, job.FileName.c_str(), L"rb") == 0, false);
+
+	vector<CopyChunk> chunks;
+	PlanChunks(chunks, job.Layouts, m_chunkSize);
+
+	auto success = true;
+	for (const auto& chunk : chunks)
+	{
+		success = copyChunk(job, chunk, pFile);
+		if (!success) break;
+	}
+	fclose(pFile);
+
+	return success;
+}
+
+bool TextureStreamer::copyChunk(const Job& job, const CopyChunk& chunk, FILE* pFile)
+{
+	XUSG_N_RETURN(chunk.StagingSize <= m_stagingRing.GetSize(), false);
+
+	// Make room in the ring, submitting the open batch first if it holds the space we wait for.
+	uint64_t stagingOffset;
+	while (!m_stagingRing.Allocate(stagingOffset, chunk.StagingSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT))
+	{
+		if (m_numBatchCopies > 0) XUSG_N_RETURN(submitBatch(), false);
+		XUSG_N_RETURN(waitForFence(m_stagingRing.GetOldestFenceValue()), false);
+		m_stagingRing.Reclaim(m_fence->GetCompletedValue());
+	}
+
+	// Read the rows into system memory first, and write the staging memory strictly sequentially.
+	const auto srcSize = static_cast<size_t>(chunk.SrcRowPitch) * chunk.NumRows;
+	m_scratch.resize(srcSize);
+	XUSG_N_RETURN(_fseeki64(pFile, static_cast<int64_t>(chunk.SrcOffset), SEEK_SET) == 0, false);
+	XUSG_N_RETURN(fread(m_scratch.data(), 1, srcSize, pFile) == srcSize, false);
+
+	const auto pDst = &m_pStagingData[stagingOffset];
+	if (chunk.SrcRowPitch == chunk.StagingRowPitch) memcpy(pDst, m_scratch.data(), srcSize);
+	else for (auto i = 0u; i < chunk.NumRows; ++i)
+		memcpy(&pDst[static_cast<size_t>(chunk.StagingRowPitch) * i],
+			&m_scratch[static_cast<size_t>(chunk.SrcRowPitch) * i], chunk.SrcRowPitch);
+
+	// The placed footprint is not exposed by CommandList::CopyTextureRegion, hence the native call.
+	const auto& layout = job.Layouts[chunk.Subresource];
+	const auto format = job.Texture->GetFormat();
+	const auto isBC = DDS::Parser::IsBlockCompressed(format);
+	const auto blockSize = isBC ? 4u : 1u;
+
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	src.pResource = static_cast<ID3D12Resource*>(m_staging->GetHandle());
+	src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	src.PlacedFootprint.Offset = stagingOffset;
+	src.PlacedFootprint.Footprint.Format = static_cast<DXGI_FORMAT>(format);
+	src.PlacedFootprint.Footprint.Width = XUSG_DIV_UP(layout.Width, blockSize) * blockSize;
+	src.PlacedFootprint.Footprint.Height = chunk.NumRows * blockSize;
+	src.PlacedFootprint.Footprint.Depth = 1;
+	src.PlacedFootprint.Footprint.RowPitch = chunk.StagingRowPitch;
+
+	D3D12_TEXTURE_COPY_LOCATION dst = {};
+	dst.pResource = static_cast<ID3D12Resource*>(job.Texture->GetHandle());
+	dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	dst.SubresourceIndex = chunk.Subresource;
+
+	const auto pCommandList = static_cast<ID3D12GraphicsCommandList*>(m_commandList->GetHandle());
+	pCommandList->CopyTextureRegion(&dst, 0, chunk.FirstRow * blockSize, chunk.Slice, &src, nullptr);
+	++m_numBatchCopies;
+
+	return true;
+}
+
+bool TextureStreamer::beginBatch()
+{
+	// Recycle the oldest allocator once the GPU is done with it.
+	m_allocatorIndex = (m_allocatorIndex + 1) % NUM_ALLOCATORS;
+	XUSG_N_RETURN(waitForFence(m_allocatorFenceValues[m_allocatorIndex]), false);
+
+	const auto pAllocator = m_commandAllocators[m_allocatorIndex].get();
+	XUSG_N_RETURN(pAllocator->Reset(), false);
+	XUSG_N_RETURN(m_commandList->Reset(pAllocator, nullptr), false);
+
+	return true;
+}
+
+bool TextureStreamer::submitBatch()
+{
+	if (!m_numBatchCopies) return true;
+
+	XUSG_N_RETURN(m_commandList->Close(), false);
+	m_copyQueue->ExecuteCommandList(m_commandList.get());
+	XUSG_N_RETURN(m_copyQueue->Signal(m_fence.get(), ++m_fenceValue), false);
+
+	m_allocatorFenceValues[m_allocatorIndex] = m_fenceValue;
+	m_stagingRing.Retire(m_fenceValue);
+	m_numBatchCopies = 0;
+
+	return beginBatch();
+}
+
+bool TextureStreamer::waitForFence(uint64_t value)
+{
+	if (m_fence->GetCompletedValue() >= value) return true;
+
+	XUSG_N_RETURN(m_fence->SetEventOnCompletion(value, m_fenceEvent), false);
+	WaitForSingleObject(m_fenceEvent, INFINITE);
+
+	return true;
+}
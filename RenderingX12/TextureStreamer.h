@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Fixed-size staging ring; allocations are retired with a fence value and reclaimed in order
+	//--------------------------------------------------------------------------------------
+	class StagingRing
+	{
+	public:
+		StagingRing();
+		virtual ~StagingRing();
+
+		void Init(uint64_t size);
+
+		// Fails without side effects if the ring has no room until older batches are reclaimed
+		bool Allocate(uint64_t& offset, uint64_t size, uint64_t alignment);
+		void Retire(uint64_t fenceValue);
+		void Reclaim(uint64_t completedFenceValue);
+
+		uint64_t GetSize() const { return m_size; }
+		uint64_t GetUsedSize() const { return m_head - m_tail; }
+		uint64_t GetOldestFenceValue() const;
+
+		// A scripted wrap and an empty ring taking a request larger than the room left past its
+		// head, then random sizes and alignments retired in batches: every offset is aligned,
+		// live allocations never overlap, and an empty ring never refuses a request that fits.
+		static bool Check(uint32_t numAllocations = 100000, uint64_t size = 1 << 20);
+
+	protected:
+		struct Retirement
+		{
+			uint64_t FenceValue;
+			uint64_t Head;
+		};
+
+		std::deque<Retirement> m_retirements;
+		uint64_t m_size;
+		uint64_t m_head;	// Monotonic; wrapped by m_size on use
+		uint64_t m_tail;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Streams DDS mip chains to the GPU on a dedicated copy queue
+	//--------------------------------------------------------------------------------------
+	class TextureStreamer
+	{
+	public:
+		// Block rows of one depth slice of a subresource, copied through the staging ring at once
+		struct CopyChunk
+		{
+			uint32_t Subresource;
+			uint32_t Slice;
+			uint32_t FirstRow;
+			uint32_t NumRows;
+			uint64_t SrcOffset;
+			uint32_t SrcRowPitch;
+			uint32_t StagingRowPitch;
+			uint64_t StagingSize;
+		};
+
+		TextureStreamer();
+		virtual ~TextureStreamer();
+
+		bool Init(const Device* pDevice, uint64_t stagingSize = 32 << 20,
+			uint64_t chunkSize = 1 << 20, API api = API::DIRECTX_12);
+		void Stop();
+
+		// Creates the texture in the COMMON state and queues its contents; the texture must not
+		// be sampled before IsReady(requestId). Mips above mostDetailedMip in the file are skipped,
+		// so that the texture starts at that mip.
+		bool CreateTexture(const wchar_t* fileName, Texture::sptr& texture, bool forceSRGB = false,
+			uint64_t* pRequestId = nullptr, const wchar_t* name = nullptr,
+			DDS::AlphaMode* pAlphaMode = nullptr, uint8_t mostDetailedMip = 0);
+
+		bool IsReady(uint64_t requestId);
+		uint32_t GetNumPending() const { return m_numPending; }
+		void Flush();
+
+		static bool IsValidTopMip(const DDS::TextureInfo& info, uint8_t mip);
+		static void PlanChunks(std::vector<CopyChunk>& chunks, const std::vector<DDS::SubresourceLayout>& layouts,
+			uint64_t maxChunkSize);
+
+		using uptr = std::unique_ptr<TextureStreamer>;
+		using sptr = std::shared_ptr<TextureStreamer>;
+
+	protected:
+		static const uint8_t NUM_ALLOCATORS = 3;
+
+		struct Job
+		{
+			uint64_t RequestId;
+			std::wstring FileName;
+			Texture::sptr Texture;
+			std::vector<DDS::SubresourceLayout> Layouts;
+		};
+
+		void run();
+		bool processJob(Job& job);
+		bool copyChunk(const Job& job, const CopyChunk& chunk, FILE* pFile);
+		bool beginBatch();
+		bool submitBatch();
+		bool waitForFence(uint64_t value);
+
+		const Device*		m_pDevice;
+		CommandQueue::uptr	m_copyQueue;
+		CommandAllocator::uptr m_commandAllocators[NUM_ALLOCATORS];
+		CommandList::uptr	m_commandList;
+		Fence::uptr			m_fence;
+		Buffer::uptr		m_staging;
+		uint8_t*			m_pStagingData;
+		API					m_api;
+
+		StagingRing			m_stagingRing;
+		uint64_t			m_chunkSize;
+		uint64_t			m_allocatorFenceValues[NUM_ALLOCATORS];
+		uint64_t			m_fenceValue;
+		uint8_t				m_allocatorIndex;
+		uint32_t			m_numBatchCopies;
+		std::vector<uint8_t> m_scratch;
+		void*				m_fenceEvent;
+
+		std::thread			m_worker;
+		std::mutex			m_mutex;
+		std::condition_variable m_jobCV;
+		std::condition_variable m_flushCV;
+		std::deque<Job>		m_jobs;
+		std::deque<std::pair<uint64_t, uint64_t>> m_submitted;	// Request ID, fence value
+		std::atomic<uint32_t> m_numPending;
+		uint64_t			m_requestId;
+		uint64_t			m_completedRequestId;
+		uint64_t			m_lastSubmittedValue;
+		bool				m_isRunning;
+	};
+}
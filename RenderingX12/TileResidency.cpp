@@ -0,0 +1,436 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TileResidency.h"
+
+using namespace std;
+using namespace XUSG;
+
+TileResidency::TileResidency() :
+	m_textures(),
+	m_freeTiles(),
+	m_mappedTiles(),
+	m_unmappedTiles(),
+	m_queuedRequests(),
+	m_maxTilesPerUpdate(32),
+	m_stats()
+{
+}
+
+TileResidency::~TileResidency()
+{
+}
+
+void TileResidency::Init(uint32_t numHeapTiles, uint32_t maxTilesPerUpdate)
+{
+	m_textures.clear();
+	m_mappedTiles.clear();
+	m_unmappedTiles.clear();
+	m_queuedRequests.clear();
+	m_maxTilesPerUpdate = maxTilesPerUpdate;
+
+	// Popped from the back, so that tiles are handed out in ascending order
+	m_freeTiles.resize(numHeapTiles);
+	for (auto i = 0u; i < numHeapTiles; ++i) m_freeTiles[i] = numHeapTiles - 1 - i;
+
+	m_stats = {};
+	m_stats.NumHeapTiles = numHeapTiles;
+	m_stats.NumFreeTiles = numHeapTiles;
+}
+
+uint32_t TileResidency::AddTexture(const DDS::TextureInfo& info, uint8_t numStandardMips,
+	const TileShape* pTileShape, uint32_t numPackedTiles)
+{
+	XUSG_N_RETURN(info.Dimension == DDS::Dimension::TEXTURE2D && info.ArraySize == 1 &&
+		info.MipLevels <= MAX_MIPS, UINT32_MAX);
+
+	Entry entry = {};
+	entry.Shape = pTileShape ? *pTileShape : GetStandardTileShape(info.Format);
+	XUSG_N_RETURN(entry.Shape.WidthInTexels > 0 && entry.Shape.HeightInTexels > 0, UINT32_MAX);
+	entry.NumStandardMips = numStandardMips != UINT8_MAX ? numStandardMips : GetNumStandardMips(info, entry.Shape);
+	XUSG_N_RETURN(entry.NumStandardMips <= info.MipLevels, UINT32_MAX);
+
+	auto numTiles = 0u;
+	for (uint8_t m = 0; m < entry.NumStandardMips; ++m)
+	{
+		entry.FirstTiles[m] = numTiles;
+		entry.NumTilesX[m] = XUSG_DIV_UP((max)(info.Width >> m, 1u), entry.Shape.WidthInTexels);
+		entry.NumTilesY[m] = XUSG_DIV_UP((max)(info.Height >> m, 1u), entry.Shape.HeightInTexels);
+		numTiles += entry.NumTilesX[m] * entry.NumTilesY[m];
+	}
+	entry.Tiles.resize(numTiles, { NULL_TILE, 0, UINT64_MAX });
+
+	// The mip tail packs the remaining mips into whole tiles.
+	if (numPackedTiles == UINT32_MAX)
+	{
+		uint64_t packedSize = 0;
+		for (auto m = entry.NumStandardMips; m < info.MipLevels; ++m)
+		{
+			uint64_t slicePitch;
+			DDS::Parser::GetSurfaceInfo((max)(info.Width >> m, 1u), (max)(info.Height >> m, 1u),
+				info.Format, nullptr, nullptr, &slicePitch);
+			packedSize += slicePitch;
+		}
+		numPackedTiles = static_cast<uint32_t>(XUSG_DIV_UP(packedSize, TILE_SIZE));
+	}
+	XUSG_N_RETURN(numPackedTiles <= m_freeTiles.size(), UINT32_MAX);
+
+	entry.PackedTiles.resize(numPackedTiles);
+	for (auto& tile : entry.PackedTiles)
+	{
+		tile = m_freeTiles.back();
+		m_freeTiles.pop_back();
+	}
+	m_stats.NumFreeTiles = static_cast<uint32_t>(m_freeTiles.size());
+
+	const auto numTilesX0 = entry.NumStandardMips > 0 ? entry.NumTilesX[0] : 1;
+	const auto numTilesY0 = entry.NumStandardMips > 0 ? entry.NumTilesY[0] : 1;
+	entry.Feedback.assign(numTilesX0 * numTilesY0, UINT8_MAX);
+	entry.ResidencyMap.assign(numTilesX0 * numTilesY0, entry.NumStandardMips);
+
+	m_textures.push_back(move(entry));
+
+	return GetNumTextures() - 1;
+}
+
+void TileResidency::SetFeedback(uint32_t texture, const uint8_t* pFinestMips)
+{
+	auto& entry = m_textures[texture];
+	memcpy(entry.Feedback.data(), pFinestMips, entry.Feedback.size());
+	entry.HasFeedback = true;
+}
+
+void TileResidency::Update(uint64_t frame)
+{
+	m_mappedTiles.clear();
+	m_unmappedTiles.clear();
+
+	// Each sampled region needs its tile in the sampled mip and in every coarser one, so that
+	// sampling can fall back to a resident mip. All of them count as used in this frame.
+	vector<Request> requests;
+	const auto numTextures = GetNumTextures();
+	for (auto i = 0u; i < numTextures; ++i)
+	{
+		auto& entry = m_textures[i];
+		if (!entry.HasFeedback) continue;
+		entry.HasFeedback = false;
+
+		const auto numTilesX0 = entry.NumStandardMips > 0 ? entry.NumTilesX[0] : 1;
+		for (size_t j = 0; j < entry.Feedback.size(); ++j)
+		{
+			const auto x0 = static_cast<uint32_t>(j % numTilesX0);
+			const auto y0 = static_cast<uint32_t>(j / numTilesX0);
+			for (auto m = entry.Feedback[j]; m < entry.NumStandardMips; ++m)
+			{
+				const auto t = getTileIndex(entry, m, x0, y0);
+				auto& tile = entry.Tiles[t];
+				tile.LastUsedFrame = frame;
+				if (tile.HeapTile == NULL_TILE && tile.RequestedFrame != frame)
+				{
+					tile.RequestedFrame = frame;
+					requests.push_back({ m, i, t });
+				}
+			}
+		}
+	}
+
+	// The queued requests still unmapped, unless the feedback asked for them again
+	for (const auto& request : m_queuedRequests)
+	{
+		auto& tile = m_textures[request.Texture].Tiles[request.Tile];
+		if (tile.HeapTile == NULL_TILE && tile.RequestedFrame != frame)
+		{
+			tile.RequestedFrame = frame;
+			requests.push_back(request);
+		}
+	}
+
+	// Coarser mips first, so that a partial update still leaves complete fallbacks
+	sort(requests.begin(), requests.end(), [](const Request& a, const Request& b)
+	{
+		if (a.Mip != b.Mip) return a.Mip > b.Mip;
+
+		return a.Texture != b.Texture ? a.Texture < b.Texture : a.Tile < b.Tile;
+	});
+
+	// Eviction candidates are the tiles not used in this frame, oldest first and finer mips first
+	// on ties. A coarser tile is used whenever a finer one is, so chains are evicted from the top.
+	struct Candidate
+	{
+		uint64_t	LastUsedFrame;
+		uint8_t		Mip;
+		uint32_t	Texture;
+		uint32_t	Tile;
+	};
+
+	vector<Candidate> candidates;
+	auto hasCandidates = false;
+	const auto numRequests = (min)(static_cast<uint32_t>(requests.size()), m_maxTilesPerUpdate);
+	m_queuedRequests.assign(requests.cbegin() + numRequests, requests.cend());
+	for (auto i = 0u; i < numRequests; ++i)
+	{
+		const auto& request = requests[i];
+		if (m_freeTiles.empty())
+		{
+			if (!hasCandidates)
+			{
+				for (auto j = 0u; j < numTextures; ++j)
+				{
+					const auto& entry = m_textures[j];
+					for (uint8_t m = 0; m < entry.NumStandardMips; ++m)
+					{
+						const auto numMipTiles = entry.NumTilesX[m] * entry.NumTilesY[m];
+						for (auto t = entry.FirstTiles[m]; t < entry.FirstTiles[m] + numMipTiles; ++t)
+						{
+							const auto& tile = entry.Tiles[t];
+							if (tile.HeapTile != NULL_TILE && tile.LastUsedFrame < frame)
+								candidates.push_back({ tile.LastUsedFrame, m, j, t });
+						}
+					}
+				}
+
+				// Popped from the back
+				sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+				{
+					if (a.LastUsedFrame != b.LastUsedFrame) return a.LastUsedFrame > b.LastUsedFrame;
+					if (a.Mip != b.Mip) return a.Mip > b.Mip;
+
+					return a.Texture != b.Texture ? a.Texture > b.Texture : a.Tile > b.Tile;
+				});
+				hasCandidates = true;
+			}
+
+			if (candidates.empty())
+			{
+				m_stats.NumDeniedTiles += numRequests - i;
+				break;
+			}
+
+			const auto& candidate = candidates.back();
+			auto& entry = m_textures[candidate.Texture];
+			auto& tile = entry.Tiles[candidate.Tile];
+			m_unmappedTiles.push_back(getTileUpdate(candidate.Texture, candidate.Tile));
+			m_freeTiles.push_back(tile.HeapTile);
+			tile.HeapTile = NULL_TILE;
+			--entry.NumMappedTiles;
+			++m_stats.NumEvictedTiles;
+			candidates.pop_back();
+		}
+
+		auto& entry = m_textures[request.Texture];
+		entry.Tiles[request.Tile].HeapTile = m_freeTiles.back();
+		m_freeTiles.pop_back();
+		++entry.NumMappedTiles;
+		++m_stats.NumMappedTiles;
+		m_mappedTiles.push_back(getTileUpdate(request.Texture, request.Tile));
+	}
+	m_stats.NumFreeTiles = static_cast<uint32_t>(m_freeTiles.size());
+
+	for (auto i = 0u; i < numTextures; ++i) updateResidencyMap(i);
+}
+
+uint32_t TileResidency::GetHeapTile(uint32_t texture, uint8_t mip, uint32_t x, uint32_t y) const
+{
+	const auto& entry = m_textures[texture];
+	assert(mip < entry.NumStandardMips && x < entry.NumTilesX[mip] && y < entry.NumTilesY[mip]);
+
+	return entry.Tiles[entry.FirstTiles[mip] + entry.NumTilesX[mip] * y + x].HeapTile;
+}
+
+float TileResidency::GetResidentFraction(uint32_t texture) const
+{
+	const auto& entry = m_textures[texture];
+	const auto numPackedTiles = static_cast<uint32_t>(entry.PackedTiles.size());
+	const auto numTiles = static_cast<uint32_t>(entry.Tiles.size()) + numPackedTiles;
+
+	return numTiles > 0 ? static_cast<float>(entry.NumMappedTiles + numPackedTiles) / numTiles : 1.0f;
+}
+
+TileShape TileResidency::GetStandardTileShape(Format format)
+{
+	// Standard 64KB 2D tile shapes by element size; BC formats count in 4x4 blocks.
+	const auto bpp = DDS::Loader::BitsPerPixel(format);
+	const auto isBC = DDS::Parser::IsBlockCompressed(format);
+	const auto elementSize = isBC ? bpp * 2 : bpp / 8;	// Bytes per block or per texel
+
+	TileShape shape = { 0, 0, 1 };
+	switch (elementSize)
+	{
+	case 1: shape.WidthInTexels = 256; shape.HeightInTexels = 256; break;
+	case 2: shape.WidthInTexels = 256; shape.HeightInTexels = 128; break;
+	case 4: shape.WidthInTexels = 128; shape.HeightInTexels = 128; break;
+	case 8: shape.WidthInTexels = 128; shape.HeightInTexels = 64; break;
+	case 16: shape.WidthInTexels = 64; shape.HeightInTexels = 64; break;
+	}
+
+	if (isBC)
+	{
+		shape.WidthInTexels *= 4;
+		shape.HeightInTexels *= 4;
+	}
+
+	return shape;
+}
+
+uint8_t TileResidency::GetNumStandardMips(const DDS::TextureInfo& info, const TileShape& shape)
+{
+	// Mips smaller than a tile in either dimension go to the packed tail.
+	uint8_t numMips = 0;
+	while (numMips < info.MipLevels && (info.Width >> numMips) >= shape.WidthInTexels &&
+		(info.Height >> numMips) >= shape.HeightInTexels) ++numMips;
+
+	return numMips;
+}
+
+bool TileResidency::Check()
+{
+	// Standard shapes by bytes per texel, and per 4x4 block for BC formats
+	const struct
+	{
+		Format		Format;
+		uint32_t	Width;
+		uint32_t	Height;
+	} shapes[] =
+	{
+		{ Format::R8_UNORM, 256, 256 },
+		{ Format::R8G8_UNORM, 256, 128 },
+		{ Format::R8G8B8A8_UNORM, 128, 128 },
+		{ Format::R16G16B16A16_FLOAT, 128, 64 },
+		{ Format::R32G32B32A32_FLOAT, 64, 64 },
+		{ Format::BC1_UNORM, 512, 256 },
+		{ Format::BC7_UNORM, 256, 256 }
+	};
+
+	for (const auto& shape : shapes)
+	{
+		const auto tileShape = GetStandardTileShape(shape.Format);
+		XUSG_N_RETURN(tileShape.WidthInTexels == shape.Width && tileShape.HeightInTexels == shape.Height &&
+			tileShape.DepthInTexels == 1, false);
+	}
+
+	// 1024x1024 RGBA8: 8x8, 4x4, 2x2 and 1x1 tiles in mips 0 to 3, the rest in one packed tile
+	DDS::TextureInfo info = {};
+	info.Format = Format::R8G8B8A8_UNORM;
+	info.Dimension = DDS::Dimension::TEXTURE2D;
+	info.Width = 1024;
+	info.Height = 1024;
+	info.Depth = 1;
+	info.ArraySize = 1;
+	info.MipLevels = 11;
+
+	const auto numTilesX0 = 8u;
+	vector<uint8_t> feedback(numTilesX0 * numTilesX0);
+	const auto setFeedback = [&](TileResidency& residency, uint32_t x0, uint32_t y0, uint8_t mip)
+	{
+		fill(feedback.begin(), feedback.end(), UINT8_MAX);
+		feedback[numTilesX0 * y0 + x0] = mip;
+		residency.SetFeedback(0, feedback.data());
+	};
+
+	const auto isMapped = [](const vector<TileUpdate>& tiles, uint8_t mip, uint32_t x, uint32_t y)
+	{
+		for (const auto& tile : tiles)
+			if (tile.Coord.Subresource == mip && tile.Coord.X == x && tile.Coord.Y == y) return true;
+
+		return false;
+	};
+
+	// Requests beyond the limit in the next updates, coarser mips first
+	{
+		TileResidency residency;
+		residency.Init(64, 4);
+		XUSG_N_RETURN(residency.AddTexture(info) == 0, false);
+		XUSG_N_RETURN(residency.GetNumStandardMips(0) == 4 && residency.GetPackedTiles(0).size() == 1, false);
+
+		// Mip 1 everywhere: 1 + 4 + 16 tiles over 6 updates
+		fill(feedback.begin(), feedback.end(), 1);
+		residency.SetFeedback(0, feedback.data());
+
+		const uint32_t numMapped[] = { 4, 4, 4, 4, 4, 1, 0 };
+		auto mip = UINT8_MAX;
+		for (auto i = 0u; i < 7; ++i)
+		{
+			residency.Update(i + 1);
+			const auto& mappedTiles = residency.GetMappedTiles();
+			XUSG_N_RETURN(mappedTiles.size() == numMapped[i], false);
+			for (const auto& tile : mappedTiles)
+			{
+				XUSG_N_RETURN(tile.Coord.Subresource <= mip, false);
+				mip = static_cast<uint8_t>(tile.Coord.Subresource);
+			}
+		}
+
+		for (const auto& residentMip : residency.GetResidencyMap(0)) XUSG_N_RETURN(residentMip == 1, false);
+	}
+
+	// A pool of the packed tile and 4 more
+	{
+		TileResidency residency;
+		residency.Init(5, 8);
+		XUSG_N_RETURN(residency.AddTexture(info) == 0, false);
+
+		setFeedback(residency, 0, 0, 1);
+		residency.Update(1);
+		XUSG_N_RETURN(residency.GetMappedTiles().size() == 3 && residency.GetStats().NumFreeTiles == 1, false);
+		XUSG_N_RETURN(residency.GetResidencyMap(0)[0] == 1, false);
+
+		// The finer tile of the other corner unmaps the finer tile not used in this frame.
+		setFeedback(residency, 7, 7, 1);
+		residency.Update(2);
+		const auto& mappedTiles = residency.GetMappedTiles();
+		const auto& unmappedTiles = residency.GetUnmappedTiles();
+		XUSG_N_RETURN(mappedTiles.size() == 2 && isMapped(mappedTiles, 2, 1, 1) && isMapped(mappedTiles, 1, 3, 3), false);
+		XUSG_N_RETURN(unmappedTiles.size() == 1 && isMapped(unmappedTiles, 1, 0, 0), false);
+		XUSG_N_RETURN(residency.GetResidencyMap(0)[0] == 2 && residency.GetResidencyMap(0)[numTilesX0 * 8 - 1] == 1, false);
+
+		// Every mapped tile is in use: both requests are denied, not queued.
+		feedback[0] = 0;
+		residency.SetFeedback(0, feedback.data());
+		residency.Update(3);
+		XUSG_N_RETURN(residency.GetMappedTiles().empty() && residency.GetUnmappedTiles().empty(), false);
+		XUSG_N_RETURN(residency.GetStats().NumDeniedTiles == 2, false);
+		residency.Update(4);
+		XUSG_N_RETURN(residency.GetMappedTiles().empty() && residency.GetStats().NumDeniedTiles == 2, false);
+	}
+
+	return true;
+}
+
+uint32_t TileResidency::getTileIndex(const Entry& entry, uint8_t mip, uint32_t x0, uint32_t y0) const
+{
+	const auto x = (min)(x0 >> mip, entry.NumTilesX[mip] - 1);
+	const auto y = (min)(y0 >> mip, entry.NumTilesY[mip] - 1);
+
+	return entry.FirstTiles[mip] + entry.NumTilesX[mip] * y + x;
+}
+
+TileResidency::TileUpdate TileResidency::getTileUpdate(uint32_t texture, uint32_t tile) const
+{
+	const auto& entry = m_textures[texture];
+	uint8_t mip = 0;
+	while (mip + 1 < entry.NumStandardMips && tile >= entry.FirstTiles[mip + 1]) ++mip;
+
+	const auto index = tile - entry.FirstTiles[mip];
+	const auto x = index % entry.NumTilesX[mip];
+	const auto y = index / entry.NumTilesX[mip];
+
+	return { texture, TiledResourceCoord(x, y, 0, mip), entry.Tiles[tile].HeapTile };
+}
+
+void TileResidency::updateResidencyMap(uint32_t texture)
+{
+	auto& entry = m_textures[texture];
+	if (entry.NumStandardMips == 0) return;
+
+	const auto numTilesX0 = entry.NumTilesX[0];
+	for (size_t i = 0; i < entry.ResidencyMap.size(); ++i)
+	{
+		const auto x0 = static_cast<uint32_t>(i % numTilesX0);
+		const auto y0 = static_cast<uint32_t>(i / numTilesX0);
+
+		auto mip = entry.NumStandardMips;
+		while (mip > 0 && entry.Tiles[getTileIndex(entry, mip - 1, x0, y0)].HeapTile != NULL_TILE) --mip;
+		entry.ResidencyMap[i] = mip;
+	}
+}
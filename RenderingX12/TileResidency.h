@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSParser.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Page table of reserved (tiled) 2D textures over a shared pool of 64KB heap tiles.
+	// Sampling feedback requests tiles, coarser mips first; the least recently used tiles
+	// are unmapped when the pool runs out. Pure bookkeeping, no GPU objects.
+	//--------------------------------------------------------------------------------------
+	class TileResidency
+	{
+	public:
+		static const uint32_t TILE_SIZE = 65536;
+		static const uint32_t NULL_TILE = UINT32_MAX;
+
+		// Coord.Subresource is the mip
+		struct TileUpdate
+		{
+			uint32_t	Texture;
+			TiledResourceCoord Coord;
+			uint32_t	HeapTile;
+		};
+
+		struct Stats
+		{
+			uint32_t	NumHeapTiles;
+			uint32_t	NumFreeTiles;
+			uint64_t	NumMappedTiles;		// Over all updates
+			uint64_t	NumEvictedTiles;
+			uint64_t	NumDeniedTiles;		// Requests left unmapped as the pool was full of tiles in use
+		};
+
+		TileResidency();
+		virtual ~TileResidency();
+
+		// Requests beyond maxTilesPerUpdate stay queued for the next updates.
+		void Init(uint32_t numHeapTiles, uint32_t maxTilesPerUpdate = 32);
+
+		// The mip tail is mapped up front and never evicted. The tiling comes from Resource::GetTiling
+		// on the GPU; the defaults assume standard 64KB tile shapes. Returns UINT32_MAX on failure.
+		uint32_t AddTexture(const DDS::TextureInfo& info, uint8_t numStandardMips = UINT8_MAX,
+			const TileShape* pTileShape = nullptr, uint32_t numPackedTiles = UINT32_MAX);
+
+		// Finest mip sampled in each mip-0 tile of the texture, UINT8_MAX where not sampled;
+		// used by the next update.
+		void SetFeedback(uint32_t texture, const uint8_t* pFinestMips);
+
+		// Unmaps and maps tiles for the pending feedback and the queued requests. Requests denied
+		// as the pool is full of tiles in use are dropped; the next feedback asks for them again.
+		void Update(uint64_t frame);
+
+		// Tiles mapped by the last update, whose contents need loading, and the ones unmapped
+		const std::vector<TileUpdate>& GetMappedTiles() const { return m_mappedTiles; }
+		const std::vector<TileUpdate>& GetUnmappedTiles() const { return m_unmappedTiles; }
+
+		// Per mip-0 tile, the finest mip resident together with all coarser ones, for clamping
+		// the sampled LOD; NumStandardMips where only the mip tail is.
+		const std::vector<uint8_t>& GetResidencyMap(uint32_t texture) const { return m_textures[texture].ResidencyMap; }
+
+		const std::vector<uint32_t>& GetPackedTiles(uint32_t texture) const { return m_textures[texture].PackedTiles; }
+		uint32_t GetHeapTile(uint32_t texture, uint8_t mip, uint32_t x, uint32_t y) const;
+		uint32_t GetNumTilesX(uint32_t texture, uint8_t mip) const { return m_textures[texture].NumTilesX[mip]; }
+		uint32_t GetNumTilesY(uint32_t texture, uint8_t mip) const { return m_textures[texture].NumTilesY[mip]; }
+		uint8_t GetNumStandardMips(uint32_t texture) const { return m_textures[texture].NumStandardMips; }
+		const TileShape& GetTileShape(uint32_t texture) const { return m_textures[texture].Shape; }
+		uint32_t GetNumTextures() const { return static_cast<uint32_t>(m_textures.size()); }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Mapped tiles over all tiles, including the mip tail
+		float GetResidentFraction(uint32_t texture) const;
+
+		static TileShape GetStandardTileShape(Format format);
+		static uint8_t GetNumStandardMips(const DDS::TextureInfo& info, const TileShape& shape);
+
+		// Standard tile shapes by element size; then scripted feedback over one texture: requests
+		// are mapped coarser mips first, those beyond the limit in the next updates, and a full
+		// pool unmaps the least recently used tiles, finer mips first, or denies.
+		static bool Check();
+
+		using uptr = std::unique_ptr<TileResidency>;
+		using sptr = std::shared_ptr<TileResidency>;
+
+	protected:
+		static const uint8_t MAX_MIPS = 16;
+
+		struct Request
+		{
+			uint8_t		Mip;
+			uint32_t	Texture;
+			uint32_t	Tile;
+		};
+
+		struct Tile
+		{
+			uint32_t	HeapTile;
+			uint64_t	LastUsedFrame;
+			uint64_t	RequestedFrame;
+		};
+
+		struct Entry
+		{
+			TileShape	Shape;
+			uint8_t		NumStandardMips;
+			uint32_t	FirstTiles[MAX_MIPS];
+			uint32_t	NumTilesX[MAX_MIPS];
+			uint32_t	NumTilesY[MAX_MIPS];
+			uint32_t	NumMappedTiles;
+			std::vector<Tile>		Tiles;
+			std::vector<uint32_t>	PackedTiles;
+			std::vector<uint8_t>	Feedback;
+			std::vector<uint8_t>	ResidencyMap;
+			bool		HasFeedback;
+		};
+
+		uint32_t getTileIndex(const Entry& entry, uint8_t mip, uint32_t x0, uint32_t y0) const;
+		TileUpdate getTileUpdate(uint32_t texture, uint32_t tile) const;
+		void updateResidencyMap(uint32_t texture);
+
+		std::vector<Entry>		m_textures;
+		std::vector<uint32_t>	m_freeTiles;
+		std::vector<TileUpdate>	m_mappedTiles;
+		std::vector<TileUpdate>	m_unmappedTiles;
+		std::vector<Request>	m_queuedRequests;	// Beyond the limit of the last update
+		uint32_t				m_maxTilesPerUpdate;
+		Stats					m_stats;
+	};
+}
@@ -0,0 +1,279 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TiledTexture.h"
+
+using namespace std;
+using namespace XUSG;
+
+TiledTexture::TiledTexture() :
+	m_pDevice(nullptr),
+	m_api(API::DIRECTX_12),
+	m_textures(0),
+	m_maxTilesPerUpdate(0),
+	m_frameCount(0)
+{
+}
+
+TiledTexture::~TiledTexture()
+{
+}
+
+bool TiledTexture::Init(const Device* pDevice, uint32_t numHeapTiles, uint32_t maxTilesPerUpdate,
+	uint8_t frameCount, API api)
+{
+	XUSG_N_RETURN(numHeapTiles > 0 && maxTilesPerUpdate > 0 && frameCount > 0, false);
+
+	m_pDevice = pDevice;
+	m_api = api;
+	m_maxTilesPerUpdate = maxTilesPerUpdate;
+	m_frameCount = frameCount;
+	m_textures.clear();
+	m_residency.Init(numHeapTiles, maxTilesPerUpdate);
+
+	m_tileHeap = Heap::MakeUnique(api);
+	XUSG_N_RETURN(m_tileHeap->Create(pDevice, static_cast<uint64_t>(numHeapTiles) * TileResidency::TILE_SIZE,
+		MemoryType::DEFAULT, MemoryFlag::DENY_BUFFERS | MemoryFlag::DENY_RT_DS_TEXTURES, 0, L"TileHeap"), false);
+
+	// A page holds the tiles of one update.
+	XUSG_N_RETURN(m_uploadAllocator.Init(pDevice, static_cast<uint64_t>(maxTilesPerUpdate) * TileResidency::TILE_SIZE, api), false);
+
+	return true;
+}
+
+uint32_t TiledTexture::AddTexture(CommandList* pCommandList, CommandQueue* pCommandQueue,
+	const wchar_t* fileName, bool forceSRGB, const wchar_t* name)
+{
+	DDS::TextureInfo info;
+	uint64_t fileSize;
+	Entry entry;
+	XUSG_N_RETURN(DDS::Parser::LoadHeader(info, fileName, &fileSize), UINT32_MAX);
+	XUSG_N_RETURN(info.Dimension == DDS::Dimension::TEXTURE2D && info.ArraySize == 1 && !info.IsCubeMap, UINT32_MAX);
+	XUSG_N_RETURN(DDS::Parser::GetSubresourceLayouts(entry.Layouts, info, fileSize), UINT32_MAX);
+	entry.FileName = fileName;
+
+	// XUSG has no reserved resource creation, hence the native call.
+	const auto format = forceSRGB ? DDS::Parser::MakeSRGB(info.Format) : info.Format;
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	desc.Width = info.Width;
+	desc.Height = info.Height;
+	desc.DepthOrArraySize = 1;
+	desc.MipLevels = info.MipLevels;
+	desc.Format = static_cast<DXGI_FORMAT>(format);
+	desc.SampleDesc.Count = 1;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+
+	const auto pDevice = static_cast<ID3D12Device*>(m_pDevice->GetHandle());
+	com_ptr<ID3D12Resource> resource;
+	XUSG_N_RETURN(SUCCEEDED(pDevice->CreateReservedResource(&desc, D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr, IID_PPV_ARGS(&resource))), UINT32_MAX);
+
+	entry.Texture = Texture::MakeShared(m_api);
+	entry.Texture->Create(pDevice, resource.get(), name ? name : fileName);
+	const auto srvHeapStart = entry.Texture->AllocateCbvSrvUavHeap(m_pDevice, 1);
+	XUSG_N_RETURN(srvHeapStart, UINT32_MAX);
+	entry.SRV = entry.Texture->CreateSRV(srvHeapStart, 0, 1, 0, format, info.MipLevels);
+
+	uint32_t numTiles;
+	PackedMipInfo packedMipInfo;
+	TileShape tileShape;
+	entry.Texture->GetTiling(&numTiles, &packedMipInfo, &tileShape);
+
+	// Stage the mip tail in the pooled upload pages.
+	const auto firstMip = packedMipInfo.NumStandardMips;
+	const auto numPackedMips = static_cast<uint32_t>(info.MipLevels - firstMip);
+	vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(numPackedMips);
+	UploadAllocator::Allocation upload = {};
+	if (numPackedMips > 0)
+	{
+		uint64_t uploadSize;
+		pDevice->GetCopyableFootprints(&desc, firstMip, numPackedMips, 0, footprints.data(), nullptr, nullptr, &uploadSize);
+		XUSG_N_RETURN(m_uploadAllocator.Allocate(upload, uploadSize), UINT32_MAX);
+
+		FILE* pFile;
+		XUSG_N_RETURN(_wfopen_s(&pFile, fileName, L"rb") == 0, UINT32_MAX);
+		auto success = true;
+		for (auto i = 0u; i < numPackedMips && success; ++i)
+		{
+			const auto& layout = entry.Layouts[firstMip + i];
+			auto& footprint = footprints[i];
+			for (auto row = 0u; row < layout.NumRows && success; ++row)
+			{
+				const auto pDst = &upload.pData[footprint.Offset + static_cast<size_t>(footprint.Footprint.RowPitch) * row];
+				success = _fseeki64(pFile, static_cast<int64_t>(layout.Offset + static_cast<uint64_t>(layout.RowPitch) * row), SEEK_SET) == 0 &&
+					fread(pDst, 1, layout.RowPitch, pFile) == layout.RowPitch;
+			}
+			footprint.Offset += upload.Offset;
+		}
+		fclose(pFile);
+		XUSG_N_RETURN(success, UINT32_MAX);
+	}
+
+	const auto texture = m_residency.AddTexture(info, packedMipInfo.NumStandardMips,
+		&tileShape, packedMipInfo.NumTilesForPackedMips);
+	XUSG_N_RETURN(texture != UINT32_MAX, UINT32_MAX);
+
+	// Map the mip tail for good.
+	const auto& packedTiles = m_residency.GetPackedTiles(texture);
+	const auto numPackedTiles = static_cast<uint32_t>(packedTiles.size());
+	if (numPackedTiles > 0)
+	{
+		const TiledResourceCoord coord(0, 0, 0, packedMipInfo.NumStandardMips);
+		const TileRegionSize regionSize = { numPackedTiles, false, 0, 0, 0 };
+		m_rangeFlags.assign(numPackedTiles, TileRangeFlag::NONE);
+		m_rangeTileCounts.assign(numPackedTiles, 1);
+		pCommandQueue->UpdateTileMappings(entry.Texture.get(), 1, &coord, &regionSize, m_tileHeap.get(),
+			numPackedTiles, m_rangeFlags.data(), packedTiles.data(), m_rangeTileCounts.data());
+	}
+
+	// Record the mip tail copies once its tiles are mapped.
+	if (numPackedMips > 0)
+	{
+		const auto pNativeCommandList = static_cast<ID3D12GraphicsCommandList*>(pCommandList->GetHandle());
+		for (auto i = 0u; i < numPackedMips; ++i)
+		{
+			D3D12_TEXTURE_COPY_LOCATION src = {};
+			src.pResource = static_cast<ID3D12Resource*>(upload.pResource->GetHandle());
+			src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+			src.PlacedFootprint = footprints[i];
+
+			D3D12_TEXTURE_COPY_LOCATION dst = {};
+			dst.pResource = resource.get();
+			dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			dst.SubresourceIndex = firstMip + i;
+
+			pNativeCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+	}
+
+	ResourceBarrier barrier;
+	const auto numBarriers = entry.Texture->SetBarrier(&barrier, ResourceState::ALL_SHADER_RESOURCE, 0,
+		XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COPY_DEST);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	m_textures.push_back(move(entry));
+
+	return texture;
+}
+
+bool TiledTexture::Update(CommandList* pCommandList, CommandQueue* pCommandQueue, uint64_t frame)
+{
+	if (frame >= m_frameCount) m_uploadAllocator.Reclaim(frame - m_frameCount);
+
+	m_residency.Update(frame);
+	const auto& mappedTiles = m_residency.GetMappedTiles();
+	const auto numTextures = GetNumTextures();
+	for (auto i = 0u; i < numTextures; ++i) updateMappings(pCommandQueue, i);
+
+	// The upload memory of this frame, and of the mip tails staged since the last update, is
+	// reused once the frame is complete.
+	UploadAllocator::Allocation upload = {};
+	const auto uploadSize = static_cast<uint64_t>(mappedTiles.size()) * TileResidency::TILE_SIZE;
+	const auto success = mappedTiles.empty() || m_uploadAllocator.Allocate(upload, uploadSize);
+	m_uploadAllocator.Retire(frame);
+	XUSG_N_RETURN(success, false);
+	if (mappedTiles.empty()) return true;
+
+	// Load the new tiles, one texture at a time.
+	vector<bool> isLoaded(numTextures, false);
+	vector<ResourceBarrier> barriers(numTextures);
+	auto numBarriers = 0u;
+	for (const auto& update : mappedTiles)
+	{
+		if (isLoaded[update.Texture]) continue;
+		isLoaded[update.Texture] = true;
+
+		const auto& entry = m_textures[update.Texture];
+		FILE* pFile;
+		XUSG_N_RETURN(_wfopen_s(&pFile, entry.FileName.c_str(), L"rb") == 0, false);
+		for (auto j = 0u; j < mappedTiles.size(); ++j)
+		{
+			if (mappedTiles[j].Texture != update.Texture) continue;
+			if (!loadTile(pFile, entry, mappedTiles[j], &upload.pData[static_cast<size_t>(j) * TileResidency::TILE_SIZE]))
+			{
+				fclose(pFile);
+
+				return false;
+			}
+		}
+		fclose(pFile);
+
+		numBarriers = entry.Texture->SetBarrier(barriers.data(), ResourceState::COPY_DEST, numBarriers);
+	}
+	pCommandList->Barrier(numBarriers, barriers.data());
+
+	const TileRegionSize regionSize = { 1, false, 0, 0, 0 };
+	for (auto j = 0u; j < mappedTiles.size(); ++j)
+	{
+		const auto& update = mappedTiles[j];
+		pCommandList->CopyTiles(m_textures[update.Texture].Texture.get(), &update.Coord, regionSize, upload.pResource,
+			upload.Offset + static_cast<uint64_t>(j) * TileResidency::TILE_SIZE,
+			TileCopyFlag::LINEAR_BUFFER_TO_SWIZZLED_TILED_RESOURCE);
+	}
+
+	numBarriers = 0;
+	for (auto i = 0u; i < numTextures; ++i)
+		if (isLoaded[i]) numBarriers = m_textures[i].Texture->SetBarrier(barriers.data(),
+			ResourceState::ALL_SHADER_RESOURCE, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers.data());
+
+	return true;
+}
+
+void TiledTexture::updateMappings(CommandQueue* pCommandQueue, uint32_t texture)
+{
+	// One single-tile region per change; unmapped tiles get null ranges.
+	m_coords.clear();
+	m_rangeFlags.clear();
+	m_rangeStartOffsets.clear();
+	for (const auto tileUpdates : { &m_residency.GetUnmappedTiles(), &m_residency.GetMappedTiles() })
+	{
+		const auto isMapping = tileUpdates == &m_residency.GetMappedTiles();
+		for (const auto& update : *tileUpdates)
+		{
+			if (update.Texture != texture) continue;
+			m_coords.push_back(update.Coord);
+			m_rangeFlags.push_back(isMapping ? TileRangeFlag::NONE : TileRangeFlag::NULL_RANGE);
+			m_rangeStartOffsets.push_back(isMapping ? update.HeapTile : 0);
+		}
+	}
+
+	const auto numRegions = static_cast<uint32_t>(m_coords.size());
+	if (numRegions == 0) return;
+
+	m_regionSizes.assign(numRegions, { 1, false, 0, 0, 0 });
+	m_rangeTileCounts.assign(numRegions, 1);
+	pCommandQueue->UpdateTileMappings(m_textures[texture].Texture.get(), numRegions, m_coords.data(),
+		m_regionSizes.data(), m_tileHeap.get(), numRegions, m_rangeFlags.data(), m_rangeStartOffsets.data(),
+		m_rangeTileCounts.data());
+}
+
+bool TiledTexture::loadTile(FILE* pFile, const Entry& entry, const TileResidency::TileUpdate& update, uint8_t* pDst)
+{
+	// A tile in the linear layout is rows of its blocks; parts outside the mip are zeroed.
+	const auto& layout = entry.Layouts[update.Coord.Subresource];
+	const auto& shape = m_residency.GetTileShape(update.Texture);
+	const auto blockSize = DDS::Parser::IsBlockCompressed(entry.Texture->GetFormat()) ? 4u : 1u;
+	const auto numBlocksX = shape.WidthInTexels / blockSize;
+	const auto numRows = shape.HeightInTexels / blockSize;
+	const auto rowSize = TileResidency::TILE_SIZE / numRows;
+	const auto bytesPerBlock = rowSize / numBlocksX;
+
+	const auto firstBlockX = update.Coord.X * numBlocksX;
+	const auto firstRow = update.Coord.Y * numRows;
+	const auto layoutBlocksX = layout.RowPitch / bytesPerBlock;
+	const auto copySize = (min)(numBlocksX, layoutBlocksX - firstBlockX) * bytesPerBlock;
+	if (copySize < rowSize || firstRow + numRows > layout.NumRows) memset(pDst, 0, TileResidency::TILE_SIZE);
+
+	for (auto row = 0u; row < numRows && firstRow + row < layout.NumRows; ++row)
+	{
+		const auto offset = layout.Offset + static_cast<uint64_t>(layout.RowPitch) * (firstRow + row) +
+			static_cast<uint64_t>(firstBlockX) * bytesPerBlock;
+		XUSG_N_RETURN(_fseeki64(pFile, static_cast<int64_t>(offset), SEEK_SET) == 0, false);
+		XUSG_N_RETURN(fread(&pDst[static_cast<size_t>(rowSize) * row], 1, copySize, pFile) == copySize, false);
+	}
+
+	return true;
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "TileResidency.h"
+#include "UploadAllocator.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Reserved DDS textures backed by one tile heap; tiles are mapped and loaded on demand
+	// as TileResidency decides, while the mip tail stays resident.
+	//--------------------------------------------------------------------------------------
+	class TiledTexture
+	{
+	public:
+		TiledTexture();
+		virtual ~TiledTexture();
+
+		// Upload memory is recycled frameCount frames after its use.
+		bool Init(const Device* pDevice, uint32_t numHeapTiles, uint32_t maxTilesPerUpdate = 32,
+			uint8_t frameCount = 3, API api = API::DIRECTX_12);
+
+		// Reserves the texture, maps its mip tail and records the upload of it. Returns the
+		// texture index, or UINT32_MAX on failure.
+		uint32_t AddTexture(CommandList* pCommandList, CommandQueue* pCommandQueue,
+			const wchar_t* fileName, bool forceSRGB = false, const wchar_t* name = nullptr);
+
+		// See TileResidency::SetFeedback
+		void SetFeedback(uint32_t texture, const uint8_t* pFinestMips) { m_residency.SetFeedback(texture, pFinestMips); }
+
+		// Remaps tiles on the queue, and records the loads of the newly mapped tiles to the
+		// command list, which must execute on the same queue afterwards. Frames are numbered
+		// consecutively, and the frame frameCount before must be complete on the GPU.
+		bool Update(CommandList* pCommandList, CommandQueue* pCommandQueue, uint64_t frame);
+
+		const Texture::sptr& GetTexture(uint32_t texture) const { return m_textures[texture].Texture; }
+		const Descriptor& GetSRV(uint32_t texture) const { return m_textures[texture].SRV; }
+		const std::vector<uint8_t>& GetResidencyMap(uint32_t texture) const { return m_residency.GetResidencyMap(texture); }
+		float GetResidentFraction(uint32_t texture) const { return m_residency.GetResidentFraction(texture); }
+		uint32_t GetNumTextures() const { return static_cast<uint32_t>(m_textures.size()); }
+		const TileResidency& GetResidency() const { return m_residency; }
+
+		using uptr = std::unique_ptr<TiledTexture>;
+		using sptr = std::shared_ptr<TiledTexture>;
+
+	protected:
+		struct Entry
+		{
+			std::wstring	FileName;
+			Texture::sptr	Texture;
+			Descriptor		SRV;
+			std::vector<DDS::SubresourceLayout> Layouts;
+		};
+
+		void updateMappings(CommandQueue* pCommandQueue, uint32_t texture);
+		bool loadTile(FILE* pFile, const Entry& entry, const TileResidency::TileUpdate& update, uint8_t* pDst);
+
+		const Device*		m_pDevice;
+		TileResidency		m_residency;
+		Heap::uptr			m_tileHeap;
+		UploadAllocator		m_uploadAllocator;
+		API					m_api;
+
+		std::vector<Entry>	m_textures;
+		std::vector<TiledResourceCoord> m_coords;
+		std::vector<TileRegionSize> m_regionSizes;
+		std::vector<TileRangeFlag> m_rangeFlags;
+		std::vector<uint32_t> m_rangeStartOffsets;
+		std::vector<uint32_t> m_rangeTileCounts;
+
+		uint32_t			m_maxTilesPerUpdate;
+		uint8_t				m_frameCount;
+	};
+}
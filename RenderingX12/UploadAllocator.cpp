@@ -0,0 +1,317 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "UploadAllocator.h"
+
+using namespace std;
+using namespace XUSG;
+
+//--------------------------------------------------------------------------------------
+// Upload pages
+//--------------------------------------------------------------------------------------
+
+UploadPages::UploadPages() :
+	m_pageSizes(0),
+	m_freePages(0),
+	m_usedPages(0),
+	m_retiredPages(),
+	m_pageSize(0),
+	m_currentPage(UINT32_MAX),
+	m_head(0),
+	m_stats()
+{
+}
+
+UploadPages::~UploadPages()
+{
+}
+
+void UploadPages::Init(uint64_t pageSize)
+{
+	m_pageSizes.clear();
+	m_freePages.clear();
+	m_usedPages.clear();
+	m_retiredPages.clear();
+	m_pageSize = pageSize;
+	m_currentPage = UINT32_MAX;
+	m_head = 0;
+	m_stats = {};
+}
+
+bool UploadPages::Allocate(Allocation& allocation, uint64_t size, uint64_t alignment)
+{
+	XUSG_N_RETURN(size > 0 && alignment > 0, false);
+
+	auto offset = m_currentPage != UINT32_MAX ? XUSG_DIV_UP(m_head, alignment) * alignment : 0;
+	if (m_currentPage == UINT32_MAX || offset + size > m_pageSizes[m_currentPage])
+	{
+		if (m_currentPage != UINT32_MAX) m_stats.PaddingSize += m_pageSizes[m_currentPage] - m_head;
+		XUSG_N_RETURN(openPage(size), false);
+		offset = 0;
+	}
+
+	m_stats.PaddingSize += offset - m_head;
+	m_stats.AllocatedSize += size;
+	++m_stats.NumAllocations;
+	m_head = offset + size;
+
+	allocation.Page = m_currentPage;
+	allocation.Offset = offset;
+
+	return true;
+}
+
+uint64_t UploadPages::GetNewPageSize(uint64_t size, uint64_t alignment) const
+{
+	if (m_currentPage != UINT32_MAX && XUSG_DIV_UP(m_head, alignment) * alignment + size <= m_pageSizes[m_currentPage])
+		return 0;
+
+	return findFreePage(size) < m_freePages.size() ? 0 : (max)(size, m_pageSize);
+}
+
+void UploadPages::Retire(uint64_t fenceValue)
+{
+	if (m_currentPage != UINT32_MAX)
+	{
+		m_stats.PaddingSize += m_pageSizes[m_currentPage] - m_head;
+		m_currentPage = UINT32_MAX;
+		m_head = 0;
+	}
+
+	for (const auto page : m_usedPages) m_retiredPages.emplace_back(fenceValue, page);
+	m_usedPages.clear();
+}
+
+void UploadPages::Reclaim(uint64_t completedFenceValue)
+{
+	while (!m_retiredPages.empty() && m_retiredPages.front().first <= completedFenceValue)
+	{
+		m_freePages.push_back(m_retiredPages.front().second);
+		m_retiredPages.pop_front();
+	}
+	m_stats.NumFreePages = static_cast<uint32_t>(m_freePages.size());
+}
+
+size_t UploadPages::findFreePage(uint64_t size) const
+{
+	// The smallest free page that fits; standard pages are all the same size.
+	auto best = m_freePages.size();
+	for (size_t i = 0; i < m_freePages.size(); ++i)
+	{
+		const auto pageSize = m_pageSizes[m_freePages[i]];
+		if (pageSize >= size && (best == m_freePages.size() || pageSize < m_pageSizes[m_freePages[best]])) best = i;
+		if (pageSize == m_pageSize && size <= m_pageSize) break;
+	}
+
+	return best;
+}
+
+bool UploadPages::openPage(uint64_t size)
+{
+	const auto best = findFreePage(size);
+	if (best < m_freePages.size())
+	{
+		m_currentPage = m_freePages[best];
+		m_freePages[best] = m_freePages.back();
+		m_freePages.pop_back();
+	}
+	else
+	{
+		XUSG_N_RETURN(m_pageSizes.size() < UINT32_MAX, false);
+		m_currentPage = static_cast<uint32_t>(m_pageSizes.size());
+		m_pageSizes.push_back((max)(size, m_pageSize));
+		m_stats.PoolSize += m_pageSizes.back();
+	}
+
+	m_usedPages.push_back(m_currentPage);
+	m_head = 0;
+	m_stats.NumPages = static_cast<uint32_t>(m_pageSizes.size());
+	m_stats.NumFreePages = static_cast<uint32_t>(m_freePages.size());
+
+	return true;
+}
+
+bool UploadPages::CheckAlignment(uint32_t numAllocations, uint64_t pageSize)
+{
+	mt19937 rng(0x5eed);
+	uniform_int_distribution<uint64_t> sizes(1, pageSize / 4);
+	uniform_int_distribution<uint32_t> alignmentLog2(0, 16);
+	uniform_int_distribution<uint32_t> percent(0, 99);
+
+	UploadPages pages;
+	pages.Init(pageSize);
+
+	vector<uint64_t> pageHeads;	// End of the last allocation in each page since it was opened
+	auto prevPage = UINT32_MAX;
+	for (auto i = 0u; i < numAllocations; ++i)
+	{
+		// Now and then, an allocation larger than a page
+		const auto size = percent(rng) ? sizes(rng) : pageSize + sizes(rng);
+		const auto alignment = 1ull << alignmentLog2(rng);
+
+		Allocation allocation;
+		XUSG_N_RETURN(pages.Allocate(allocation, size, alignment), false);
+		pageHeads.resize(pages.GetNumPages(), 0);
+
+		auto& head = pageHeads[allocation.Page];
+		if (allocation.Page != prevPage) head = 0;
+		XUSG_N_RETURN(allocation.Offset % alignment == 0, false);
+		XUSG_N_RETURN(allocation.Offset >= head, false);
+		XUSG_N_RETURN(allocation.Offset + size <= pages.GetPageSize(allocation.Page), false);
+		head = allocation.Offset + size;
+		prevPage = allocation.Page;
+
+		// Pages are recycled at once, so that reopened pages are covered as well
+		if (percent(rng) < 5)
+		{
+			pages.Retire(i);
+			pages.Reclaim(i);
+			prevPage = UINT32_MAX;
+		}
+	}
+
+	const auto& stats = pages.GetStats();
+
+	return stats.NumAllocations == numAllocations;
+}
+
+bool UploadPages::CheckRecycling(uint32_t numFrames, uint32_t numFramesInFlight, uint64_t pageSize)
+{
+	mt19937 rng(0x5eed);
+	uniform_int_distribution<uint32_t> numAllocations(50, 200);
+	uniform_int_distribution<uint64_t> sizes(256, 64 << 10);
+
+	UploadPages pages;
+	pages.Init(pageSize);
+
+	// Frame of the last allocation in each page; UINT64_MAX for never used
+	vector<uint64_t> lastUses;
+	uint64_t completed = 0;
+	uint32_t maxPages = 0;
+	for (auto frame = 1u; frame <= numFrames; ++frame)
+	{
+		const auto n = numAllocations(rng);
+		for (auto i = 0u; i < n; ++i)
+		{
+			Allocation allocation;
+			XUSG_N_RETURN(pages.Allocate(allocation, sizes(rng), 512), false);
+			lastUses.resize(pages.GetNumPages(), UINT64_MAX);
+
+			auto& lastUse = lastUses[allocation.Page];
+			XUSG_N_RETURN(lastUse == UINT64_MAX || lastUse == frame || lastUse <= completed, false);
+			lastUse = frame;
+		}
+
+		pages.Retire(frame);
+		if (frame > numFramesInFlight)
+		{
+			completed = frame - numFramesInFlight;
+			pages.Reclaim(completed);
+		}
+
+		// The pool must settle once the frames in flight have all been seen.
+		if (frame == 4 * (numFramesInFlight + 1)) maxPages = pages.GetNumPages() + pages.GetNumPages() / 2;
+		XUSG_N_RETURN(!maxPages || pages.GetNumPages() <= maxPages, false);
+	}
+
+	return true;
+}
+
+void UploadPages::Benchmark(BenchmarkResult& result, uint32_t numAllocations, uint64_t pageSize)
+{
+	result = {};
+	XUSG_N_RETURN(numAllocations > 0, );
+
+	mt19937 rng(0x5eed);
+	uniform_int_distribution<uint64_t> sizeDist(256, 64 << 10);
+	vector<uint64_t> sizes(4096);
+	for (auto& size : sizes) size = sizeDist(rng);
+
+	UploadPages pages;
+	pages.Init(pageSize);
+
+	const auto batchSize = 1000u;
+	const auto numFramesInFlight = 3u;
+	auto frame = 0ull;
+	Allocation allocation;
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < numAllocations; ++i)
+	{
+		pages.Allocate(allocation, sizes[i & 4095], 512);
+		if ((i + 1) % batchSize == 0)
+		{
+			pages.Retire(++frame);
+			if (frame > numFramesInFlight) pages.Reclaim(frame - numFramesInFlight);
+		}
+	}
+	const chrono::duration<double> time = chrono::high_resolution_clock::now() - start;
+
+	const auto& stats = pages.GetStats();
+	result.AllocationsPerSecond = time.count() > 0.0 ? numAllocations / time.count() : 0.0;
+	result.NumPages = stats.NumPages;
+	result.PaddingRatio = stats.AllocatedSize ? static_cast<double>(stats.PaddingSize) / stats.AllocatedSize : 0.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Upload allocator
+//--------------------------------------------------------------------------------------
+
+UploadAllocator::UploadAllocator() :
+	m_pDevice(nullptr),
+	m_buffers(0),
+	m_pData(0),
+	m_api(API::DIRECTX_12)
+{
+}
+
+UploadAllocator::~UploadAllocator()
+{
+}
+
+bool UploadAllocator::Init(const Device* pDevice, uint64_t pageSize, API api)
+{
+	XUSG_N_RETURN(pageSize > 0, false);
+
+	m_pDevice = pDevice;
+	m_api = api;
+	m_buffers.clear();
+	m_pData.clear();
+	m_pages.Init(pageSize);
+
+	return true;
+}
+
+bool UploadAllocator::Allocate(Allocation& allocation, uint64_t size, uint64_t alignment)
+{
+	// Create the memory of a new page, mapped for its lifetime, before the page is committed,
+	// so that a failure leaves the pages and the buffers in step.
+	const auto newPageSize = m_pages.GetNewPageSize(size, alignment);
+	if (newPageSize > 0)
+	{
+		const auto page = m_pages.GetNumPages();
+		assert(page == m_buffers.size());
+		auto buffer = Buffer::MakeUnique(m_api);
+		XUSG_N_RETURN(buffer->Create(m_pDevice, static_cast<size_t>(newPageSize), ResourceFlag::NONE,
+			MemoryType::UPLOAD, 0, nullptr, 0, nullptr, MemoryFlag::NONE,
+			(L"UploadPage" + to_wstring(page)).c_str()), false);
+		const auto pData = static_cast<uint8_t*>(buffer->Map());
+		XUSG_N_RETURN(pData, false);
+
+		m_buffers.push_back(move(buffer));
+		m_pData.push_back(pData);
+	}
+
+	UploadPages::Allocation pageAllocation;
+	XUSG_N_RETURN(m_pages.Allocate(pageAllocation, size, alignment), false);
+
+	const auto page = pageAllocation.Page;
+	assert(page < m_buffers.size() && m_pages.GetNumPages() == m_buffers.size());
+	allocation.pResource = m_buffers[page].get();
+	allocation.Offset = pageAllocation.Offset;
+	allocation.pData = &m_pData[page][pageAllocation.Offset];
+
+	return true;
+}
@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <deque>
+#include "Advanced/XUSGAdvanced.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Linear suballocation over a pool of pages; pages filled since the last retirement are
+	// tagged with a fence value and reused once it completes. Bookkeeping only.
+	//--------------------------------------------------------------------------------------
+	class UploadPages
+	{
+	public:
+		struct Allocation
+		{
+			uint32_t Page;
+			uint64_t Offset;
+		};
+
+		struct Stats
+		{
+			uint32_t NumPages;
+			uint32_t NumFreePages;
+			uint64_t PoolSize;
+			uint64_t NumAllocations;	// Since Init
+			uint64_t AllocatedSize;
+			uint64_t PaddingSize;		// Alignment and page tails left unused
+		};
+
+		struct BenchmarkResult
+		{
+			double		AllocationsPerSecond;
+			uint32_t	NumPages;			// At the end of the run
+			double		PaddingRatio;		// Padding over allocated size
+		};
+
+		UploadPages();
+		virtual ~UploadPages();
+
+		void Init(uint64_t pageSize);
+
+		// Opens a new page when the current one is full; sizes above the page size get a page of
+		// their own. The caller creates the memory of pages beyond its previous GetNumPages().
+		bool Allocate(Allocation& allocation, uint64_t size, uint64_t alignment);
+
+		// Size of the page that Allocate would add to the pool, or 0 if it would fit in the
+		// current page or a free one; lets the caller create the page memory beforehand.
+		uint64_t GetNewPageSize(uint64_t size, uint64_t alignment) const;
+
+		// Tags the pages used since the last call, including the current one, which is closed.
+		void Retire(uint64_t fenceValue);
+		void Reclaim(uint64_t completedFenceValue);
+
+		uint64_t GetPageSize(uint32_t page) const { return m_pageSizes[page]; }
+		uint32_t GetNumPages() const { return static_cast<uint32_t>(m_pageSizes.size()); }
+		const Stats& GetStats() const { return m_stats; }
+
+		// Random sizes and power-of-two alignments up to 64 KB: every offset is aligned, and
+		// the allocations of a page neither overlap nor cross its end.
+		static bool CheckAlignment(uint32_t numAllocations = 100000, uint64_t pageSize = 4 << 20);
+
+		// Frames retired with their number and reclaimed numFramesInFlight later: a page is
+		// never handed out again before its fence value completes, and the pool stops growing.
+		static bool CheckRecycling(uint32_t numFrames = 256, uint32_t numFramesInFlight = 3,
+			uint64_t pageSize = 1 << 20);
+
+		// Allocations of 256 B to 64 KB at 512-byte alignment, retired every 1000 allocations
+		static void Benchmark(BenchmarkResult& result, uint32_t numAllocations = 1000000,
+			uint64_t pageSize = 4 << 20);
+
+	protected:
+		size_t findFreePage(uint64_t size) const;
+		bool openPage(uint64_t size);
+
+		std::vector<uint64_t>	m_pageSizes;
+		std::vector<uint32_t>	m_freePages;
+		std::vector<uint32_t>	m_usedPages;
+		std::deque<std::pair<uint64_t, uint32_t>> m_retiredPages;	// Fence value, page
+
+		uint64_t	m_pageSize;
+		uint32_t	m_currentPage;
+		uint64_t	m_head;
+		Stats		m_stats;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Persistently mapped upload buffers suballocated by UploadPages, in place of a committed
+	// uploader per resource
+	//--------------------------------------------------------------------------------------
+	class UploadAllocator
+	{
+	public:
+		struct Allocation
+		{
+			Resource*	pResource;
+			uint64_t	Offset;
+			uint8_t*	pData;
+		};
+
+		UploadAllocator();
+		virtual ~UploadAllocator();
+
+		bool Init(const Device* pDevice, uint64_t pageSize = 4 << 20, API api = API::DIRECTX_12);
+
+		bool Allocate(Allocation& allocation, uint64_t size,
+			uint64_t alignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+		// Fence values may be frame numbers as long as both calls agree.
+		void Retire(uint64_t fenceValue) { m_pages.Retire(fenceValue); }
+		void Reclaim(uint64_t completedFenceValue) { m_pages.Reclaim(completedFenceValue); }
+
+		const UploadPages::Stats& GetStats() const { return m_pages.GetStats(); }
+
+		using uptr = std::unique_ptr<UploadAllocator>;
+		using sptr = std::shared_ptr<UploadAllocator>;
+
+	protected:
+		const Device*			m_pDevice;
+		UploadPages				m_pages;
+		std::vector<Buffer::uptr> m_buffers;
+		std::vector<uint8_t*>	m_pData;
+		API						m_api;
+	};
+}
@@ -0,0 +1,316 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <random>
+#include "VisibilityCache.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+VisibilityCache::VisibilityCache() :
+	m_pTree(nullptr),
+	m_nodeEntries(0),
+	m_itemEntries(0),
+	m_visibleFrames(0),
+	m_maxCoords(0.0f, 0.0f, 0.0f),
+	m_key(),
+	m_frame(1),
+	m_quantizationBits(0),
+	m_isValid(false),
+	m_stats()
+{
+}
+
+VisibilityCache::~VisibilityCache()
+{
+}
+
+void VisibilityCache::Init(const LinearOctree* pTree, uint8_t quantizationBits)
+{
+	m_pTree = pTree;
+	m_quantizationBits = (min)(quantizationBits, static_cast<uint8_t>(23));
+	m_isValid = false;
+	m_frame = 1;
+
+	const Entry entry = { OctNode::VISIBILITY_INTERSECT, 0.0f, 0 };
+	m_nodeEntries.assign(pTree ? pTree->GetNumNodes() : 0, entry);
+	m_itemEntries.assign(pTree ? pTree->GetItemBounds().GetCount() : 0, entry);
+	m_visibleFrames.assign(m_itemEntries.size(), 0);
+	m_sortItems.clear();
+
+	// The root bound holds every node and item.
+	m_maxCoords = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	if (!m_nodeEntries.empty())
+	{
+		XMFLOAT3 center, extents;
+		pTree->GetNodeBounds().Get(0, center, extents);
+		m_maxCoords = XMFLOAT3(fabsf(center.x) + extents.x, fabsf(center.y) + extents.y, fabsf(center.z) + extents.z);
+	}
+}
+
+void VisibilityCache::Sort(vector<XMUINT2>& meshIDQueue, CXMMATRIX viewProj, FXMVECTOR eyePt, bool isNearToFar)
+{
+	XUSG_N_RETURN(m_pTree, );
+	m_stats = {};
+
+	// Static camera: the queue of the last frame, with no test within the quantization
+	XMFLOAT4X4 matrix;
+	XMFLOAT3 eye;
+	XMStoreFloat4x4(&matrix, viewProj);
+	XMStoreFloat3(&eye, eyePt);
+	const float values[KEY_SIZE - 1] =
+	{
+		matrix._11, matrix._12, matrix._13, matrix._14, matrix._21, matrix._22, matrix._23, matrix._24,
+		matrix._31, matrix._32, matrix._33, matrix._34, matrix._41, matrix._42, matrix._43, matrix._44,
+		eye.x, eye.y, eye.z
+	};
+
+	uint32_t key[KEY_SIZE];
+	for (uint8_t i = 0; i < KEY_SIZE - 1; ++i)
+	{
+		memcpy(&key[i], &values[i], sizeof(uint32_t));
+		key[i] = (key[i] + (1u << m_quantizationBits >> 1)) >> m_quantizationBits;
+	}
+	key[KEY_SIZE - 1] = isNearToFar;
+
+	if (m_isValid && equal(key, key + KEY_SIZE, m_key))
+	{
+		meshIDQueue.insert(meshIDQueue.end(), m_queue.cbegin(), m_queue.cend());
+		m_stats.IsQueueReused = true;
+
+		return;
+	}
+
+	// Largest change of any plane over the tree; entries holding by more are still valid.
+	FrustumCulling::Frustum frustum;
+	FrustumCulling::GetFrustum(frustum, viewProj);
+	auto displacement = FLT_MAX;
+	if (m_isValid)
+	{
+		displacement = 0.0f;
+		for (uint8_t p = 0; p < 6; ++p)
+		{
+			const auto& plane = frustum.Planes[p];
+			const auto& prevPlane = m_frustum.Planes[p];
+			displacement = (max)(fabsf(plane.x - prevPlane.x) * m_maxCoords.x + fabsf(plane.y - prevPlane.y) * m_maxCoords.y +
+				fabsf(plane.z - prevPlane.z) * m_maxCoords.z + fabsf(plane.w - prevPlane.w), displacement);
+		}
+	}
+	++m_frame;
+
+	const auto& nodes = m_pTree->GetNodes();
+	const auto& nodeBounds = m_pTree->GetNodeBounds();
+	const auto& itemBounds = m_pTree->GetItemBounds();
+	const auto numNodes = m_pTree->GetNumNodes();
+	vector<uint32_t> items;
+	for (auto i = 0u; i < numNodes;)
+	{
+		const auto& node = nodes[i];
+		auto& entry = m_nodeEntries[i];
+		if (classify(entry, nodeBounds, i, frustum, displacement)) ++m_stats.NumReusedNodes;
+		else ++m_stats.NumNodeTests;
+
+		if (entry.Visibility == OctNode::VISIBILITY_OUTSIDE) i = node.SkipIndex;
+		else if (entry.Visibility == OctNode::VISIBILITY_INSIDE)
+		{
+			for (auto j = node.FirstItem; j < node.ItemEnd; ++j) items.push_back(j);
+			i = node.SkipIndex;
+		}
+		else
+		{
+			for (auto j = node.FirstItem; j < node.FirstItem + node.NumItems; ++j)
+			{
+				auto& itemEntry = m_itemEntries[j];
+				if (classify(itemEntry, itemBounds, j, frustum, displacement)) ++m_stats.NumReusedItems;
+				else ++m_stats.NumItemTests;
+				if (itemEntry.Visibility != OctNode::VISIBILITY_OUTSIDE) items.push_back(j);
+			}
+			++i;
+		}
+	}
+
+	// Sorted as LinearOctree::Sort does. The items still visible keep their order of the last
+	// frame, which is nearly sorted, and the others are sorted apart and merged in.
+	const auto getSortItem = [&](uint32_t item)
+	{
+		XMFLOAT3 center, extents;
+		itemBounds.Get(item, center, extents);
+		const auto distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&center) - eyePt));
+
+		return make_pair(isNearToFar ? distSq : -distSq, item);
+	};
+
+	for (const auto item : items) m_visibleFrames[item] = m_frame;
+
+	auto numKept = 0u;
+	for (const auto& sortItem : m_sortItems)
+	{
+		if (m_visibleFrames[sortItem.second] != m_frame) continue;
+		m_visibleFrames[sortItem.second] = 0;
+		m_sortItems[numKept++] = getSortItem(sortItem.second);
+	}
+	m_sortItems.resize(numKept);
+	sortAdaptive(m_sortItems);
+
+	m_newSortItems.clear();
+	for (const auto item : items)
+		if (m_visibleFrames[item] == m_frame) m_newSortItems.push_back(getSortItem(item));
+	sort(m_newSortItems.begin(), m_newSortItems.end());
+
+	m_sortItems.insert(m_sortItems.end(), m_newSortItems.cbegin(), m_newSortItems.cend());
+	inplace_merge(m_sortItems.begin(), m_sortItems.begin() + numKept, m_sortItems.end());
+
+	const auto& meshIDs = m_pTree->GetMeshIDs();
+	m_queue.resize(m_sortItems.size());
+	for (size_t i = 0; i < m_sortItems.size(); ++i) m_queue[i] = meshIDs[m_sortItems[i].second];
+	meshIDQueue.insert(meshIDQueue.end(), m_queue.cbegin(), m_queue.cend());
+
+	m_frustum = frustum;
+	copy(key, key + KEY_SIZE, m_key);
+	m_isValid = true;
+}
+
+void VisibilityCache::Benchmark(BenchmarkResult& result, const LinearOctree::Item* pItems, uint32_t numItems,
+	uint32_t numFrames)
+{
+	result = {};
+	XUSG_N_RETURN(numItems > 0 && numFrames > 0, );
+
+	LinearOctree tree;
+	tree.CreateTree(pItems, numItems);
+	VisibilityCache cache;
+	cache.Init(&tree);
+
+	// The path starts at the edge of the root cell, at a third of its height, looking inwards.
+	XMFLOAT3 center, extents;
+	tree.GetNodeBounds().Get(0, center, extents);
+	const auto radius = (max)(extents.x, extents.z);
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, radius * 0.001f, radius * 4.0f);
+	const auto segmentSize = (max)(numFrames / 6, 1u);
+	mt19937 rng(0x5eed);
+	uniform_real_distribution<float> jump(-0.5f, 0.5f);
+	auto eye = XMFLOAT3(center.x, center.y - extents.y / 3.0f, center.z - radius * 0.8f);
+	auto yaw = 0.0f;
+
+	vector<XMUINT2> cachedQueue, queue;
+	cachedQueue.reserve(numItems);
+	queue.reserve(numItems);
+	double cachedSeconds = 0.0, seconds = 0.0;
+	uint64_t numTests = 0, numReused = 0;
+	result.IsIdentical = true;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		switch (i / segmentSize)
+		{
+		case 1:
+		case 5:
+			yaw += 0.002f;
+			break;
+		case 2:
+			eye.x += radius * 0.0005f;
+			eye.z += radius * 0.0003f;
+			break;
+		case 3:
+			yaw += 0.5f;
+			eye.x = center.x + radius * jump(rng);
+			eye.z = center.z + radius * jump(rng);
+			break;
+		}
+
+		const auto eyePt = XMLoadFloat3(&eye);
+		const auto viewProj = XMMatrixLookToLH(eyePt, XMVectorSet(sinf(yaw), -0.05f, cosf(yaw), 0.0f),
+			XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj;
+
+		cachedQueue.clear();
+		auto start = chrono::high_resolution_clock::now();
+		cache.Sort(cachedQueue, viewProj, eyePt, true);
+		cachedSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+		queue.clear();
+		start = chrono::high_resolution_clock::now();
+		tree.Sort(queue, viewProj, eyePt, true);
+		seconds += chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+		// Element by element, in the order of the queues
+		auto isIdentical = cachedQueue.size() == queue.size();
+		for (size_t j = 0; isIdentical && j < queue.size(); ++j)
+			isIdentical = cachedQueue[j].x == queue[j].x && cachedQueue[j].y == queue[j].y;
+		result.IsIdentical = result.IsIdentical && isIdentical;
+
+		const auto& stats = cache.GetStats();
+		numTests += stats.NumNodeTests + stats.NumItemTests;
+		numReused += stats.NumReusedNodes + stats.NumReusedItems;
+		result.NumQueuesReused += stats.IsQueueReused ? 1 : 0;
+	}
+
+	result.CachedMicroseconds = cachedSeconds * 1.0e6 / numFrames;
+	result.SortMicroseconds = seconds * 1.0e6 / numFrames;
+	result.NumTests = static_cast<double>(numTests) / numFrames;
+	result.NumReused = static_cast<double>(numReused) / numFrames;
+}
+
+void VisibilityCache::sortAdaptive(vector<SortItem>& sortItems)
+{
+	// Insertion sort, until the items prove too far from sorted
+	const auto maxMoves = sortItems.size() * 16;
+	size_t numMoves = 0;
+	for (size_t i = 1; i < sortItems.size(); ++i)
+	{
+		const auto sortItem = sortItems[i];
+		auto j = i;
+		for (; j > 0 && sortItem < sortItems[j - 1]; --j) sortItems[j] = sortItems[j - 1];
+		sortItems[j] = sortItem;
+
+		numMoves += i - j;
+		if (numMoves > maxMoves)
+		{
+			sort(sortItems.begin(), sortItems.end());
+
+			return;
+		}
+	}
+}
+
+bool VisibilityCache::classify(Entry& entry, const FrustumCulling::Boxes& boxes, uint32_t i,
+	const FrustumCulling::Frustum& frustum, float displacement)
+{
+	// Reuse, with the margin reduced by the displacement so that it holds for this frame
+	const auto isReused = entry.Frame + 1 == m_frame && entry.Visibility != OctNode::VISIBILITY_INTERSECT &&
+		entry.Margin > displacement;
+	entry.Frame = m_frame;
+	if (isReused)
+	{
+		entry.Margin -= displacement;
+
+		return true;
+	}
+
+	XMFLOAT3 center, extents;
+	boxes.Get(i, center, extents);
+	entry.Visibility = OctNode::VISIBILITY_INSIDE;
+	entry.Margin = FLT_MAX;
+	for (const auto& plane : frustum.Planes)
+	{
+		const auto dist = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		const auto radius = fabsf(plane.x) * extents.x + fabsf(plane.y) * extents.y + fabsf(plane.z) * extents.z;
+		if (dist + radius < 0.0f)
+		{
+			entry.Visibility = OctNode::VISIBILITY_OUTSIDE;
+			entry.Margin = -(dist + radius);
+
+			return false;
+		}
+
+		if (dist - radius < 0.0f)
+		{
+			entry.Visibility = OctNode::VISIBILITY_INTERSECT;
+			entry.Margin = 0.0f;
+		}
+		else if (entry.Visibility == OctNode::VISIBILITY_INSIDE) entry.Margin = (min)(dist - radius, entry.Margin);
+	}
+
+	return false;
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "LinearOctree.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Frame-to-frame reuse of the frustum classification of a linear octree. The queue is
+	// returned as is while the view-projection does not change. Otherwise, inside and
+	// outside results are kept where their margin to the planes exceeds the largest
+	// displacement of the planes over the tree, and the rest is re-tested.
+	//--------------------------------------------------------------------------------------
+	class VisibilityCache
+	{
+	public:
+		struct Stats
+		{
+			uint32_t	NumNodeTests;
+			uint32_t	NumItemTests;
+			uint32_t	NumReusedNodes;
+			uint32_t	NumReusedItems;
+			bool		IsQueueReused;
+		};
+
+		struct BenchmarkResult
+		{
+			double		CachedMicroseconds;		// Per frame
+			double		SortMicroseconds;		// Per frame, LinearOctree::Sort
+			double		NumTests;				// Per frame, nodes and items
+			double		NumReused;				// Per frame, nodes and items
+			uint32_t	NumQueuesReused;
+			bool		IsIdentical;			// Same queue as LinearOctree::Sort on every frame
+		};
+
+		VisibilityCache();
+		virtual ~VisibilityCache();
+
+		// Matrix elements equal in all but their low quantizationBits mantissa bits share a key.
+		// Views sharing a key get the queue of the first untested, so only the default of 0 is
+		// exact; coarser keys trade misses at the frustum edges for still but jittering cameras.
+		void Init(const LinearOctree* pTree, uint8_t quantizationBits = 0);
+		void Invalidate() { m_isValid = false; }
+
+		// Same queue as LinearOctree::Sort
+		void Sort(std::vector<DirectX::XMUINT2>& meshIDQueue, DirectX::CXMMATRIX viewProj,
+			DirectX::FXMVECTOR eyePt, bool isNearToFar);
+
+		const Stats& GetStats() const { return m_stats; }
+
+		// Times Sort against LinearOctree::Sort, comparing their queues, over a camera path
+		// through the items: still, turning slowly, walking, jumping, still and turning again.
+		static void Benchmark(BenchmarkResult& result, const LinearOctree::Item* pItems, uint32_t numItems,
+			uint32_t numFrames = 600);
+
+		using uptr = std::unique_ptr<VisibilityCache>;
+		using sptr = std::shared_ptr<VisibilityCache>;
+
+	protected:
+		static const uint8_t KEY_SIZE = 20;	// View-projection, eye point, order
+
+		using SortItem = std::pair<float, uint32_t>;
+
+		// Classification with the margin by which it holds, as of the frame of the stamp
+		struct Entry
+		{
+			OctNode::Visibility Visibility;
+			float		Margin;
+			uint32_t	Frame;
+		};
+
+		bool classify(Entry& entry, const FrustumCulling::Boxes& boxes, uint32_t i,
+			const FrustumCulling::Frustum& frustum, float displacement);
+
+		static void sortAdaptive(std::vector<SortItem>& sortItems);
+
+		const LinearOctree*		m_pTree;
+		std::vector<Entry>		m_nodeEntries;
+		std::vector<Entry>		m_itemEntries;
+		std::vector<uint32_t>	m_visibleFrames;
+		std::vector<SortItem>	m_sortItems;	// Of the last frame
+		std::vector<SortItem>	m_newSortItems;
+		std::vector<DirectX::XMUINT2> m_queue;
+
+		FrustumCulling::Frustum	m_frustum;
+		DirectX::XMFLOAT3		m_maxCoords;	// Largest absolute coordinates in the tree
+		uint32_t				m_key[KEY_SIZE];
+		uint32_t				m_frame;
+		uint8_t					m_quantizationBits;
+		bool					m_isValid;
+		Stats					m_stats;
+	};
+}